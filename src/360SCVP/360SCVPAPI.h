@@ -345,6 +345,9 @@ typedef struct INPUT_ONESTREAM_IFO
 //! \param    VUI_enable,            input,           the flag indicates Video Usability Information enable or not
 //! \param    pTiledBitstream,       input,           this is pointer, which points all of the bistreams
 //! \param    sliceType,             output,          the slice type[I(2), P(1)] of the input bistream
+//! \param    mergeThreadNum,        input,           the number of threads merging the tiles, the slice headers of different
+//!                                                   input bitstreams are rewritten in parallel; 0 or 1 means merging in the calling thread.
+//!                                                   for E_MERGE_AND_VIEWPORT, the max number of threads in I360SCVP_processViewports
 typedef struct PARAM_STREAMSTITCHINFO
 {
     bool                   AUD_enable;
@@ -352,8 +355,44 @@ typedef struct PARAM_STREAMSTITCHINFO
     param_oneStream_info **pTiledBitstream;
     uint32_t               sliceType;
     uint32_t               pts;
+    uint32_t               mergeThreadNum;
 }param_streamStitchInfo;
 
+//!
+//! \brief  This structure is for one segment of the stitched bitstream in the segment output mode
+//!
+//! \param    pData,      output,   the segment data, either in the buffer owned by the library (parameter sets, SEI
+//!                                 and rewritten slice headers) or in one of the input tile bitstreams (slice data)
+//! \param    dataLen,    output,   the length of the segment data
+typedef struct PARAM_BITSTREAMSEGMENT
+{
+    uint8_t               *pData;
+    uint32_t               dataLen;
+}Param_BitstreamSegment;
+
+//!
+//! \brief  This structure is for the viewport of one client and its merged output in I360SCVP_processViewports
+//!
+//! \param    yaw,                input,    the angle rotated aroud y of the viewport
+//! \param    pitch,              input,    the angle rotated aroud z of the viewport
+//! \param    pOutputBitstream,   input,    the buffer for the merged bitstream, at least as large as the one in I360SCVP_process
+//! \param    outputBitstreamLen, output,   the length of the merged bitstream
+//! \param    pOutputSEI,         input,    the buffer for the output RWPK SEI
+//! \param    outputSEILen,       output,   the length of the output RWPK SEI
+//! \param    sameSelectionIdx,   output,   the index of the first viewport in the batch which selected the same tiles,
+//!                                         its own index if it is the first one, the outputs are the same in both cases
+//!
+typedef struct PARAM_VIEWPORTBATCHITEM
+{
+    float                  yaw;
+    float                  pitch;
+    uint8_t               *pOutputBitstream;
+    uint32_t               outputBitstreamLen;
+    uint8_t               *pOutputSEI;
+    uint32_t               outputSEILen;
+    int32_t                sameSelectionIdx;
+}Param_ViewportBatchItem;
+
 //!
 //! \brief  This structure is for the stitch parameters
 //!
@@ -376,6 +415,11 @@ typedef struct PARAM_STREAMSTITCHINFO
 //! \param    inputLowBistreamLen,input,    the length of the low resolution input bistream, just used in the usedType=E_MERGE_AND_VIEWPORT
 //! \param    pOutputSEI,         output,   the buffer for the output SEI bistream, mainly RWPK, just used in the usedType=E_MERGE_AND_VIEWPORT
 //! \param    outputSEILen,       output,   the length of the output SEI bistream, just used in the usedType=E_MERGE_AND_VIEWPORT
+//! \param    bSegmentOutput,     input,    output the stitched bitstream as a list of segments instead of copying it into
+//!                                         pOutputBitstream, just used in the usedType=E_STREAM_STITCH_ONLY
+//! \param    pOutputSegments,    output,   the segments of the stitched bitstream in order, owned by the library and valid until
+//!                                         the next I360SCVP_process or I360SCVP_unInit, just used when bSegmentOutput is set
+//! \param    outputSegmentNum,   output,   the number of the output segments, just used when bSegmentOutput is set
 //!
 typedef struct PARAM_360SCVP
 {
@@ -397,6 +441,9 @@ typedef struct PARAM_360SCVP
     unsigned int           inputLowBistreamLen;
     unsigned char         *pOutputSEI;
     unsigned int           outputSEILen;
+    bool                   bSegmentOutput;
+    Param_BitstreamSegment *pOutputSegments;
+    uint32_t               outputSegmentNum;
 }param_360SCVP;
 
 //!
@@ -444,6 +491,24 @@ int32_t I360SCVP_process(param_360SCVP* pParam360SCVP, void * p360SCVPHandle);
 //!
 int32_t I360SCVP_setViewPort(void * p360SCVPHandle, float yaw, float pitch);
 
+//!
+//! \brief      This function completes the stitch of one input frame for many viewports, used in the usedType=E_MERGE_AND_VIEWPORT.
+//!             the input frames are parsed once, the viewports selecting the same tiles share one merge, and the
+//!             different selections are merged in parallel when threadNum is larger than 1.
+//!             after the call the viewport of the handle is the one of the last item
+//! \param      param_360SCVP*            pParam360SCVP,     input,        the input bitstreams, refer to the structure param_360SCVP
+//! \param      Param_ViewportBatchItem*  pViewports,        input/output, the viewports and their outputs
+//! \param      uint32_t                  viewportNum,       input,        the number of the viewports
+//! \param      uint32_t                  threadNum,         input,        the number of threads merging the viewports, at most
+//!                                                                          the mergeThreadNum of the initialization
+//! \param      void *                    p360SCVPHandle,    input,        which is created by the I360SVCP_Init function
+//!
+//! \return     int32_t, the status of the function.
+//!     0,      if succeed
+//!     not 0,  if fail
+//!
+int32_t I360SCVP_processViewports(param_360SCVP* pParam360SCVP, Param_ViewportBatchItem* pViewports, uint32_t viewportNum, uint32_t threadNum, void * p360SCVPHandle);
+
 //!
 //! \brief      This function completes the un-initialization, free the memory
 //!
@@ -105,6 +105,14 @@ int32_t I360SCVP_setViewPort(void* p360SCVPHandle, float yaw, float pitch)
     return ret;
 }
 
+int32_t I360SCVP_processViewports(param_360SCVP* pParam360SCVP, Param_ViewportBatchItem* pViewports, uint32_t viewportNum, uint32_t threadNum, void* p360SCVPHandle)
+{
+    TstitchStream* pStitch = (TstitchStream*)(p360SCVPHandle);
+    if (!pStitch || !pParam360SCVP || !pViewports)
+        return -1;
+    return pStitch->processViewports(pParam360SCVP, pViewports, viewportNum, threadNum);
+}
+
 int32_t   I360SCVP_unInit(void* p360SCVPHandle)
 {
     int32_t ret = 0;
@@ -206,6 +206,72 @@ static uint8_t BS_ReadByte(GTS_BitStream *bs)
     return 0;
 }
 
+/*loads up to 8 bytes big-endian into a 64-bit word, MSB first, missing bytes are zero*/
+static inline uint64_t bs_load_be64(const int8_t *ptr, uint64_t avail)
+{
+    uint64_t word = 0;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    if (avail >= 8) {
+        memcpy(&word, ptr, 8);
+        return __builtin_bswap64(word);
+    }
+#endif
+    uint32_t count = avail < 8 ? (uint32_t)avail : 8;
+    for (uint32_t i = 0; i < count; i++)
+        word |= ((uint64_t)(uint8_t)ptr[i]) << (56 - 8 * i);
+    return word;
+}
+
+static inline uint32_t bs_clz64(uint64_t word)
+{
+#if defined(__GNUC__)
+    return (uint32_t)__builtin_clzll(word);
+#else
+    uint32_t count = 0;
+    while (!(word & 0x8000000000000000ULL)) {
+        word <<= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+/*fills a 64-bit cache with the next unread bits of a memory read bitstream in one load,
+ *the pending bits of the current byte come first. Returns the number of valid bits*/
+static uint32_t bs_fill_cache(GTS_BitStream *bs, uint64_t *cache)
+{
+    uint32_t pending = 8 - bs->nbBits;
+    uint64_t avail = (bs->size > bs->position) ? (bs->size - bs->position) : 0;
+    uint64_t word = avail ? bs_load_be64(bs->original + bs->position, avail) : 0;
+    uint32_t valid = (avail >= 8) ? 64 : (uint32_t)(avail * 8);
+
+    if (pending) {
+        uint64_t head = (uint64_t)((bs->current & 0xFF) >> bs->nbBits);
+        word = (word >> pending) | (head << (64 - pending));
+        valid = (valid + pending > 64) ? 64 : valid + pending;
+    }
+    *cache = word;
+    return valid;
+}
+
+/*consumes nBits bits previously returned by bs_fill_cache, keeping position/current/nbBits
+ *in the same state the bit by bit reader would have left them*/
+static void bs_consume_cache(GTS_BitStream *bs, uint32_t nBits)
+{
+    uint32_t pending = 8 - bs->nbBits;
+    if (nBits <= pending) {
+        bs->nbBits += nBits;
+        bs->current <<= nBits;
+        return;
+    }
+    uint32_t rest = nBits - pending;
+    uint32_t bytes = (rest + 7) / 8;
+    uint8_t last = (uint8_t)bs->original[bs->position + bytes - 1];
+    bs->position += bytes;
+    bs->nbBits = rest - (bytes - 1) * 8;
+    bs->current = ((uint32_t)last) << bs->nbBits;
+}
+
 uint8_t gf_bs_read_bit(GTS_BitStream *bs)
 {
     if (bs->nbBits == 8) {
@@ -227,6 +293,13 @@ uint8_t gf_bs_read_bit(GTS_BitStream *bs)
 uint32_t gts_bs_read_int(GTS_BitStream *bs, uint32_t nBits)
 {
     uint32_t ret = 0;
+    if ((bs->bsmode == GTS_BITSTREAM_READ) && nBits && (nBits <= 32)) {
+        uint64_t cache;
+        if (nBits <= bs_fill_cache(bs, &cache)) {
+            bs_consume_cache(bs, nBits);
+            return (uint32_t)(cache >> (64 - nBits));
+        }
+    }
     while (nBits-- > 0) {
         ret <<= 1;
         ret |= gf_bs_read_bit(bs);
@@ -255,15 +328,58 @@ uint64_t gts_bs_read_long_int(GTS_BitStream *bs, uint32_t nBits)
     if (nBits>64) {
         gts_bs_read_long_int(bs, nBits-64);
         ret = gts_bs_read_long_int(bs, 64);
+    } else if (nBits > 32) {
+        ret = ((uint64_t)gts_bs_read_int(bs, nBits - 32)) << 32;
+        ret |= gts_bs_read_int(bs, 32);
     } else {
-        while (nBits-- > 0) {
-            ret <<= 1;
-            ret |= gf_bs_read_bit(bs);
-        }
+        ret = gts_bs_read_int(bs, nBits);
     }
     return ret;
 }
 
+uint32_t gts_bs_read_ue(GTS_BitStream *bs)
+{
+    uint32_t leadingZeros = 0;
+    if (!bs) return 0;
+
+    if (bs->bsmode == GTS_BITSTREAM_READ) {
+        uint64_t cache;
+        uint32_t valid = bs_fill_cache(bs, &cache);
+        if (cache) {
+            leadingZeros = bs_clz64(cache);
+            if ((leadingZeros < 32) && (2 * leadingZeros + 1 <= valid)) {
+                bs_consume_cache(bs, 2 * leadingZeros + 1);
+                return (uint32_t)((cache << leadingZeros) >> (63 - leadingZeros)) - 1;
+            }
+            leadingZeros = 0;
+        }
+    }
+
+    /*slow path for file streams and codes running past the end of the buffer*/
+    uint32_t peeked = 0;
+    while (1) {
+        peeked = gts_bs_peek_bits(bs, 8, 0);
+        if (peeked) break;
+        //check whether we still have data once the peek is done since we may have less than 8 data available
+        if (!gts_bs_available(bs)) {
+            return 0;
+        }
+        gts_bs_read_int(bs, 8);
+        leadingZeros += 8;
+    }
+    uint32_t zeros = bs_clz64(peeked) - 56;
+    gts_bs_read_int(bs, zeros);
+    leadingZeros += zeros;
+    return gts_bs_read_int(bs, leadingZeros + 1) - 1;
+}
+
+int32_t gts_bs_read_se(GTS_BitStream *bs)
+{
+    uint32_t v = gts_bs_read_ue(bs);
+    if ((v & 0x1) == 0) return (int32_t)(0 - (v >> 1));
+    return (v + 1) >> 1;
+}
+
 
 uint32_t gts_bs_read_data(GTS_BitStream *bs, int8_t *data, uint32_t nbBytes)
 {
@@ -350,43 +466,42 @@ static void BS_WriteByte(GTS_BitStream *bs, uint8_t val)
     bs->position += 1;
 }
 
-static void BS_WriteBit(GTS_BitStream *bs, uint32_t bit)
+/*writes a completed byte, inserting the emulation prevention byte when needed*/
+static inline void BS_WriteByteEmulated(GTS_BitStream *bs, uint8_t val)
 {
     const uint8_t emulation_prevention_three_byte = 0x03;
 
-    bs->current <<= 1;
-    bs->current |= bit;
-    if (++ bs->nbBits == 8) {
-        bs->nbBits = 0;
-
-        if((bs->zeroCount == 2) && ((uint8_t) bs->current < 4))
-        {
-            BS_WriteByte(bs, emulation_prevention_three_byte);
-            bs->zeroCount = 0;
-        }
-        bs->zeroCount = ((uint8_t) bs->current) == 0 ? bs->zeroCount+1 : 0;
-
-        BS_WriteByte(bs, (uint8_t) bs->current);
-        bs->current = 0;
+    if((bs->zeroCount == 2) && (val < 4))
+    {
+        BS_WriteByte(bs, emulation_prevention_three_byte);
+        bs->zeroCount = 0;
     }
-}
+    bs->zeroCount = val == 0 ? bs->zeroCount+1 : 0;
 
+    BS_WriteByte(bs, val);
+}
 
 void gts_bs_write_int(GTS_BitStream *bs, int32_t _value, int32_t nBits)
 {
     if (!bs) return;
-    uint32_t value, nb_shift;
-    if (!nBits) return;
+    uint64_t cache;
+    uint32_t value, total;
+    if (nBits <= 0) return;
+    if (nBits > 32) nBits = 32;
     value = (uint32_t) _value;
-    nb_shift = sizeof (int32_t) * 8 - nBits;
-    if (nb_shift)
-        value <<= nb_shift;
-
-    while (--nBits >= 0) {
-        //but check value as signed
-        BS_WriteBit (bs, ((int32_t)value) < 0);
-        value <<= 1;
+    if (nBits < 32)
+        value &= (1u << nBits) - 1;
+
+    /*the pending bits (less than 8) and the new value fit in one 64-bit accumulator,
+    completed bytes are flushed from the top*/
+    cache = (((uint64_t) bs->current) << nBits) | value;
+    total = bs->nbBits + nBits;
+    while (total >= 8) {
+        total -= 8;
+        BS_WriteByteEmulated(bs, (uint8_t) (cache >> total));
     }
+    bs->nbBits = total;
+    bs->current = (uint32_t) (cache & ((1u << total) - 1));
 }
 
 
@@ -534,6 +649,186 @@ uint32_t gts_bs_write_data(GTS_BitStream *bs, const int8_t *data, uint32_t nbByt
     return (uint32_t) (bs->position - begin);
 }
 
+/***************************************************
+// Emulation prevention byte insertion, the same as writing every byte
+// through BS_WriteByteEmulated: 0x03 is inserted before a byte less than 0x04 when
+// two zero bytes are counted, and the counting restarts after insertion.
+// A byte can only get an insertion when the two bytes before it are zero,
+// so the SIMD kernels look for these candidates with vector compares and
+// copy the blocks without candidates in bulk.
+****************************************************/
+static uint32_t bs_insert_emulation_bytes_c(const uint8_t *src, uint8_t *dst, uint32_t size, uint8_t *zeroCount)
+{
+    uint32_t written = 0;
+    uint8_t zeroCnt = *zeroCount;
+    for (uint32_t n = 0; n < size; n++)
+    {
+        if (zeroCnt == 2 && src[n] < 4)
+        {
+            dst[written++] = 0x03;
+            zeroCnt = 0;
+        }
+        zeroCnt = src[n] == 0 ? zeroCnt + 1 : 0;
+        dst[written++] = src[n];
+    }
+    *zeroCount = zeroCnt;
+    return written;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GTS_BS_SIMD 1
+
+__attribute__((target("sse2")))
+static inline uint32_t bs_emulation_candidate_sse2(const uint8_t *p)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i b0 = _mm_loadu_si128((const __m128i *)p);
+    __m128i m = _mm_cmpeq_epi8(_mm_min_epu8(b0, _mm_set1_epi8(0x03)), b0);
+    m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p - 1)), zero));
+    m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p - 2)), zero));
+    return (uint32_t)_mm_movemask_epi8(m);
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t bs_emulation_candidate_avx2(const uint8_t *p)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i b0 = _mm256_loadu_si256((const __m256i *)p);
+    __m256i m = _mm256_cmpeq_epi8(_mm256_min_epu8(b0, _mm256_set1_epi8(0x03)), b0);
+    m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p - 1)), zero));
+    m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p - 2)), zero));
+    return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+// lastInsert is the position of the last inserted 0x03 (the byte after it), a candidate
+// at n gets an insertion when both zero bytes before it are counted after lastInsert
+#define BS_INSERT_EMULATION_SIMD(name, width, candfunc, isa)                                    \
+__attribute__((target(isa)))                                                                    \
+static uint32_t name(const uint8_t *src, uint8_t *dst, uint32_t size, uint8_t *zeroCount)       \
+{                                                                                               \
+    if (size < 2 * width)                                                                       \
+        return bs_insert_emulation_bytes_c(src, dst, size, zeroCount);                          \
+    int64_t lastInsert = -(int64_t)(*zeroCount);                                                \
+    uint8_t zeroCnt = *zeroCount;                                                               \
+    uint32_t written = 0;                                                                       \
+    uint32_t n = 0;                                                                             \
+    for (; n < 2; n++)                                                                          \
+    {                                                                                           \
+        if (zeroCnt == 2 && src[n] < 4)                                                         \
+        {                                                                                       \
+            dst[written++] = 0x03;                                                              \
+            zeroCnt = 0;                                                                        \
+            lastInsert = n;                                                                     \
+        }                                                                                       \
+        zeroCnt = src[n] == 0 ? zeroCnt + 1 : 0;                                                \
+        dst[written++] = src[n];                                                                \
+    }                                                                                           \
+    uint32_t runStart = n;                                                                      \
+    for (; n + width <= size; n += width)                                                       \
+    {                                                                                           \
+        uint32_t mask = candfunc(src + n);                                                      \
+        while (mask)                                                                            \
+        {                                                                                       \
+            uint32_t pos = n + __builtin_ctz(mask);                                             \
+            mask &= mask - 1;                                                                   \
+            if (lastInsert > (int64_t)pos - 2)                                                  \
+                continue;                                                                       \
+            memcpy(dst + written, src + runStart, pos - runStart);                              \
+            written += pos - runStart;                                                          \
+            dst[written++] = 0x03;                                                              \
+            lastInsert = pos;                                                                   \
+            runStart = pos;                                                                     \
+        }                                                                                       \
+    }                                                                                           \
+    for (; n < size; n++)                                                                       \
+    {                                                                                           \
+        if (src[n] < 4 && !src[n - 1] && !src[n - 2] && lastInsert <= (int64_t)n - 2)          \
+        {                                                                                       \
+            memcpy(dst + written, src + runStart, n - runStart);                                \
+            written += n - runStart;                                                            \
+            dst[written++] = 0x03;                                                              \
+            lastInsert = n;                                                                     \
+            runStart = n;                                                                       \
+        }                                                                                       \
+    }                                                                                           \
+    memcpy(dst + written, src + runStart, size - runStart);                                     \
+    written += size - runStart;                                                                 \
+    zeroCnt = 0;                                                                                \
+    for (int64_t idx = (int64_t)size - 1; idx >= (int64_t)size - 2; idx--)                      \
+    {                                                                                           \
+        if (src[idx] || idx < lastInsert)                                                       \
+            break;                                                                              \
+        zeroCnt++;                                                                              \
+    }                                                                                           \
+    *zeroCount = zeroCnt;                                                                       \
+    return written;                                                                             \
+}
+
+BS_INSERT_EMULATION_SIMD(bs_insert_emulation_bytes_sse2, 16, bs_emulation_candidate_sse2, "sse2")
+BS_INSERT_EMULATION_SIMD(bs_insert_emulation_bytes_avx2, 32, bs_emulation_candidate_avx2, "avx2")
+#endif
+
+typedef uint32_t (*BsInsertEmulationFunc)(const uint8_t *src, uint8_t *dst, uint32_t size, uint8_t *zeroCount);
+
+static BsInsertEmulationFunc bs_select_insert_emulation()
+{
+#ifdef GTS_BS_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return bs_insert_emulation_bytes_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return bs_insert_emulation_bytes_sse2;
+#endif
+    return bs_insert_emulation_bytes_c;
+}
+
+uint32_t gts_bs_insert_emulation_bytes(const int8_t *src, int8_t *dst, uint32_t size, uint8_t *zeroCount)
+{
+    static const BsInsertEmulationFunc insertFunc = bs_select_insert_emulation();
+    if (!src || !dst || !zeroCount)
+        return 0;
+    return insertFunc((const uint8_t *)src, (uint8_t *)dst, size, zeroCount);
+}
+
+uint32_t gts_bs_write_data_with_emulation(GTS_BitStream *bs, const int8_t *data, uint32_t nbBytes)
+{
+    if (!bs || !data) return 0;
+    if (!nbBytes) return 0;
+    uint64_t begin = bs->position;
+    uint64_t maxSize = (uint64_t)nbBytes + nbBytes / 2 + 2;
+
+    if (gts_bs_is_align(bs) && bs->original
+        && ((bs->bsmode == GTS_BITSTREAM_WRITE) || (bs->bsmode == GTS_BITSTREAM_WRITE_DYN)))
+    {
+        if ((bs->position + maxSize > bs->size) && (bs->bsmode == GTS_BITSTREAM_WRITE_DYN))
+        {
+            uint64_t new_size = bs->size ? bs->size * 2 : BS_MEM_BLOCK_ALLOC_SIZE;
+            while (new_size < bs->position + maxSize)
+                new_size *= 2;
+            if (new_size > 0xFFFFFFFF)
+                return 0;
+            int8_t *original = (int8_t*)gts_realloc(bs->original, (uint32_t)new_size);
+            if (!original)
+                return 0;
+            bs->original = original;
+            bs->size = new_size;
+        }
+        if (bs->position + maxSize <= bs->size)
+        {
+            bs->position += gts_bs_insert_emulation_bytes(data, bs->original + bs->position, nbBytes, &bs->zeroCount);
+            return (uint32_t)(bs->position - begin);
+        }
+    }
+
+    while (nbBytes) {
+        gts_bs_write_int(bs, (int32_t) *data, 8);
+        data++;
+        nbBytes--;
+    }
+    return (uint32_t) (bs->position - begin);
+}
+
 uint8_t gts_bs_align(GTS_BitStream *bs)
 {
     if (!bs) return 0;
@@ -187,6 +187,24 @@ uint32_t gts_bs_read_int(GTS_BitStream *bs, uint32_t nBits);
  */
 uint64_t gts_bs_read_long_int(GTS_BitStream *bs, uint32_t nBits);
 
+/*!
+ *    \brief Reads an unsigned Exp-Golomb coded integer, ue(v).
+ *
+ *    \param GTS_BitStream *bs   input  the target bitstream
+ *
+ *    \return uint32_t the integer value read, 0 if the code is truncated or longer than 32 bits.
+ */
+uint32_t gts_bs_read_ue(GTS_BitStream *bs);
+
+/*!
+ *    \brief Reads a signed Exp-Golomb coded integer, se(v).
+ *
+ *    \param GTS_BitStream *bs   input  the target bitstream
+ *
+ *    \return int32_t the integer value read.
+ */
+int32_t gts_bs_read_se(GTS_BitStream *bs);
+
 /*!
  *    \brief Reads a data buffer
  *
@@ -247,6 +265,30 @@ void gts_bs_write_int(GTS_BitStream *bs, int32_t value, int32_t nBits);
  */
 uint32_t gts_bs_write_data(GTS_BitStream *bs, const int8_t *data, uint32_t nbBytes);
 
+/*!
+ *    \brief Writes a data buffer with emulation prevention bytes inserted, the output is the same as
+ *           writing the bytes one by one with gts_bs_write_int.
+ *
+ *    \param GTS_BitStream *bs      input  the target bitstream
+ *    \param const int8_t * data    input  the data to write
+ *    \param uint32_t       nbBytes input  number of data bytes to write
+ *
+ *    \return the number of bytes written, including the inserted emulation prevention bytes
+ */
+uint32_t gts_bs_write_data_with_emulation(GTS_BitStream *bs, const int8_t *data, uint32_t nbBytes);
+
+/*!
+ *    \brief Inserts emulation prevention bytes into a data buffer.
+ *
+ *    \param const int8_t * src       input  the data without emulation prevention bytes
+ *    \param int8_t       * dst       output the data with emulation prevention bytes, size + size / 2 + 2 bytes at least
+ *    \param uint32_t       size      input  number of data bytes
+ *    \param uint8_t      * zeroCount input/output the number of counted zero bytes before and after the data
+ *
+ *    \return the number of bytes in dst
+ */
+uint32_t gts_bs_insert_emulation_bytes(const int8_t *src, int8_t *dst, uint32_t size, uint8_t *zeroCount);
+
 /*!
  *    \brief Writes an integer on 8 bits starting at a byte boundary in the bitstream
  *
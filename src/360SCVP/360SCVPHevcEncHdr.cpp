@@ -493,16 +493,12 @@ void hevc_write_pps(GTS_BitStream *stream, HEVCState * const state)
     hevc_write_bitstream_pic_parameter_set(stream, state);
 }
 
-static void hevc_write_bitstream_slice_header_independent(GTS_BitStream * stream, HEVCState * state)
+static void hevc_write_bitstream_slice_header_independent(GTS_BitStream * stream, HEVC_SPS * sps, HEVC_PPS * pps, HEVCSliceInfo * si)
 {
-    HEVC_SPS      *sps = &state->sps[state->last_parsed_sps_id];
-    HEVC_PPS      *pps = &state->pps[state->last_parsed_pps_id];
-    HEVCSliceInfo *si  = &state->s_info;
-
-    bitstream_put_ue(stream, state->s_info.slice_type); //, "slice_type"
+    bitstream_put_ue(stream, si->slice_type); //, "slice_type"
 
-    if (state->s_info.nal_unit_type != GTS_HEVC_NALU_SLICE_IDR_W_DLP
-        && state->s_info.nal_unit_type != GTS_HEVC_NALU_SLICE_IDR_N_LP)
+    if (si->nal_unit_type != GTS_HEVC_NALU_SLICE_IDR_W_DLP
+        && si->nal_unit_type != GTS_HEVC_NALU_SLICE_IDR_N_LP)
     {
         gts_bs_write_int(stream, si->poc_lsb, 16);//, "pic_order_cnt_lsb");
         gts_bs_write_int(stream, si->short_term_ref_pic_set_sps_flag, 1);//, "short_term_ref_pic_set_sps_flag");
@@ -521,14 +517,14 @@ static void hevc_write_bitstream_slice_header_independent(GTS_BitStream * stream
     }
 
 
-    if (state->sps[state->last_parsed_sps_id].sample_adaptive_offset_enabled_flag) {
+    if (sps->sample_adaptive_offset_enabled_flag) {
         gts_bs_write_int(stream, si->slice_sao_luma_flag, 1); //, "slice_sao_luma_flag"
-        if (state->sps[state->last_parsed_sps_id].chroma_format_idc != CSP_400) {
+        if (sps->chroma_format_idc != CSP_400) {
             gts_bs_write_int(stream, si->slice_sao_chroma_flag, 1); //, "slice_sao_chroma_flag"
         }
     }
 
-    if (state->s_info.slice_type != SLICE_I) {
+    if (si->slice_type != SLICE_I) {
         gts_bs_write_int(stream, si->num_ref_idx_active_override_flag, 1); //, "num_ref_idx_active_override_flag"
         if(si->num_ref_idx_active_override_flag)
         {
@@ -549,28 +545,28 @@ static void hevc_write_bitstream_slice_header_independent(GTS_BitStream * stream
     }
 }
 
-void hevc_write_bitstream_slice_header(GTS_BitStream * stream, HEVCState * state)
+static void hevc_write_slice_header_bits(GTS_BitStream * stream, HEVC_SPS * sps, HEVC_PPS * pps, HEVCSliceInfo * si)
 {
-    bool first_slice_segment_in_pic = state->s_info.first_slice_segment_in_pic_flag;
+    bool first_slice_segment_in_pic = si->first_slice_segment_in_pic_flag;
 
     gts_bs_write_int(stream, first_slice_segment_in_pic, 1); //, "first_slice_segment_in_pic_flag"
 
-    if (state->s_info.nal_unit_type >= GTS_HEVC_NALU_SLICE_BLA_W_LP
-        && state->s_info.nal_unit_type < GTS_HEVC_NALU_VID_PARAM) { //23
+    if (si->nal_unit_type >= GTS_HEVC_NALU_SLICE_BLA_W_LP
+        && si->nal_unit_type < GTS_HEVC_NALU_VID_PARAM) { //23
         gts_bs_write_int(stream, 0, 1); //, "no_output_of_prior_pics_flag"
     }
 
     bitstream_put_ue(stream, 0); //, "slice_pic_parameter_set_id"
 
     if (!first_slice_segment_in_pic) {
-         int32_t lcu_cnt = state->sps[state->last_parsed_sps_id].width / LCU_WIDTH * state->sps[state->last_parsed_sps_id].height / LCU_WIDTH;
+         int32_t lcu_cnt = sps->width / LCU_WIDTH * sps->height / LCU_WIDTH;
         int32_t num_bits = math_ceil_log2(lcu_cnt);
-        gts_bs_write_int(stream, state->s_info.slice_segment_address, num_bits); //, "slice_segment_address"
+        gts_bs_write_int(stream, si->slice_segment_address, num_bits); //, "slice_segment_address"
     }
 
-    hevc_write_bitstream_slice_header_independent(stream, state);
+    hevc_write_bitstream_slice_header_independent(stream, sps, pps, si);
 
-        if (state->pps[state->last_parsed_pps_id].tiles_enabled_flag) {
+        if (pps->tiles_enabled_flag) {
             int32_t num_entry_points = 1;
             int32_t num_offsets = num_entry_points - 1;
 
@@ -579,6 +575,12 @@ void hevc_write_bitstream_slice_header(GTS_BitStream * stream, HEVCState * state
         }
 }
 
+void hevc_write_bitstream_slice_header(GTS_BitStream * stream, HEVCState * state)
+{
+    hevc_write_slice_header_bits(stream, &state->sps[state->last_parsed_sps_id],
+        &state->pps[state->last_parsed_pps_id], &state->s_info);
+}
+
  void hevc_write_slice_header(GTS_BitStream * stream, HEVCState * state)
 {
     state->first_nal = true;
@@ -589,6 +591,169 @@ void hevc_write_bitstream_slice_header(GTS_BitStream * stream, HEVCState * state
     hevc_bitstream_add_rbsp_trailing_bits(stream);
 }
 
+static bool hevc_get_slice_header_layout(HEVC_SPS * sps, HEVC_PPS * pps, HEVCSliceInfo * si, HevcSliceHdrLayout *pLayout)
+{
+    memset(pLayout, 0, sizeof(HevcSliceHdrLayout));
+    pLayout->nal_unit_type = si->nal_unit_type;
+    pLayout->first_slice_segment_in_pic_flag = si->first_slice_segment_in_pic_flag;
+    pLayout->sps_id = sps->id;
+    pLayout->pps_id = pps->id;
+    if (!si->first_slice_segment_in_pic_flag)
+    {
+        int32_t lcu_cnt = sps->width / LCU_WIDTH * sps->height / LCU_WIDTH;
+        pLayout->address_bits = math_ceil_log2(lcu_cnt);
+    }
+    pLayout->slice_type = si->slice_type;
+
+    if (si->nal_unit_type != GTS_HEVC_NALU_SLICE_IDR_W_DLP
+        && si->nal_unit_type != GTS_HEVC_NALU_SLICE_IDR_N_LP)
+    {
+        if (si->rps[0].num_negative_pics > 16)
+            return false;
+        pLayout->short_term_ref_pic_set_sps_flag = si->short_term_ref_pic_set_sps_flag;
+        pLayout->num_negative_pics = si->rps[0].num_negative_pics;
+        pLayout->num_positive_pics = si->rps[0].num_positive_pics;
+        for (uint32_t j = 0; j < si->rps[0].num_negative_pics; j++)
+        {
+            pLayout->delta_poc[j] = si->rps[0].delta_poc[j];
+            pLayout->used_by_curr_pic_s0_flag[j] = si->used_by_curr_pic_s0_flag[j];
+        }
+        pLayout->temporal_mvp_enable_flag = sps->temporal_mvp_enable_flag;
+        if (sps->temporal_mvp_enable_flag)
+            pLayout->slice_temporal_mvp_enabled_flag = si->slice_temporal_mvp_enabled_flag;
+    }
+
+    pLayout->sample_adaptive_offset_enabled_flag = sps->sample_adaptive_offset_enabled_flag;
+    if (sps->sample_adaptive_offset_enabled_flag)
+    {
+        pLayout->slice_sao_luma_flag = si->slice_sao_luma_flag;
+        pLayout->sao_chroma_present = sps->chroma_format_idc != CSP_400;
+        if (pLayout->sao_chroma_present)
+            pLayout->slice_sao_chroma_flag = si->slice_sao_chroma_flag;
+    }
+
+    if (si->slice_type != SLICE_I)
+        pLayout->num_ref_idx_active_override_flag = si->num_ref_idx_active_override_flag;
+
+    pLayout->slice_qp_delta = si->slice_qp_delta;
+    pLayout->slice_chroma_qp_offsets_present_flag = pps->slice_chroma_qp_offsets_present_flag;
+    if (pps->slice_chroma_qp_offsets_present_flag)
+    {
+        pLayout->slice_cb_qp_offset = si->slice_cb_qp_offset;
+        pLayout->slice_cr_qp_offset = si->slice_cr_qp_offset;
+    }
+    pLayout->tiles_enabled_flag = pps->tiles_enabled_flag;
+    return true;
+}
+
+static bool hevc_build_slice_header_template(HEVC_SPS * sps, HEVC_PPS * pps, HEVCSliceInfo * si, HevcSliceHdrTemplate *pTemplate)
+{
+    // the largest header (16 reference pictures with 32 bits codes) is below 256 bytes
+    // even with emulation prevention bytes
+    int8_t buffer[512];
+    GTS_BitStream *bs = gts_bs_new(buffer, sizeof(buffer), GTS_BITSTREAM_WRITE);
+    if (!bs)
+        return false;
+
+    hevc_write_slice_header_bits(bs, sps, pps, si);
+    hevc_bitstream_add_rbsp_trailing_bits(bs);
+    uint32_t size = (uint32_t)gts_bs_get_position(bs);
+    gts_bs_del(bs);
+
+    // the template keeps the rbsp, the emulation prevention depends on the bytes
+    // before the header and is done again when the template is written
+    int8_t rbsp[sizeof(buffer)];
+    uint32_t rbspLen = gts_media_nalu_remove_emulation_bytes(buffer, rbsp, size);
+    if (!rbspLen || rbspLen > HEVC_SLICE_HDR_TEMPLATE_SIZE)
+        return false;
+
+    memcpy(pTemplate->rbsp, rbsp, rbspLen);
+    pTemplate->rbspLen = rbspLen;
+
+    // same order as hevc_write_bitstream_slice_header
+    uint32_t bitPos = 1;
+    if (pTemplate->layout.nal_unit_type >= GTS_HEVC_NALU_SLICE_BLA_W_LP
+        && pTemplate->layout.nal_unit_type < GTS_HEVC_NALU_VID_PARAM)
+        bitPos++;
+    bitPos++;
+    pTemplate->addrBitPos = bitPos;
+    bitPos += pTemplate->layout.address_bits;
+    bitPos += math_floor_log2(pTemplate->layout.slice_type + 1) * 2 + 1;
+    pTemplate->pocBitPos = bitPos;
+    return true;
+}
+
+static void hevc_patch_bits(uint8_t *pBuf, uint32_t bitPos, uint32_t value, uint32_t nBits)
+{
+    for (uint32_t i = 0; i < nBits; i++, bitPos++)
+    {
+        uint8_t mask = (uint8_t)(0x80 >> (bitPos & 7));
+        if ((value >> (nBits - 1 - i)) & 1)
+            pBuf[bitPos >> 3] |= mask;
+        else
+            pBuf[bitPos >> 3] &= ~mask;
+    }
+}
+
+static void hevc_write_slice_header_nal(GTS_BitStream * stream, HEVC_SPS * sps, HEVC_PPS * pps, HEVCSliceInfo * si)
+{
+    nal_write(stream, si->nal_unit_type, 0, 1);
+    hevc_write_slice_header_bits(stream, sps, pps, si);
+    hevc_bitstream_add_rbsp_trailing_bits(stream);
+}
+
+void hevc_write_slice_header_with_params(GTS_BitStream * stream, HEVC_SPS * sps, HEVC_PPS * pps, HEVCSliceInfo * si, HevcSliceHdrCache *pCache)
+{
+    HevcSliceHdrLayout layout;
+    if (!pCache || !stream || !gts_bs_is_align(stream) || !hevc_get_slice_header_layout(sps, pps, si, &layout))
+    {
+        hevc_write_slice_header_nal(stream, sps, pps, si);
+        return;
+    }
+
+    HevcSliceHdrTemplate *pTemplate = NULL;
+    for (uint32_t i = 0; i < HEVC_SLICE_HDR_TEMPLATE_NUM; i++)
+    {
+        if (pCache->templates[i].valid
+            && !memcmp(&pCache->templates[i].layout, &layout, sizeof(HevcSliceHdrLayout)))
+        {
+            pTemplate = &pCache->templates[i];
+            break;
+        }
+    }
+
+    if (!pTemplate)
+    {
+        pTemplate = &pCache->templates[pCache->nextSlot];
+        pCache->nextSlot = (pCache->nextSlot + 1) % HEVC_SLICE_HDR_TEMPLATE_NUM;
+        pTemplate->layout = layout;
+        pTemplate->valid = hevc_build_slice_header_template(sps, pps, si, pTemplate);
+        if (!pTemplate->valid)
+        {
+            hevc_write_slice_header_nal(stream, sps, pps, si);
+            return;
+        }
+    }
+
+    uint8_t rbsp[HEVC_SLICE_HDR_TEMPLATE_SIZE];
+    memcpy(rbsp, pTemplate->rbsp, pTemplate->rbspLen);
+    if (!layout.first_slice_segment_in_pic_flag)
+        hevc_patch_bits(rbsp, pTemplate->addrBitPos, si->slice_segment_address, layout.address_bits);
+    if (layout.nal_unit_type != GTS_HEVC_NALU_SLICE_IDR_W_DLP
+        && layout.nal_unit_type != GTS_HEVC_NALU_SLICE_IDR_N_LP)
+        hevc_patch_bits(rbsp, pTemplate->pocBitPos, si->poc_lsb, 16);
+
+    nal_write(stream, si->nal_unit_type, 0, 1);
+    gts_bs_write_data_with_emulation(stream, (const int8_t *)rbsp, pTemplate->rbspLen);
+}
+
+void hevc_write_slice_header_cached(GTS_BitStream * stream, HEVCState * state, HevcSliceHdrCache *pCache)
+{
+    state->first_nal = false;
+    hevc_write_slice_header_with_params(stream, &state->sps[state->last_parsed_sps_id],
+        &state->pps[state->last_parsed_pps_id], &state->s_info, pCache);
+}
+
  void writeSEINalHeader(GTS_BitStream *bs, H265SEIType payloadType, unsigned int payloadSize, int temporalIdPlus1)
  {
      // add NAL header
@@ -30,9 +30,93 @@
 #include "360SCVPBitstream.h"
 #include "360SCVPAPI.h"
 
+#define HEVC_SLICE_HDR_TEMPLATE_NUM   4
+#define HEVC_SLICE_HDR_TEMPLATE_SIZE  64
+
+//!
+//! \brief  every syntax value which decides the bits of the rewritten slice header,
+//!         except slice_segment_address and pic_order_cnt_lsb which are patched in
+//!         place. The sps/pps fields the header depends on are part of it, so a
+//!         changed parameter set never matches an old template
+//!
+typedef struct HEVC_SLICE_HDR_LAYOUT
+{
+    uint32_t nal_unit_type;
+    uint32_t first_slice_segment_in_pic_flag;
+    uint32_t sps_id;
+    uint32_t pps_id;
+    uint32_t address_bits;
+    uint32_t slice_type;
+    uint32_t short_term_ref_pic_set_sps_flag;
+    uint32_t num_negative_pics;
+    uint32_t num_positive_pics;
+    int32_t  delta_poc[16];
+    uint32_t used_by_curr_pic_s0_flag[16];
+    uint32_t temporal_mvp_enable_flag;
+    uint32_t slice_temporal_mvp_enabled_flag;
+    uint32_t sample_adaptive_offset_enabled_flag;
+    uint32_t sao_chroma_present;
+    uint32_t slice_sao_luma_flag;
+    uint32_t slice_sao_chroma_flag;
+    uint32_t num_ref_idx_active_override_flag;
+    int32_t  slice_qp_delta;
+    uint32_t slice_chroma_qp_offsets_present_flag;
+    int32_t  slice_cb_qp_offset;
+    int32_t  slice_cr_qp_offset;
+    uint32_t tiles_enabled_flag;
+}HevcSliceHdrLayout;
+
+//!
+//! \brief  the rbsp bits of one slice header (without emulation prevention bytes),
+//!         with the bit positions of the fields patched for each slice
+//!
+typedef struct HEVC_SLICE_HDR_TEMPLATE
+{
+    bool               valid;
+    HevcSliceHdrLayout layout;
+    uint8_t            rbsp[HEVC_SLICE_HDR_TEMPLATE_SIZE];
+    uint32_t           rbspLen;
+    uint32_t           addrBitPos;
+    uint32_t           pocBitPos;
+}HevcSliceHdrTemplate;
+
+//!
+//! \brief  a small set of slice header templates, usually one per slice type and
+//!         parameter set of the tile. It should be memset to 0 before the first use
+//!
+typedef struct HEVC_SLICE_HDR_CACHE
+{
+    HevcSliceHdrTemplate templates[HEVC_SLICE_HDR_TEMPLATE_NUM];
+    uint32_t             nextSlot;
+}HevcSliceHdrCache;
+
 void hevc_write_bitstream_aud(GTS_BitStream *stream,    HEVCState * const state);
 void hevc_write_parameter_sets(GTS_BitStream *stream, HEVCState * const state);
 void hevc_write_slice_header(GTS_BitStream * stream, HEVCState * state);
+
+//!
+//! \brief  write the same slice header nal as hevc_write_slice_header, but reuse
+//!         the cached template with the same layout and only patch the slice
+//!         address and the poc lsb. A new template is generated on a miss
+//!
+//! \param  GTS_BitStream     *stream, output, the bitstream to write into
+//! \param  HEVCState         *state,  input,  the slice header to write
+//! \param  HevcSliceHdrCache *pCache, input/output, the templates, NULL to disable
+//!
+void hevc_write_slice_header_cached(GTS_BitStream * stream, HEVCState * state, HevcSliceHdrCache *pCache);
+
+//!
+//! \brief  write a slice header nal like hevc_write_slice_header_cached, but with
+//!         explicit parameter sets and slice info instead of the ones selected in
+//!         a HEVCState, so a state shared by several handles is never written
+//!
+//! \param  GTS_BitStream     *stream, output, the bitstream to write into
+//! \param  HEVC_SPS          *sps,    input,  the sps the header refers to
+//! \param  HEVC_PPS          *pps,    input,  the pps the header refers to
+//! \param  HEVCSliceInfo     *si,     input,  the slice header to write
+//! \param  HevcSliceHdrCache *pCache, input/output, the templates, NULL to disable
+//!
+void hevc_write_slice_header_with_params(GTS_BitStream * stream, HEVC_SPS * sps, HEVC_PPS * pps, HEVCSliceInfo * si, HevcSliceHdrCache *pCache);
 uint32_t hevc_write_RwpkSEI(GTS_BitStream * stream, const RegionWisePacking* pRegion, int32_t temporalIdPlus1);
 uint32_t hevc_write_ProjectionSEI(GTS_BitStream * stream, int32_t projType, int32_t temporalIdPlus1);
 uint32_t hevc_write_SphereRotSEI(GTS_BitStream * stream, const SphereRotation* pSphereRot, int32_t temporalIdPlus1);
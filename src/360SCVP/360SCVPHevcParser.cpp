@@ -34,7 +34,15 @@ uint32_t gts_get_bit_size(uint32_t MaxVal)
     return k;
 }
 
-uint32_t gts_media_nalu_emulation_bytes_remove_count(const int8_t *buffer, uint32_t size_nal)
+/***************************************************
+// Emulation prevention byte removal. A byte is removed when it is 0x03,
+// it follows exactly two zero bytes, and the next byte (compared as
+// int8_t) is less than 0x04. The condition only depends on the bytes
+// around it, so the SIMD kernels find these positions with vector
+// compares on 16/32 bytes and copy the runs between them in bulk; the
+// scalar code is kept for the heads, tails and non-x86 builds.
+****************************************************/
+static uint32_t nalu_emulation_bytes_remove_count_c(const int8_t *buffer, uint32_t size_nal)
 {
     uint32_t n = 0, emulation_bytes_count = 0;
     uint8_t zero_counter = 0;
@@ -57,7 +65,7 @@ uint32_t gts_media_nalu_emulation_bytes_remove_count(const int8_t *buffer, uint3
     return emulation_bytes_count;
 }
 
-uint32_t gts_media_nalu_remove_emulation_bytes(const int8_t *src_buffer, int8_t *dst_buffer, uint32_t size_nal)
+static uint32_t nalu_remove_emulation_bytes_c(const int8_t *src_buffer, int8_t *dst_buffer, uint32_t size_nal)
 {
     uint32_t n = 0, emulation_bytes_count = 0;
     uint8_t zero_counter = 0;
@@ -81,68 +89,166 @@ uint32_t gts_media_nalu_remove_emulation_bytes(const int8_t *src_buffer, int8_t
     return size_nal - emulation_bytes_count;
 }
 
+// whether buffer[n] is an emulation prevention byte, n >= 2
+static inline bool nalu_is_emulation_byte(const int8_t *buffer, uint32_t n, uint32_t size_nal)
+{
+    return buffer[n] == 0x03 && !buffer[n - 1] && !buffer[n - 2] && (n == 2 || buffer[n - 3])
+        && n + 1 < size_nal && buffer[n + 1] < 0x04;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GTS_NALU_SIMD 1
+
+// copy [start, end) of src to dst except the bytes marked in mask (bit k for start + k)
+static inline uint32_t nalu_copy_runs(const int8_t *src, int8_t *dst, uint32_t start, uint32_t end, uint32_t mask)
+{
+    uint32_t written = 0;
+    uint32_t runStart = start;
+    while (mask)
+    {
+        uint32_t pos = start + __builtin_ctz(mask);
+        memcpy(dst + written, src + runStart, pos - runStart);
+        written += pos - runStart;
+        runStart = pos + 1;
+        mask &= mask - 1;
+    }
+    memcpy(dst + written, src + runStart, end - runStart);
+    return written + end - runStart;
+}
+
+__attribute__((target("sse2")))
+static inline uint32_t nalu_emulation_mask_sse2(const int8_t *p)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i b0 = _mm_loadu_si128((const __m128i *)p);
+    __m128i m = _mm_cmpeq_epi8(b0, _mm_set1_epi8(0x03));
+    m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p - 1)), zero));
+    m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p - 2)), zero));
+    m = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p - 3)), zero), m);
+    m = _mm_and_si128(m, _mm_cmplt_epi8(_mm_loadu_si128((const __m128i *)(p + 1)), _mm_set1_epi8(0x04)));
+    return (uint32_t)_mm_movemask_epi8(m);
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t nalu_emulation_mask_avx2(const int8_t *p)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i b0 = _mm256_loadu_si256((const __m256i *)p);
+    __m256i m = _mm256_cmpeq_epi8(b0, _mm256_set1_epi8(0x03));
+    m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p - 1)), zero));
+    m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p - 2)), zero));
+    m = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p - 3)), zero), m);
+    m = _mm256_and_si256(m, _mm256_cmpgt_epi8(_mm256_set1_epi8(0x04), _mm256_loadu_si256((const __m256i *)(p + 1))));
+    return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+// the vector body covers n in [3, size_nal - 1), the bytes n - 3 ... n + 1 are loaded
+#define NALU_EMULATION_COUNT_SIMD(name, width, maskfunc, isa)                                   \
+__attribute__((target(isa)))                                                                    \
+static uint32_t name(const int8_t *buffer, uint32_t size_nal)                                   \
+{                                                                                               \
+    uint32_t count = 0;                                                                         \
+    uint32_t n = 3;                                                                             \
+    if (size_nal > 2 && nalu_is_emulation_byte(buffer, 2, size_nal))                            \
+        count++;                                                                                \
+    for (; n + width < size_nal; n += width)                                                    \
+        count += __builtin_popcount(maskfunc(buffer + n));                                      \
+    for (; n < size_nal; n++)                                                                   \
+        count += nalu_is_emulation_byte(buffer, n, size_nal);                                   \
+    return count;                                                                               \
+}
+
+#define NALU_REMOVE_EMULATION_SIMD(name, width, maskfunc, isa)                                  \
+__attribute__((target(isa)))                                                                    \
+static uint32_t name(const int8_t *src_buffer, int8_t *dst_buffer, uint32_t size_nal)           \
+{                                                                                               \
+    uint32_t written = 0;                                                                       \
+    uint32_t n = 0;                                                                             \
+    for (; n < 3 && n < size_nal; n++)                                                          \
+    {                                                                                           \
+        if (n == 2 && nalu_is_emulation_byte(src_buffer, n, size_nal))                          \
+            continue;                                                                           \
+        dst_buffer[written++] = src_buffer[n];                                                  \
+    }                                                                                           \
+    for (; n + width < size_nal; n += width)                                                    \
+    {                                                                                           \
+        uint32_t mask = maskfunc(src_buffer + n);                                               \
+        if (!mask)                                                                              \
+        {                                                                                       \
+            memcpy(dst_buffer + written, src_buffer + n, width);                                \
+            written += width;                                                                   \
+        }                                                                                       \
+        else                                                                                    \
+            written += nalu_copy_runs(src_buffer, dst_buffer + written, n, n + width, mask);    \
+    }                                                                                           \
+    for (; n < size_nal; n++)                                                                   \
+    {                                                                                           \
+        if (nalu_is_emulation_byte(src_buffer, n, size_nal))                                    \
+            continue;                                                                           \
+        dst_buffer[written++] = src_buffer[n];                                                  \
+    }                                                                                           \
+    return written;                                                                             \
+}
+
+NALU_EMULATION_COUNT_SIMD(nalu_emulation_bytes_remove_count_sse2, 16, nalu_emulation_mask_sse2, "sse2")
+NALU_EMULATION_COUNT_SIMD(nalu_emulation_bytes_remove_count_avx2, 32, nalu_emulation_mask_avx2, "avx2,popcnt")
+NALU_REMOVE_EMULATION_SIMD(nalu_remove_emulation_bytes_sse2, 16, nalu_emulation_mask_sse2, "sse2")
+NALU_REMOVE_EMULATION_SIMD(nalu_remove_emulation_bytes_avx2, 32, nalu_emulation_mask_avx2, "avx2")
+#endif
+
+typedef uint32_t (*NaluEmulationCountFunc)(const int8_t *buffer, uint32_t size_nal);
+typedef uint32_t (*NaluRemoveEmulationFunc)(const int8_t *src_buffer, int8_t *dst_buffer, uint32_t size_nal);
+
+static NaluEmulationCountFunc nalu_select_emulation_count()
+{
+#ifdef GTS_NALU_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return nalu_emulation_bytes_remove_count_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return nalu_emulation_bytes_remove_count_sse2;
+#endif
+    return nalu_emulation_bytes_remove_count_c;
+}
+
+static NaluRemoveEmulationFunc nalu_select_remove_emulation()
+{
+#ifdef GTS_NALU_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return nalu_remove_emulation_bytes_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return nalu_remove_emulation_bytes_sse2;
+#endif
+    return nalu_remove_emulation_bytes_c;
+}
+
+uint32_t gts_media_nalu_emulation_bytes_remove_count(const int8_t *buffer, uint32_t size_nal)
+{
+    static const NaluEmulationCountFunc countFunc = nalu_select_emulation_count();
+    if (!buffer)
+        return 0;
+    return countFunc(buffer, size_nal);
+}
+
+uint32_t gts_media_nalu_remove_emulation_bytes(const int8_t *src_buffer, int8_t *dst_buffer, uint32_t size_nal)
+{
+    static const NaluRemoveEmulationFunc removeFunc = nalu_select_remove_emulation();
+    if (!src_buffer || !dst_buffer)
+        return 0;
+    return removeFunc(src_buffer, dst_buffer, size_nal);
+}
 
-static uint8_t digits_of_agm[256] = {
-    8, 7, 6, 6, 5, 5, 5, 5,
-    4, 4, 4, 4, 4, 4, 4, 4,
-    3, 3, 3, 3, 3, 3, 3, 3,
-    3, 3, 3, 3, 3, 3, 3, 3,
-    2, 2, 2, 2, 2, 2, 2, 2,
-    2, 2, 2, 2, 2, 2, 2, 2,
-    2, 2, 2, 2, 2, 2, 2, 2,
-    2, 2, 2, 2, 2, 2, 2, 2,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0
-};
 
 static uint32_t bs_get_ue(GTS_BitStream *gts_bitstream)
 {
-    uint8_t flag_c;
-    uint32_t data = 0, flag_r = 0;
-    while (1) {
-        flag_r = gts_bs_peek_bits(gts_bitstream, 8, 0);
-        if (flag_r) break;
-        //check whether we still have data once the peek is done since we may have less than 8 data available
-        if (!gts_bs_available(gts_bitstream)) {
-            //GF_LOG(GF_LOG_ERROR, GF_LOG_CODING, ("[AVC/HEVC] Not enough data in bitstream !!\n"));
-            return 0;
-        }
-        gts_bs_read_int(gts_bitstream, 8);
-        data += 8;
-    }
-    flag_c = digits_of_agm[flag_r];
-    gts_bs_read_int(gts_bitstream, flag_c);
-    data += flag_c;
-    return gts_bs_read_int(gts_bitstream, data + 1) - 1;
+    return gts_bs_read_ue(gts_bitstream);
 }
 
 static int32_t bs_get_se(GTS_BitStream *bs)
 {
-    uint32_t v = bs_get_ue(bs);
-    if ((v & 0x1) == 0) return (int32_t)(0 - (v >> 1));
-    return (v + 1) >> 1;
+    return gts_bs_read_se(bs);
 }
 
 uint32_t gts_media_nalu_is_start_code(GTS_BitStream *bs)
@@ -1670,7 +1776,7 @@ static int32_t gts_media_hevc_read_pps_bs(GTS_BitStream *gts_bitstream, HEVCStat
     return index_hevc_pps;
 }
 
-int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data, uint32_t size, HEVCState *hevc)
+static int32_t hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data, uint32_t size, HEVCState *hevc, HEVCSliceInfo *s_info)
 {
     GTS_BitStream *bs=NULL;
     int8_t *data_without_emulation_bytes = NULL;
@@ -1684,11 +1790,11 @@ int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data,
     uint16_t* slicehdrlen = &pSpecialInfo->sliceHeaderLen;
     uint16_t* payloadType = &pSpecialInfo->seiPayloadType;
 
-    memcpy(&n_state, &hevc->s_info, sizeof(HEVCSliceInfo));
+    memcpy(&n_state, s_info, sizeof(HEVCSliceInfo));
 
     //hevc->last_parsed_vps_id = hevc->last_parsed_sps_id = hevc->last_parsed_pps_id = -1;
-    hevc->s_info.entry_point_start_bits = -1;
-    hevc->s_info.payload_start_offset = -1;
+    s_info->entry_point_start_bits = -1;
+    s_info->payload_start_offset = -1;
 
     data_without_emulation_bytes_size = gts_media_nalu_emulation_bytes_remove_count(data, size);
     if (!data_without_emulation_bytes_size) {
@@ -1740,7 +1846,7 @@ int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data,
 
         ret = 0;
 
-        if (hevc->s_info.poc != n_state.poc) {
+        if (s_info->poc != n_state.poc) {
             ret=1;
             break;
         }
@@ -1769,16 +1875,16 @@ int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data,
     }
 
     /* save _prev values */
-    if (ret && hevc->s_info.sps) {
-        n_state.frame_num_offset_prev = hevc->s_info.frame_num_offset;
-        n_state.frame_num_prev = hevc->s_info.frame_num;
+    if (ret && s_info->sps) {
+        n_state.frame_num_offset_prev = s_info->frame_num_offset;
+        n_state.frame_num_prev = s_info->frame_num;
 
-        n_state.poc_lsb_prev = hevc->s_info.poc_lsb;
-        n_state.poc_msb_prev = hevc->s_info.poc_msb;
+        n_state.poc_lsb_prev = s_info->poc_lsb;
+        n_state.poc_msb_prev = s_info->poc_msb;
         n_state.prev_layer_id_plus1 = *layer_id + 1;
     }
     if (is_slice) hevc_compute_poc(&n_state);
-    memcpy(&hevc->s_info, &n_state, sizeof(HEVCSliceInfo));
+    memcpy(s_info, &n_state, sizeof(HEVCSliceInfo));
 
 exit:
     if (bs) gts_bs_del(bs);
@@ -1786,6 +1892,25 @@ exit:
     return ret;
 }
 
+int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data, uint32_t size, HEVCState *hevc)
+{
+    return hevc_parse_nalu(pSpecialInfo, data, size, hevc, &hevc->s_info);
+}
+
+int32_t gts_media_hevc_parse_slice_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data, uint32_t size, HEVCState *hevc, HEVCSliceInfo *s_info)
+{
+    if (!pSpecialInfo || !data || size < 2 || !hevc || !s_info)
+        return -1;
+
+    //only slices are accepted, so the parameter sets in hevc are never touched
+    uint8_t nal_unit_type = (data[0] & 0x7E) >> 1;
+    if (nal_unit_type > GTS_HEVC_NALU_SLICE_CRA
+        || (nal_unit_type > GTS_HEVC_NALU_SLICE_RASL_R && nal_unit_type < GTS_HEVC_NALU_SLICE_BLA_W_LP))
+        return -1;
+
+    return hevc_parse_nalu(pSpecialInfo, data, size, hevc, s_info);
+}
+
 int32_t gts_media_hevc_stitch_sps(HEVCState *hevc, uint32_t frameWidth, uint32_t frameHeight)
 {
     HEVC_SPS *sps = &hevc->sps[0];//&hevc->sps[hevc->last_parsed_sps_id];
@@ -448,6 +448,8 @@ enum
 };
 
 int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data, uint32_t size, HEVCState *hevc);
+//parse one slice nal into s_info with the parameter sets of hevc, hevc itself is left unchanged
+int32_t gts_media_hevc_parse_slice_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data, uint32_t size, HEVCState *hevc, HEVCSliceInfo *s_info);
 bool gts_media_hevc_slice_is_intra(HEVCState *hevc);
 bool gts_media_hevc_slice_is_IDR(HEVCState *hevc);
 
@@ -456,6 +458,9 @@ int32_t gts_media_hevc_stitch_pps(HEVCState *hevc, void *gentiledstream);
 int32_t gts_media_hevc_stitch_slice_segment(HEVCState *hevc, void* slice, uint32_t frameWidth, uint32_t sub_tile_index);
 
 uint32_t gts_media_nalu_next_start_code_bs(GTS_BitStream *bs);
+// count / remove the emulation prevention bytes of one nal, dst_buffer should have size_nal bytes at least
+uint32_t gts_media_nalu_emulation_bytes_remove_count(const int8_t *buffer, uint32_t size_nal);
+uint32_t gts_media_nalu_remove_emulation_bytes(const int8_t *src_buffer, int8_t *dst_buffer, uint32_t size_nal);
 int32_t hevc_read_RwpkSEI(int8_t *pRWPKBits, uint32_t RWPKBitsSize, RegionWisePacking* pRWPK);
 #define MAX_TILE_ROWS 64
 #define MAX_TILE_COLS 64
@@ -424,6 +424,7 @@ void*   genTiledStream_Init(param_gen_tiledStream* pParamGenTiledStream)
                     pGen = NULL;
                     return NULL;
                 }
+                memset(pGen->pTiledBitstreams[i*pGen->tilesWidthCount + j], 0, sizeof(oneStream_info));
                 pGen->pTiledBitstreams[i*pGen->tilesWidthCount + j]->hevcSlice = (HEVCState*)malloc(sizeof(HEVCState));
                 if (pGen->pTiledBitstreams[i*pGen->tilesWidthCount + j]->hevcSlice)
                 {
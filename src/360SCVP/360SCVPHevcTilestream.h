@@ -27,6 +27,7 @@
 #define _360SCVP_HEVC_TILESTREAM_H_
 #include "360SCVPBitstream.h"
 #include "360SCVPHevcParser.h"
+#include "360SCVPHevcEncHdr.h"
 #include "360SCVPTiledstreamAPI.h"
 #include "360SCVPCommonDef.h"
 
@@ -58,6 +59,7 @@ typedef struct ONESTREAM_INFO
     int32_t             rowHeight[20];
     int32_t             address;
     int32_t             currentTileIdx;
+    HevcSliceHdrCache   sliceHdrCache;
 
 }oneStream_info;
 
@@ -43,12 +43,14 @@ TstitchStream::TstitchStream()
     m_pDownRight = new point[6];
     m_pNalInfo[0] = new nal_info[1000];
     m_pNalInfo[1] = new nal_info[1000];
-    m_hevcState = new HEVCState;
+    m_sharedHevcState.reset(new HEVCState);
+    m_hevcState = m_sharedHevcState.get();
     if (m_hevcState)
     {
         memset(m_hevcState, 0, sizeof(HEVCState));
         m_hevcState->sps_active_idx = -1;
     }
+    memset(&m_sliceInfo, 0, sizeof(HEVCSliceInfo));
     memset(&m_pViewportParam, 0, sizeof(generateViewPortParam));
     memset(&m_mergeStreamParam, 0, sizeof(param_mergeStream));
     memset(&m_streamStitch, 0, sizeof(param_gen_tiledStream));
@@ -94,6 +96,10 @@ TstitchStream::TstitchStream()
     m_xTopLeftNet = 0;
     m_yTopLeftNet = 0;
     m_dstRwpk = RegionWisePacking();
+    m_bSegmentOutput = false;
+    m_pSegmentBs = NULL;
+    m_segmentHeaderOffset = -1;
+    memset(&m_sliceHdrCache, 0, sizeof(HevcSliceHdrCache));
 }
 
 TstitchStream::TstitchStream(TstitchStream& other)
@@ -108,11 +114,11 @@ TstitchStream::TstitchStream(TstitchStream& other)
     memcpy(m_pNalInfo[0], other.m_pNalInfo[0], 1000 * sizeof(nal_info));
     m_pNalInfo[1] = new nal_info[1000];
     memcpy(m_pNalInfo[1], other.m_pNalInfo[1], 1000 * sizeof(nal_info));
-    m_hevcState = new HEVCState;
+    m_sharedHevcState = other.m_sharedHevcState;
+    m_hevcState = m_sharedHevcState.get();
+    memset(&m_sliceInfo, 0, sizeof(HEVCSliceInfo));
     if (m_hevcState)
-    {
-        memcpy(m_hevcState, other.m_hevcState, sizeof(HEVCState));
-    }
+        memcpy(&m_sliceInfo, &m_hevcState->s_info, sizeof(HEVCSliceInfo));
 
     memcpy(&m_pViewportParam, &(other.m_pViewportParam), sizeof(generateViewPortParam));
     memcpy(&m_mergeStreamParam, &(other.m_mergeStreamParam), sizeof(param_mergeStream));
@@ -168,6 +174,11 @@ TstitchStream::TstitchStream(TstitchStream& other)
     m_yTopLeftNet = other.m_yTopLeftNet;
     m_dstRwpk = RegionWisePacking();
     m_dstRwpk = other.m_dstRwpk;
+    m_dstRwpk.rectRegionPacking = NULL;
+    m_bSegmentOutput = false;
+    m_pSegmentBs = NULL;
+    m_segmentHeaderOffset = -1;
+    memset(&m_sliceHdrCache, 0, sizeof(HevcSliceHdrCache));
 }
 
 TstitchStream::~TstitchStream()
@@ -192,10 +203,8 @@ TstitchStream::~TstitchStream()
         delete []m_pNalInfo[1];
         m_pNalInfo[1] = nullptr;
     }
-    if (m_hevcState) {
-        delete m_hevcState;
-        m_hevcState = nullptr;
-    }
+    m_sharedHevcState.reset();
+    m_hevcState = nullptr;
     if (m_specialInfo[0]) {
         delete []m_specialInfo[0];
         m_specialInfo[0] = nullptr;
@@ -204,6 +213,10 @@ TstitchStream::~TstitchStream()
         delete []m_specialInfo[1];
         m_specialInfo[1] = nullptr;
     }
+    if (m_pSegmentBs) {
+        gts_bs_del(m_pSegmentBs);
+        m_pSegmentBs = NULL;
+    }
 }
 
 int32_t TstitchStream::initViewport(Param_ViewPortInfo* pViewPortInfo, int32_t tilecolCount, int32_t tilerowCount)
@@ -338,6 +351,8 @@ int32_t TstitchStream::init(param_360SCVP* pParamStitchStream)
         m_pSteamStitch = genTiledStream_Init(&m_streamStitch);
         if (!m_pSteamStitch)
             return -1;
+        if (m_mergeWorkers.init((int32_t)pParamStitchStream->paramStitchInfo.mergeThreadNum))
+            return -1;
         return ret;
     }
     if (parseNals(pParamStitchStream, pParamStitchStream->usedType, NULL, 0) < 0)
@@ -362,6 +377,10 @@ int32_t TstitchStream::init(param_360SCVP* pParamStitchStream)
 
         // Init the merge library
         ret = initMerge(pParamStitchStream, sliceSize);
+
+        // the workers merging different viewports in processViewports
+        if (!ret && m_mergeWorkers.init((int32_t)pParamStitchStream->paramStitchInfo.mergeThreadNum))
+            return -1;
     }
     return ret;
 }
@@ -424,8 +443,7 @@ int32_t TstitchStream::uninit()
         delete[]m_pNalInfo[1];
     m_pNalInfo[1] = NULL;
 
-    if (m_hevcState)
-        delete m_hevcState;
+    m_sharedHevcState.reset();
     m_hevcState = NULL;
     if (m_specialInfo[0])
          delete[]m_specialInfo[0];
@@ -438,9 +456,35 @@ int32_t TstitchStream::uninit()
         delete[]m_dstRwpk.rectRegionPacking;
     m_dstRwpk.rectRegionPacking = NULL;
 
+    if (m_pSegmentBs)
+        gts_bs_del(m_pSegmentBs);
+    m_pSegmentBs = NULL;
+    m_outputSegments.clear();
+    m_mergeWorkers.uninit();
+    for (size_t i = 0; i < m_viewportMergers.size(); i++)
+    {
+        m_viewportMergers[i]->uninit();
+        delete m_viewportMergers[i];
+    }
+    m_viewportMergers.clear();
+
     return ret;
 }
 
+int32_t TstitchStream::makeHevcStateWritable()
+{
+    if (!m_sharedHevcState)
+        return -1;
+    if (m_sharedHevcState.use_count() > 1)
+    {
+        std::shared_ptr<HEVCState> pState(new HEVCState);
+        memcpy(pState.get(), m_sharedHevcState.get(), sizeof(HEVCState));
+        m_sharedHevcState = pState;
+        m_hevcState = m_sharedHevcState.get();
+    }
+    return 0;
+}
+
 int32_t TstitchStream::parseNals(param_360SCVP* pParamStitchStream, int32_t parseType, Nalu* pNALU, int32_t streamIdx)
 {
     if (!pParamStitchStream && !pNALU)
@@ -507,6 +551,11 @@ int32_t TstitchStream::parseNals(param_360SCVP* pParamStitchStream, int32_t pars
 
         genTiledStream_parseNals(&GenStreamParam, pGenStream);
 
+        if (makeHevcStateWritable() < 0)
+        {
+            genTiledStream_unInit(pGenStream);
+            return -1;
+        }
         if(pGenTilesStream->parseType != E_PARSER_ONENAL)
             memcpy(m_hevcState, pSlice->hevcSlice, sizeof(HEVCState));
         else
@@ -675,11 +724,148 @@ int32_t TstitchStream::doMerge(param_360SCVP* pParamStitchStream)
         ret = EncRWPKSEI(&m_dstRwpk, pParamStitchStream->pOutputSEI, &pParamStitchStream->outputSEILen);
 
     pParamStitchStream->outputBitstreamLen = m_mergeStreamParam.outputiledbistreamlen;
-    memcpy(pParamStitchStream->pOutputBitstream, m_mergeStreamParam.pOutputBitstream, m_mergeStreamParam.outputiledbistreamlen);
+    if (pParamStitchStream->pOutputBitstream != m_mergeStreamParam.pOutputBitstream)
+        memcpy(pParamStitchStream->pOutputBitstream, m_mergeStreamParam.pOutputBitstream, m_mergeStreamParam.outputiledbistreamlen);
+
+    return ret;
+}
+
+TstitchStream* TstitchStream::createViewportMerger(param_360SCVP* pParamStitchStream)
+{
+    TstitchStream *pMerger = new TstitchStream(*this);
+    if (!pMerger)
+        return NULL;
+
+    int32_t sliceHeight = pParamStitchStream->paramViewPort.faceHeight / m_tileHeightCountOri[0];
+    int32_t sliceWidth = pParamStitchStream->paramViewPort.faceWidth / m_tileWidthCountOri[0];
+    if (pMerger->initMerge(pParamStitchStream, sliceHeight * sliceWidth * 3 / 2) < 0 || !pMerger->m_pMergeStream)
+    {
+        pMerger->uninit();
+        delete pMerger;
+        return NULL;
+    }
+    return pMerger;
+}
 
+int32_t TstitchStream::mergeViewport(param_360SCVP* pParamStitchStream, TileDef* pSelectedTiles, Param_ViewportBatchItem* pViewport)
+{
+    memcpy(m_pOutTile, pSelectedTiles, m_tileWidthCountSel[0] * m_tileHeightCountSel[0] * sizeof(TileDef));
+
+    // merge into the buffer of the viewport directly
+    param_360SCVP paramViewport = *pParamStitchStream;
+    paramViewport.pOutputBitstream = pViewport->pOutputBitstream;
+    paramViewport.pOutputSEI = pViewport->pOutputSEI;
+    uint8_t *pMergeOutput = m_mergeStreamParam.pOutputBitstream;
+    m_mergeStreamParam.pOutputBitstream = pViewport->pOutputBitstream;
+
+    int32_t ret = feedParamToGenStream(&paramViewport);
+    if (ret == 0)
+        ret = doMerge(&paramViewport);
+    m_mergeStreamParam.pOutputBitstream = pMergeOutput;
+
+    pViewport->outputBitstreamLen = paramViewport.outputBitstreamLen;
+    pViewport->outputSEILen = paramViewport.outputSEILen;
     return ret;
 }
 
+int32_t TstitchStream::processViewports(param_360SCVP* pParamStitchStream, Param_ViewportBatchItem* pViewports, uint32_t viewportNum, uint32_t threadNum)
+{
+    if (!pParamStitchStream || !pViewports || !viewportNum)
+        return -1;
+    if (m_usedType != E_MERGE_AND_VIEWPORT || !m_pViewport || !m_pMergeStream)
+        return -1;
+
+    // the input frames are parsed once for all the viewports
+    parseNals(pParamStitchStream, E_MERGE_AND_VIEWPORT, NULL, 0);
+    parseNals(pParamStitchStream, E_MERGE_AND_VIEWPORT, NULL, 1);
+
+    // select the tiles of each viewport, and keep each different selection once
+    int32_t selTilesNum = m_tileWidthCountSel[0] * m_tileHeightCountSel[0];
+    std::vector<TileDef> selections;
+    std::vector<uint32_t> selectionOwners;
+    std::vector<size_t> viewportSelection(viewportNum, 0);
+    for (uint32_t i = 0; i < viewportNum; i++)
+    {
+        if (!pViewports[i].pOutputBitstream || !pViewports[i].pOutputSEI)
+            return -1;
+        if (setViewPort(pViewports[i].yaw, pViewports[i].pitch) < 0 || getViewPortTiles() < 0)
+            return -1;
+
+        pViewports[i].sameSelectionIdx = (int32_t)i;
+        for (size_t k = 0; k < selectionOwners.size(); k++)
+        {
+            if (!memcmp(&selections[k * selTilesNum], m_pOutTile, selTilesNum * sizeof(TileDef)))
+            {
+                pViewports[i].sameSelectionIdx = (int32_t)selectionOwners[k];
+                viewportSelection[i] = k;
+                break;
+            }
+        }
+        if (pViewports[i].sameSelectionIdx == (int32_t)i)
+        {
+            viewportSelection[i] = selectionOwners.size();
+            selections.insert(selections.end(), m_pOutTile, m_pOutTile + selTilesNum);
+            selectionOwners.push_back(i);
+        }
+    }
+
+    // this handle and the extra mergers each take every mergerNum-th selection,
+    // at most one merger per thread of the pool started at init
+    int32_t mergerNum = threadNum > 1 ? (int32_t)threadNum : 1;
+    if (mergerNum > m_mergeWorkers.getWorkerNum() + 1)
+        mergerNum = m_mergeWorkers.getWorkerNum() + 1;
+    if (mergerNum > (int32_t)selectionOwners.size())
+        mergerNum = (int32_t)selectionOwners.size();
+    while ((int32_t)m_viewportMergers.size() < mergerNum - 1)
+    {
+        TstitchStream *pMerger = createViewportMerger(pParamStitchStream);
+        if (!pMerger)
+            return -1;
+        m_viewportMergers.push_back(pMerger);
+    }
+    for (int32_t m = 0; m < mergerNum - 1; m++)
+    {
+        TstitchStream *pMerger = m_viewportMergers[m];
+        for (int32_t k = 0; k < 2; k++)
+        {
+            pMerger->m_specialDataLen[k] = m_specialDataLen[k];
+            memcpy(pMerger->m_pNalInfo[k], m_pNalInfo[k], m_tileWidthCountOri[k] * m_tileHeightCountOri[k] * sizeof(nal_info));
+        }
+    }
+
+    std::vector<int32_t> results(mergerNum, 0);
+    m_mergeWorkers.parallelFor(mergerNum, [&](int32_t m)
+    {
+        TstitchStream *pMerger = m ? m_viewportMergers[m - 1] : this;
+        for (size_t k = m; k < selectionOwners.size(); k += mergerNum)
+        {
+            results[m] |= pMerger->mergeViewport(pParamStitchStream, &selections[k * selTilesNum],
+                                                 &pViewports[selectionOwners[k]]);
+        }
+    });
+    for (int32_t m = 0; m < mergerNum; m++)
+    {
+        if (results[m])
+            return -1;
+    }
+
+    // the viewports sharing a selection get a copy of the merged output
+    for (uint32_t i = 0; i < viewportNum; i++)
+    {
+        Param_ViewportBatchItem *pOwner = &pViewports[pViewports[i].sameSelectionIdx];
+        if (pOwner == &pViewports[i])
+            continue;
+        memcpy(pViewports[i].pOutputBitstream, pOwner->pOutputBitstream, pOwner->outputBitstreamLen);
+        memcpy(pViewports[i].pOutputSEI, pOwner->pOutputSEI, pOwner->outputSEILen);
+        pViewports[i].outputBitstreamLen = pOwner->outputBitstreamLen;
+        pViewports[i].outputSEILen = pOwner->outputSEILen;
+    }
+
+    // keep the selection of the last viewport in this handle, as I360SCVP_setViewPort does
+    memcpy(m_pOutTile, &selections[viewportSelection[viewportNum - 1] * selTilesNum], selTilesNum * sizeof(TileDef));
+    return 0;
+}
+
 int TstitchStream::EncRWPKSEI(RegionWisePacking* pRWPK, uint8_t *pRWPKBits, uint32_t* pRWPKBitsSize)
 {
     if (!pRWPK || !pRWPKBits || !pRWPKBitsSize)
@@ -846,6 +1032,7 @@ int32_t  TstitchStream::doStreamStitch(param_360SCVP* pParamStitchStream)
     }
 
     pGenTilesStream->pOutputTiledBitstream = pParamStitchStream->pOutputBitstream;
+    m_bSegmentOutput = pParamStitchStream->bSegmentOutput;
 
     ret = merge_partstream_into1bitstream(pParamStitchStream->inputBitstreamLen);
 
@@ -871,13 +1058,19 @@ int32_t  TstitchStream::doStreamStitch(param_360SCVP* pParamStitchStream)
     pParamStitchStream->paramStitchInfo.sliceType = (slice_type)(idr_flag ? SLICE_IDR : pSlice->hevcSlice->s_info.slice_type);
     pParamStitchStream->paramStitchInfo.pts = idr_flag ? 0 : pSlice->hevcSlice->s_info.poc_lsb;
     pParamStitchStream->outputBitstreamLen = outputlen;
+    if (m_bSegmentOutput)
+    {
+        pParamStitchStream->pOutputSegments = m_outputSegments.empty() ? NULL : &m_outputSegments[0];
+        pParamStitchStream->outputSegmentNum = (uint32_t)m_outputSegments.size();
+    }
     return ret;
 }
 
-int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSlice, GTS_BitStream *bs, bool bFirstTile)
+int32_t TstitchStream::merge_one_tile_header(oneStream_info* pSlice, GTS_BitStream *bs, bool bFirstTile,
+                                             uint8_t **ppSliceData, uint32_t *pSliceDataLen, int64_t *pHeaderOffset)
 {
     hevc_gen_tiledstream* pGenTilesStream = (hevc_gen_tiledstream*)m_pSteamStitch;
-    if (!pGenTilesStream || !pBitstream || !pSlice || !bs)
+    if (!pGenTilesStream || !pSlice || !bs || !ppSliceData || !pSliceDataLen || !pHeaderOffset)
         return GTS_BAD_PARAM;
 
     uint32_t nalsize[20];
@@ -887,10 +1080,6 @@ int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSli
     uint8_t *pBufferSliceCur = pSlice->pTiledBitstreamBuffer + pSlice->curBufferLen;
     int32_t lenSlice = pSlice->inputBufferLen - pSlice->curBufferLen;
 
-    uint8_t *pBitstreamCur = *pBitstream;
-    if (!pBitstreamCur)
-        return GTS_BAD_PARAM;
-
     HEVCState *hevc = pSlice->hevcSlice;
     if (!hevc)
         return GTS_BAD_PARAM;
@@ -906,13 +1095,13 @@ int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSli
         = hevc->pps[hevc->last_parsed_pps_id].org_tiles_enabled_flag;
 
     memset(nalsize, 0, sizeof(nalsize));
-    uint64_t bs_position = bs->position;
     int32_t spsCnt;
     parse_hevc_specialinfo(&specialInfo, hevc, nalsize, &specialLen, &spsCnt, 0);
 
     specialLen += nalsize[SLICE_HEADER];
     framesize = specialLen + nalsize[SLICE_DATA];
     lenSlice -= framesize;
+    *pHeaderOffset = -1;
 
     if (pGenTilesStream->AUD_enable && bFirstTile)
     {
@@ -931,6 +1120,7 @@ int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSli
         if (pSlice->address == 0)
         {
             pGenTilesStream->headerNal = (uint8_t*)bs->original + bs->position;
+            *pHeaderOffset = (int64_t)bs->position;
             pGenTilesStream->headerNalSize = (uint8_t)(bs->position);
             hevc_write_parameter_sets(bs, hevc);
             //add the sei information, rwpk, projectoin, sphere rotation, and framepacking
@@ -966,45 +1156,112 @@ int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSli
     hevc->pps[hevc->last_parsed_pps_id].tiles_enabled_flag = (bool)(pGenTilesStream->outTilesWidthCount > 1
         || pGenTilesStream->outTilesHeightCount > 1);
 
-    // modify the tiled slice header , and merge slice data
+    // modify the tiled slice header
     gts_media_hevc_stitch_slice_segment(hevc, pSlice, pGenTilesStream->frameWidth, (uint32_t)pSlice->currentTileIdx);
-    hevc_write_slice_header(bs, hevc);
+    hevc_write_slice_header_cached(bs, hevc, &pSlice->sliceHdrCache);
+
+    pSlice->currentTileIdx++;
+    *ppSliceData = pBufferSliceCur + specialLen;
+    *pSliceDataLen = nalsize[SLICE_DATA];
+
+    return framesize;
+}
+
+int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSlice, GTS_BitStream *bs, bool bFirstTile)
+{
+    if (!pBitstream || !pSlice || !bs)
+        return GTS_BAD_PARAM;
+
+    uint8_t *pBitstreamCur = *pBitstream;
+    if (!pBitstreamCur && !m_bSegmentOutput)
+        return GTS_BAD_PARAM;
+
+    uint64_t bs_position = bs->position;
+    uint8_t *pSliceData = NULL;
+    uint32_t sliceDataLen = 0;
+    int64_t headerOffset = -1;
+    int32_t framesize = merge_one_tile_header(pSlice, bs, bFirstTile, &pSliceData, &sliceDataLen, &headerOffset);
+    if (framesize < 0)
+        return framesize;
+    if (headerOffset >= 0)
+        m_segmentHeaderOffset = headerOffset;
+
+    if (m_bSegmentOutput)
+    {
+        //the new bytes stay in the owned buffer, the slice data is referenced in the input
+        addOutputSegment(NULL, (uint32_t)(bs->position - bs_position));
+        addOutputSegment(pSliceData, sliceDataLen);
+        return framesize;
+    }
 
     //move to current address
     pBitstreamCur += bs->position - bs_position;
-    bs_position = bs->position;
 
     //copy slice data
-    memcpy(pBitstreamCur, pBufferSliceCur + specialLen, nalsize[SLICE_DATA]);
-    pBitstreamCur += nalsize[SLICE_DATA];
-    bs->position += nalsize[SLICE_DATA];
-    pBufferSliceCur += specialLen + nalsize[SLICE_DATA];
+    memcpy(pBitstreamCur, pSliceData, sliceDataLen);
+    pBitstreamCur += sliceDataLen;
+    bs->position += sliceDataLen;
 
-    pSlice->currentTileIdx++;
     *pBitstream = pBitstreamCur;
 
     return framesize;
 }
 
+int32_t TstitchStream::get_merge_tile_stream(int32_t tileRow, int32_t tileCol)
+{
+    hevc_gen_tiledstream* pGenTilesStream = (hevc_gen_tiledstream*)m_pSteamStitch;
+    int32_t tilesWidthCount = pGenTilesStream->tilesWidthCount;
+    int32_t tilesHeightCount = pGenTilesStream->tilesHeightCount;
+    int32_t kw = 0, kh = 0;
+    int32_t widthIdx = tileCol, heightIdx = tileRow;
+    for (; kw < tilesWidthCount; kw++)
+    {
+        if (widthIdx <= pGenTilesStream->columnCnt[kw] - 1)
+            break;
+        widthIdx -= pGenTilesStream->columnCnt[kw];
+    }
+    for (; kh < tilesHeightCount; kh++)
+    {
+        if (heightIdx <= pGenTilesStream->rowCnt[kh] - 1)
+            break;
+        heightIdx -= pGenTilesStream->rowCnt[kh];
+    }
+    return kh * tilesWidthCount + kw;
+}
+
 int32_t TstitchStream::merge_partstream_into1bitstream(int32_t totalInputLen)
 {
     hevc_gen_tiledstream* pGenTilesStream = (hevc_gen_tiledstream*)m_pSteamStitch;
     if (!pGenTilesStream)
         return GTS_BAD_PARAM;
 
+    if (m_mergeWorkers.getWorkerNum() && !m_bSegmentOutput)
+        return merge_partstream_parallel(totalInputLen);
+
     // Set bs size larger than input, in case of additional syntax
     // need to be wrote into output bitstream.
     int32_t outputBSLen = 2 * totalInputLen;
 
     uint8_t* pBitstreamCur = pGenTilesStream->pOutputTiledBitstream;
-    if (!pBitstreamCur)
+    if (!pBitstreamCur && !m_bSegmentOutput)
         return GTS_BAD_PARAM;
 
-    // define nxm tiles here, uniform type is default setting
-    int32_t tilesWidthCount = pGenTilesStream->tilesWidthCount;
-    int32_t tilesHeightCount = pGenTilesStream->tilesHeightCount;
-
-    GTS_BitStream *bs = gts_bs_new((const int8_t *)pBitstreamCur, outputBSLen, GTS_BITSTREAM_WRITE);
+    GTS_BitStream *bs = NULL;
+    if (m_bSegmentOutput)
+    {
+        // only the new bytes are written, into a buffer growing on demand,
+        // the one of the previous frame is released here
+        if (m_pSegmentBs)
+            gts_bs_del(m_pSegmentBs);
+        m_pSegmentBs = gts_bs_new(NULL, 0, GTS_BITSTREAM_WRITE);
+        m_outputSegments.clear();
+        m_segmentHeaderOffset = -1;
+        bs = m_pSegmentBs;
+    }
+    else
+    {
+        bs = gts_bs_new((const int8_t *)pBitstreamCur, outputBSLen, GTS_BITSTREAM_WRITE);
+    }
     if (!bs)
         return GTS_OUT_OF_MEM;
 
@@ -1014,35 +1271,161 @@ int32_t TstitchStream::merge_partstream_into1bitstream(int32_t totalInputLen)
     {
         for (int32_t j = 0; j < pGenTilesStream->outTilesWidthCount; j++)
         {
-            int32_t kw = 0, kh = 0;
-            int32_t widthIdx = j, heightIdx = i;
-            for (; kw < tilesWidthCount; kw++)
-            {
-                if (widthIdx <= pGenTilesStream->columnCnt[kw] - 1)
-                    break;
-                widthIdx -= pGenTilesStream->columnCnt[kw];
-            }
-            for (; kh < tilesHeightCount; kh++)
-            {
-                if (heightIdx <= pGenTilesStream->rowCnt[kh] - 1)
-                    break;
-                heightIdx -= pGenTilesStream->rowCnt[kh];
-            }
-            oneStream_info * pSliceCur = pGenTilesStream->pTiledBitstreams[kh*tilesWidthCount + kw];
+            oneStream_info * pSliceCur = pGenTilesStream->pTiledBitstreams[get_merge_tile_stream(i, j)];
 
             uint64_t bspos = 0;
             if (bs) bspos = bs->position;
+            size_t segmentIdx = m_outputSegments.size();
             bool bFirstTile = (bool)((i == 0 && j == 0) == 1 ? 1 : 0);
             int32_t curframesize = merge_one_tile(&pBitstreamCur, pSliceCur, bs, bFirstTile);
             pSliceCur->curBufferLen += curframesize;
-            pSliceCur->outputBufferLen += (uint32_t)(bs->position - bspos);
+            if (m_bSegmentOutput)
+            {
+                for (size_t k = segmentIdx; k < m_outputSegments.size(); k++)
+                    pSliceCur->outputBufferLen += m_outputSegments[k].dataLen;
+            }
+            else
+                pSliceCur->outputBufferLen += (uint32_t)(bs->position - bspos);
+        }
+    }
+
+    if (m_bSegmentOutput)
+    {
+        // the owned buffer may have moved while growing, so the segments in it
+        // get their address only once all the new bytes are written
+        uint8_t *pOwned = (uint8_t *)m_pSegmentBs->original;
+        for (size_t k = 0; k < m_outputSegments.size(); k++)
+        {
+            if (!m_outputSegments[k].pData)
+            {
+                m_outputSegments[k].pData = pOwned;
+                pOwned += m_outputSegments[k].dataLen;
+            }
         }
+        if (m_segmentHeaderOffset >= 0)
+            pGenTilesStream->headerNal = (uint8_t *)m_pSegmentBs->original + m_segmentHeaderOffset;
+        return 0;
     }
 
     if (bs) gts_bs_del(bs);
     return 0;
 }
 
+// Two phase merge, phase one rewrites the headers of each input bitstream into
+// its own buffers, the bitstreams in parallel and the tiles of one bitstream in
+// order since they share its HEVCState; the output offsets are then the prefix
+// sums of header and slice data lengths, and phase two copies all the tiles
+// in parallel. Every header starts with a start code right after the rbsp
+// trailing bits of the previous one, so writing it alone gives the same bytes.
+int32_t TstitchStream::merge_partstream_parallel(int32_t totalInputLen)
+{
+    hevc_gen_tiledstream* pGenTilesStream = (hevc_gen_tiledstream*)m_pSteamStitch;
+    uint8_t* pOutput = pGenTilesStream->pOutputTiledBitstream;
+    if (!pOutput)
+        return GTS_BAD_PARAM;
+
+    parse_tiles_info(pGenTilesStream);
+
+    struct MergeTileTask
+    {
+        oneStream_info *pSlice;
+        GTS_BitStream  *pHeaderBs;
+        uint8_t        *pSliceData;
+        uint32_t        sliceDataLen;
+        int32_t         frameSize;
+        int64_t         headerOffset;
+        uint64_t        outputOffset;
+    };
+
+    int32_t streamNum = pGenTilesStream->tilesWidthCount * pGenTilesStream->tilesHeightCount;
+    int32_t tileNum = pGenTilesStream->outTilesWidthCount * pGenTilesStream->outTilesHeightCount;
+    std::vector<MergeTileTask> tasks(tileNum);
+    std::vector<std::vector<int32_t>> streamTiles(streamNum);
+    for (int32_t i = 0; i < pGenTilesStream->outTilesHeightCount; i++)
+    {
+        for (int32_t j = 0; j < pGenTilesStream->outTilesWidthCount; j++)
+        {
+            int32_t tileIdx = i * pGenTilesStream->outTilesWidthCount + j;
+            int32_t streamIdx = get_merge_tile_stream(i, j);
+            memset(&tasks[tileIdx], 0, sizeof(MergeTileTask));
+            tasks[tileIdx].pSlice = pGenTilesStream->pTiledBitstreams[streamIdx];
+            tasks[tileIdx].headerOffset = -1;
+            streamTiles[streamIdx].push_back(tileIdx);
+        }
+    }
+
+    // phase one, per input bitstream
+    m_mergeWorkers.parallelFor(streamNum, [&](int32_t streamIdx) {
+        for (size_t k = 0; k < streamTiles[streamIdx].size(); k++)
+        {
+            int32_t tileIdx = streamTiles[streamIdx][k];
+            MergeTileTask *pTask = &tasks[tileIdx];
+            pTask->pHeaderBs = gts_bs_new(NULL, 0, GTS_BITSTREAM_WRITE);
+            if (!pTask->pHeaderBs)
+            {
+                pTask->frameSize = GTS_OUT_OF_MEM;
+                return;
+            }
+            pTask->frameSize = merge_one_tile_header(pTask->pSlice, pTask->pHeaderBs, tileIdx == 0,
+                &pTask->pSliceData, &pTask->sliceDataLen, &pTask->headerOffset);
+            if (pTask->frameSize < 0)
+                return;
+            pTask->pSlice->curBufferLen += pTask->frameSize;
+            pTask->pSlice->outputBufferLen += (uint32_t)pTask->pHeaderBs->position + pTask->sliceDataLen;
+        }
+    });
+
+    int32_t ret = 0;
+    uint64_t outputLen = 0;
+    for (int32_t tileIdx = 0; tileIdx < tileNum; tileIdx++)
+    {
+        MergeTileTask *pTask = &tasks[tileIdx];
+        if (!pTask->pHeaderBs || pTask->frameSize < 0)
+        {
+            ret = pTask->pHeaderBs ? pTask->frameSize : GTS_OUT_OF_MEM;
+            break;
+        }
+        pTask->outputOffset = outputLen;
+        outputLen += pTask->pHeaderBs->position + pTask->sliceDataLen;
+    }
+    if (!ret && outputLen > (uint64_t)2 * totalInputLen)
+        ret = GTS_OUT_OF_MEM;
+
+    // phase two, per output tile
+    if (!ret)
+    {
+        m_mergeWorkers.parallelFor(tileNum, [&](int32_t tileIdx) {
+            MergeTileTask *pTask = &tasks[tileIdx];
+            uint32_t headerLen = (uint32_t)pTask->pHeaderBs->position;
+            memcpy(pOutput + pTask->outputOffset, pTask->pHeaderBs->original, headerLen);
+            memcpy(pOutput + pTask->outputOffset + headerLen, pTask->pSliceData, pTask->sliceDataLen);
+        });
+
+        for (int32_t tileIdx = 0; tileIdx < tileNum; tileIdx++)
+        {
+            if (tasks[tileIdx].headerOffset >= 0)
+                pGenTilesStream->headerNal = pOutput + tasks[tileIdx].outputOffset + tasks[tileIdx].headerOffset;
+        }
+    }
+
+    for (int32_t tileIdx = 0; tileIdx < tileNum; tileIdx++)
+    {
+        if (tasks[tileIdx].pHeaderBs)
+            gts_bs_del(tasks[tileIdx].pHeaderBs);
+    }
+    return ret;
+}
+
+void TstitchStream::addOutputSegment(uint8_t *pData, uint32_t dataLen)
+{
+    if (!dataLen)
+        return;
+    Param_BitstreamSegment segment;
+    segment.pData = pData;
+    segment.dataLen = dataLen;
+    m_outputSegments.push_back(segment);
+}
+
 
 int32_t TstitchStream::getPicInfo(Param_PicInfo* pPicInfo)
 {
@@ -1175,7 +1558,9 @@ int32_t  TstitchStream::GeneratePPS(param_360SCVP* pParamStitchStream, TileArran
         uint32_t nalsize[20];
         memset(nalsize, 0, sizeof(nalsize));
         int32_t spsCnt;
-        ret = hevc_import_ffextradata(&specialInfo, m_hevcState, nalsize, &spsCnt, 0);
+        ret = makeHevcStateWritable();
+        if (ret == 0)
+            ret = hevc_import_ffextradata(&specialInfo, m_hevcState, nalsize, &spsCnt, 0);
         if (ret < 0)
         {
             gts_bs_del(bs);
@@ -1269,7 +1654,9 @@ int32_t  TstitchStream::GenerateSPS(param_360SCVP* pParamStitchStream)
         uint32_t nalsize[20];
         memset(nalsize, 0, sizeof(nalsize));
         int32_t spsCnt;
-        ret = hevc_import_ffextradata(&specialInfo, m_hevcState, nalsize, &spsCnt, 0);
+        ret = makeHevcStateWritable();
+        if (ret == 0)
+            ret = hevc_import_ffextradata(&specialInfo, m_hevcState, nalsize, &spsCnt, 0);
         if (ret < 0)
         {
             if(bs)
@@ -1342,8 +1729,7 @@ int32_t  TstitchStream::GenerateSliceHdr(param_360SCVP* pParam360SCVP, int32_t n
 {
     int32_t ret = -1;
     GTS_BitStream *bsWrite = NULL;
-    HEVCState hevcTmp;
-    if (!pParam360SCVP)
+    if (!pParam360SCVP || !pParam360SCVP->pInputBitstream || !m_hevcState)
         return -1;
 
     // new bs
@@ -1352,39 +1738,76 @@ int32_t  TstitchStream::GenerateSliceHdr(param_360SCVP* pParam360SCVP, int32_t n
     if (bsWrite)
     {
         // parse the old slice header
-        uint32_t nalsize[20];
         hevc_specialInfo specialInfo;
-        int32_t spsCnt;
         memset(&specialInfo, 0, sizeof(hevc_specialInfo));
         specialInfo.ptr = pParam360SCVP->pInputBitstream;
         specialInfo.ptr_size = pParam360SCVP->inputBitstreamLen;
-        memset(nalsize, 0, sizeof(nalsize));
-        ret = hevc_import_ffextradata(&specialInfo, m_hevcState, nalsize, &spsCnt, 0);
+
+        // a single slice nal is parsed against the shared parameter sets, anything
+        // else is imported into the own copy of the state like before
+        uint8_t *pInput = pParam360SCVP->pInputBitstream;
+        uint32_t inputLen = pParam360SCVP->inputBitstreamLen;
+        uint32_t startCodeLen = 0;
+        if (inputLen > 4 && !pInput[0] && !pInput[1] && pInput[2] == 1)
+            startCodeLen = 3;
+        else if (inputLen > 5 && !pInput[0] && !pInput[1] && !pInput[2] && pInput[3] == 1)
+            startCodeLen = 4;
+        ret = -1;
+        if (startCodeLen)
+        {
+            uint32_t nalSize = 0;
+            GTS_BitStream *bs = gts_bs_new((const int8_t *)pInput, inputLen, GTS_BITSTREAM_READ);
+            if (bs)
+            {
+                gts_bs_seek(bs, startCodeLen);
+                nalSize = gts_media_nalu_next_start_code_bs(bs);
+                gts_bs_del(bs);
+            }
+            if (nalSize == inputLen - startCodeLen)
+                ret = gts_media_hevc_parse_slice_nalu(&specialInfo, (int8_t *)(pInput + startCodeLen), nalSize, m_hevcState, &m_sliceInfo);
+        }
         if (ret < 0)
         {
-            if(bsWrite)
+            uint32_t nalsize[20];
+            int32_t spsCnt;
+            memset(nalsize, 0, sizeof(nalsize));
+            ret = makeHevcStateWritable();
+            if (ret == 0)
+                ret = hevc_import_ffextradata(&specialInfo, m_hevcState, nalsize, &spsCnt, 0);
+            if (ret < 0)
             {
                 gts_bs_del(bsWrite);
+                return ret;
             }
-            return ret;
+            memcpy(&m_sliceInfo, &m_hevcState->s_info, sizeof(HEVCSliceInfo));
+        }
+        if (m_hevcState->last_parsed_sps_id < 0 || m_hevcState->last_parsed_sps_id > 15
+            || m_hevcState->last_parsed_pps_id < 0 || m_hevcState->last_parsed_pps_id > 63)
+        {
+            gts_bs_del(bsWrite);
+            return -1;
         }
-        // modify the sliceheader
-        memcpy(&hevcTmp, m_hevcState, sizeof(HEVCState));
 
-        HEVC_SPS *sps = &(hevcTmp.sps[0]);
-        sps->width = pParam360SCVP->destWidth;
-        sps->height = pParam360SCVP->destHeight;
+        // the picture size is changed in a copy of the sps, the slice address in the
+        // own slice info, so the parameter sets stay untouched
+        HEVC_SPS sps = m_hevcState->sps[m_hevcState->last_parsed_sps_id];
+        HEVC_PPS *pps = &m_hevcState->pps[m_hevcState->last_parsed_pps_id];
+        HEVCSliceInfo *si = &m_sliceInfo;
+        bool orgFirstSlice = si->first_slice_segment_in_pic_flag;
+        uint32_t orgSliceAddr = si->slice_segment_address;
 
-        HEVCSliceInfo *si = &hevcTmp.s_info;
-        if (!si)
-            return -1;
+        sps.width = pParam360SCVP->destWidth;
+        sps.height = pParam360SCVP->destHeight;
         si->first_slice_segment_in_pic_flag = 1;
         if (newSliceAddr)
             si->first_slice_segment_in_pic_flag = 0;
         si->slice_segment_address = newSliceAddr;
 
         // write the new sliceheader
-        hevc_write_slice_header(bsWrite, &hevcTmp);
+        hevc_write_slice_header_with_params(bsWrite, &sps, pps, si, &m_sliceHdrCache);
+
+        si->first_slice_segment_in_pic_flag = orgFirstSlice;
+        si->slice_segment_address = orgSliceAddr;
         pParam360SCVP->outputBitstreamLen = gts_bs_get_position(bsWrite);
         gts_bs_del(bsWrite);
         ret = 0;
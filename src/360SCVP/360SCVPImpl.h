@@ -25,7 +25,10 @@
  */
 #ifndef _360SCVP_IMPL_H_
 #define _360SCVP_IMPL_H_
+#include <vector>
+#include <memory>
 #include "360SCVPHevcTilestream.h"
+#include "360SCVPWorkerPool.h"
 
 class TstitchStream
 {
@@ -68,13 +71,29 @@ protected:
     int32_t         m_maxSelTiles;
     int32_t         m_bSPSReady; //used in the usetype = E_PARSER_ONENAL
     int32_t         m_bPPSReady; //used in the usetype = E_PARSER_ONENAL
+    //the parsed parameter sets are shared by the handles cloned by I360SCVP_New, and
+    //copied on the first write; m_hevcState always points to the state in use
+    std::shared_ptr<HEVCState> m_sharedHevcState;
     HEVCState      *m_hevcState;
+    //the slice header parsed by GenerateSliceHdr, per handle so the state can stay shared
+    HEVCSliceInfo   m_sliceInfo;
     unsigned char * m_specialInfo[2];
     int32_t         m_lrTilesInCol;
     int32_t         m_lrTilesInRow;
     int32_t         m_hrTilesInRow;
     int32_t         m_hrTilesInCol;
     RegionWisePacking m_dstRwpk;
+    //segment output mode, new bytes are kept in m_pSegmentBs and slice data is referenced in the input
+    bool                m_bSegmentOutput;
+    GTS_BitStream      *m_pSegmentBs;
+    int64_t             m_segmentHeaderOffset;
+    std::vector<Param_BitstreamSegment> m_outputSegments;
+    //the worker threads rewriting the tile headers or merging the viewport batches in parallel
+    TWorkerPool         m_mergeWorkers;
+    //the handles merging the viewports of processViewports besides this one, one per extra thread
+    std::vector<TstitchStream*> m_viewportMergers;
+    //slice header templates of GenerateSliceHdr, only the address and poc lsb are patched per call
+    HevcSliceHdrCache   m_sliceHdrCache;
 
 public:
     uint16_t        m_nalType;
@@ -100,6 +119,7 @@ public:
     int32_t  feedParamToGenStream(param_360SCVP* pParamStitchStream);
     int32_t  setViewPort(float yaw, float pitch);
     int32_t  doMerge(param_360SCVP* pParamStitchStream);
+    int32_t  processViewports(param_360SCVP* pParamStitchStream, Param_ViewportBatchItem* pViewports, uint32_t viewportNum, uint32_t threadNum);
     int32_t  getFixedNumTiles(TileDef* pOutTile);
     int32_t  parseNals(param_360SCVP* pParamStitchStream, int32_t parseType, Nalu* pNALU, int32_t streamIdx);
     int32_t  GenerateRWPK(RegionWisePacking* pRWPK, uint8_t *pRWPKBits, int32_t* pRWPKBitsSize);
@@ -124,9 +144,18 @@ public:
     TileDef* getSelectedTile();
 
 protected:
+    //give this handle its own copy of the parameter sets before they are modified
+    int32_t  makeHevcStateWritable();
     int32_t initMerge(param_360SCVP* pParamStitchStream, int32_t sliceSize);
     int32_t initViewport(Param_ViewPortInfo* pViewPortInfo, int32_t tilecolCount, int32_t tilerowCount);
     int32_t merge_partstream_into1bitstream(int32_t totalInputLen);
+    int32_t merge_partstream_parallel(int32_t totalInputLen);
+    int32_t merge_one_tile_header(oneStream_info* pSlice, GTS_BitStream *bs, bool bFirstTile,
+                                  uint8_t **ppSliceData, uint32_t *pSliceDataLen, int64_t *pHeaderOffset);
+    int32_t get_merge_tile_stream(int32_t tileRow, int32_t tileCol);
+    TstitchStream* createViewportMerger(param_360SCVP* pParamStitchStream);
+    int32_t mergeViewport(param_360SCVP* pParamStitchStream, TileDef* pSelectedTiles, Param_ViewportBatchItem* pViewport);
+    void    addOutputSegment(uint8_t *pData, uint32_t dataLen);
 };// END CLASS DEFINITION
 
 #endif // _360SCVP_IMPL_H_
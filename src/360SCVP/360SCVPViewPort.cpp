@@ -30,6 +30,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <vector>
 #include "360SCVPViewPort.h"
 
 
@@ -115,3 +116,271 @@ void ViewPort::map3DTo2D(SPos *,SPos *)
     assert(!"Viewport 3D to 2D is not supported ");
 }
 
+void ViewPort::mapToSource(Geometry *pGeoSrc, int32_t i, int32_t j, SPos *pPos3D, SPos *pPos2D)
+{
+    int32_t *pRot = m_sVideoInfo.sVideoRotation.degree;
+    SPos in(0, (POSType)i, (POSType)j, 0);
+    map2DTo3D(in, pPos3D);
+    rotate3D(*pPos3D, pRot[0], pRot[1], pRot[2]);
+    pGeoSrc->map3DTo2D(pPos3D, pPos2D);
+}
+
+POSType ViewPort::sourceX(Geometry *pGeoSrc, int32_t i, int32_t j)
+{
+    SPos pos3D, pos2D;
+    mapToSource(pGeoSrc, i, j, &pos3D, &pos2D);
+    return pos2D.x;
+}
+
+POSType ViewPort::sourceY(Geometry *pGeoSrc, int32_t i, int32_t j)
+{
+    SPos pos3D, pos2D;
+    mapToSource(pGeoSrc, i, j, &pos3D, &pos2D);
+    return pos2D.y;
+}
+
+// grow the range of one face by the source position of pixel (i, j), slot -1 means the face of the position
+void ViewPort::updateRange(Geometry *pGeoSrc, int32_t i, int32_t j, int32_t slot)
+{
+    SPos pos3D, pos2D;
+    mapToSource(pGeoSrc, i, j, &pos3D, &pos2D);
+    SPos *pUpLeftTmp = m_upLeft + (slot < 0 ? pos2D.faceIdx : slot);
+    SPos *pDownRightTmp = m_downRight + (slot < 0 ? pos2D.faceIdx : slot);
+    int32_t yTmp = (int32_t)pos2D.y;
+    int32_t xTmp = (int32_t)pos2D.x;
+    if (pUpLeftTmp->x > xTmp)
+        pUpLeftTmp->x = xTmp;
+    if (pUpLeftTmp->y > yTmp)
+        pUpLeftTmp->y = yTmp;
+    if (pDownRightTmp->x < xTmp)
+        pDownRightTmp->x = xTmp;
+    if (pDownRightTmp->y < yTmp)
+        pDownRightTmp->y = yTmp;
+    pUpLeftTmp->faceIdx = pos2D.faceIdx;
+    pDownRightTmp->faceIdx = pos2D.faceIdx;
+}
+
+// pixel by pixel walk of [start, end) in row j, same as Geometry::geometryMapping,
+// return the position where the row exits the erp boundary, or end
+int32_t ViewPort::walkRow(Geometry *pGeoSrc, int32_t j, int32_t start, int32_t end, int32_t slot, bool bBreakAtZero)
+{
+    for (int32_t i = start; i < end; i++)
+    {
+        if (bBreakAtZero && i != 0 && (int32_t)sourceX(pGeoSrc, i, j) == 0)
+            return i;
+        updateRange(pGeoSrc, i, j, slot);
+    }
+    return end;
+}
+
+/***************************************************
+// For erp source, each viewport row is a great circle arc shorter than half
+// circle, so the source x along the row is monotone with at most one wrap,
+// and the source y has at most one extremum. Only the ends of the monotone
+// pieces and the extremum of y are mapped, and the boundary handling of
+// the pixel walk (first face ends where the row reaches source column 0,
+// second face is the right part of the viewport from that position) is kept.
+****************************************************/
+void ViewPort::footprintEquiRect(Geometry *pGeoSrc)
+{
+    int32_t iWidth = m_sVideoInfo.iFaceWidth;
+    int32_t iHeight = m_sVideoInfo.iFaceHeight;
+    int32_t nNextAreaX = iWidth;
+    // -1 in wrapIdx means the row is walked pixel by pixel
+    std::vector<int32_t> wrapIdx(iHeight), yMaxIdx(iHeight), yMinIdx(iHeight);
+
+    for (int32_t j = 0; j < iHeight; j++)
+    {
+        SPos pos3D0, pos2D0, pos3DL, pos2DL;
+        mapToSource(pGeoSrc, 0, j, &pos3D0, &pos2D0);
+        mapToSource(pGeoSrc, iWidth - 1, j, &pos3DL, &pos2DL);
+
+        // the normal of the great circle, the longitude is not monotone if the circle passes the pole
+        POSType nx = pos3D0.y * pos3DL.z - pos3D0.z * pos3DL.y;
+        POSType ny = pos3D0.z * pos3DL.x - pos3D0.x * pos3DL.z;
+        POSType nz = pos3D0.x * pos3DL.y - pos3D0.y * pos3DL.x;
+        if (iWidth < 3 || sfabs(ny) <= 1e-9 * ssqrt(nx * nx + ny * ny + nz * nz))
+        {
+            wrapIdx[j] = -1;
+            int32_t nBreak = walkRow(pGeoSrc, j, 0, iWidth, -1, true);
+            if (nBreak < iWidth)
+                nNextAreaX = nBreak;
+            continue;
+        }
+        bool bIncrease = ny > 0;
+        POSType x0 = pos2D0.x;
+
+        int32_t nWrap = iWidth;
+        if (bIncrease ? (pos2DL.x < x0) : (pos2DL.x > x0))
+        {
+            int32_t lo = 1, hi = iWidth - 1;
+            while (lo < hi)
+            {
+                int32_t mid = (lo + hi) >> 1;
+                POSType x = sourceX(pGeoSrc, mid, j);
+                if (bIncrease ? (x < x0) : (x > x0))
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            nWrap = lo;
+        }
+
+        // the first pixel except the left most one whose source x is truncated to 0
+        int32_t nBreak = iWidth;
+        if (bIncrease)
+        {
+            if (nWrap > 1 && sourceX(pGeoSrc, 1, j) < 1)
+                nBreak = 1;
+            else if (nWrap < iWidth && sourceX(pGeoSrc, nWrap, j) < 1)
+                nBreak = nWrap;
+        }
+        else
+        {
+            int32_t lo = iWidth, hi = iWidth;
+            if (nWrap > 1 && sourceX(pGeoSrc, nWrap - 1, j) < 1)
+            {
+                lo = 1;
+                hi = nWrap - 1;
+            }
+            else if (nWrap < iWidth && pos2DL.x < 1)
+            {
+                lo = nWrap;
+                hi = iWidth - 1;
+            }
+            if (lo < iWidth)
+            {
+                while (lo < hi)
+                {
+                    int32_t mid = (lo + hi) >> 1;
+                    if (sourceX(pGeoSrc, mid, j) < 1)
+                        hi = mid;
+                    else
+                        lo = mid + 1;
+                }
+                nBreak = lo;
+            }
+        }
+
+        int32_t lo = 0, hi = iWidth - 1;
+        while (lo < hi)
+        {
+            int32_t mid = (lo + hi) >> 1;
+            if (sourceY(pGeoSrc, mid, j) < sourceY(pGeoSrc, mid + 1, j))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        yMaxIdx[j] = lo;
+        lo = 0;
+        hi = iWidth - 1;
+        while (lo < hi)
+        {
+            int32_t mid = (lo + hi) >> 1;
+            if (sourceY(pGeoSrc, mid, j) > sourceY(pGeoSrc, mid + 1, j))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        yMinIdx[j] = lo;
+        wrapIdx[j] = nWrap;
+
+        if (nBreak < iWidth)
+            nNextAreaX = nBreak;
+        updateRowRange(pGeoSrc, j, 0, nBreak, nWrap, yMaxIdx[j], yMinIdx[j], 0);
+    }
+
+    // judge if exiting boundary
+    if (nNextAreaX == iWidth)
+        return;
+    for (int32_t j = 0; j < iHeight; j++)
+    {
+        if (wrapIdx[j] < 0)
+            walkRow(pGeoSrc, j, nNextAreaX, iWidth, 1, false);
+        else
+            updateRowRange(pGeoSrc, j, nNextAreaX, iWidth, wrapIdx[j], yMaxIdx[j], yMinIdx[j], 1);
+    }
+}
+
+// grow the range of one face by [start, end) in row j, which is split into monotone pieces at nWrap
+void ViewPort::updateRowRange(Geometry *pGeoSrc, int32_t j, int32_t start, int32_t end, int32_t nWrap, int32_t nMaxY, int32_t nMinY, int32_t slot)
+{
+    int32_t pieces[2][2] = { {start, nWrap < end ? nWrap : end}, {nWrap > start ? nWrap : start, end} };
+    for (int32_t p = 0; p < 2; p++)
+    {
+        int32_t first = pieces[p][0];
+        int32_t last = pieces[p][1] - 1;
+        if (first > last)
+            continue;
+        updateRange(pGeoSrc, first, j, slot);
+        if (last != first)
+            updateRange(pGeoSrc, last, j, slot);
+        if (nMaxY > first && nMaxY < last)
+            updateRange(pGeoSrc, nMaxY, j, slot);
+        if (nMinY > first && nMinY < last)
+            updateRange(pGeoSrc, nMinY, j, slot);
+    }
+}
+
+/***************************************************
+// For cube map source, the pixels of one face are continuous in each
+// viewport row, and the source position in the face is monotone along
+// the row, so only the ends of each face in the row are mapped.
+****************************************************/
+void ViewPort::footprintCubeMap(Geometry *pGeoSrc)
+{
+    int32_t iWidth = m_sVideoInfo.iFaceWidth;
+    int32_t iHeight = m_sVideoInfo.iFaceHeight;
+    for (int32_t j = 0; j < iHeight; j++)
+    {
+        int32_t start = 0;
+        while (start < iWidth)
+        {
+            SPos pos3D, pos2D;
+            mapToSource(pGeoSrc, start, j, &pos3D, &pos2D);
+            int32_t faceIdx = pos2D.faceIdx;
+            int32_t lo = start + 1, hi = iWidth;
+            while (lo < hi)
+            {
+                int32_t mid = (lo + hi) >> 1;
+                mapToSource(pGeoSrc, mid, j, &pos3D, &pos2D);
+                if (pos2D.faceIdx != faceIdx)
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            updateRange(pGeoSrc, start, j, faceIdx);
+            if (lo - 1 != start)
+                updateRange(pGeoSrc, lo - 1, j, faceIdx);
+            start = lo;
+        }
+    }
+}
+
+void ViewPort::geometryMapping(Geometry *pGeoSrc)
+{
+    GeometryType srcType = pGeoSrc->getType();
+    if (m_bConvOutputPaddingNeeded || m_sVideoInfo.iNumFaces != 1
+        || (srcType != SVIDEO_EQUIRECT && srcType != SVIDEO_CUBEMAP))
+    {
+        Geometry::geometryMapping(pGeoSrc);
+        return;
+    }
+    assert(!m_bGeometryMapping);
+
+    setRotMat();
+    setInvK();
+    if (srcType == SVIDEO_EQUIRECT)
+        footprintEquiRect(pGeoSrc);
+    else
+        footprintCubeMap(pGeoSrc);
+
+    SPos *pUpLeftTmp = m_upLeft;
+    for (int32_t i = 0; i < FACE_NUMBER; i++)
+    {
+        if (pUpLeftTmp->faceIdx >= 0)
+            m_numFaces++;
+        pUpLeftTmp++;
+    }
+    m_bGeometryMapping = true;
+}
@@ -50,6 +50,18 @@ public:
     void setRotMat();
     void setInvK();
     void matInv(POSType[3][3]);
+    //footprint of the viewport on the source, only the viewport rows are walked instead of every pixel
+    virtual void geometryMapping(Geometry *pGeoSrc);
+
+private:
+    void mapToSource(Geometry *pGeoSrc, int32_t i, int32_t j, SPos *pPos3D, SPos *pPos2D);
+    POSType sourceX(Geometry *pGeoSrc, int32_t i, int32_t j);
+    POSType sourceY(Geometry *pGeoSrc, int32_t i, int32_t j);
+    void updateRange(Geometry *pGeoSrc, int32_t i, int32_t j, int32_t slot);
+    int32_t walkRow(Geometry *pGeoSrc, int32_t j, int32_t start, int32_t end, int32_t slot, bool bBreakAtZero);
+    void updateRowRange(Geometry *pGeoSrc, int32_t j, int32_t start, int32_t end, int32_t nWrap, int32_t nMaxY, int32_t nMinY, int32_t slot);
+    void footprintEquiRect(Geometry *pGeoSrc);
+    void footprintCubeMap(Geometry *pGeoSrc);
 };
 
 #endif // __T360SCVP_GEOMETRY__
@@ -120,6 +120,21 @@ int32_t   genViewport_process(generateViewPortParam* pParamGenViewport, void* pG
 //!
 int32_t genViewport_setViewPort(void* pGenHandle, float yaw, float pitch);
 
+//!
+//! \brief    This function builds the precomputed viewport lookup table. The viewport range and the tiles inside the viewport
+//!           are calculated once for every (yaw, pitch) on a grid with the given step, according to the FOV and tile
+//!           layout set in the initialization phase. After that, genViewport_process snaps the viewPort to the nearest
+//!           grid point and fetches the result from the table instead of mapping every viewport pixel.
+//!
+//! \param    void*  pGenHandle,        input, which is created by the genTiledStream_Init function
+//! \param    float  fGridStep,         input, the grid step in degree, 0 to release the table and go back to the mapping mode
+//!
+//! \return   s32, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t genViewport_buildLookupTable(void* pGenHandle, float fGridStep);
+
 //!
 //! \brief    This function sets the maxmimum selected tile number for the viewPort.
 //!
@@ -158,11 +158,19 @@ int32_t   genViewport_process(generateViewPortParam* pParamGenViewport, void* pG
     TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
     if (!cTAppConvCfg || !pParamGenViewport)
         return -1;
-    if (cTAppConvCfg->parseCfg() < 0)
-        return -1;
+    if (cTAppConvCfg->m_lutStep > 0)
+    {
+        if (cTAppConvCfg->lookupViewport() < 0)
+            return -1;
+    }
+    else
+    {
+        if (cTAppConvCfg->parseCfg() < 0)
+            return -1;
 
-    if (cTAppConvCfg->convert() < 0)
-        return -1;
+        if (cTAppConvCfg->convert() < 0)
+            return -1;
+    }
 
     pParamGenViewport->m_numFaces = cTAppConvCfg->m_numFaces;
 
@@ -194,6 +202,19 @@ int32_t   genViewport_process(generateViewPortParam* pParamGenViewport, void* pG
 }
 
 
+int32_t genViewport_buildLookupTable(void* pGenHandle, float fGridStep)
+{
+    TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
+    if (!cTAppConvCfg)
+        return -1;
+    if (fGridStep <= 0)
+    {
+        cTAppConvCfg->clearLookupTable();
+        return 0;
+    }
+    return cTAppConvCfg->buildLookupTable(fGridStep);
+}
+
 int32_t genViewport_setMaxSelTiles(void* pGenHandle, int32_t maxSelTiles)
 {
     TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
@@ -412,11 +433,8 @@ int32_t   genViewport_unInit(void* pGenHandle)
         return 1;
 
     cTAppConvCfg->destroy();
-    if(pGenHandle)
-    {
-        free(pGenHandle);
-        pGenHandle = NULL;
-    }
+    delete cTAppConvCfg;
+    cTAppConvCfg = NULL;
 
     return 0;
 }
@@ -441,6 +459,11 @@ TgenViewport::TgenViewport()
     m_maxTileNum = 0;
     m_numFaces = 0;
     m_srd = new ITileInfo;
+    m_lutStep = 0;
+    m_lutYawNum = 0;
+    m_lutPitchNum = 0;
+    m_lutTileNum = 0;
+    m_lutCurIdx = -1;
 }
 
 TgenViewport::~TgenViewport()
@@ -482,6 +505,16 @@ TgenViewport& TgenViewport::operator=(const TgenViewport& src)
     this->m_iInputWidth = src.m_iInputWidth;
     this->m_iInputHeight = src.m_iInputHeight;
     memcpy(this->m_srd, src.m_srd, sizeof(ITileInfo));
+    this->m_lutStep = src.m_lutStep;
+    this->m_lutYawNum = src.m_lutYawNum;
+    this->m_lutPitchNum = src.m_lutPitchNum;
+    this->m_lutTileNum = src.m_lutTileNum;
+    this->m_lutCurIdx = src.m_lutCurIdx;
+    this->m_lutUpLeft = src.m_lutUpLeft;
+    this->m_lutDownRight = src.m_lutDownRight;
+    this->m_lutNumFaces = src.m_lutNumFaces;
+    this->m_lutOccupy = src.m_lutOccupy;
+    this->m_lutOccupyNum = src.m_lutOccupyNum;
     return *this;
 }
 
@@ -585,10 +618,6 @@ int32_t  TgenViewport::convert()
         return -1;
     }
 
-    // starting time
-    double dResult;
-    clock_t lBefore = clock();
-
     pcInputGeomtry->geoConvert(pcCodingGeomtry);
 
     if (pcCodingGeomtry->getType() == SVIDEO_VIEWPORT)
@@ -615,9 +644,6 @@ int32_t  TgenViewport::convert()
         pcCodingGeomtry->geoUnInit();
     }
 
-    dResult = (double)(clock() - lBefore) / CLOCKS_PER_SEC;
-    printf("\n Total Time: %12.3f sec.\n", dResult);
-
     if(pcInputGeomtry)
     {
         delete pcInputGeomtry;
@@ -711,6 +737,14 @@ int32_t TgenViewport::calcTilesInViewport(ITileInfo* pTileInfo, int32_t tileCol,
     int32_t ret = 0;
     ITileInfo *pTileInfoTmp = pTileInfo;
     int32_t faceNum = (m_sourceSVideoInfo.geoType==SVIDEO_CUBEMAP) ? 6 : 1;
+    //the occupy flags of the current pose are already in the lookup table
+    if (m_lutCurIdx >= 0 && pTileInfo == m_srd && faceNum * tileRow * tileCol == m_lutTileNum)
+    {
+        uint8_t *pOccupy = &m_lutOccupy[(size_t)m_lutCurIdx * m_lutTileNum];
+        for (int32_t i = 0; i < m_lutTileNum; i++)
+            pTileInfoTmp[i].isOccupy = pOccupy[i];
+        return m_lutOccupyNum[m_lutCurIdx];
+    }
     for (int32_t faceid = 0; faceid < faceNum; faceid++)
     {
         for (int32_t row = 0; row < tileRow; row++)
@@ -728,4 +762,109 @@ int32_t TgenViewport::calcTilesInViewport(ITileInfo* pTileInfo, int32_t tileCol,
     }
     return ret;
 }
+
+void TgenViewport::clearLookupTable()
+{
+    m_lutStep = 0;
+    m_lutYawNum = 0;
+    m_lutPitchNum = 0;
+    m_lutTileNum = 0;
+    m_lutCurIdx = -1;
+    m_lutUpLeft.clear();
+    m_lutDownRight.clear();
+    m_lutNumFaces.clear();
+    m_lutOccupy.clear();
+    m_lutOccupyNum.clear();
+}
+
+int32_t TgenViewport::buildLookupTable(float step)
+{
+    if (step <= 0 || step > 90)
+        return -1;
+
+    clearLookupTable();
+    if (parseCfg() < 0)
+        return -1;
+
+    float fYaw = m_codingSVideoInfo.viewPort.fYaw;
+    float fPitch = m_codingSVideoInfo.viewPort.fPitch;
+    int32_t faceNum = (m_sourceSVideoInfo.geoType == SVIDEO_CUBEMAP) ? 6 : 1;
+    int32_t yawNum = (int32_t)ceil(360.0 / step);
+    int32_t pitchNum = (int32_t)floor(180.0 / step) + 1;
+    int32_t tileNum = faceNum * m_tileNumRow * m_tileNumCol;
+    size_t entryNum = (size_t)yawNum * pitchNum;
+
+    m_lutUpLeft.resize(entryNum * FACE_NUMBER);
+    m_lutDownRight.resize(entryNum * FACE_NUMBER);
+    m_lutNumFaces.resize(entryNum);
+    m_lutOccupy.resize(entryNum * tileNum);
+    m_lutOccupyNum.resize(entryNum);
+
+    int32_t ret = 0;
+    for (int32_t p = 0; p < pitchNum && !ret; p++)
+    {
+        for (int32_t y = 0; y < yawNum; y++)
+        {
+            size_t entry = (size_t)p * yawNum + y;
+            m_codingSVideoInfo.viewPort.fYaw = -180 + y * step;
+            m_codingSVideoInfo.viewPort.fPitch = -90 + p * step;
+            if (convert() < 0)
+            {
+                ret = -1;
+                break;
+            }
+            for (int32_t i = 0; i < FACE_NUMBER; i++)
+            {
+                m_lutUpLeft[entry * FACE_NUMBER + i] = m_pUpLeft[i];
+                m_lutDownRight[entry * FACE_NUMBER + i] = m_pDownRight[i];
+            }
+            m_lutNumFaces[entry] = m_numFaces;
+            m_lutOccupyNum[entry] = calcTilesInViewport(m_srd, m_tileNumCol, m_tileNumRow);
+            for (int32_t i = 0; i < tileNum; i++)
+                m_lutOccupy[entry * tileNum + i] = (uint8_t)m_srd[i].isOccupy;
+        }
+    }
+
+    m_codingSVideoInfo.viewPort.fYaw = fYaw;
+    m_codingSVideoInfo.viewPort.fPitch = fPitch;
+    if (ret)
+    {
+        clearLookupTable();
+        return ret;
+    }
+    m_lutStep = step;
+    m_lutYawNum = yawNum;
+    m_lutPitchNum = pitchNum;
+    m_lutTileNum = tileNum;
+    return 0;
+}
+
+int32_t TgenViewport::lookupViewport()
+{
+    if (m_lutStep <= 0 || !m_lutYawNum || !m_lutPitchNum)
+        return -1;
+
+    //snap the current pose to the nearest grid point
+    POSType yaw = fmod((POSType)m_codingSVideoInfo.viewPort.fYaw + 180, 360);
+    if (yaw < 0)
+        yaw += 360;
+    POSType pitch = m_codingSVideoInfo.viewPort.fPitch;
+    if (pitch < -90)
+        pitch = -90;
+    if (pitch > 90)
+        pitch = 90;
+    int32_t yawIdx = (int32_t)floor(yaw / m_lutStep + 0.5) % m_lutYawNum;
+    int32_t pitchIdx = (int32_t)floor((pitch + 90) / m_lutStep + 0.5);
+    if (pitchIdx >= m_lutPitchNum)
+        pitchIdx = m_lutPitchNum - 1;
+
+    m_lutCurIdx = pitchIdx * m_lutYawNum + yawIdx;
+    for (int32_t i = 0; i < FACE_NUMBER; i++)
+    {
+        m_pUpLeft[i] = m_lutUpLeft[(size_t)m_lutCurIdx * FACE_NUMBER + i];
+        m_pDownRight[i] = m_lutDownRight[(size_t)m_lutCurIdx * FACE_NUMBER + i];
+    }
+    m_numFaces = m_lutNumFaces[m_lutCurIdx];
+    return 0;
+}
 //! \}
@@ -93,6 +93,17 @@ public:
     int32_t       m_aiPad[2];                                       ///< number of padded pixels for width and height
     int32_t   m_faceSizeAlignment;
     int32_t       m_maxTileNum;
+    //precomputed viewport lookup table, indexed by the quantized (yaw, pitch)
+    float         m_lutStep;                                        ///< grid step in degree, 0 when the table is not used
+    int32_t       m_lutYawNum;                                      ///< grid point number in yaw direction
+    int32_t       m_lutPitchNum;                                    ///< grid point number in pitch direction
+    int32_t       m_lutTileNum;                                     ///< tile number of all faces
+    int32_t       m_lutCurIdx;                                      ///< table entry of the current viewport, -1 if none
+    std::vector<SPos>     m_lutUpLeft;                              ///< FACE_NUMBER up left points for each entry
+    std::vector<SPos>     m_lutDownRight;                           ///< FACE_NUMBER down right points for each entry
+    std::vector<int32_t>  m_lutNumFaces;                            ///< face number taken by the viewport for each entry
+    std::vector<uint8_t>  m_lutOccupy;                              ///< m_lutTileNum occupy flags for each entry
+    std::vector<int32_t>  m_lutOccupyNum;                           ///< occupied tile number for each entry
     inline int32_t round(POSType t) { return (int32_t)(t+ (t>=0? 0.5 :-0.5)); };
 public:
     TgenViewport();
@@ -107,6 +118,10 @@ public:
     //analysis;
     bool     isInside(int32_t x, int32_t y, int32_t width, int32_t height, int32_t faceId);
     int32_t  calcTilesInViewport(ITileInfo* pTileInfo, int32_t tileCol, int32_t tileRow);
+    //precomputed mode
+    int32_t  buildLookupTable(float step);   ///< precompute the viewport range and tiles for every grid pose
+    void     clearLookupTable();
+    int32_t  lookupViewport();               ///< fetch the table entry of the current pose
 
 };// END CLASS DEFINITION
 
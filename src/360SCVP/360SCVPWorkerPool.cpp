@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2018, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <system_error>
+#include "360SCVPWorkerPool.h"
+
+TWorkerPool::TWorkerPool()
+{
+    m_task = NULL;
+    m_taskNum = 0;
+    m_nextTask = 0;
+    m_busyWorkers = 0;
+    m_generation = 0;
+    m_bStop = false;
+}
+
+TWorkerPool::~TWorkerPool()
+{
+    uninit();
+}
+
+int32_t TWorkerPool::init(int32_t threadNum)
+{
+    uninit();
+    m_bStop = false;
+    for (int32_t i = 1; i < threadNum; i++)
+    {
+        try
+        {
+            m_workers.push_back(std::thread(&TWorkerPool::workerLoop, this));
+        }
+        catch (const std::system_error&)
+        {
+            uninit();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void TWorkerPool::uninit()
+{
+    if (m_workers.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+    }
+    m_startCond.notify_all();
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        if (m_workers[i].joinable())
+            m_workers[i].join();
+    }
+    m_workers.clear();
+}
+
+void TWorkerPool::runTasks()
+{
+    for (int32_t idx = m_nextTask++; idx < m_taskNum; idx = m_nextTask++)
+    {
+        (*m_task)(idx);
+    }
+}
+
+void TWorkerPool::workerLoop()
+{
+    uint64_t generation = 0;
+    while (1)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_startCond.wait(lock, [&] { return m_bStop || m_generation != generation; });
+            if (m_bStop)
+                return;
+            generation = m_generation;
+        }
+
+        runTasks();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_busyWorkers == 0)
+                m_doneCond.notify_one();
+        }
+    }
+}
+
+void TWorkerPool::parallelFor(int32_t taskNum, const std::function<void(int32_t)>& task)
+{
+    if (m_workers.empty() || taskNum <= 1)
+    {
+        for (int32_t idx = 0; idx < taskNum; idx++)
+            task(idx);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_taskNum = taskNum;
+        m_nextTask = 0;
+        m_busyWorkers = (int32_t)m_workers.size();
+        m_generation++;
+    }
+    m_startCond.notify_all();
+
+    runTasks();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCond.wait(lock, [&] { return m_busyWorkers == 0; });
+    m_task = NULL;
+    m_taskNum = 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2018, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _360SCVP_WORKERPOOL_H_
+#define _360SCVP_WORKERPOOL_H_
+
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+//!
+//! \brief  This class is a small pool of worker threads owned by one stitch handle,
+//!         it runs the independent tasks of one frame and returns when all of them are done
+//!
+class TWorkerPool
+{
+public:
+    TWorkerPool();
+    virtual ~TWorkerPool();
+
+    //!
+    //! \brief    start the worker threads, the calling thread also runs tasks in parallelFor
+    //!
+    //! \param    int32_t  threadNum,  input,  the total number of threads running the tasks,
+    //!                                        0 or 1 means the tasks run in the calling thread only
+    //!
+    //! \return   int32_t, 0 if succeed, not 0 if fail
+    //!
+    int32_t init(int32_t threadNum);
+
+    //!
+    //! \brief    stop and join the worker threads
+    //!
+    void    uninit();
+
+    //!
+    //! \brief    run task(0) ... task(taskNum - 1) on the pool and wait for all of them
+    //!
+    //! \param    int32_t                              taskNum,  input,  the number of tasks
+    //! \param    const std::function<void(int32_t)>&  task,     input,  the task body, called with the task index
+    //!
+    void    parallelFor(int32_t taskNum, const std::function<void(int32_t)>& task);
+
+    //!
+    //! \brief    get the number of worker threads, not counting the calling thread
+    //!
+    int32_t getWorkerNum() { return (int32_t)m_workers.size(); };
+
+private:
+    void    workerLoop();
+    void    runTasks();
+
+    std::vector<std::thread>                m_workers;
+    std::mutex                              m_mutex;
+    std::condition_variable                 m_startCond;
+    std::condition_variable                 m_doneCond;
+    const std::function<void(int32_t)>*     m_task;
+    int32_t                                 m_taskNum;
+    std::atomic<int32_t>                    m_nextTask;
+    int32_t                                 m_busyWorkers;
+    uint64_t                                m_generation;
+    bool                                    m_bStop;
+};
+
+#endif // _360SCVP_WORKERPOOL_H_
@@ -0,0 +1,6 @@
+#!/bin/bash -e
+
+g++ -std=c++11 -I../util/ -O2 -g -c perfI360SCVP.cpp -D_GLIBCXX_USE_CXX11_ABI=0
+LD_FLAGS="-I/usr/local/include/ -l360SCVP -lstdc++ -lpthread -lm -L/usr/local/lib"
+g++ -L/usr/local/lib perfI360SCVP.o -o perfI360SCVP ${LD_FLAGS}
+./perfI360SCVP --format=json > perfI360SCVP.json
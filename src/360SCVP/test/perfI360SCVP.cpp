@@ -0,0 +1,488 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//!
+//! \file:   perfI360SCVP.cpp
+//! \brief:  micro benchmarks of the 360SCVP hot paths on the bundled streams.
+//!
+//! Every case is repeated until the minimal time is reached, then the time per
+//! operation and the throughput are reported. "bytes" is the input consumed for
+//! parsing and merging, and the output produced for the header/SEI generators.
+//! The result is written as json (the layout of google benchmark, so its
+//! compare tools can be used) or csv to stdout, the progress goes to stderr.
+//!
+//! usage: perfI360SCVP [--min_time=<s>] [--filter=<substring>] [--format=json|csv]
+//!                     [--input_dir=<dir with test.265 and test_low.265>]
+//!
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include "../360SCVPAPI.h"
+
+namespace{
+
+typedef struct PERF_RESULT
+{
+    std::string name;
+    uint64_t    iterations;
+    double      nsPerOp;
+    double      bytesPerSecond;
+}PerfResult;
+
+//! the merge moves the parameter sets in front of the input in place, so the buffers
+//! have the room of a raw frame like the buffers of the application
+typedef struct PERF_STREAM
+{
+    std::string          name;
+    std::vector<uint8_t> data;
+    uint32_t             size;
+}PerfStream;
+
+class PerfRunner
+{
+public:
+    PerfRunner(double minTime, const std::string& filter)
+        : m_minTime(minTime), m_filter(filter) {};
+
+    bool enabled(const std::string& name)
+    {
+        return m_filter.empty() || name.find(m_filter) != std::string::npos;
+    };
+
+    //! run op until m_minTime is over, op returns the bytes of one operation or < 0 on error
+    template<typename Op>
+    void run(const std::string& name, Op op)
+    {
+        if (!enabled(name))
+            return;
+        fprintf(stderr, "running %s\n", name.c_str());
+
+        // warm up the caches and the lazily created states
+        if (op() < 0)
+        {
+            fprintf(stderr, "%s failed\n", name.c_str());
+            return;
+        }
+
+        uint64_t iterations = 0;
+        uint64_t batch = 1;
+        int64_t bytes = 0;
+        double elapsed = 0;
+        while (elapsed < m_minTime)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < batch; i++)
+            {
+                int64_t opBytes = op();
+                if (opBytes < 0)
+                {
+                    fprintf(stderr, "%s failed\n", name.c_str());
+                    return;
+                }
+                bytes += opBytes;
+            }
+            elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            iterations += batch;
+            // keep the clock reads rare for the cheap operations
+            if (batch < (1 << 16))
+                batch *= 2;
+        }
+
+        PerfResult result;
+        result.name = name;
+        result.iterations = iterations;
+        result.nsPerOp = elapsed * 1e9 / iterations;
+        result.bytesPerSecond = bytes / elapsed;
+        m_results.push_back(result);
+    };
+
+    void printJson()
+    {
+        char date[64];
+        time_t now = time(NULL);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+        printf("{\n");
+        printf("  \"context\": {\n");
+        printf("    \"date\": \"%s\",\n", date);
+        printf("    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+        printf("    \"library\": \"360SCVP\"\n");
+        printf("  },\n");
+        printf("  \"benchmarks\": [\n");
+        for (size_t i = 0; i < m_results.size(); i++)
+        {
+            PerfResult& r = m_results[i];
+            printf("    {\n");
+            printf("      \"name\": \"%s\",\n", r.name.c_str());
+            printf("      \"iterations\": %llu,\n", (unsigned long long)r.iterations);
+            printf("      \"real_time\": %.3f,\n", r.nsPerOp);
+            printf("      \"cpu_time\": %.3f,\n", r.nsPerOp);
+            printf("      \"time_unit\": \"ns\",\n");
+            printf("      \"bytes_per_second\": %.1f,\n", r.bytesPerSecond);
+            printf("      \"mb_per_second\": %.3f\n", r.bytesPerSecond / 1e6);
+            printf("    }%s\n", i + 1 < m_results.size() ? "," : "");
+        }
+        printf("  ]\n");
+        printf("}\n");
+    };
+
+    void printCsv()
+    {
+        printf("name,iterations,ns_per_op,mb_per_second\n");
+        for (size_t i = 0; i < m_results.size(); i++)
+        {
+            PerfResult& r = m_results[i];
+            printf("%s,%llu,%.3f,%.3f\n", r.name.c_str(), (unsigned long long)r.iterations,
+                r.nsPerOp, r.bytesPerSecond / 1e6);
+        }
+    };
+
+    bool empty() { return m_results.empty(); };
+
+private:
+    double                  m_minTime;
+    std::string             m_filter;
+    std::vector<PerfResult> m_results;
+};
+
+bool loadStream(const std::string& dir, const char* name, uint32_t capacity, PerfStream* pStream)
+{
+    std::string path = dir + "/" + name;
+    FILE* pFile = fopen(path.c_str(), "rb");
+    if (!pFile)
+    {
+        fprintf(stderr, "can not open %s\n", path.c_str());
+        return false;
+    }
+    fseek(pFile, 0, SEEK_END);
+    long size = ftell(pFile);
+    fseek(pFile, 0, SEEK_SET);
+    if (size <= 0 || (uint32_t)size > capacity)
+    {
+        fclose(pFile);
+        return false;
+    }
+    pStream->name = name;
+    pStream->data.resize(capacity);
+    pStream->size = fread(&pStream->data[0], 1, size, pFile);
+    fclose(pFile);
+    return pStream->size == (uint32_t)size;
+}
+
+void setMergeParam(param_360SCVP* pParam, PerfStream& high, PerfStream& low,
+    std::vector<uint8_t>& output, std::vector<uint8_t>& outputSEI)
+{
+    memset(pParam, 0, sizeof(param_360SCVP));
+    pParam->usedType = E_MERGE_AND_VIEWPORT;
+    pParam->pInputBitstream = &high.data[0];
+    pParam->inputBitstreamLen = high.size;
+    pParam->pInputLowBitstream = &low.data[0];
+    pParam->inputLowBistreamLen = low.size;
+    pParam->frameWidth = 3840;
+    pParam->frameHeight = 2048;
+    pParam->frameWidthLow = 1280;
+    pParam->frameHeightLow = 768;
+    pParam->pOutputBitstream = &output[0];
+    pParam->pOutputSEI = &outputSEI[0];
+    pParam->paramViewPort.faceWidth = 3840;
+    pParam->paramViewPort.faceHeight = 2048;
+    pParam->paramViewPort.geoTypeInput = EGeometryType(E_SVIDEO_EQUIRECT);
+    pParam->paramViewPort.viewportWidth = 960;
+    pParam->paramViewPort.viewportHeight = 960;
+    pParam->paramViewPort.geoTypeOutput = E_SVIDEO_VIEWPORT;
+    pParam->paramViewPort.viewPortYaw = -90;
+    pParam->paramViewPort.viewPortPitch = 0;
+    pParam->paramViewPort.viewPortFOVH = 80;
+    pParam->paramViewPort.viewPortFOVV = 80;
+}
+
+// ParseNAL: one operation parses the next nal of the stream, wrapping at the end
+void perfParseNAL(PerfRunner& runner, PerfStream& stream)
+{
+    std::string name = "ParseNAL/" + stream.name;
+    if (!runner.enabled(name))
+        return;
+
+    param_360SCVP param;
+    memset(&param, 0, sizeof(param_360SCVP));
+    param.usedType = E_PARSER_ONENAL;
+    param.pInputBitstream = &stream.data[0];
+    param.inputBitstreamLen = stream.size;
+    void* pI360SCVP = I360SCVP_Init(&param);
+    if (!pI360SCVP)
+        return;
+
+    uint8_t* pCur = &stream.data[0];
+    uint8_t* pEnd = pCur + stream.size;
+    runner.run(name, [&]() -> int64_t {
+        if (pEnd - pCur <= 4)
+            pCur = &stream.data[0];
+        Nalu nal;
+        memset(&nal, 0, sizeof(Nalu));
+        nal.data = pCur;
+        nal.dataSize = pEnd - pCur;
+        if (I360SCVP_ParseNAL(&nal, pI360SCVP) || nal.dataSize <= 0)
+            return -1;
+        pCur += nal.dataSize;
+        return nal.dataSize;
+    });
+    I360SCVP_unInit(pI360SCVP);
+}
+
+// Process: one operation merges the high and low resolution frame for the current viewport
+void perfProcess(PerfRunner& runner, PerfStream& high, PerfStream& low, const char* variant, float yaw, float pitch)
+{
+    std::string name = std::string("Process/") + variant;
+    if (!runner.enabled(name))
+        return;
+
+    std::vector<uint8_t> output(high.data.size());
+    std::vector<uint8_t> outputSEI(2000);
+    param_360SCVP param;
+    setMergeParam(&param, high, low, output, outputSEI);
+    void* pI360SCVP = I360SCVP_Init(&param);
+    if (!pI360SCVP)
+        return;
+    I360SCVP_setViewPort(pI360SCVP, yaw, pitch);
+
+    runner.run(name, [&]() -> int64_t {
+        if (I360SCVP_process(&param, pI360SCVP))
+            return -1;
+        return (int64_t)param.inputBitstreamLen + param.inputLowBistreamLen;
+    });
+    I360SCVP_unInit(pI360SCVP);
+}
+
+// ViewportSweep: one operation moves the viewport to the next pose and gets its tiles
+void perfViewportSweep(PerfRunner& runner, PerfStream& high, PerfStream& low)
+{
+    std::string name = "ViewportSweep/erp_960x960_fov80";
+    if (!runner.enabled(name))
+        return;
+
+    std::vector<uint8_t> output(high.data.size());
+    std::vector<uint8_t> outputSEI(2000);
+    param_360SCVP param;
+    setMergeParam(&param, high, low, output, outputSEI);
+    void* pI360SCVP = I360SCVP_Init(&param);
+    if (!pI360SCVP)
+        return;
+
+    std::vector<float> yaws;
+    std::vector<float> pitches;
+    for (float yaw = -180; yaw < 180; yaw += 15)
+    {
+        for (float pitch = 0; pitch <= 60; pitch += 15)
+        {
+            yaws.push_back(yaw);
+            pitches.push_back(pitch);
+        }
+    }
+
+    TileDef tiles[1024];
+    Param_ViewportOutput viewportOutput;
+    size_t pose = 0;
+    runner.run(name, [&]() -> int64_t {
+        if (I360SCVP_setViewPort(pI360SCVP, yaws[pose], pitches[pose]))
+            return -1;
+        if (I360SCVP_getFixedNumTiles(tiles, &viewportOutput, pI360SCVP) <= 0)
+            return -1;
+        pose = (pose + 1) % yaws.size();
+        return 0;
+    });
+    I360SCVP_unInit(pI360SCVP);
+}
+
+// GenerateSliceHdr: one operation rewrites the header of a single tile nal, like the extractor track
+void perfGenerateSliceHdr(PerfRunner& runner, PerfStream& stream)
+{
+    std::string name = "GenerateSliceHdr/" + stream.name;
+    if (!runner.enabled(name))
+        return;
+
+    param_360SCVP param;
+    memset(&param, 0, sizeof(param_360SCVP));
+    param.usedType = E_PARSER_ONENAL;
+    param.pInputBitstream = &stream.data[0];
+    param.inputBitstreamLen = stream.size;
+    void* pI360SCVP = I360SCVP_Init(&param);
+    if (!pI360SCVP)
+        return;
+
+    // parse the parameter sets up to the first slice
+    Nalu nal;
+    memset(&nal, 0, sizeof(Nalu));
+    uint8_t* pCur = &stream.data[0];
+    uint8_t* pEnd = pCur + stream.size;
+    bool bSlice = false;
+    while (pEnd - pCur > 4)
+    {
+        nal.data = pCur;
+        nal.dataSize = pEnd - pCur;
+        if (I360SCVP_ParseNAL(&nal, pI360SCVP) || nal.dataSize <= 0)
+            break;
+        if (nal.naluType < 22)
+        {
+            bSlice = true;
+            break;
+        }
+        pCur += nal.dataSize;
+    }
+    void* pClone = bSlice ? I360SCVP_New(pI360SCVP) : NULL;
+    if (!pClone)
+    {
+        I360SCVP_unInit(pI360SCVP);
+        return;
+    }
+
+    std::vector<uint8_t> slice(nal.data, nal.data + nal.dataSize);
+    slice[0] = 0;
+    slice[1] = 0;
+    slice[2] = 0;
+    slice[3] = 1;
+    uint8_t sliceHdr[256];
+    param.pInputBitstream = &slice[0];
+    param.inputBitstreamLen = slice.size();
+    param.pOutputBitstream = sliceHdr;
+    param.destWidth = 1280;
+    param.destHeight = 768;
+    int32_t sliceAddr = 0;
+    runner.run(name, [&]() -> int64_t {
+        if (I360SCVP_GenerateSliceHdr(&param, sliceAddr, pClone))
+            return -1;
+        sliceAddr = (sliceAddr + 4) % 60;
+        return param.outputBitstreamLen;
+    });
+    I360SCVP_unInit(pClone);
+    I360SCVP_unInit(pI360SCVP);
+}
+
+// GenerateRWPK / GenerateProj: one operation writes one SEI nal
+void perfGenerateSEI(PerfRunner& runner)
+{
+    param_360SCVP param;
+    memset(&param, 0, sizeof(param_360SCVP));
+    param.usedType = E_PARSER_ONENAL;
+    void* pI360SCVP = I360SCVP_Init(&param);
+    if (!pI360SCVP)
+        return;
+
+    uint8_t seiBits[256];
+    int32_t seiLen = 0;
+    RectangularRegionWisePacking regions[4];
+    RegionWisePacking rwpk;
+    memset(&rwpk, 0, sizeof(RegionWisePacking));
+    memset(regions, 0, sizeof(regions));
+    rwpk.numRegions = 4;
+    rwpk.projPicWidth = 3840;
+    rwpk.projPicHeight = 2048;
+    rwpk.packedPicWidth = 1920;
+    rwpk.packedPicHeight = 1024;
+    rwpk.rectRegionPacking = regions;
+    for (int32_t i = 0; i < rwpk.numRegions; i++)
+    {
+        regions[i].projRegWidth = 960;
+        regions[i].projRegHeight = 1024;
+        regions[i].projRegLeft = i * 960;
+        regions[i].packedRegWidth = 960;
+        regions[i].packedRegHeight = 512;
+        regions[i].packedRegLeft = (i % 2) * 960;
+        regions[i].packedRegTop = (i / 2) * 512;
+    }
+    runner.run("GenerateRWPK/4regions", [&]() -> int64_t {
+        if (I360SCVP_GenerateRWPK(pI360SCVP, &rwpk, seiBits, &seiLen))
+            return -1;
+        return seiLen;
+    });
+    runner.run("GenerateProj/equirect", [&]() -> int64_t {
+        if (I360SCVP_GenerateProj(pI360SCVP, E_EQUIRECT_PROJECTION, seiBits, &seiLen))
+            return -1;
+        return seiLen;
+    });
+    I360SCVP_unInit(pI360SCVP);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    double minTime = 0.5;
+    std::string filter;
+    std::string format = "json";
+    std::string inputDir = ".";
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.compare(0, 11, "--min_time=") == 0)
+            minTime = atof(arg.c_str() + 11);
+        else if (arg.compare(0, 9, "--filter=") == 0)
+            filter = arg.substr(9);
+        else if (arg.compare(0, 9, "--format=") == 0)
+            format = arg.substr(9);
+        else if (arg.compare(0, 12, "--input_dir=") == 0)
+            inputDir = arg.substr(12);
+        else
+        {
+            fprintf(stderr, "usage: %s [--min_time=<s>] [--filter=<substring>] [--format=json|csv] [--input_dir=<dir>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    PerfStream high, low;
+    if (!loadStream(inputDir, "test.265", 3840 * 2048 * 3 / 2, &high)
+        || !loadStream(inputDir, "test_low.265", 3840 * 2048 * 3 / 2, &low))
+        return 1;
+
+    // the library logs to stdout, keep it for the results only
+    fflush(stdout);
+    int32_t stdoutFd = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    PerfRunner runner(minTime, filter);
+    perfParseNAL(runner, high);
+    perfParseNAL(runner, low);
+    perfProcess(runner, high, low, "yaw-90_pitch0", -90, 0);
+    perfProcess(runner, high, low, "yaw0_pitch30", 0, 30);
+    perfViewportSweep(runner, high, low);
+    perfGenerateSliceHdr(runner, high);
+    perfGenerateSliceHdr(runner, low);
+    perfGenerateSEI(runner);
+
+    fflush(stdout);
+    dup2(stdoutFd, STDOUT_FILENO);
+    close(stdoutFd);
+    if (format == "csv")
+        runner.printCsv();
+    else
+        runner.printJson();
+    return runner.empty() ? 1 : 0;
+}
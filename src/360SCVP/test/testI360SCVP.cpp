@@ -28,6 +28,11 @@
 #include <string>
 #include <fstream>
 #include "../360SCVPAPI.h"
+#include "../360SCVPViewportAPI.h"
+#include "../360SCVPViewPort.h"
+#include "../360SCVPHevcParser.h"
+#include "../360SCVPHevcEncHdr.h"
+#include "../360SCVPCommonDef.h"
 
 namespace{
 class I360SCVPTest : public testing::Test {
@@ -1004,4 +1009,581 @@ TEST_F(I360SCVPTest, parseRWPK)
     EXPECT_TRUE(ret == 0);
 }
 
+TEST_F(I360SCVPTest, ViewportLookupTable)
+{
+    generateViewPortParam paramViewport;
+    point upLeftMap[6], downRightMap[6], upLeftLut[6], downRightLut[6];
+    memset(&paramViewport, 0, sizeof(generateViewPortParam));
+    paramViewport.m_iViewportWidth = 960;
+    paramViewport.m_iViewportHeight = 960;
+    paramViewport.m_viewPort_hFOV = 80;
+    paramViewport.m_viewPort_vFOV = 80;
+    paramViewport.m_output_geoType = E_SVIDEO_VIEWPORT;
+    paramViewport.m_input_geoType = E_SVIDEO_EQUIRECT;
+    paramViewport.m_iInputWidth = frameWidth;
+    paramViewport.m_iInputHeight = frameHeight;
+    paramViewport.m_tileNumRow = 6;
+    paramViewport.m_tileNumCol = 10;
+
+    generateViewPortParam paramMap = paramViewport;
+    generateViewPortParam paramLut = paramViewport;
+    paramMap.m_pUpLeft = upLeftMap;
+    paramMap.m_pDownRight = downRightMap;
+    paramLut.m_pUpLeft = upLeftLut;
+    paramLut.m_pDownRight = downRightLut;
+    void* pMapHandle = genViewport_Init(&paramMap);
+    void* pLutHandle = genViewport_Init(&paramLut);
+    EXPECT_TRUE(pMapHandle != NULL);
+    EXPECT_TRUE(pLutHandle != NULL);
+    if (!pMapHandle || !pLutHandle)
+    {
+        genViewport_unInit(pMapHandle);
+        genViewport_unInit(pLutHandle);
+        return;
+    }
+    int32_t ret = genViewport_buildLookupTable(pLutHandle, 45);
+    EXPECT_TRUE(ret == 0);
+
+    // the poses are on the grid, so the lookup must equal the per-pixel mapping
+    float poses[][2] = { {0, 0}, {-90, 45}, {135, -45}, {-180, 0}, {90, 90} };
+    TileDef tilesMap[60], tilesLut[60];
+    for (uint32_t i = 0; i < sizeof(poses) / sizeof(poses[0]); i++)
+    {
+        genViewport_setViewPort(pMapHandle, poses[i][0], poses[i][1]);
+        genViewport_setViewPort(pLutHandle, poses[i][0], poses[i][1]);
+        ret = genViewport_process(&paramMap, pMapHandle);
+        ret |= genViewport_process(&paramLut, pLutHandle);
+        EXPECT_TRUE(ret == 0);
+        EXPECT_TRUE(paramMap.m_numFaces == paramLut.m_numFaces);
+        for (int32_t j = 0; j < paramMap.m_numFaces; j++)
+        {
+            EXPECT_TRUE(upLeftMap[j].x == upLeftLut[j].x && upLeftMap[j].y == upLeftLut[j].y);
+            EXPECT_TRUE(downRightMap[j].x == downRightLut[j].x && downRightMap[j].y == downRightLut[j].y);
+        }
+
+        CCDef ccMap, ccLut;
+        genViewport_getContentCoverage(pMapHandle, &ccMap);
+        genViewport_getContentCoverage(pLutHandle, &ccLut);
+        EXPECT_TRUE(ccMap.centreAzimuth == ccLut.centreAzimuth && ccMap.centreElevation == ccLut.centreElevation);
+        EXPECT_TRUE(ccMap.azimuthRange == ccLut.azimuthRange && ccMap.elevationRange == ccLut.elevationRange);
+
+        int32_t numMap = genViewport_getFixedNumTiles(pMapHandle, tilesMap);
+        int32_t numLut = genViewport_getFixedNumTiles(pLutHandle, tilesLut);
+        EXPECT_TRUE(numMap == numLut);
+        for (int32_t j = 0; j < numMap && j < numLut; j++)
+            EXPECT_TRUE(tilesMap[j].idx == tilesLut[j].idx);
+    }
+
+    // off-grid pose is snapped to the nearest grid point
+    genViewport_setViewPort(pLutHandle, 95, 40);
+    ret = genViewport_process(&paramLut, pLutHandle);
+    EXPECT_TRUE(ret == 0);
+    genViewport_setViewPort(pMapHandle, 90, 45);
+    ret = genViewport_process(&paramMap, pMapHandle);
+    EXPECT_TRUE(ret == 0);
+    EXPECT_TRUE(upLeftMap[0].x == upLeftLut[0].x && downRightMap[0].y == downRightLut[0].y);
+
+    genViewport_unInit(pMapHandle);
+    genViewport_unInit(pLutHandle);
+}
+
+TEST_F(I360SCVPTest, ViewportFootprint)
+{
+    // the row based footprint must give the same range as the pixel walk
+    int32_t srcTypes[2] = { SVIDEO_EQUIRECT, SVIDEO_CUBEMAP };
+    int32_t mismatch = 0;
+    for (int32_t t = 0; t < 2; t++)
+    {
+        for (int32_t pitch = -90; pitch <= 90; pitch += 30)
+        {
+            for (int32_t yaw = -180; yaw < 180; yaw += 30)
+            {
+                SVideoInfo srcInfo, vpInfo;
+                memset(&srcInfo, 0, sizeof(SVideoInfo));
+                memset(&vpInfo, 0, sizeof(SVideoInfo));
+                srcInfo.geoType = srcTypes[t];
+                srcInfo.iFaceWidth = frameWidth;
+                srcInfo.iFaceHeight = frameHeight;
+                srcInfo.iNumFaces = (srcTypes[t] == SVIDEO_CUBEMAP) ? 6 : 1;
+                vpInfo.geoType = SVIDEO_VIEWPORT;
+                vpInfo.iFaceWidth = 320;
+                vpInfo.iFaceHeight = 240;
+                vpInfo.iNumFaces = 1;
+                vpInfo.viewPort.hFOV = 90;
+                vpInfo.viewPort.vFOV = 90;
+                vpInfo.viewPort.fYaw = (float)yaw + 7.5f;
+                vpInfo.viewPort.fPitch = (float)pitch;
+
+                Geometry *pSrc = Geometry::create(srcInfo);
+                Geometry *pWalk = Geometry::create(vpInfo);
+                Geometry *pFootprint = Geometry::create(vpInfo);
+                pWalk->Geometry::geometryMapping(pSrc);
+                pFootprint->geometryMapping(pSrc);
+                if (pWalk->m_numFaces != pFootprint->m_numFaces)
+                    mismatch++;
+                for (int32_t i = 0; i < FACE_NUMBER; i++)
+                {
+                    if (pWalk->m_upLeft[i].faceIdx != pFootprint->m_upLeft[i].faceIdx
+                        || pWalk->m_upLeft[i].x != pFootprint->m_upLeft[i].x
+                        || pWalk->m_upLeft[i].y != pFootprint->m_upLeft[i].y
+                        || pWalk->m_downRight[i].x != pFootprint->m_downRight[i].x
+                        || pWalk->m_downRight[i].y != pFootprint->m_downRight[i].y)
+                        mismatch++;
+                }
+                pWalk->geoUnInit();
+                pFootprint->geoUnInit();
+                delete pWalk;
+                delete pFootprint;
+                delete pSrc;
+            }
+        }
+    }
+    EXPECT_TRUE(mismatch == 0);
+}
+
+TEST_F(I360SCVPTest, EmulationPreventionBytes)
+{
+    // payload with many zero runs, so that emulation prevention bytes are inserted in every vector block
+    uint32_t size = 4096;
+    int8_t *pPayload = new int8_t[size];
+    int8_t *pEmulated = new int8_t[size * 2];
+    int8_t *pRemoved = new int8_t[size * 2];
+    int8_t *pBitsWriter = new int8_t[size * 2];
+    int8_t *pDataWriter = new int8_t[size * 2];
+    srand(1);
+    for (uint32_t i = 0; i < size; i++)
+        pPayload[i] = (rand() % 3) ? 0 : (int8_t)(rand() % 6);
+
+    uint8_t zeroCount = 0;
+    uint32_t emulatedSize = gts_bs_insert_emulation_bytes(pPayload, pEmulated, size, &zeroCount);
+    EXPECT_TRUE(emulatedSize > size);
+    EXPECT_TRUE(gts_media_nalu_emulation_bytes_remove_count(pEmulated, emulatedSize) == emulatedSize - size);
+    uint32_t removedSize = gts_media_nalu_remove_emulation_bytes(pEmulated, pRemoved, emulatedSize);
+    EXPECT_TRUE(removedSize == size);
+    EXPECT_TRUE(memcmp(pRemoved, pPayload, size) == 0);
+
+    // bulk write must give the same bytes as the bit writer
+    GTS_BitStream *bsBits = gts_bs_new(pBitsWriter, size * 2, GTS_BITSTREAM_WRITE);
+    GTS_BitStream *bsData = gts_bs_new(pDataWriter, size * 2, GTS_BITSTREAM_WRITE);
+    for (uint32_t i = 0; i < size; i++)
+        gts_bs_write_int(bsBits, pPayload[i], 8);
+    gts_bs_write_data_with_emulation(bsData, pPayload, size / 2);
+    gts_bs_write_data_with_emulation(bsData, pPayload + size / 2, size - size / 2);
+    EXPECT_TRUE(bsBits->position == bsData->position);
+    EXPECT_TRUE(bsBits->position == emulatedSize);
+    EXPECT_TRUE(memcmp(pBitsWriter, pDataWriter, emulatedSize) == 0);
+    gts_bs_del(bsBits);
+    gts_bs_del(bsData);
+
+    delete[] pPayload;
+    delete[] pEmulated;
+    delete[] pRemoved;
+    delete[] pBitsWriter;
+    delete[] pDataWriter;
+}
+
+TEST_F(I360SCVPTest, BitstreamWordReadWrite)
+{
+    // mixed fixed length fields and Exp-Golomb codes, written with the accumulator writer
+    uint32_t count = 2000;
+    uint32_t size = count * 16;
+    int8_t *pWritten = new int8_t[size];
+    int8_t *pPayload = new int8_t[size];
+    uint32_t *pValues = new uint32_t[count];
+    uint32_t *pWidths = new uint32_t[count];
+    srand(2);
+    GTS_BitStream *bsWrite = gts_bs_new(pWritten, size, GTS_BITSTREAM_WRITE);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        pWidths[i] = rand() % 3 ? (rand() % 32 + 1) : 0;
+        if (pWidths[i])
+        {
+            pValues[i] = (uint32_t)rand() & (uint32_t)((1ULL << pWidths[i]) - 1);
+            gts_bs_write_int(bsWrite, pValues[i], pWidths[i]);
+        }
+        else
+        {
+            // ue(v): leadingZeros zero bits then value+1 on leadingZeros+1 bits
+            pValues[i] = (rand() % 4) ? rand() % 64 : rand() % 0xFFFF;
+            uint32_t codeNum = pValues[i] + 1;
+            uint32_t leadingZeros = 0;
+            while ((codeNum >> (leadingZeros + 1)) != 0)
+                leadingZeros++;
+            gts_bs_write_int(bsWrite, 0, leadingZeros);
+            gts_bs_write_int(bsWrite, codeNum, leadingZeros + 1);
+        }
+    }
+    gts_bs_align(bsWrite);
+    uint32_t writtenSize = (uint32_t)bsWrite->position;
+    gts_bs_del(bsWrite);
+
+    uint32_t payloadSize = gts_media_nalu_remove_emulation_bytes(pWritten, pPayload, writtenSize);
+    GTS_BitStream *bsRead = gts_bs_new(pPayload, payloadSize, GTS_BITSTREAM_READ);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (pWidths[i])
+            EXPECT_TRUE(gts_bs_read_int(bsRead, pWidths[i]) == pValues[i]);
+        else
+            EXPECT_TRUE(gts_bs_read_ue(bsRead) == pValues[i]);
+    }
+    EXPECT_TRUE(gts_bs_get_bit_offset(bsRead) + 8 > payloadSize * 8);
+    gts_bs_del(bsRead);
+
+    // se(v) mapping: 1 -> 1, 2 -> -1, 3 -> 2
+    int8_t seCodes[2] = { 0x4C, (int8_t)0x80 }; // 010 011 00100 ...
+    bsRead = gts_bs_new(seCodes, 2, GTS_BITSTREAM_READ);
+    EXPECT_TRUE(gts_bs_read_se(bsRead) == 1);
+    EXPECT_TRUE(gts_bs_read_se(bsRead) == -1);
+    EXPECT_TRUE(gts_bs_read_se(bsRead) == 2);
+    EXPECT_TRUE(gts_bs_get_bit_offset(bsRead) == 11);
+    gts_bs_del(bsRead);
+
+    delete[] pWritten;
+    delete[] pPayload;
+    delete[] pValues;
+    delete[] pWidths;
+}
+
+TEST_F(I360SCVPTest, StreamStitchSegmentOutput)
+{
+    // stitch two copies of the low resolution stream side by side, once copied into
+    // the output buffer and once as segments referencing the input slice data
+    int32_t streamNum = 2;
+    uint32_t copyLen = 0;
+    unsigned char *pCopyOutput = new unsigned char[bufferlenlow * streamNum * 2];
+    for (int32_t mode = 0; mode < 2; mode++)
+    {
+        unsigned char *pStreams[2];
+        param_oneStream_info streams[2];
+        param_oneStream_info *pStreamList[2];
+        for (int32_t i = 0; i < streamNum; i++)
+        {
+            pStreams[i] = new unsigned char[bufferlenlow];
+            memcpy(pStreams[i], pInputBufferlow, bufferlenlow);
+            memset(&streams[i], 0, sizeof(param_oneStream_info));
+            streams[i].pTiledBitstreamBuffer = pStreams[i];
+            streams[i].inputBufferLen = bufferlenlow;
+            pStreamList[i] = &streams[i];
+        }
+        memset(&param, 0, sizeof(param_360SCVP));
+        param.usedType = E_STREAM_STITCH_ONLY;
+        param.paramPicInfo.picWidth = frameWidthlow * streamNum;
+        param.paramPicInfo.picHeight = frameHeightlow;
+        param.paramPicInfo.tileWidthNum = streamNum;
+        param.paramPicInfo.tileHeightNum = 1;
+        param.paramPicInfo.tileIsUniform = 1;
+        param.paramStitchInfo.pTiledBitstream = pStreamList;
+        param.inputBitstreamLen = bufferlenlow * streamNum;
+        param.pOutputBitstream = mode ? NULL : pCopyOutput;
+        param.bSegmentOutput = mode ? true : false;
+
+        void* pI360SCVP = I360SCVP_Init(&param);
+        EXPECT_TRUE(pI360SCVP != NULL);
+        if (pI360SCVP)
+        {
+            int32_t ret = I360SCVP_process(&param, pI360SCVP);
+            EXPECT_TRUE(ret == 0);
+            if (!mode)
+            {
+                copyLen = param.outputBitstreamLen;
+            }
+            else
+            {
+                // the segments put together give the same bytes as the copy mode
+                EXPECT_TRUE(param.outputSegmentNum > 0);
+                EXPECT_TRUE(param.outputBitstreamLen == copyLen);
+                uint32_t offset = 0;
+                bool sameData = true;
+                for (uint32_t i = 0; i < param.outputSegmentNum; i++)
+                {
+                    Param_BitstreamSegment *pSegment = &param.pOutputSegments[i];
+                    if (offset + pSegment->dataLen > copyLen
+                        || memcmp(pCopyOutput + offset, pSegment->pData, pSegment->dataLen))
+                    {
+                        sameData = false;
+                        break;
+                    }
+                    offset += pSegment->dataLen;
+                }
+                EXPECT_TRUE(sameData);
+                EXPECT_TRUE(offset == copyLen);
+            }
+            I360SCVP_unInit(pI360SCVP);
+        }
+        for (int32_t i = 0; i < streamNum; i++)
+            delete[] pStreams[i];
+    }
+    delete[] pCopyOutput;
+}
+
+TEST_F(I360SCVPTest, StreamStitchParallelMerge)
+{
+    // stitch 2x2 copies of the low resolution stream in the calling thread and on
+    // the merge worker threads, the outputs must be the same
+    int32_t streamNum = 4;
+    uint32_t outputLen[2] = { 0, 0 };
+    uint32_t streamOutputLen[2][4];
+    unsigned char *pOutput[2];
+    for (int32_t mode = 0; mode < 2; mode++)
+    {
+        pOutput[mode] = new unsigned char[bufferlenlow * streamNum * 2];
+        unsigned char *pStreams[4];
+        param_oneStream_info streams[4];
+        param_oneStream_info *pStreamList[4];
+        for (int32_t i = 0; i < streamNum; i++)
+        {
+            pStreams[i] = new unsigned char[bufferlenlow];
+            memcpy(pStreams[i], pInputBufferlow, bufferlenlow);
+            memset(&streams[i], 0, sizeof(param_oneStream_info));
+            streams[i].pTiledBitstreamBuffer = pStreams[i];
+            streams[i].inputBufferLen = bufferlenlow;
+            pStreamList[i] = &streams[i];
+        }
+        memset(&param, 0, sizeof(param_360SCVP));
+        param.usedType = E_STREAM_STITCH_ONLY;
+        param.paramPicInfo.picWidth = frameWidthlow * 2;
+        param.paramPicInfo.picHeight = frameHeightlow * 2;
+        param.paramPicInfo.tileWidthNum = 2;
+        param.paramPicInfo.tileHeightNum = 2;
+        param.paramPicInfo.tileIsUniform = 1;
+        param.paramStitchInfo.pTiledBitstream = pStreamList;
+        param.paramStitchInfo.mergeThreadNum = mode ? 4 : 0;
+        param.inputBitstreamLen = bufferlenlow * streamNum;
+        param.pOutputBitstream = pOutput[mode];
+
+        void* pI360SCVP = I360SCVP_Init(&param);
+        EXPECT_TRUE(pI360SCVP != NULL);
+        if (pI360SCVP)
+        {
+            int32_t ret = I360SCVP_process(&param, pI360SCVP);
+            EXPECT_TRUE(ret == 0);
+            outputLen[mode] = param.outputBitstreamLen;
+            for (int32_t i = 0; i < streamNum; i++)
+                streamOutputLen[mode][i] = streams[i].outputBufferLen;
+            I360SCVP_unInit(pI360SCVP);
+        }
+        for (int32_t i = 0; i < streamNum; i++)
+            delete[] pStreams[i];
+    }
+    EXPECT_TRUE(outputLen[0] > 0);
+    EXPECT_TRUE(outputLen[0] == outputLen[1]);
+    EXPECT_TRUE(memcmp(pOutput[0], pOutput[1], outputLen[0]) == 0);
+    EXPECT_TRUE(memcmp(streamOutputLen[0], streamOutputLen[1], sizeof(streamOutputLen[0])) == 0);
+    delete[] pOutput[0];
+    delete[] pOutput[1];
+}
+
+TEST_F(I360SCVPTest, SliceHeaderTemplate)
+{
+    HEVCState *state = new HEVCState;
+    memset(state, 0, sizeof(HEVCState));
+    HevcSliceHdrCache cache;
+    memset(&cache, 0, sizeof(HevcSliceHdrCache));
+
+    HEVC_SPS *sps = &state->sps[0];
+    sps->width = 3840;
+    sps->height = 1920;
+    sps->temporal_mvp_enable_flag = 1;
+    sps->sample_adaptive_offset_enabled_flag = 1;
+    sps->chroma_format_idc = 1;
+    state->pps[0].tiles_enabled_flag = 1;
+
+    HEVCSliceInfo *si = &state->s_info;
+    si->rps[0].num_negative_pics = 1;
+    si->rps[0].delta_poc[0] = 1;
+    si->used_by_curr_pic_s0_flag[0] = 1;
+
+    // the cached headers should be the same as the fully written ones for every
+    // slice address and poc, also when the slice type or parameter set changes
+    uint8_t nalTypes[3] = { GTS_HEVC_NALU_SLICE_IDR_W_DLP, GTS_HEVC_NALU_SLICE_TRAIL_R, GTS_HEVC_NALU_SLICE_CRA };
+    int8_t full[256];
+    int8_t cached[256];
+    srand(7);
+    for (uint32_t i = 0; i < 600; i++)
+    {
+        si->nal_unit_type = nalTypes[(i / 50) % 3];
+        si->slice_type = si->nal_unit_type == GTS_HEVC_NALU_SLICE_TRAIL_R ? SLICE_P : SLICE_I;
+        si->slice_qp_delta = (int32_t)(i / 200) - 1;
+        sps->height = (i / 300) ? 1920 : 960;
+        si->first_slice_segment_in_pic_flag = (i % 8) == 0;
+        si->slice_segment_address = (i % 8) * 60 + rand() % 60;
+        si->poc_lsb = rand() % 3 ? rand() & 0xFFFF : 0;
+
+        GTS_BitStream *bsFull = gts_bs_new(full, sizeof(full), GTS_BITSTREAM_WRITE);
+        GTS_BitStream *bsCached = gts_bs_new(cached, sizeof(cached), GTS_BITSTREAM_WRITE);
+        hevc_write_slice_header(bsFull, state);
+        hevc_write_slice_header_cached(bsCached, state, &cache);
+        uint64_t fullLen = gts_bs_get_position(bsFull);
+        EXPECT_TRUE(fullLen == gts_bs_get_position(bsCached));
+        EXPECT_TRUE(memcmp(full, cached, fullLen) == 0);
+        gts_bs_del(bsFull);
+        gts_bs_del(bsCached);
+    }
+    delete state;
+}
+
+TEST_F(I360SCVPTest, ProcessViewportsBatch)
+{
+    param.paramViewPort.faceWidth = 3840;
+    param.paramViewPort.faceHeight = 2048;
+    param.paramViewPort.geoTypeInput = EGeometryType(E_SVIDEO_EQUIRECT);
+    param.paramViewPort.viewportHeight = 960;
+    param.paramViewPort.viewportWidth = 960;
+    param.paramViewPort.geoTypeOutput = E_SVIDEO_VIEWPORT;
+    param.paramViewPort.viewPortYaw = -90;
+    param.paramViewPort.viewPortPitch = 0;
+    param.paramViewPort.viewPortFOVH = 80;
+    param.paramViewPort.viewPortFOVV = 80;
+    param.usedType = E_MERGE_AND_VIEWPORT;
+
+    // the fourth viewport repeats the first one
+    const uint32_t viewportNum = 4;
+    float yaw[viewportNum] = { -90, 0, 90, -90 };
+    float pitch[viewportNum] = { 0, 30, 0, 0 };
+    unsigned char *pExpected[viewportNum];
+    unsigned char *pExpectedSEI[viewportNum];
+    uint32_t expectedLen[viewportNum];
+    uint32_t expectedSEILen[viewportNum];
+
+    // one viewport per process call as the reference
+    void* pI360SCVP = I360SCVP_Init(&param);
+    EXPECT_TRUE(pI360SCVP != NULL);
+    if (!pI360SCVP)
+        return;
+    for (uint32_t i = 0; i < viewportNum; i++)
+    {
+        pExpected[i] = new unsigned char[bufferlen];
+        pExpectedSEI[i] = new unsigned char[2000];
+        EXPECT_TRUE(I360SCVP_setViewPort(pI360SCVP, yaw[i], pitch[i]) == 0);
+        EXPECT_TRUE(I360SCVP_process(&param, pI360SCVP) == 0);
+        expectedLen[i] = param.outputBitstreamLen;
+        expectedSEILen[i] = param.outputSEILen;
+        memcpy(pExpected[i], param.pOutputBitstream, expectedLen[i]);
+        memcpy(pExpectedSEI[i], param.pOutputSEI, expectedSEILen[i]);
+    }
+    I360SCVP_unInit(pI360SCVP);
+
+    for (uint32_t threadNum = 1; threadNum <= 3; threadNum += 2)
+    {
+        param.paramStitchInfo.mergeThreadNum = threadNum;
+        pI360SCVP = I360SCVP_Init(&param);
+        EXPECT_TRUE(pI360SCVP != NULL);
+        if (!pI360SCVP)
+            break;
+
+        Param_ViewportBatchItem viewports[viewportNum];
+        for (uint32_t i = 0; i < viewportNum; i++)
+        {
+            memset(&viewports[i], 0, sizeof(Param_ViewportBatchItem));
+            viewports[i].yaw = yaw[i];
+            viewports[i].pitch = pitch[i];
+            viewports[i].pOutputBitstream = new unsigned char[bufferlen];
+            viewports[i].pOutputSEI = new unsigned char[2000];
+        }
+        // run twice to reuse the mergers created by the first batch
+        for (uint32_t loop = 0; loop < 2; loop++)
+        {
+            EXPECT_TRUE(I360SCVP_processViewports(&param, viewports, viewportNum, threadNum, pI360SCVP) == 0);
+            EXPECT_TRUE(viewports[0].sameSelectionIdx == 0);
+            EXPECT_TRUE(viewports[1].sameSelectionIdx == 1);
+            EXPECT_TRUE(viewports[2].sameSelectionIdx == 2);
+            EXPECT_TRUE(viewports[3].sameSelectionIdx == 0);
+            for (uint32_t i = 0; i < viewportNum; i++)
+            {
+                EXPECT_TRUE(viewports[i].outputBitstreamLen == expectedLen[i]);
+                EXPECT_TRUE(memcmp(viewports[i].pOutputBitstream, pExpected[i], expectedLen[i]) == 0);
+                EXPECT_TRUE(viewports[i].outputSEILen == expectedSEILen[i]);
+                EXPECT_TRUE(memcmp(viewports[i].pOutputSEI, pExpectedSEI[i], expectedSEILen[i]) == 0);
+            }
+        }
+        I360SCVP_unInit(pI360SCVP);
+        for (uint32_t i = 0; i < viewportNum; i++)
+        {
+            delete[] viewports[i].pOutputBitstream;
+            delete[] viewports[i].pOutputSEI;
+        }
+    }
+
+    for (uint32_t i = 0; i < viewportNum; i++)
+    {
+        delete[] pExpected[i];
+        delete[] pExpectedSEI[i];
+    }
+}
+
+TEST_F(I360SCVPTest, GenerateSliceHdr_SharedState)
+{
+    param.usedType = E_PARSER_ONENAL;
+    void* pI360SCVP = I360SCVP_Init(&param);
+    EXPECT_TRUE(pI360SCVP != NULL);
+    if (!pI360SCVP)
+        return;
+
+    Nalu nal;
+    int32_t ret = 0;
+    unsigned char* pInputBufferTmp = pInputBuffer;
+    int32_t left = bufferlen;
+    memset(&nal, 0, sizeof(Nalu));
+    while (left > 4)
+    {
+        nal.data = pInputBufferTmp;
+        nal.dataSize = left;
+        ret = I360SCVP_ParseNAL(&nal, pI360SCVP);
+        if (ret < 0 || nal.naluType < 22)
+            break;
+        pInputBufferTmp += nal.dataSize;
+        left -= nal.dataSize;
+    }
+    EXPECT_TRUE(ret >= 0 && nal.naluType < 22);
+
+    // the clone shares the parameter sets of the source handle
+    void* pClone = I360SCVP_New(pI360SCVP);
+    EXPECT_TRUE(pClone != NULL);
+    if (!pClone)
+    {
+        I360SCVP_unInit(pI360SCVP);
+        return;
+    }
+
+    // a single slice nal like the extractor track writes it
+    unsigned char* pSlice = new unsigned char[nal.dataSize];
+    memcpy(pSlice, nal.data, nal.dataSize);
+    pSlice[0] = 0;
+    pSlice[1] = 0;
+    pSlice[2] = 0;
+    pSlice[3] = 1;
+    unsigned char sliceHdr[3][256];
+    uint32_t sliceHdrLen[3];
+    void* handles[3] = { pClone, pI360SCVP, pClone };
+    for (int32_t i = 0; i < 3; i++)
+    {
+        if (i == 2)
+        {
+            // the source handle writes its own copy of the parameter sets
+            param.pInputBitstream = pInputBuffer;
+            param.inputBitstreamLen = bufferlen;
+            param.pOutputBitstream = pOutputBuffer;
+            param.destWidth = 640;
+            param.destHeight = 320;
+            EXPECT_TRUE(I360SCVP_GenerateSPS(&param, pI360SCVP) == 0);
+        }
+        param.pInputBitstream = pSlice;
+        param.inputBitstreamLen = nal.dataSize;
+        param.pOutputBitstream = sliceHdr[i];
+        param.destWidth = 1280;
+        param.destHeight = 768;
+        EXPECT_TRUE(I360SCVP_GenerateSliceHdr(&param, 5, handles[i]) == 0);
+        sliceHdrLen[i] = param.outputBitstreamLen;
+    }
+    EXPECT_TRUE(sliceHdrLen[0] > 4);
+    EXPECT_TRUE(sliceHdrLen[1] == sliceHdrLen[0]);
+    EXPECT_TRUE(memcmp(sliceHdr[1], sliceHdr[0], sliceHdrLen[0]) == 0);
+    EXPECT_TRUE(sliceHdrLen[2] == sliceHdrLen[0]);
+    EXPECT_TRUE(memcmp(sliceHdr[2], sliceHdr[0], sliceHdrLen[0]) == 0);
+
+    delete[] pSlice;
+    I360SCVP_unInit(pClone);
+    I360SCVP_unInit(pI360SCVP);
+}
+
 }
@@ -33,24 +33,34 @@
  */
 
 #include "DownloadManager.h"
+#include "OmafDashDownload/OmafThroughputEstimator.h"
+#include "OmafDashDownload/Stream.h"
 
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <map>
+#include <sys/mman.h>
+#include <chrono>
 
-#define MAX_PATH_COUNT 1024
+// the default byte budget of the segments kept in memory
+#define DEFAULT_MEM_CACHE_SIZE 64*1024*1024
 
 VCD_OMAF_BEGIN
 
-typedef struct GatherStruct{
-    int         size;
-    std::string prefix;
-}GatherStruct;
+static int ToKbps(uint64_t bps)
+{
+    uint64_t kbps = bps / 1000;
+    return kbps > INT32_MAX ? INT32_MAX : (int)kbps;
+}
+
+static uint64_t NowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
 
 DownloadManager::DownloadManager()
 {
@@ -65,225 +75,345 @@ DownloadManager::DownloadManager()
     // same random file name, so ignore 0
     m_count = 1;
     mUseCache = false;
+    mMemCacheSize = DEFAULT_MEM_CACHE_SIZE;
+    mMemCacheUsage = 0;
+    mSpillUsage = 0;
+    mSpillStop = false;
 }
 
 DownloadManager::~DownloadManager()
 {
+    {
+        std::lock_guard<std::mutex> lock(mSegCacheMtx);
+        mSpillStop = true;
+    }
+    mSpillCv.notify_all();
+    if(mSpillThread.joinable())
+        mSpillThread.join();
+
+    CleanCache();
+    mSpillQueue.clear();
+    mSpillPending.clear();
+    mMemCache.clear();
+    mMemLRU.clear();
+
     pthread_mutex_destroy( &mMutex );
 }
 
-int DownloadManager::DeleteCacheFile(std::string url)
+void DownloadManager::SetMemCacheSize(uint64_t size)
 {
-    if( remove(url.c_str()))
     {
-
-        LOG(WARNING) << "Failed to delete file in cache ! Be cautious cache may exceed the storage limitation!"<<endl;
-        return ERROR_INVALID;
+        std::lock_guard<std::mutex> lock(mSegCacheMtx);
+        mMemCacheSize = size;
+        EvictMemSegments();
     }
-    return ERROR_NONE;
+    mSpillCv.notify_one();
 }
 
-int DownloadManager::SetCacheFolder( std::string cache_dir )
+SegmentData DownloadManager::GetCachedSegment(const std::string& url)
 {
-    mCacheDir = cache_dir;
-    if( ( access( mCacheDir.c_str(), 2) ) != -1){
-        DeleteCacheBySize( );
-        return ERROR_NONE;
+    std::lock_guard<std::mutex> lock(mSegCacheMtx);
+
+    auto it = mMemCache.find(url);
+    if(it != mMemCache.end())
+    {
+        mMemLRU.splice(mMemLRU.begin(), mMemLRU, it->second.lruPos);
+        return it->second.data;
     }
 
-    if( -1 == mkdir(mCacheDir.c_str(), 0755) ) return ERROR_INVALID;
+    // still waiting for the spill thread, it's hot again so keep it in memory
+    auto pending = mSpillPending.find(url);
+    if(pending != mSpillPending.end())
+    {
+        SegmentData data = pending->second;
+        mSpillPending.erase(pending);
+
+        mMemLRU.push_front(url);
+        MemCacheEntry entry;
+        entry.lruPos = mMemLRU.begin();
+        entry.data = data;
+        mMemCache[url] = entry;
+        mMemCacheUsage += data->GetSize();
+        EvictMemSegments();
+        mSpillCv.notify_one();
+        return data;
+    }
 
-    return ERROR_NONE;
-}
+    auto spilled = mSpillCache.find(url);
+    if(spilled == mSpillCache.end())
+        return NULL;
 
-std::string DownloadManager::AssignCacheFileName()
-{
-    pthread_mutex_lock(&mMutex);
-    std::string file_name = GetRandomString(32);
-    pthread_mutex_unlock(&mMutex);
+    SpillEntry& entry = spilled->second;
+    if(!entry.mapped)
+        entry.mapped = MapSpilledSegment(entry.file, entry.size);
+    if(entry.mapped)
+        mSpillLRU.splice(mSpillLRU.begin(), mSpillLRU, entry.lruPos);
 
-    return file_name;
+    return entry.mapped;
 }
 
-/// get download bit rate
-int DownloadManager::GetImmediateBitrate()
+void DownloadManager::CacheSegment(const std::string& url, SegmentData data)
 {
-    return 0;
-}
+    if(!data || !data->GetSize() || data->GetSize() > mMemCacheSize)
+        return;
 
-int DownloadManager::GetAverageBitrate()
-{
-    return 0;
-}
+    {
+        std::lock_guard<std::mutex> lock(mSegCacheMtx);
 
-void DownloadManager::CleanCache()
-{
-    delete_all_cached_files( mCacheDir.c_str() );
+        auto it = mMemCache.find(url);
+        if(it != mMemCache.end())
+        {
+            mMemCacheUsage -= it->second.data->GetSize();
+            mMemLRU.erase(it->second.lruPos);
+            mMemCache.erase(it);
+        }
+        mSpillPending.erase(url);
+
+        mMemLRU.push_front(url);
+        MemCacheEntry entry;
+        entry.lruPos = mMemLRU.begin();
+        entry.data = data;
+        mMemCache[url] = entry;
+        mMemCacheUsage += data->GetSize();
+
+        EvictMemSegments();
+    }
+
+    mSpillCv.notify_one();
 }
 
-void DownloadManager::DeleteCacheByTime( uint64_t interval )
+void DownloadManager::EvictMemSegments()
 {
-    if(mCacheMtx.try_lock())
+    while(mMemCacheUsage > mMemCacheSize && mMemLRU.size())
     {
-        uint64_t out_size = CacheGetSize( mCacheDir.c_str() );
-        if (out_size < mMaxCacheSize)
-        {
-            mCacheMtx.unlock();
-            return;
-        }
+        std::string url = mMemLRU.back();
+        mMemLRU.pop_back();
 
-        auto cachePath = GetCacheFolder();
-        DIR *dir = opendir(cachePath.c_str());
-        if(!dir)
+        auto it = mMemCache.find(url);
+        SegmentData data = it->second.data;
+        mMemCacheUsage -= data->GetSize();
+        mMemCache.erase(it);
+
+        // the file is written on the spill thread, not on the caller's
+        if(mUseCache && !mSpillStop && mSpillCache.find(url) == mSpillCache.end())
         {
-            LOG(WARNING) << "Failed to open cache folder! Be cautious cache may exceed the storage limitation!" <<endl;
-            mCacheMtx.unlock();
-            return;
+            if(!mSpillThread.joinable())
+                mSpillThread = std::thread(&DownloadManager::SpillThread, this);
+
+            mSpillPending[url] = data;
+            mSpillQueue.push_back(url);
         }
+    }
+}
+
+void DownloadManager::SpillThread()
+{
+    std::unique_lock<std::mutex> lock(mSegCacheMtx);
+
+    while(true)
+    {
+        mSpillCv.wait(lock, [this]{ return mSpillStop || mSpillQueue.size(); });
+        if(mSpillStop)
+            break;
+
+        std::string url = mSpillQueue.front();
+        mSpillQueue.pop_front();
 
-        dirent *ent = readdir (dir);
-        int32_t removeCnt = 0;
-        while(ent && ((uint32_t)removeCnt) < out_size / 2)
+        // revisited after it's queued
+        auto it = mSpillPending.find(url);
+        if(it == mSpillPending.end())
+            continue;
+
+        SegmentData data = it->second;
+        std::string file = mCacheDir + "/" + AssignCacheFileName();
+
+        lock.unlock();
+        bool written = WriteSpillFile(file, data);
+        lock.lock();
+
+        it = mSpillPending.find(url);
+        if(!written || it == mSpillPending.end() || it->second != data)
         {
-            struct stat st;
-            if(stat(ent->d_name, &st))
-            {
-                LOG(WARNING) << "Failed to get cache file time info! Be cautious cache may exceed the storage limitation!" <<endl;
-                mCacheMtx.unlock();
-                return;
-            }
-            if((uint64_t)(st.st_mtim.tv_nsec) < GetStartTime() + interval)
+            if(written)
             {
-                if(remove(ent->d_name))
-                    LOG(WARNING) << "Failed to delete file in cache ! Be cautious cache may exceed the storage limitation!"<<endl;
+                lock.unlock();
+                DeleteCacheFile(file);
+                lock.lock();
             }
-
-            ent = readdir (dir);
+            continue;
+        }
+        mSpillPending.erase(it);
+
+        mSpillLRU.push_front(url);
+        SpillEntry entry;
+        entry.lruPos = mSpillLRU.begin();
+        entry.file = file;
+        entry.size = data->GetSize();
+        entry.spillTime = NowMs();
+        mSpillCache[url] = entry;
+        mSpillUsage += entry.size;
+
+        std::vector<std::string> files = EvictSpilledSegments(mMaxCacheSize);
+        if(files.size())
+        {
+            lock.unlock();
+            DeleteCacheFiles(files);
+            lock.lock();
         }
-        closedir (dir);
-
-        mCacheMtx.unlock();
     }
-    return;
 }
 
-void DownloadManager::DeleteCacheBySize( )
+bool DownloadManager::WriteSpillFile(const std::string& file, const SegmentData& data)
 {
-    uint64_t out_size = CacheGetSize( mCacheDir.c_str() );
-    if (out_size >= mMaxCacheSize) {
-        delete_all_cached_files( mCacheDir.c_str() );
+    FILE* fp = fopen(file.c_str(), "wb");
+    if(!fp)
+    {
+        LOG(WARNING) << "Failed to spill segment to cache folder!" << endl;
+        return false;
+    }
+    size_t written = fwrite(data->GetData(), 1, data->GetSize(), fp);
+    fclose(fp);
+    if(written != data->GetSize())
+    {
+        remove(file.c_str());
+        return false;
     }
+
+    return true;
+}
+
+SegmentData DownloadManager::MapSpilledSegment(const std::string& file, uint64_t size)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if(fd < 0)
+        return NULL;
+
+    void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+        return NULL;
+
+    // the mapping stays valid after the file is deleted
+    return std::make_shared<StreamBuffer>((char*)mapped, size);
 }
 
-static bool delete_cache_files( void *cbck,
-                                std::string item_name,
-                                std::string itemPath )
+std::vector<std::string> DownloadManager::EvictSpilledSegments(uint64_t maxSize)
 {
-    std::string* startPattern;
-    uint32_t sz;
-    if(NULL == cbck ) return false;
-    if( 0 == item_name.size() ) return false;
-    if( 0 == itemPath.size() ) return false;
-
-    startPattern = (std::string *) cbck;
-    sz = (uint32_t) strlen( startPattern->c_str() );
-    if(!strncmp(startPattern->c_str(), item_name.c_str(), sz)) {
-        if( remove(itemPath.c_str()) == 0)
-            return true;
+    std::vector<std::string> files;
+    while(mSpillUsage > maxSize && mSpillLRU.size())
+    {
+        auto oldest = mSpillCache.find(mSpillLRU.back());
+        mSpillLRU.pop_back();
+        mSpillUsage -= oldest->second.size;
+        files.push_back(oldest->second.file);
+        mSpillCache.erase(oldest);
     }
 
-    return false;
+    return files;
 }
 
-void DownloadManager::delete_all_cached_files( std::string directory )
+void DownloadManager::DeleteCacheFiles(const std::vector<std::string>& files)
 {
-    enum_directory( directory.c_str(), false, delete_cache_files, (void*)&mFilePrefix , NULL);
+    for(auto& file: files)
+        DeleteCacheFile(file);
 }
 
-static bool GatherCacheSize( void *cbck,
-                              std::string item_name,
-                              std::string itemPath )
+int DownloadManager::DeleteCacheFile(std::string url)
 {
-    GatherStruct *out = (GatherStruct *)cbck;
-    if (!strncmp(out->prefix.c_str(), item_name.c_str(), out->prefix.size())) {
-        struct stat statbuf;
-        stat( itemPath.c_str(), &statbuf );
-        out->size += statbuf.st_size;
-        return true;
+    if( remove(url.c_str()))
+    {
+
+        LOG(WARNING) << "Failed to delete file in cache ! Be cautious cache may exceed the storage limitation!"<<endl;
+        return ERROR_INVALID;
     }
-    return false;
+    return ERROR_NONE;
 }
 
-uint64_t DownloadManager::CacheGetSize( std::string directory )
+int DownloadManager::SetCacheFolder( std::string cache_dir )
 {
-    GatherStruct gat;
-    gat.prefix = mFilePrefix;
-    gat.size = 0;
+    mCacheDir = cache_dir;
+    if( ( access( mCacheDir.c_str(), 2) ) != -1){
+        DeleteCacheBySize( );
+        return ERROR_NONE;
+    }
+
+    if( -1 == mkdir(mCacheDir.c_str(), 0755) ) return ERROR_INVALID;
 
-    enum_directory(directory.c_str(), false, GatherCacheSize, (void*)&gat, NULL);
-    return gat.size;
+    return ERROR_NONE;
 }
 
-int DownloadManager::enum_directory( const char *dir,
-                           bool enum_directory,
-                           enum_dir_item enumDirFct,
-                           void *cbck,
-                           const char *filter )
+std::string DownloadManager::AssignCacheFileName()
 {
-    unsigned char itemPath[MAX_PATH_COUNT];
-    unsigned char path[MAX_PATH_COUNT], *file;
-    DIR *currentDir;
-    struct dirent* currentFile;
-    struct stat st;
+    pthread_mutex_lock(&mMutex);
+    std::string file_name = GetRandomString(32);
+    pthread_mutex_unlock(&mMutex);
 
-    if (!dir || !enumDirFct)
-        return ERROR_INVALID;
+    return file_name;
+}
 
-    strncpy((char*)path, dir, strlen(dir) + 1);
-    if (path[strlen((const char*)path)-1] != '\\')
-        strncat((char*)path, "\\", strlen("\\"));
+/// get download bit rate
+int DownloadManager::GetImmediateBitrate()
+{
+    return ToKbps(THROUGHPUTESTIMATOR::GetInstance()->GetWindowThroughput());
+}
 
-    currentDir = opendir((char*)path);
-    if (currentDir == NULL)
-        return ERROR_INVALID;
+int DownloadManager::GetAverageBitrate()
+{
+    return ToKbps(THROUGHPUTESTIMATOR::GetInstance()->GetAverageThroughput());
+}
 
-    currentFile = readdir(currentDir);
-    while (currentFile)
-    {
-        if (!strcmp(currentFile->d_name, ".."))
-            goto end;
-        if (currentFile->d_name[0] == '.')
-            goto end;
+int DownloadManager::GetEwmaBitrate()
+{
+    return ToKbps(THROUGHPUTESTIMATOR::GetInstance()->GetEwmaThroughput());
+}
 
-        if (filter)
-        {
-            char *separate = strrchr(currentFile->d_name, '.');
-            if (!separate) goto end;
-            if (!strstr(filter, separate+1)) goto end;
-	    }
-
-        strncpy((char*)itemPath, (const char*)path, strlen((const char*)path) + 1);
-        if(strlen(currentFile->d_name) < 1024 - strlen((const char*)itemPath)) strncat((char*)itemPath, currentFile->d_name, sizeof(currentFile->d_name));
-        if (stat( (const char*)itemPath, &st ) != 0)
-            goto end;
-        if (enum_directory && ( (st.st_mode & S_IFMT) != S_IFDIR))
-        {
-            goto end;
-        }
+int DownloadManager::GetRoundTripTime()
+{
+    return (int)THROUGHPUTESTIMATOR::GetInstance()->GetRTT();
+}
 
-	    if (!enum_directory && ((st.st_mode & S_IFMT) == S_IFDIR))
-            goto end;
-        file = (unsigned char*)currentFile->d_name;
+void DownloadManager::CleanCache()
+{
+    std::vector<std::string> files;
+    {
+        std::lock_guard<std::mutex> lock(mSegCacheMtx);
+        files = EvictSpilledSegments(0);
+    }
+    DeleteCacheFiles(files);
+}
 
-        if (enumDirFct(cbck, (char *)file, (char *)itemPath))
+void DownloadManager::DeleteCacheByTime( uint64_t interval )
+{
+    std::vector<std::string> files;
+    {
+        std::lock_guard<std::mutex> lock(mSegCacheMtx);
+        if (mSpillUsage < mMaxCacheSize)
+            return;
+
+        for(auto it = mSpillCache.begin(); it != mSpillCache.end();)
         {
-            break;
+            if(it->second.spillTime < GetStartTime() + interval)
+            {
+                mSpillLRU.erase(it->second.lruPos);
+                mSpillUsage -= it->second.size;
+                files.push_back(it->second.file);
+                it = mSpillCache.erase(it);
+            }
+            else
+                it++;
         }
-end:
-        currentFile = readdir(currentDir);
     }
+    DeleteCacheFiles(files);
+}
 
-    return ERROR_NONE;
+void DownloadManager::DeleteCacheBySize( )
+{
+    std::vector<std::string> files;
+    {
+        std::lock_guard<std::mutex> lock(mSegCacheMtx);
+        files = EvictSpilledSegments(mMaxCacheSize);
+    }
+    DeleteCacheFiles(files);
 }
 
 std::string DownloadManager::GetRandomString(int size)
@@ -39,11 +39,20 @@
 
 #include "general.h"
 #include <mutex>
-
-typedef bool (*enum_dir_item)(void *cbck, std::string item_name, std::string item_path);
+#include <memory>
+#include <vector>
+#include <list>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
 
 VCD_OMAF_BEGIN
 
+class StreamBuffer;
+
+typedef std::shared_ptr<StreamBuffer> SegmentData;    //<! data of a downloaded segment shared with the cache
+
 class DownloadManager {
 public:
     DownloadManager();
@@ -61,14 +70,14 @@ public:
     void CleanCache();
 
     //!
-    //! \brief  Delete a all cached files from cache with condition that
-    //!         the file time is less than ...
+    //! \brief  Delete the cached files spilled before the start time plus
+    //!         interval, if the total cache size reaches MaxCacheSize
     //!
     void DeleteCacheByTime( uint64_t interval );
 
     //!
-    //! \brief  Delete a all cached files from cache with condition that
-    //!         the total cache size is large thanm MaxCacheSize
+    //! \brief  Delete the least recently used cached files until the total
+    //!         cache size is no larger than MaxCacheSize
     //!
     void DeleteCacheBySize( );
 
@@ -78,15 +87,43 @@ public:
     std::string AssignCacheFileName();
 
     //!
-    //! \brief  Get a downloading bit rate
+    //! \brief  Get a downloaded segment from the segment cache, the segment
+    //!         becomes the most recently used one. A segment spilled to the
+    //!         cache folder is served from a mapping of its file, which is
+    //!         kept as long as the segment is cached.
+    //!
+    //! \return the segment data, or NULL if the url isn't cached
+    //!
+    SegmentData GetCachedSegment(const std::string& url);
+
+    //!
+    //! \brief  Add a downloaded segment to the segment cache, the data is
+    //!         shared and not copied. The least recently used segments over
+    //!         the memory budget are spilled to the cache folder on the spill
+    //!         thread if caching is on, else dropped.
+    //!
+    void CacheSegment(const std::string& url, SegmentData data);
+
+    //!
+    //! \brief  Get a downloading bit rate of the last few seconds in kbps
     //!
     int GetImmediateBitrate();
 
     //!
-    //! \brief  Get an average downloading bit rate
+    //! \brief  Get an average downloading bit rate since the beginning in kbps
     //!
     int GetAverageBitrate();
 
+    //!
+    //! \brief  Get an exponentially weighted moving average downloading bit rate in kbps
+    //!
+    int GetEwmaBitrate();
+
+    //!
+    //! \brief  Get the smoothed round trip time of the requests in ms
+    //!
+    int GetRoundTripTime();
+
     //!
     //! \brief  Get/Set methods for properties
     //!
@@ -101,46 +138,73 @@ public:
     std::string GetFilePrefix()                         { return mFilePrefix;          };
     bool        UseCache()                              { return mUseCache;            };
     void        SetUseCache(bool bCache)                { mUseCache = bCache;          };
+    void        SetMemCacheSize(uint64_t size);
+    uint64_t    GetMemCacheSize()                       { return mMemCacheSize;        };
+    uint64_t    GetMemCacheUsage()                      { return mMemCacheUsage;       };
 
 private:
 
     //!
-    //! \brief  the implementation to delete all files
+    //! \brief  generate a random string for assigning cache file name
     //!
-    void delete_all_cached_files( std::string directory );
+    std::string GetRandomString(int size);
 
     //!
-    //! \brief  the implementation to get cache size
+    //! \brief  evict the least recently used segments until the memory usage
+    //!         is in budget, mSegCacheMtx must be held
     //!
-    uint64_t CacheGetSize( std::string directory );
+    void EvictMemSegments();
 
     //!
-    //! \brief callback to delete file
+    //! \brief  the spill thread, which writes the segments evicted from
+    //!         memory to files in the cache folder
     //!
-    //static bool delete_cache_files( void *cbck,
-    //                         std::string item_name,
-    //                         std::string item_path );
+    void SpillThread();
 
     //!
-    //! \brief  callback to get size of each file
+    //! \brief  write the segment data to the file
     //!
-    //static bool GatherCacheSize( void *cbck,
-    //                      std::string item_name,
-     //                     std::string item_path );
+    bool WriteSpillFile(const std::string& file, const SegmentData& data);
 
     //!
-    //! \brief  enumerate all files in a directory
+    //! \brief  map the file of a spilled segment, mSegCacheMtx must be held
     //!
-    int enum_directory( const char *dir,
-                        bool enum_directory,
-                        enum_dir_item enum_dir_fct,
-                        void *cbck,
-                        const char *filter = NULL);
+    SegmentData MapSpilledSegment(const std::string& file, uint64_t size);
 
     //!
-    //! \brief  generate a random string for assigning cache file name
+    //! \brief  remove the least recently used spilled segments until the
+    //!         total size is no larger than maxSize, mSegCacheMtx must be held
     //!
-    std::string GetRandomString(int size);
+    //! \return the files of the removed segments, to be deleted after
+    //!         mSegCacheMtx is released
+    //!
+    std::vector<std::string> EvictSpilledSegments(uint64_t maxSize);
+
+    //!
+    //! \brief  delete the files of the removed spilled segments
+    //!
+    void DeleteCacheFiles(const std::vector<std::string>& files);
+
+    typedef std::list<std::string>                      CacheLRU;           //<! urls, the most recently used first
+
+    //!
+    //! \brief  one segment in the memory cache
+    //!
+    typedef struct MEMCACHEENTRY{
+        CacheLRU::iterator      lruPos;
+        SegmentData             data;
+    }MemCacheEntry;
+
+    //!
+    //! \brief  one segment spilled to the cache folder
+    //!
+    typedef struct SPILLENTRY{
+        CacheLRU::iterator      lruPos;
+        std::string             file;
+        uint64_t                size;
+        uint64_t                spillTime;    //<! when the segment is spilled, in ms
+        SegmentData             mapped;       //<! the mapping of the file once revisited
+    }SpillEntry;
 
 private:
     int                            mDownloadedBytes;    //<! the total downloaded bytes
@@ -152,7 +216,19 @@ private:
     uint64_t                       mMaxCacheSize;       //<! the threshold of total cache file size
     bool                           mUseCache;           //<! the flag to indicate whether using file caching
     int32_t                        m_count;             //<! count for random file name
-    std::mutex                     mCacheMtx;                //<! mutex for cache clear
+    std::mutex                     mSegCacheMtx;        //<! mutex for the segment cache
+    CacheLRU                       mMemLRU;             //<! LRU order of the segments in memory
+    std::unordered_map<std::string, MemCacheEntry> mMemCache;   //<! segments in memory by url
+    uint64_t                       mMemCacheSize;       //<! the byte budget of the segments in memory
+    uint64_t                       mMemCacheUsage;      //<! the bytes of the segments in memory
+    CacheLRU                       mSpillLRU;           //<! LRU order of the spilled segments
+    std::unordered_map<std::string, SpillEntry> mSpillCache;    //<! spilled segments by url
+    uint64_t                       mSpillUsage;         //<! the bytes of the spilled segments
+    std::deque<std::string>        mSpillQueue;         //<! urls of the segments to spill in order
+    std::unordered_map<std::string, SegmentData> mSpillPending; //<! segments waiting for the spill thread by url
+    std::condition_variable        mSpillCv;            //<! wakes the spill thread
+    std::thread                    mSpillThread;        //<! the thread writing spilled segments
+    bool                           mSpillStop;          //<! the flag to stop the spill thread
 };
 
 typedef VCD::VRVideo::Singleton<DownloadManager> DOWNLOADMANAGER;    //<! singleton of DownloadManager
@@ -39,21 +39,116 @@
 
 #include "general.h"
 #include "OmafMediaStream.h"
+#include <mutex>
+#include <map>
+#include <vector>
+#include <memory>
+#include <algorithm>
 
 VCD_OMAF_BEGIN
 
+#define POOL_MIN_BUFFER_SIZE   4096
+#define POOL_MAX_FREE_BUFFERS  16
+
+//!
+//! \brief  recycles the payload buffers of the packets of one track. Buffers
+//!         are kept in size classes of 2^n and 1.5*2^n bytes, so a packet never
+//!         wastes more than a third of its buffer
+//!
+class PacketBufferPool {
+public:
+    PacketBufferPool(){};
+
+    ~PacketBufferPool(){
+        for(auto& it : m_freeBuffers){
+            for(auto buf : it.second)
+                free(buf);
+        }
+        m_freeBuffers.clear();
+    };
+
+    //!
+    //! \brief  get the size class which holds size bytes
+    //!
+    static int ClassSize(int size){
+        if(size <= POOL_MIN_BUFFER_SIZE) return POOL_MIN_BUFFER_SIZE;
+
+        int classSize = POOL_MIN_BUFFER_SIZE;
+        while(classSize < size) classSize <<= 1;
+        int halfStep = (classSize >> 1) + (classSize >> 2);
+        return size <= halfStep ? halfStep : classSize;
+    };
+
+    //!
+    //! \brief  get a buffer of at least size bytes, the content is not initialized
+    //!
+    //! \param  [in] size
+    //!         the size needed
+    //! \param  [out] allocSize
+    //!         the real size of the buffer
+    //!
+    //! \return
+    //!         the buffer, NULL if failed
+    //!
+    char* Acquire(int size, int& allocSize){
+        allocSize = ClassSize(size);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_freeBuffers.find(allocSize);
+            if(it != m_freeBuffers.end() && !it->second.empty()){
+                char* buf = it->second.back();
+                it->second.pop_back();
+                return buf;
+            }
+        }
+        char* buf = (char*)malloc(allocSize);
+        if(NULL == buf) allocSize = 0;
+        return buf;
+    };
+
+    //!
+    //! \brief  give back a buffer got from Acquire, it is freed if too many
+    //!         buffers of its size class are already kept
+    //!
+    void Release(char* buf, int allocSize){
+        if(NULL == buf) return;
+        if(ClassSize(allocSize) == allocSize){
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<char*>& freeList = m_freeBuffers[allocSize];
+            if(freeList.size() < POOL_MAX_FREE_BUFFERS){
+                freeList.push_back(buf);
+                return;
+            }
+        }
+        free(buf);
+    };
+
+    //!
+    //! \brief  get the number of free buffers kept of a size class
+    //!
+    int GetFreeCount(int allocSize){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_freeBuffers.find(allocSize);
+        return it != m_freeBuffers.end() ? (int)it->second.size() : 0;
+    };
+
+private:
+    std::mutex                          m_mutex;        //!<lock for the free lists
+    std::map<int, std::vector<char*>>   m_freeBuffers;  //!<free buffers of each size class
+};
+
 class MediaPacket {
 public:
     //!
     //! \brief  construct
     //!
     MediaPacket(){
+        m_pBuffer = NULL;
         m_pPayload = NULL;
         m_nAllocSize = 0;
         m_type = -1;
         mPts = 0;
         m_nRealSize = 0;
-        m_rwpk = NULL;
     };
 
     //!
@@ -64,23 +159,20 @@ public:
         memcpy(m_pPayload, buf, size);
         m_type = -1;
         mPts = 0;
-        m_rwpk = NULL;
     };
 
     //!
     //! \brief  de-construct
     //!
     virtual ~MediaPacket(){
-        if( NULL != m_pPayload ){
-            free(m_pPayload);
-            m_pPayload = NULL;
+        if( NULL != m_pBuffer ){
+            FreePayload();
             m_nAllocSize = 0;
             m_type = -1;
             mPts = 0;
             m_nRealSize = 0;
         }
-        if (m_rwpk != NULL)
-            deleteRwpk();
+        m_rwpk.reset();
     };
 
     //!
@@ -95,17 +187,13 @@ public:
     //!         size of new allocated packet
     //!
     int AllocatePacket(int size, char fill = 0){
-        if( NULL != m_pPayload ){
-            free(m_pPayload);
-            m_pPayload = NULL;
-            m_nAllocSize = 0;
+        if( NULL != m_pBuffer ){
+            FreePayload();
         }
 
-        m_pPayload = (char*)malloc( size );
-
-        if(NULL == m_pPayload) return -1;
+        if( AcquireBuffer( size ) < 0 ) return -1;
 
-        m_nAllocSize = size;
+        m_pPayload = m_pBuffer;
         memset(m_pPayload, fill, m_nAllocSize );
         m_nRealSize = 0;
         return size;
@@ -135,27 +223,136 @@ public:
     //!         size of new allocated packet
     //!
     int ReAllocatePacket(int size){
-        if(NULL==m_pPayload)
+        if(NULL==m_pBuffer)
             return AllocatePacket(size);
 
-        if( size < m_nAllocSize )
+        int oldSize = GetAllocSize();
+        if( size < oldSize )
             return AllocatePacket(size);
 
-        char* buf = m_pPayload;
+        char* buf = m_pBuffer;
+        char* payload = m_pPayload;
+        int   bufSize = m_nAllocSize;
 
-        m_pPayload = (char*)malloc( size );
+        m_pBuffer = (char*)malloc( size );
 
-        if(NULL == m_pPayload) return -1;
+        if(NULL == m_pBuffer){
+            m_pBuffer = buf;
+            return -1;
+        }
 
-        memcpy(m_pPayload, buf, m_nAllocSize);
+        memcpy(m_pBuffer, payload, oldSize);
 
-        free(buf);
+        ReleaseBuffer(buf, bufSize);
 
+        m_pPayload = m_pBuffer;
         m_nAllocSize = size;
         m_nRealSize = 0;
         return 0;
     };
 
+    //!
+    //! \brief  make sure the payload buffer holds at least size bytes after headroom
+    //!         bytes kept free in front of it. The buffer is kept if it is large
+    //!         enough, otherwise a new one is taken from the pool. Neither the old
+    //!         data is kept nor the buffer is filled
+    //!
+    //! \param  [in] size
+    //!         the payload size needed
+    //! \param  [in] headroom
+    //!         the room reserved before the payload for PrependData
+    //!
+    //! \return
+    //!         size of the payload buffer, -1 if failed
+    //!
+    int ReservePacket(int size, int headroom = 0){
+        if( NULL != m_pBuffer && headroom + size <= m_nAllocSize ){
+            m_pPayload = m_pBuffer + headroom;
+            m_nRealSize = 0;
+            return GetAllocSize();
+        }
+
+        if( NULL != m_pBuffer ){
+            FreePayload();
+        }
+
+        if( AcquireBuffer( headroom + size ) < 0 ) return -1;
+
+        m_pPayload = m_pBuffer + headroom;
+        m_nRealSize = 0;
+        return GetAllocSize();
+    };
+
+    //!
+    //! \brief  read a sample into the payload buffer reserved by ReservePacket. The
+    //!         sample is read by read(payload, size), with size set to the buffer
+    //!         size and set back to the sample size. While the buffer is reported
+    //!         too small, it grows to the size required, or doubles up to maxSize
+    //!         if the size required is unknown, and the sample is read again
+    //!
+    //! \param  [in] read
+    //!         the function reading the sample, returns OMAF_MEMORY_TOO_SMALL_BUFFER
+    //!         if the buffer is too small
+    //! \param  [in] headroom
+    //!         the room reserved before the payload when the buffer grows
+    //! \param  [in] maxSize
+    //!         the largest payload size to grow to
+    //! \param  [out] size
+    //!         the size of the sample read
+    //!
+    //! \return
+    //!         the last result of read
+    //!
+    template<typename ReadFunc>
+    int ReadPayload(ReadFunc read, int headroom, uint32_t maxSize, uint32_t& size){
+        int ret = OMAF_ERROR_NULL_PTR;
+        while( NULL != m_pPayload ){
+            uint32_t allocSize = GetAllocSize();
+            size = allocSize;
+            ret = read(m_pPayload, size);
+            if( ret != OMAF_MEMORY_TOO_SMALL_BUFFER )
+                break;
+
+            uint32_t newSize = size > allocSize ? size : std::min(allocSize * 2, maxSize);
+            if( newSize <= allocSize || ReservePacket(newSize, headroom) < 0 )
+                break;
+        }
+        return ret;
+    };
+
+    //!
+    //! \brief  put data in front of the payload, using the headroom reserved by
+    //!         ReservePacket, so the payload is not moved
+    //!
+    //! \return
+    //!         true if the data is put, false if the headroom is too small
+    //!
+    bool PrependData(const char* data, int size){
+        if( NULL == m_pPayload || size > GetHeadroom() ) return false;
+
+        m_pPayload -= size;
+        memcpy(m_pPayload, data, size);
+        m_nRealSize += size;
+        return true;
+    };
+
+    //!
+    //! \brief  get the size the payload buffer can hold
+    //!
+    int GetAllocSize(){ return m_pBuffer ? m_nAllocSize - GetHeadroom() : 0; };
+
+    //!
+    //! \brief  get the free room before the payload
+    //!
+    int GetHeadroom(){ return (int)(m_pPayload - m_pBuffer); };
+
+    //!
+    //! \brief  Set the pool the payload buffer is taken from and given back to.
+    //!         It should be set before the buffer is allocated
+    //!
+    void SetPool(std::shared_ptr<PacketBufferPool> pool){ m_pool = pool; };
+    std::shared_ptr<PacketBufferPool> GetPool(){ return m_pool; };
+
     //!
     //! \brief  Set the type for packet
     //!
@@ -178,30 +375,78 @@ public:
     void SetRealSize(uint64_t realSize) { m_nRealSize = realSize; };
     uint64_t GetRealSize() { return m_nRealSize; };
 
-    void SetRwpk(RegionWisePacking *rwpk) { m_rwpk = rwpk; };
-    RegionWisePacking* GetRwpk() { return m_rwpk; };
+    //!
+    //! \brief  Set the region wise packing, the packet takes the ownership of it
+    //!
+    void SetRwpk(RegionWisePacking *rwpk) { m_rwpk = std::shared_ptr<RegionWisePacking>(rwpk, DeleteRwpk); };
+    RegionWisePacking* GetRwpk() { return m_rwpk.get(); };
+
+    //!
+    //! \brief  Set the region wise packing shared with other packets, such as the
+    //!         packets of the same segment
+    //!
+    void SetSharedRwpk(std::shared_ptr<RegionWisePacking> rwpk) { m_rwpk = rwpk; };
+    std::shared_ptr<RegionWisePacking> GetSharedRwpk() { return m_rwpk; };
+
+    //!
+    //! \brief  release a region wise packing and its regions
+    //!
+    static void DeleteRwpk(RegionWisePacking *rwpk)
+    {
+        if (rwpk != NULL)
+        {
+            if (rwpk->rectRegionPacking != NULL)
+            {
+                delete []rwpk->rectRegionPacking;
+                rwpk->rectRegionPacking = NULL;
+            }
+            delete rwpk;
+        }
+    }
 
 private:
+    char* m_pBuffer;                     //!<the allocated buffer, the payload may start after some headroom
     char* m_pPayload;                    //!<the payload buffer of the packet
-    int   m_nAllocSize;                  //!<the allocated size of packet
+    int   m_nAllocSize;                  //!<the allocated size of m_pBuffer
     uint64_t m_nRealSize;                //!< real size of packet
     int   m_type;                        //!<the type of the payload
     uint64_t mPts;
-    RegionWisePacking *m_rwpk;
+    std::shared_ptr<RegionWisePacking> m_rwpk;  //!<the region wise packing, may be shared by packets
+    std::shared_ptr<PacketBufferPool> m_pool;   //!<the pool of the payload buffer, NULL if it is malloced
 
-    void deleteRwpk()
+    int AcquireBuffer(int size)
     {
-        if (m_rwpk != NULL)
-        {
-            if (m_rwpk->rectRegionPacking != NULL)
-            {
-                delete []m_rwpk->rectRegionPacking;
-                m_rwpk->rectRegionPacking = NULL;
-            }
-            delete m_rwpk;
-            m_rwpk = NULL;
+        if( m_pool ){
+            m_pBuffer = m_pool->Acquire( size, m_nAllocSize );
+        }else{
+            m_pBuffer = (char*)malloc( size );
+            m_nAllocSize = size;
+        }
+
+        if(NULL == m_pBuffer){
+            m_pPayload = NULL;
+            m_nAllocSize = 0;
+            return -1;
+        }
+        return m_nAllocSize;
+    }
+
+    void ReleaseBuffer(char* buf, int size)
+    {
+        if( m_pool ){
+            m_pool->Release(buf, size);
+        }else{
+            free(buf);
         }
     }
+
+    void FreePayload()
+    {
+        ReleaseBuffer(m_pBuffer, m_nAllocSize);
+        m_pBuffer = NULL;
+        m_pPayload = NULL;
+        m_nAllocSize = 0;
+    }
 };
 
 VCD_OMAF_END;
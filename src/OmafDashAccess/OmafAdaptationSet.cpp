@@ -64,6 +64,7 @@ OmafAdaptationSet::OmafAdaptationSet()
     mType              = MediaType_NONE;
     mFpt               = FP_UNKNOWN;
     mRwpkType          = RWPK_UNKNOWN;
+    mPriority          = PRIORITY_VIEWPORT;
     memset(&mVideoInfo, 0, sizeof(VideoInfo));
     memset(&mAudioInfo, 0, sizeof(AudioInfo));
     pthread_mutex_init(&mMutex, NULL);
@@ -341,7 +342,7 @@ int OmafAdaptationSet::DownloadInitializeSegment()
     return ret;
 }
 
-int OmafAdaptationSet::DownloadSegment( )
+int OmafAdaptationSet::DownloadSegment( uint32_t deadline )
 {
     int ret = ERROR_NONE;
 
@@ -383,7 +384,7 @@ int OmafAdaptationSet::DownloadSegment( )
 
     pSegment->SetInitSegID(this->mInitSegment->GetInitSegID());
 
-    ret = pSegment->Open();
+    ret = DOWNLOADSCHEDULER::GetInstance()->AddSegment(pSegment, this, deadline);
 
     if( ERROR_NONE != ret ){
         SAFE_DELETE(pSegment);
@@ -391,7 +392,7 @@ int OmafAdaptationSet::DownloadSegment( )
                    << endl;
     }
 
-    LOG(INFO)<<"Download OmafSegment for AdaptationSet "<<this->mID<<endl;
+    LOG(INFO)<<"Schedule OmafSegment for AdaptationSet "<<this->mID<<endl;
 
     pthread_mutex_lock(&mMutex);
     // NOTE: won't record segments in adaption set since GetNextSegment() not be called
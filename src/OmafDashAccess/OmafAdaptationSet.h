@@ -38,6 +38,7 @@
 
 #include "general.h"
 #include "OmafSegment.h"
+#include "OmafDownloadScheduler.h"
 #include "OmafDashParser/BaseUrlElement.h"
 #include "OmafDashParser/AdaptationSetElement.h"
 #include "OmafDashParser/DescriptorElement.h"
@@ -88,9 +89,11 @@ public:
     int DownloadInitializeSegment();
 
     //!
-    //! \brief  Download Segment for reading.
+    //! \brief  Download Segment for reading. The segment is queued in download
+    //!         scheduler which starts it by priority before the deadline
+    //! \param  deadline, the sys_clock time in ms the segment is needed by
     //!
-    int DownloadSegment( );
+    int DownloadSegment( uint32_t deadline );
 
     //!
     //! \brief  Select representation from
@@ -149,6 +152,7 @@ public:
     uint32_t                  GetStartNumber()                             { return mStartNumber;         };
     std::string               GetRepresentationId()                        { return mRepresentation->GetId(); };
     uint32_t                  GetRepresentationQualityRanking()            { return stoi(mRepresentation->GetQualityRanking());};
+    uint32_t                  GetRepresentationBandwidth()                 { return mRepresentation ? mRepresentation->GetBandwidth() : 0;};
     int                       Enable( bool bEnable )
     {
         mEnableRecord.push_back(bEnable);
@@ -165,6 +169,8 @@ public:
         return 0;
     };
     bool                      IsEnabled()                                  { return mEnable;              };
+    void                      SetDownloadPriority(DownloadPriority priority) { mPriority = priority;        };
+    DownloadPriority          GetDownloadPriority()                        { return mPriority;            };
 
     virtual OmafAdaptationSet* GetClassType(){
         return this;
@@ -219,6 +225,7 @@ protected:
     bool                                  mEnable;           //<! is Adaptation Set enabled
     bool                                  mReEnable;         //<! flag for Adaption Set is re-enabled
     std::list<bool>                       mEnableRecord;     //<! record the last 3 enable changes
+    DownloadPriority                      mPriority;         //<! the priority to download segments
 };
 
 VCD_OMAF_END;
@@ -109,7 +109,8 @@ int OmafAccess_GetMediaInfo( Handler hdl, DashMediaInfo* info );
 /*
  * description: API to get packets according to stream id in the dash media. As for viewport-based
  * Tile dashing streaming with low Resolution video, the packet is composed of viewport
- * -wise tiles and low-res tiles.
+ * -wise tiles and low-res tiles. If no packet is ready, it waits a few milliseconds
+ * for the next packet before returning none.
  * params: hdl - [in]handler created with DashStreaming_Init
  *         stream_id - [in] the stream id the packet is gotten from
  *         size - [out] the size of gotten packet;
@@ -30,7 +30,10 @@
 //! \brief:  downloader class with libcurl
 //!
 
+#include <strings.h>
 #include "OmafCurlDownloader.h"
+#include "../DownloadManager.h"
+#include "OmafThroughputEstimator.h"
 
 VCD_OMAF_BEGIN
 
@@ -40,7 +43,6 @@ OmafCurlDownloader::OmafCurlDownloader()
     m_downloadRate = 0;
     m_endTime      = 0;
     m_startTime    = 0;
-    m_curlHandler  = NULL;
 }
 
 OmafCurlDownloader::OmafCurlDownloader(string url):OmafCurlDownloader()
@@ -58,22 +60,6 @@ OmafCurlDownloader::~OmafCurlDownloader()
     }
 }
 
-ODStatus OmafCurlDownloader::InitCurl()
-{
-    curl_global_init(CURL_GLOBAL_ALL);
-
-    m_curlHandler = curl_easy_init();
-    CheckNullPtr_PrintLog_ReturnStatus(m_curlHandler, "failed to init curl library.", ERROR, OD_STATUS_OPERATION_FAILED);
-
-    curl_easy_setopt(m_curlHandler, CURLOPT_URL, m_url.c_str());
-    curl_easy_setopt(m_curlHandler, CURLOPT_SSL_VERIFYPEER, 0L);
-    curl_easy_setopt(m_curlHandler, CURLOPT_SSL_VERIFYHOST, 0L);
-    curl_easy_setopt(m_curlHandler, CURLOPT_WRITEFUNCTION, CallBackForCurl);
-    curl_easy_setopt(m_curlHandler, CURLOPT_WRITEDATA, (void*)this);
-    return OD_STATUS_SUCCESS;
-}
-
-
 ODStatus OmafCurlDownloader::Start()
 {
     ODStatus st = OD_STATUS_SUCCESS;
@@ -81,23 +67,44 @@ ODStatus OmafCurlDownloader::Start()
     if(GetStatus() != NOT_START)
         return OD_STATUS_INVALID;
 
-    st = InitCurl();
-    CheckAndReturn(st);
-
-    StartThread(true);
-
     m_startTime = chrono::duration_cast<std::chrono::milliseconds>(m_clock.now().time_since_epoch()).count();
 
     SetStatus(DOWNLOADING);
 
+    // a segment revisited on seek or viewport return is served from the cache
+    SegmentData cached = DOWNLOADMANAGER::GetInstance()->GetCachedSegment(m_url);
+    if(cached && m_stream.AttachBuffer(cached) == OD_STATUS_SUCCESS)
+    {
+        NotifyDownloadedData();
+        SetStatus(DOWNLOADED);
+        return OD_STATUS_SUCCESS;
+    }
+
+    st = CURLENGINE::GetInstance()->AddTransfer(this);
+    if(st != OD_STATUS_SUCCESS)
+    {
+        m_stream.ReachedEOS();
+        SetStatus(STOPPED);
+    }
+
     return st;
 }
 
 ODStatus OmafCurlDownloader::Stop()
 {
+    DownloaderStatus status = GetStatus();
+    if(status == STOPPED || status == DOWNLOADED)
+        return OD_STATUS_SUCCESS;
+
+    if(status == NOT_START)
+    {
+        m_stream.ReachedEOS();
+        SetStatus(STOPPED);
+        return OD_STATUS_SUCCESS;
+    }
+
     this->SetStatus(STOPPING);
-    this->Join();
-    return OD_STATUS_SUCCESS;
+    return CURLENGINE::GetInstance()->RemoveTransfer(this);
 }
 
 ODStatus OmafCurlDownloader::Read(uint8_t* data, size_t size)
@@ -115,29 +122,42 @@ ODStatus OmafCurlDownloader::Peek(uint8_t* data, size_t size, size_t offset)
     return m_stream.PeekStream((char*)data, size, offset);
 }
 
-void* OmafCurlDownloader::Download(void* downloader)
+ODStatus OmafCurlDownloader::GetDataView(const uint8_t** data, size_t* size)
 {
-    OmafCurlDownloader* curlDownloader = static_cast<OmafCurlDownloader*>(downloader);
-    LOG(INFO)<<"now download "<<curlDownloader->m_url<<endl;
-    curl_easy_perform(curlDownloader->m_curlHandler);
-    curl_easy_cleanup(curlDownloader->m_curlHandler);
-    curl_global_cleanup();
-
-    if(curlDownloader->GetStatus() == STOPPING)
-        curlDownloader->SetStatus(STOPPED);
-    else
+    CheckNullPtr_PrintLog_ReturnStatus(data, "the data pointer is null!", ERROR, OD_STATUS_INVALID);
+    CheckNullPtr_PrintLog_ReturnStatus(size, "the size pointer is null!", ERROR, OD_STATUS_INVALID);
+
+    const char* streamData = NULL;
+    uint64_t streamLen = 0;
+    ODStatus st = m_stream.GetStreamView(&streamData, &streamLen);
+    CheckAndReturn(st);
+
+    *data = (const uint8_t*)streamData;
+    *size = (size_t)streamLen;
+
+    return OD_STATUS_SUCCESS;
+}
+
+void OmafCurlDownloader::TransferDone(CURLcode result, long responseCode)
+{
+    if(result != CURLE_OK && GetStatus() != STOPPING)
     {
-        curlDownloader->SetStatus(DOWNLOADED);
+        LOG(WARNING)<<"failed to download "<<m_url<<" : "<<curl_easy_strerror(result)<<endl;
     }
 
+    // the stream is complete before the observers know it's downloaded
     m_stream.ReachedEOS();
 
-    return nullptr;
-}
+    // the cache shares the buffer of the stream
+    if(result == CURLE_OK && responseCode / 100 == 2)
+        DOWNLOADMANAGER::GetInstance()->CacheSegment(m_url, m_stream.GetBuffer());
 
-void OmafCurlDownloader::Run()
-{
-    Download(this);
+    if(GetStatus() == STOPPING)
+        SetStatus(STOPPED);
+    else
+    {
+        SetStatus(DOWNLOADED);
+    }
 }
 
 ODStatus OmafCurlDownloader::ObserverAttach(OmafDownloaderObserver *observer)
@@ -195,15 +215,13 @@ ODStatus OmafCurlDownloader::NotifyDownloadedData()
 
 ODStatus OmafCurlDownloader::CleanUp()
 {
-    // make sure downloader is stopped or wait time is more than 10 mins
-    int64_t waitTime = 0;
-    while(m_status != STOPPED && waitTime < 6000000)
-    {
-        usleep(100);
-        waitTime++;
-    }
+    // make sure the engine won't call back into the downloader any more. It
+    // only waits while the engine holds the transfer, a finished or cached
+    // one returns at once
+    if(GetStatus() == NOT_START)
+        return OD_STATUS_SUCCESS;
 
-    return OD_STATUS_SUCCESS;
+    return CURLENGINE::GetInstance()->RemoveTransfer(this);
 }
 
 size_t OmafCurlDownloader::CallBackForCurl(void* downloadedData, size_t dataSize, size_t typeSize, void* handle)
@@ -214,9 +232,10 @@ size_t OmafCurlDownloader::CallBackForCurl(void* downloadedData, size_t dataSize
         return 0;
 
     size_t size = dataSize * typeSize;
-    char* data = new char[size];
-    memcpy(data, downloadedData, size);
-    curlDownloder->m_stream.AddSubStream(data, size);
+    if(curlDownloder->m_stream.AddSubStream((const char*)downloadedData, size) != OD_STATUS_SUCCESS)
+        return 0;
+
+    THROUGHPUTESTIMATOR::GetInstance()->BytesReceived(size);
 
     // notify all the observers that more data is downloaded
     curlDownloder->NotifyDownloadedData();
@@ -230,6 +249,25 @@ size_t OmafCurlDownloader::CallBackForCurl(void* downloadedData, size_t dataSize
     return size;
 }
 
+size_t OmafCurlDownloader::HeaderCallBackForCurl(char* header, size_t dataSize, size_t typeSize, void* handle)
+{
+    OmafCurlDownloader* curlDownloder = (OmafCurlDownloader*) handle;
+    size_t size = dataSize * typeSize;
+
+    const char contentLength[] = "content-length:";
+    size_t keyLen = sizeof(contentLength) - 1;
+    if(size <= keyLen || strncasecmp(header, contentLength, keyLen))
+        return size;
+
+    // the header line isn't null-terminated
+    string value(header + keyLen, size - keyLen);
+    uint64_t length = strtoull(value.c_str(), NULL, 10);
+    if(length)
+        curlDownloder->m_stream.Reserve(length);
+
+    return size;
+}
+
 ODStatus OmafCurlDownloader::SetStatus(DownloaderStatus status)
 {
     ODStatus ret = OD_STATUS_SUCCESS;
@@ -36,6 +36,7 @@
 #include <curl/curl.h>
 #include "OmafDownloader.h"
 #include "Stream.h"
+#include "OmafCurlEngine.h"
 #include "../OmafDashParser/SegmentElement.h"
 
 VCD_USE_VRVIDEO;
@@ -44,9 +45,9 @@ VCD_OMAF_BEGIN
 
 //!
 //! \class:  OmafCurlDownloader
-//! \brief:  downloader with libcurl
+//! \brief:  downloader with libcurl, the transfer runs in the shared OmafCurlEngine
 //!
-class OmafCurlDownloader: public OmafDownloader, ThreadLock, Threadable
+class OmafCurlDownloader: public OmafDownloader, ThreadLock
 {
 public:
 
@@ -122,6 +123,20 @@ public:
     //!
     virtual ODStatus Peek(uint8_t* data, size_t size, size_t offset);
 
+    //!
+    //! \brief    Get a view of the downloaded stream without copying, it waits
+    //!           until the download is over
+    //!
+    //! \param    [out] data
+    //!           pointer to the downloaded data, valid until the downloader is destroyed
+    //! \param    [out] size
+    //!           size of the downloaded data
+    //!
+    //! \return   ODStatus
+    //!           OD_STATUS_SUCCESS if success, else fail reason
+    //!
+    virtual ODStatus GetDataView(const uint8_t** data, size_t* size);
+
     //!
     //! \brief    Attach download observer
     //!
@@ -152,13 +167,10 @@ public:
     //!
     virtual double GetDownloadRate();
 
-    //!
-    //! \brief Interface implementation from base class: Threadable
-    //!
-    virtual void Run();
-
 private:
 
+    friend class OmafCurlEngine;
+
     //!
     //! \brief    Notify observers the status has changed
     //!
@@ -175,14 +187,6 @@ private:
     //!
     ODStatus NotifyDownloadedData();
 
-    //!
-    //! \brief    Initialize curl library
-    //!
-    //! \return   ODStatus
-    //!           OD_STATUS_SUCCESS if success, else fail reason
-    //!
-    ODStatus InitCurl();
-
     //!
     //! \brief    Clean up curl related resources
     //!
@@ -209,14 +213,34 @@ private:
     static size_t CallBackForCurl(void* downloadedData, size_t dataSize, size_t typeSize, void* handle);
 
     //!
-    //! \brief    Download run in thread
+    //! \brief    Header callback function for curl, the stream buffer is
+    //!           reserved when Content-Length is received
+    //!
+    //! \param    [in] header
+    //!           pointer to one header line, not null-terminated
+    //! \param    [in] dataSize
+    //!           size of data
+    //! \param    [in] typeSize
+    //!           size of data type
+    //! \param    [in] handle
+    //!           handle for this class
+    //!
+    //! \return   size_t
+    //!           the handled size
+    //!
+    static size_t HeaderCallBackForCurl(char* header, size_t dataSize, size_t typeSize, void* handle);
+
+    //!
+    //! \brief    Called by the curl engine when the transfer is over
     //!
-    //! \param    [in] downloader
-    //!           the downloader handle
+    //! \param    [in] result
+    //!           the result of the transfer
+    //! \param    [in] responseCode
+    //!           the HTTP response code, 0 if no response
     //!
     //! \return   void
     //!
-    void* Download(void* downloader);
+    void TransferDone(CURLcode result, long responseCode);
 
     //!
     //! \brief    Set download status
@@ -252,7 +276,6 @@ private:
     ThreadLock                              m_statusLock;   //!< locker for status
     ThreadLock                              m_observerLock; //!< locker for observers
     Stream                                  m_stream;       //!< download stream
-    CURL*                                   m_curlHandler;  //!< curl handle
     string                                  m_url;          //!< download url
 
     chrono::high_resolution_clock           m_clock;        //!< clock for calculating rate
@@ -0,0 +1,358 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+//!
+//! \file:   OmafCurlEngine.cpp
+//! \brief:  shared curl multi engine driving all segment downloads
+//!
+
+#include <fcntl.h>
+#include <algorithm>
+#include "OmafCurlEngine.h"
+#include "OmafCurlDownloader.h"
+#include "OmafThroughputEstimator.h"
+
+// the idle easy handles kept for reuse
+#define MAX_IDLE_HANDLES 32
+// the idle connections kept alive by the multi handle
+#define MAX_CACHED_CONNECTIONS 64
+// the longest wait in curl_multi_wait when nothing happens, in ms
+#define MAX_WAIT_TIME 1000
+
+VCD_OMAF_BEGIN
+
+OmafCurlEngine::OmafCurlEngine()
+{
+    m_stop = false;
+    m_engineThread = 0;
+    m_wakeupPipe[0] = -1;
+    m_wakeupPipe[1] = -1;
+
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    m_multiHandle = curl_multi_init();
+    if(!m_multiHandle)
+    {
+        LOG(ERROR)<<"failed to init curl multi handle."<<endl;
+        return;
+    }
+    curl_multi_setopt(m_multiHandle, CURLMOPT_MAXCONNECTS, (long)MAX_CACHED_CONNECTIONS);
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    // multiplex the tiles on one HTTP/2 connection when the server supports it
+    curl_multi_setopt(m_multiHandle, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+#endif
+
+    if(pipe(m_wakeupPipe))
+    {
+        LOG(ERROR)<<"failed to create the wake up pipe for curl engine."<<endl;
+        m_wakeupPipe[0] = -1;
+        m_wakeupPipe[1] = -1;
+        return;
+    }
+    fcntl(m_wakeupPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(m_wakeupPipe[1], F_SETFL, O_NONBLOCK);
+
+    StartThread(false);
+}
+
+OmafCurlEngine::~OmafCurlEngine()
+{
+    if(m_multiHandle && m_wakeupPipe[0] >= 0)
+    {
+        m_requestMutex.lock();
+        m_stop = true;
+        m_requestMutex.unlock();
+        WakeUp();
+        Join();
+    }
+
+    for(auto handle: m_idleHandles)
+    {
+        curl_easy_cleanup(handle);
+    }
+    m_idleHandles.clear();
+
+    if(m_multiHandle)
+    {
+        curl_multi_cleanup(m_multiHandle);
+        m_multiHandle = NULL;
+    }
+    if(m_wakeupPipe[0] >= 0)
+    {
+        close(m_wakeupPipe[0]);
+        close(m_wakeupPipe[1]);
+    }
+
+    curl_global_cleanup();
+}
+
+ODStatus OmafCurlEngine::AddTransfer(OmafCurlDownloader* downloader)
+{
+    if(!downloader)
+        return OD_STATUS_INVALID;
+    CheckNullPtr_PrintLog_ReturnStatus(m_multiHandle, "curl engine is not initialized.", ERROR, OD_STATUS_OPERATION_FAILED);
+
+    m_requestMutex.lock();
+    if(m_stop)
+    {
+        m_requestMutex.unlock();
+        return OD_STATUS_INVALID;
+    }
+    m_pendingAdds.push_back(downloader);
+    m_activeTransfers.insert(downloader);
+    m_requestMutex.unlock();
+
+    WakeUp();
+
+    return OD_STATUS_SUCCESS;
+}
+
+ODStatus OmafCurlEngine::RemoveTransfer(OmafCurlDownloader* downloader)
+{
+    if(!downloader)
+        return OD_STATUS_INVALID;
+
+    unique_lock<mutex> lock(m_requestMutex);
+    if(m_stop)
+        return OD_STATUS_SUCCESS;
+
+    // finished, served from the cache or never started, nothing to wait for
+    if(m_activeTransfers.find(downloader) == m_activeTransfers.end())
+        return OD_STATUS_SUCCESS;
+
+    m_pendingRemoves.push_back(downloader);
+    WakeUp();
+
+    // can't wait for itself, the engine removes it in the next loop
+    if(pthread_equal(pthread_self(), m_engineThread))
+        return OD_STATUS_SUCCESS;
+
+    m_removedCv.wait(lock, [&]{
+        return m_stop || m_activeTransfers.find(downloader) == m_activeTransfers.end();
+    });
+
+    return OD_STATUS_SUCCESS;
+}
+
+CURL* OmafCurlEngine::AcquireHandle()
+{
+    if(m_idleHandles.size())
+    {
+        CURL* handle = m_idleHandles.front();
+        m_idleHandles.pop_front();
+        return handle;
+    }
+
+    return curl_easy_init();
+}
+
+void OmafCurlEngine::ReleaseHandle(CURL* handle)
+{
+    if(m_idleHandles.size() >= MAX_IDLE_HANDLES)
+    {
+        curl_easy_cleanup(handle);
+        return;
+    }
+
+    // reset keeps the dns and tls session caches of the handle
+    curl_easy_reset(handle);
+    m_idleHandles.push_back(handle);
+}
+
+ODStatus OmafCurlEngine::StartTransfer(OmafCurlDownloader* downloader)
+{
+    CURL* handle = AcquireHandle();
+    CheckNullPtr_PrintLog_ReturnStatus(handle, "failed to init curl easy handle.", ERROR, OD_STATUS_OPERATION_FAILED);
+
+    LOG(INFO)<<"now download "<<downloader->m_url<<endl;
+
+    curl_easy_setopt(handle, CURLOPT_URL, downloader->m_url.c_str());
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, OmafCurlDownloader::CallBackForCurl);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*)downloader);
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, OmafCurlDownloader::HeaderCallBackForCurl);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, (void*)downloader);
+    curl_easy_setopt(handle, CURLOPT_PRIVATE, (void*)downloader);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+#if LIBCURL_VERSION_NUM >= 0x072f00
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    // wait for a connection to multiplex on instead of opening a new one
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+#endif
+
+    if(curl_multi_add_handle(m_multiHandle, handle) != CURLM_OK)
+    {
+        LOG(ERROR)<<"failed to add "<<downloader->m_url<<" to curl engine."<<endl;
+        ReleaseHandle(handle);
+        return OD_STATUS_OPERATION_FAILED;
+    }
+    m_transfers[handle] = downloader;
+    THROUGHPUTESTIMATOR::GetInstance()->TransferStarted();
+
+    return OD_STATUS_SUCCESS;
+}
+
+void OmafCurlEngine::FinishTransfer(CURL* handle, CURLcode result)
+{
+    auto it = m_transfers.find(handle);
+    if(it == m_transfers.end())
+        return;
+
+    OmafCurlDownloader* downloader = it->second;
+    m_transfers.erase(it);
+
+    long responseCode = 0;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &responseCode);
+
+    double requestTime = 0;
+    double firstByteTime = 0;
+    curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME, &requestTime);
+    curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME, &firstByteTime);
+    THROUGHPUTESTIMATOR::GetInstance()->TransferFinished(requestTime, firstByteTime);
+
+    curl_multi_remove_handle(m_multiHandle, handle);
+    ReleaseHandle(handle);
+
+    downloader->TransferDone(result, responseCode);
+    ReleaseTransfer(downloader);
+}
+
+void OmafCurlEngine::ReleaseTransfer(OmafCurlDownloader* downloader)
+{
+    m_requestMutex.lock();
+    m_activeTransfers.erase(downloader);
+    m_requestMutex.unlock();
+    m_removedCv.notify_all();
+}
+
+void OmafCurlEngine::ProcessRequests()
+{
+    list<OmafCurlDownloader*> adds;
+    list<OmafCurlDownloader*> removes;
+
+    m_requestMutex.lock();
+    adds.swap(m_pendingAdds);
+    removes = m_pendingRemoves;
+    m_requestMutex.unlock();
+
+    for(auto downloader: adds)
+    {
+        if(StartTransfer(downloader) != OD_STATUS_SUCCESS)
+        {
+            downloader->TransferDone(CURLE_FAILED_INIT, 0);
+            ReleaseTransfer(downloader);
+        }
+    }
+
+    if(!removes.size())
+        return;
+
+    for(auto downloader: removes)
+    {
+        for(auto it = m_transfers.begin(); it != m_transfers.end(); it++)
+        {
+            if(it->second == downloader)
+            {
+                FinishTransfer(it->first, CURLE_ABORTED_BY_CALLBACK);
+                break;
+            }
+        }
+    }
+
+    m_requestMutex.lock();
+    for(auto downloader: removes)
+    {
+        auto it = find(m_pendingRemoves.begin(), m_pendingRemoves.end(), downloader);
+        if(it != m_pendingRemoves.end())
+            m_pendingRemoves.erase(it);
+    }
+    m_requestMutex.unlock();
+}
+
+void OmafCurlEngine::WakeUp()
+{
+    char signal = 1;
+    if(write(m_wakeupPipe[1], &signal, 1) < 0 && errno != EAGAIN)
+    {
+        LOG(WARNING)<<"failed to wake up curl engine."<<endl;
+    }
+}
+
+void OmafCurlEngine::Run()
+{
+    m_requestMutex.lock();
+    m_engineThread = pthread_self();
+    m_requestMutex.unlock();
+
+    while(1)
+    {
+        m_requestMutex.lock();
+        bool stop = m_stop;
+        m_requestMutex.unlock();
+        if(stop)
+            break;
+
+        ProcessRequests();
+
+        int running = 0;
+        curl_multi_perform(m_multiHandle, &running);
+
+        int msgsLeft = 0;
+        CURLMsg* msg = NULL;
+        while((msg = curl_multi_info_read(m_multiHandle, &msgsLeft)))
+        {
+            if(msg->msg == CURLMSG_DONE)
+                FinishTransfer(msg->easy_handle, msg->data.result);
+        }
+
+        // sleep until a socket is ready or a request is added
+        struct curl_waitfd wakeupFd;
+        wakeupFd.fd = m_wakeupPipe[0];
+        wakeupFd.events = CURL_WAIT_POLLIN;
+        wakeupFd.revents = 0;
+        int numfds = 0;
+        curl_multi_wait(m_multiHandle, &wakeupFd, 1, MAX_WAIT_TIME, &numfds);
+        if(wakeupFd.revents)
+        {
+            char signals[64];
+            while(read(m_wakeupPipe[0], signals, sizeof(signals)) > 0);
+        }
+    }
+
+    // the left transfers are stopped with the engine
+    while(m_transfers.size())
+    {
+        FinishTransfer(m_transfers.begin()->first, CURLE_ABORTED_BY_CALLBACK);
+    }
+    m_removedCv.notify_all();
+}
+
+VCD_OMAF_END
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+//!
+//! \file:   OmafCurlEngine.h
+//! \brief:  shared curl multi engine driving all segment downloads
+//!
+
+#ifndef OMAFCURLENGINE_H
+#define OMAFCURLENGINE_H
+
+#include <curl/curl.h>
+#include <mutex>
+#include <set>
+#include "../OmafDashParser/Common.h"
+#include "../../utils/Singleton.h"
+
+VCD_USE_VRVIDEO;
+
+VCD_OMAF_BEGIN
+
+class OmafCurlDownloader;
+
+//!
+//! \class:  OmafCurlEngine
+//! \brief:  one event loop thread running a curl multi handle for all the
+//!          downloaders. Easy handles are pooled and the multi handle keeps
+//!          the connections alive, so the tiles of a segment period share the
+//!          connections (and one HTTP/2 connection when libcurl supports it)
+//!          instead of a thread and a handshake for each tile
+//!
+class OmafCurlEngine: public Threadable
+{
+public:
+
+    //!
+    //! \brief Constructor
+    //!
+    OmafCurlEngine();
+
+    //!
+    //! \brief Destructor
+    //!
+    virtual ~OmafCurlEngine();
+
+    //!
+    //! \brief    Add the transfer of the downloader to the engine
+    //!
+    //! \param    [in] downloader
+    //!           the downloader to start, its url and callbacks are set on a pooled handle
+    //!
+    //! \return   ODStatus
+    //!           OD_STATUS_SUCCESS if success, else fail reason
+    //!
+    ODStatus AddTransfer(OmafCurlDownloader* downloader);
+
+    //!
+    //! \brief    Remove the transfer of the downloader from the engine, it returns
+    //!           after the engine won't call the downloader any more. It returns at
+    //!           once if the transfer is done or never added. Called in
+    //!           the engine thread (from a callback), the removal is only queued
+    //!
+    //! \param    [in] downloader
+    //!           the downloader to stop
+    //!
+    //! \return   ODStatus
+    //!           OD_STATUS_SUCCESS if success, else fail reason
+    //!
+    ODStatus RemoveTransfer(OmafCurlDownloader* downloader);
+
+    //!
+    //! \brief Interface implementation from base class: Threadable
+    //!
+    virtual void Run();
+
+private:
+
+    //!
+    //! \brief    Get an easy handle from the pool, or a new one if the pool is empty
+    //!
+    //! \return   CURL*
+    //!           the easy handle, NULL if failed
+    //!
+    CURL* AcquireHandle();
+
+    //!
+    //! \brief    Return the easy handle to the pool, the handle is freed if the pool is full
+    //!
+    //! \param    [in] handle
+    //!           the easy handle
+    //!
+    //! \return   void
+    //!
+    void ReleaseHandle(CURL* handle);
+
+    //!
+    //! \brief    Set the options of the downloader on the easy handle and add it to the multi handle
+    //!
+    //! \param    [in] downloader
+    //!           the downloader to start
+    //!
+    //! \return   ODStatus
+    //!           OD_STATUS_SUCCESS if success, else fail reason
+    //!
+    ODStatus StartTransfer(OmafCurlDownloader* downloader);
+
+    //!
+    //! \brief    Remove the easy handle of the downloader from the multi handle
+    //!           and tell the downloader the transfer is over
+    //!
+    //! \param    [in] handle
+    //!           the easy handle of the transfer
+    //! \param    [in] result
+    //!           the result of the transfer
+    //!
+    //! \return   void
+    //!
+    void FinishTransfer(CURL* handle, CURLcode result);
+
+    //!
+    //! \brief    Mark the downloader as no longer used by the engine, after its
+    //!           last callback returned, and wake up the threads removing it
+    //!
+    //! \param    [in] downloader
+    //!           the downloader of the finished transfer
+    //!
+    //! \return   void
+    //!
+    void ReleaseTransfer(OmafCurlDownloader* downloader);
+
+    //!
+    //! \brief    Add the pending transfers and remove the cancelled ones, called in the engine thread
+    //!
+    //! \return   void
+    //!
+    void ProcessRequests();
+
+    //!
+    //! \brief    Wake up the engine thread waiting in curl_multi_wait
+    //!
+    //! \return   void
+    //!
+    void WakeUp();
+
+    CURLM*                                  m_multiHandle;      //!< the multi handle driving all transfers
+    list<CURL*>                             m_idleHandles;      //!< pooled easy handles
+    map<CURL*, OmafCurlDownloader*>         m_transfers;        //!< running transfers, only used in engine thread
+    list<OmafCurlDownloader*>               m_pendingAdds;      //!< transfers to add in the engine thread
+    list<OmafCurlDownloader*>               m_pendingRemoves;   //!< transfers to cancel in the engine thread
+    std::set<OmafCurlDownloader*>           m_activeTransfers;  //!< downloaders added and not released yet
+    std::mutex                              m_requestMutex;     //!< lock for the pending lists, the active transfers and the engine thread id
+    condition_variable                      m_removedCv;        //!< signaled when cancelled transfers are removed
+    int                                     m_wakeupPipe[2];    //!< pipe to interrupt curl_multi_wait
+    bool                                    m_stop;             //!< flag to stop the engine thread
+    pthread_t                               m_engineThread;     //!< id of the engine thread
+};
+
+typedef Singleton<OmafCurlEngine> CURLENGINE;
+
+VCD_OMAF_END;
+
+#endif //OMAFCURLENGINE_H
@@ -113,6 +113,20 @@ public:
     //!
     virtual ODStatus Peek(uint8_t* data, size_t size, size_t offset) = 0;
 
+    //!
+    //! \brief    Get a view of the downloaded stream without copying, it waits
+    //!           until the download is over
+    //!
+    //! \param    [out] data
+    //!           pointer to the downloaded data, valid until the downloader is destroyed
+    //! \param    [out] size
+    //!           size of the downloaded data
+    //!
+    //! \return   ODStatus
+    //!           OD_STATUS_SUCCESS if success, else fail reason
+    //!
+    virtual ODStatus GetDataView(const uint8_t** data, size_t* size) = 0;
+
     //!
     //! \brief    Attach download observer
     //!
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+//!
+//! \file:   OmafThroughputEstimator.cpp
+//! \brief:  process wide estimator of the download throughput and rtt
+//!
+
+#include <math.h>
+#include "OmafThroughputEstimator.h"
+
+// the busy time to take one throughput sample, in us
+#define SAMPLE_BUSY_TIME 50000
+// the length of the sliding window, in us
+#define WINDOW_TIME 3000000
+// the busy time for the weight of an old sample to halve in EWMA, in s
+#define EWMA_HALF_LIFE 3.0
+// the weight of a new rtt sample, as tcp does
+#define RTT_GAIN 0.125
+
+VCD_OMAF_BEGIN
+
+OmafThroughputEstimator::OmafThroughputEstimator()
+{
+    m_activeTransfers = 0;
+    m_lastUpdate      = 0;
+    m_pendingBytes    = 0;
+    m_pendingBusy     = 0;
+    m_totalBytes      = 0;
+    m_totalBusy       = 0;
+    m_ewma            = 0;
+    m_ewmaWeight      = 0;
+    m_rtt             = 0;
+}
+
+OmafThroughputEstimator::~OmafThroughputEstimator()
+{
+}
+
+uint64_t OmafThroughputEstimator::NowUs()
+{
+    return chrono::duration_cast<chrono::microseconds>(m_clock.now().time_since_epoch()).count();
+}
+
+void OmafThroughputEstimator::UpdateBusyTime(uint64_t now)
+{
+    if(m_activeTransfers && now > m_lastUpdate)
+        m_pendingBusy += now - m_lastUpdate;
+    m_lastUpdate = now;
+}
+
+void OmafThroughputEstimator::TakeSample(uint64_t now)
+{
+    if(!m_pendingBusy)
+        return;
+
+    ThroughputSample sample;
+    sample.time     = now;
+    sample.bytes    = m_pendingBytes;
+    sample.busyTime = m_pendingBusy;
+    m_samples.push_back(sample);
+
+    m_totalBytes += m_pendingBytes;
+    m_totalBusy  += m_pendingBusy;
+
+    // the weight of the old estimate decays with the busy time of the sample
+    double throughput = sample.bytes * 8 * 1000000.0 / sample.busyTime;
+    double alpha = pow(0.5, sample.busyTime / 1000000.0 / EWMA_HALF_LIFE);
+    m_ewma       = alpha * m_ewma + (1 - alpha) * throughput;
+    m_ewmaWeight = alpha * m_ewmaWeight + (1 - alpha);
+
+    m_pendingBytes = 0;
+    m_pendingBusy  = 0;
+
+    DropOldSamples(now);
+}
+
+void OmafThroughputEstimator::DropOldSamples(uint64_t now)
+{
+    while(m_samples.size() && m_samples.front().time + WINDOW_TIME < now)
+        m_samples.pop_front();
+}
+
+void OmafThroughputEstimator::TransferStarted()
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    UpdateBusyTime(NowUs());
+    m_activeTransfers++;
+}
+
+void OmafThroughputEstimator::BytesReceived(uint64_t bytes)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    uint64_t now = NowUs();
+    UpdateBusyTime(now);
+    m_pendingBytes += bytes;
+
+    if(m_pendingBusy >= SAMPLE_BUSY_TIME)
+        TakeSample(now);
+}
+
+void OmafThroughputEstimator::TransferFinished(double requestTime, double firstByteTime)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    uint64_t now = NowUs();
+    UpdateBusyTime(now);
+    if(m_activeTransfers)
+        m_activeTransfers--;
+
+    // the link is idle now, take the rest as a sample
+    if(!m_activeTransfers)
+        TakeSample(now);
+
+    if(firstByteTime > 0 && firstByteTime >= requestTime)
+    {
+        double rtt = (firstByteTime - requestTime) * 1000;
+        m_rtt = m_rtt > 0 ? (1 - RTT_GAIN) * m_rtt + RTT_GAIN * rtt : rtt;
+    }
+}
+
+uint64_t OmafThroughputEstimator::GetWindowThroughput()
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    DropOldSamples(NowUs());
+
+    uint64_t bytes = 0;
+    uint64_t busyTime = 0;
+    for(auto& sample: m_samples)
+    {
+        bytes    += sample.bytes;
+        busyTime += sample.busyTime;
+    }
+
+    if(!busyTime)
+        return m_ewmaWeight > 0 ? (uint64_t)(m_ewma / m_ewmaWeight) : 0;
+
+    return (uint64_t)(bytes * 8 * 1000000.0 / busyTime);
+}
+
+uint64_t OmafThroughputEstimator::GetEwmaThroughput()
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    return m_ewmaWeight > 0 ? (uint64_t)(m_ewma / m_ewmaWeight) : 0;
+}
+
+uint64_t OmafThroughputEstimator::GetAverageThroughput()
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    return m_totalBusy ? (uint64_t)(m_totalBytes * 8 * 1000000.0 / m_totalBusy) : 0;
+}
+
+uint32_t OmafThroughputEstimator::GetRTT()
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    return (uint32_t)m_rtt;
+}
+
+void OmafThroughputEstimator::Reset()
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    m_samples.clear();
+    m_pendingBytes = 0;
+    m_pendingBusy  = 0;
+    m_totalBytes   = 0;
+    m_totalBusy    = 0;
+    m_ewma         = 0;
+    m_ewmaWeight   = 0;
+    m_rtt          = 0;
+    m_lastUpdate   = NowUs();
+}
+
+VCD_OMAF_END
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+//!
+//! \file:   OmafThroughputEstimator.h
+//! \brief:  process wide estimator of the download throughput and rtt
+//!
+
+#ifndef OMAFTHROUGHPUTESTIMATOR_H
+#define OMAFTHROUGHPUTESTIMATOR_H
+
+#include <mutex>
+#include <deque>
+#include <chrono>
+#include "../OmafDashParser/Common.h"
+#include "../../utils/Singleton.h"
+
+VCD_USE_VRVIDEO;
+
+VCD_OMAF_BEGIN
+
+//!
+//! \class:  OmafThroughputEstimator
+//! \brief:  collects the bytes and timing of all the transfers. The time
+//!          is only counted while at least one transfer is active, so the
+//!          idle time between segment periods doesn't lower the estimate,
+//!          and the parallel transfers are measured as one link
+//!
+class OmafThroughputEstimator
+{
+public:
+
+    //!
+    //! \brief Constructor
+    //!
+    OmafThroughputEstimator();
+
+    //!
+    //! \brief Destructor
+    //!
+    virtual ~OmafThroughputEstimator();
+
+    //!
+    //! \brief  a transfer starts to receive data
+    //!
+    void TransferStarted();
+
+    //!
+    //! \brief  bytes received by one of the active transfers
+    //!
+    //! \param  [in] bytes
+    //!         the size of the data received
+    //!
+    void BytesReceived(uint64_t bytes);
+
+    //!
+    //! \brief  a transfer is finished
+    //!
+    //! \param  [in] requestTime
+    //!         the time in seconds from the start until the request is sent
+    //! \param  [in] firstByteTime
+    //!         the time in seconds from the start until the first byte is
+    //!         received, 0 if nothing is received
+    //!
+    void TransferFinished(double requestTime, double firstByteTime);
+
+    //!
+    //! \brief  get the throughput in the last sliding window, in bits per
+    //!         second. It's the EWMA throughput if nothing is in the window
+    //!
+    uint64_t GetWindowThroughput();
+
+    //!
+    //! \brief  get the exponentially weighted moving average throughput,
+    //!         in bits per second
+    //!
+    uint64_t GetEwmaThroughput();
+
+    //!
+    //! \brief  get the average throughput since the first transfer, in bits
+    //!         per second
+    //!
+    uint64_t GetAverageThroughput();
+
+    //!
+    //! \brief  get the smoothed round trip time in ms, measured as the time
+    //!         between sending a request and receiving its first byte
+    //!
+    uint32_t GetRTT();
+
+    //!
+    //! \brief  drop all the samples
+    //!
+    void Reset();
+
+protected:
+
+    //!
+    //! \brief the time in us of the steady clock
+    //!
+    virtual uint64_t NowUs();
+
+private:
+
+    //!
+    //! \brief one throughput sample of SAMPLE_BUSY_TIME busy time at least
+    //!
+    typedef struct THROUGHPUTSAMPLE{
+        uint64_t time;          //!< the time the sample is taken in us
+        uint64_t bytes;         //!< the bytes received
+        uint64_t busyTime;      //!< the busy time to receive the bytes in us
+    }ThroughputSample;
+
+    //!
+    //! \brief add the time since the last update to busy time if any transfer is active
+    //!
+    void UpdateBusyTime(uint64_t now);
+
+    //!
+    //! \brief take a sample from the pending bytes and busy time
+    //!
+    void TakeSample(uint64_t now);
+
+    //!
+    //! \brief drop the samples out of the sliding window
+    //!
+    void DropOldSamples(uint64_t now);
+
+private:
+    std::mutex                             m_mutex;            //!< for synchronization
+    std::chrono::steady_clock              m_clock;            //!< clock for the timing
+    std::deque<ThroughputSample>           m_samples;          //!< the samples in the sliding window
+    uint32_t                               m_activeTransfers;  //!< the number of active transfers
+    uint64_t                               m_lastUpdate;       //!< the last time the busy time is updated in us
+    uint64_t                               m_pendingBytes;     //!< the bytes not in a sample yet
+    uint64_t                               m_pendingBusy;      //!< the busy time not in a sample yet in us
+    uint64_t                               m_totalBytes;       //!< the total bytes received
+    uint64_t                               m_totalBusy;        //!< the total busy time in us
+    double                                 m_ewma;             //!< the EWMA throughput in bps
+    double                                 m_ewmaWeight;       //!< the total weight of EWMA, for the bias at the beginning
+    double                                 m_rtt;              //!< the smoothed rtt in ms
+};
+
+typedef Singleton<OmafThroughputEstimator> THROUGHPUTESTIMATOR;
+
+VCD_OMAF_END;
+
+#endif //OMAFTHROUGHPUTESTIMATOR_H
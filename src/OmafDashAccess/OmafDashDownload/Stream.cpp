@@ -32,190 +32,228 @@
 
 #include "Stream.h"
 
+#include <sys/mman.h>
+
 VCD_OMAF_BEGIN
 
-Stream::Stream()
+// the first allocation when the total size is unknown
+#define STREAM_INIT_CAPACITY (64 * 1024)
+
+StreamBuffer::StreamBuffer()
 {
-    m_eos = false;
-    m_totalLength = 0;
+    m_data = NULL;
+    m_size = 0;
+    m_capacity = 0;
+    m_mapped = false;
 }
 
-Stream::~Stream()
+StreamBuffer::StreamBuffer(char* mapped, uint64_t size)
 {
-    if(m_listDownloadedStreams.size())
-    {
-        for(std::list<StreamInfo*>::iterator it = m_listDownloadedStreams.begin() ; it != m_listDownloadedStreams.end(); it++)
-        {
-            StreamInfo * ds = *it;
-            SAFE_DELETE(ds);
-        }
-        m_listDownloadedStreams.clear();
-    }
+    m_data = mapped;
+    m_size = size;
+    m_capacity = size;
+    m_mapped = true;
 }
 
-ODStatus Stream::AddSubStream(char* streamData, uint64_t streamLen)
+StreamBuffer::~StreamBuffer()
 {
-    StreamInfo *sInfo = new StreamInfo();
-    sInfo->data = streamData;
-    sInfo->length = streamLen;
+    if(m_mapped)
+        munmap(m_data, m_capacity);
+    else
+        SAFE_FREE(m_data);
+    m_data = NULL;
+    m_size = 0;
+    m_capacity = 0;
+}
 
-    m_lock.lock();
-    m_totalLength += streamLen;
-    m_listDownloadedStreams.push_back(sInfo);
-    m_lock.unlock();
+ODStatus StreamBuffer::Reserve(uint64_t size)
+{
+    if(size <= m_capacity)
+        return OD_STATUS_SUCCESS;
+
+    if(m_mapped)
+        return OD_STATUS_INVALID;
+
+    uint64_t newCapacity = m_capacity ? m_capacity : STREAM_INIT_CAPACITY;
+    while(newCapacity < size)
+        newCapacity *= 2;
+
+    char* newData = (char*)realloc(m_data, newCapacity);
+    CheckNullPtr_PrintLog_ReturnStatus(newData, "failed to grow the stream buffer!", ERROR, OD_STATUS_OPERATION_FAILED);
+
+    m_data = newData;
+    m_capacity = newCapacity;
 
-    // notify other threads
-    m_cv.notify_all();
     return OD_STATUS_SUCCESS;
 }
 
-ODStatus Stream::GetStream(char* streamData, uint64_t streamDataLen)
+ODStatus StreamBuffer::Append(const char* data, uint64_t len)
 {
-    CheckNullPtr_PrintLog_ReturnStatus(streamData, "the data pointer for getting output stream is null!", ERROR, OD_STATUS_INVALID);
+    ODStatus st = Reserve(m_size + len);
+    CheckAndReturn(st);
 
-    while(!GetDownloadedListSize() && !IsEOS())
-    {
-        mutex mtx;
-        unique_lock<mutex> lck(mtx);
+    memcpy(m_data + m_size, data, len);
+    m_size += len;
 
-        // wait for time out or is notified
-        m_cv.wait_for(lck, chrono::milliseconds(2));
-    }
+    return OD_STATUS_SUCCESS;
+}
 
-    m_lock.lock();
+void StreamBuffer::ShrinkToFit()
+{
+    if(m_mapped || !m_size || m_size == m_capacity)
+        return;
 
-    uint64_t gotSize = 0, gotCnt = 0;
-    for(auto stream: m_listDownloadedStreams)
+    char* newData = (char*)realloc(m_data, m_size);
+    if(newData)
     {
-        if(gotSize >= streamDataLen)
-            break;
-
-        uint64_t copysize = 0;
-        if((streamDataLen - gotSize) >= stream->length)
-        {
-            copysize = stream->length;
-            memcpy(streamData + gotSize, stream->data, copysize);
-            gotCnt++;
-        }
-        else
-        {
-            copysize = (streamDataLen - gotSize);
-            memcpy(streamData + gotSize, stream->data, copysize);
-
-            // remove the copied part of list element
-            auto leftSize = stream->length - copysize;
-            char* newData = new char(leftSize);
-            memcpy(newData, stream->data, leftSize);
-            SAFE_DELETE(stream->data);
-            stream->data = newData;
-            stream->length = leftSize;
-        }
-
-        gotSize += copysize;
+        m_data = newData;
+        m_capacity = m_size;
     }
+}
 
-    while(gotCnt)
-    {
-        auto downStream = m_listDownloadedStreams.front();
-        m_listDownloadedStreams.pop_front();
-        SAFE_DELETE(downStream);
-        gotCnt--;
-    }
+Stream::Stream()
+{
+    m_buffer = std::make_shared<StreamBuffer>();
+    m_readPos = 0;
+    m_eos = false;
+    m_totalLength = 0;
+}
 
-    m_totalLength -= streamDataLen;
+Stream::~Stream()
+{
+    m_buffer.reset();
+}
 
-    m_lock.unlock();
+ODStatus Stream::Reserve(uint64_t size)
+{
+    unique_lock<mutex> lock(m_mutex);
 
-    return OD_STATUS_SUCCESS;
+    if(m_eos)
+        return OD_STATUS_SUCCESS;
+
+    // the buffer holds the whole stream from its beginning
+    return m_buffer->Reserve(size);
 }
 
-ODStatus Stream::PeekStream(char* streamData, uint64_t streamDataLen)
+ODStatus Stream::AddSubStream(const char* streamData, uint64_t streamLen)
 {
-    CheckNullPtr_PrintLog_ReturnStatus(streamData, "The data pointer for getting output stream is null!", ERROR, OD_STATUS_INVALID);
+    CheckNullPtr_PrintLog_ReturnStatus(streamData, "the sub-stream data is null!", ERROR, OD_STATUS_INVALID);
 
-    while(!GetDownloadedListSize() && !IsEOS())
     {
-        mutex mtx;
-        unique_lock<mutex> lck(mtx);
+        unique_lock<mutex> lock(m_mutex);
+        // a complete stream may share its buffer, it mustn't change
+        if(m_eos)
+            return OD_STATUS_INVALID;
+
+        ODStatus st = m_buffer->Append(streamData, streamLen);
+        CheckAndReturn(st);
 
-        // wait for time out or is notified
-        m_cv.wait_for(lck, chrono::milliseconds(2));
+        m_totalLength += streamLen;
     }
 
-    m_lock.lock();
+    // notify other threads
+    m_cv.notify_all();
+    return OD_STATUS_SUCCESS;
+}
 
-    uint64_t gotSize = 0;
-    for(auto stream: m_listDownloadedStreams)
-    {
-        if(gotSize >= streamDataLen)
-            break;
+uint64_t Stream::WaitForData(unique_lock<mutex>& lock, uint64_t size)
+{
+    m_cv.wait(lock, [&]{ return m_eos || m_totalLength >= size; });
 
-        uint64_t copysize = (streamDataLen - gotSize) >= stream->length ? stream->length : (streamDataLen - gotSize);
+    return m_totalLength >= size ? size : m_totalLength;
+}
 
-        memcpy(streamData + gotSize, stream->data, copysize);
-        gotSize += copysize;
-    }
+ODStatus Stream::GetStream(char* streamData, uint64_t streamDataLen)
+{
+    CheckNullPtr_PrintLog_ReturnStatus(streamData, "the data pointer for getting output stream is null!", ERROR, OD_STATUS_INVALID);
 
-    m_lock.unlock();
+    unique_lock<mutex> lock(m_mutex);
 
-    return OD_STATUS_SUCCESS;
+    uint64_t gotSize = WaitForData(lock, streamDataLen);
+    if(gotSize)
+        memcpy(streamData, m_buffer->GetData() + m_readPos, gotSize);
+
+    m_readPos += gotSize;
+    m_totalLength -= gotSize;
+
+    return gotSize == streamDataLen ? OD_STATUS_SUCCESS : OD_STATUS_OPERATION_FAILED;
+}
+
+ODStatus Stream::PeekStream(char* streamData, uint64_t streamDataLen)
+{
+    return PeekStream(streamData, streamDataLen, 0);
 }
 
 ODStatus Stream::PeekStream(char* streamData, uint64_t streamDataLen, size_t offset)
 {
     CheckNullPtr_PrintLog_ReturnStatus(streamData, "The data pointer for getting output stream is null!", ERROR, OD_STATUS_INVALID);
 
-    while(!GetDownloadedListSize() && !IsEOS())
-    {
-        mutex mtx;
-        unique_lock<mutex> lck(mtx);
+    unique_lock<mutex> lock(m_mutex);
 
-        // wait for time out or is notified
-        m_cv.wait_for(lck, chrono::milliseconds(2));
-    }
+    uint64_t available = WaitForData(lock, offset + streamDataLen);
+    if(available <= offset)
+        return OD_STATUS_OPERATION_FAILED;
 
-    m_lock.lock();
+    uint64_t gotSize = available - offset;
+    memcpy(streamData, m_buffer->GetData() + m_readPos + offset, gotSize);
 
-    // find the block that offset refers
-    auto it = m_listDownloadedStreams.begin();
-    while(it != m_listDownloadedStreams.end())
-    {
-        if(offset - (*it)->length <= 0) break;
-        offset -= (*it)->length;
+    return gotSize == streamDataLen ? OD_STATUS_SUCCESS : OD_STATUS_OPERATION_FAILED;
+}
 
-        it++;
-    }
+ODStatus Stream::GetStreamView(const char** streamData, uint64_t* streamDataLen)
+{
+    CheckNullPtr_PrintLog_ReturnStatus(streamData, "The data pointer for the stream view is null!", ERROR, OD_STATUS_INVALID);
+    CheckNullPtr_PrintLog_ReturnStatus(streamDataLen, "The length pointer for the stream view is null!", ERROR, OD_STATUS_INVALID);
 
-    uint64_t gotSize = 0;
-    if (it == m_listDownloadedStreams.end())
-    {
-        return OD_STATUS_OPERATION_FAILED;
-    }
-    // copy the left data in offset block
-    memcpy(streamData, (*it)->data + offset, (*it)->length - offset);
-    gotSize += (*it)->length - offset;
-    it++;
+    unique_lock<mutex> lock(m_mutex);
 
-    for(; it!= m_listDownloadedStreams.end(); it++)
-    {
-        auto stream = (*it);
-        if(gotSize >= streamDataLen)
-            break;
+    m_cv.wait(lock, [&]{ return m_eos; });
+
+    *streamData = m_buffer->GetData() ? m_buffer->GetData() + m_readPos : NULL;
+    *streamDataLen = m_totalLength;
+
+    return OD_STATUS_SUCCESS;
+}
 
-        uint64_t copysize = (streamDataLen - gotSize) >= stream->length ? stream->length : (streamDataLen - gotSize);
+ODStatus Stream::AttachBuffer(std::shared_ptr<StreamBuffer> buffer)
+{
+    CheckNullPtr_PrintLog_ReturnStatus(buffer, "the attached stream buffer is null!", ERROR, OD_STATUS_INVALID);
 
-        memcpy(streamData + gotSize, stream->data, copysize);
-        gotSize += copysize;
+    {
+        unique_lock<mutex> lock(m_mutex);
+        if(m_eos || m_buffer->GetSize())
+            return OD_STATUS_INVALID;
+
+        m_buffer = buffer;
+        m_readPos = 0;
+        m_totalLength = buffer->GetSize();
+        m_eos = true;
     }
 
-    m_lock.unlock();
+    m_cv.notify_all();
 
     return OD_STATUS_SUCCESS;
 }
 
+std::shared_ptr<StreamBuffer> Stream::GetBuffer()
+{
+    unique_lock<mutex> lock(m_mutex);
+
+    if(!m_eos)
+        return NULL;
+
+    return m_buffer;
+}
+
 ODStatus Stream::ReachedEOS()
 {
-    m_eos = true;
+    {
+        unique_lock<mutex> lock(m_mutex);
+        // nobody views the buffer before EOS, so it can move here
+        if(!m_eos)
+            m_buffer->ShrinkToFit();
+        m_eos = true;
+    }
 
     m_cv.notify_all();
 
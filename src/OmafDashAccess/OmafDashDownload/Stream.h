@@ -40,48 +40,97 @@ VCD_USE_VRVIDEO;
 VCD_OMAF_BEGIN
 
 //!
-//! \class  StreamInfo
-//! \brief  Stream Information, including data and data size
+//! \class  StreamBuffer
+//! \brief  the memory holding a whole stream. It's either allocated and
+//!         grown while the stream is downloading, or a read only mapping of
+//!         a cached file. Once the stream reaches EOS the buffer never
+//!         changes, so it can be shared, e.g. with the segment cache
 //!
-class StreamInfo
+class StreamBuffer
 {
 public:
 
     //!
-    //! \brief Constructor
+    //! \brief Constructor of an empty buffer to be appended
     //!
-    StreamInfo()
-    {
-        data   = NULL;
-        length = 0;
-    }
+    StreamBuffer();
 
     //!
-    //! \brief Constructor with parameter
+    //! \brief Constructor of a buffer over a read only mapping, the buffer
+    //!        unmaps it when destroyed
+    //!
+    //! \param    [in] mapped
+    //!           the mapped data
+    //! \param    [in] size
+    //!           size of the mapping
     //!
-    StreamInfo(char* d, uint64_t l):StreamInfo()
-    {
-        data = d;
-        length = l;
-    }
+    StreamBuffer(char* mapped, uint64_t size);
 
     //!
     //! \brief Destructor
     //!
-    ~StreamInfo()
-    {
-        SAFE_DELETE(data);
-        length = 0;
-    }
+    ~StreamBuffer();
 
-    char*            data;   //<! stream data
-    uint64_t         length; //<! length of data
-};
+    //!
+    //! \brief    Make the buffer hold at least size bytes
+    //!
+    //! \param    [in] size
+    //!           size needed
+    //!
+    //! \return   ODStatus
+    //!           OD_STATUS_SUCCESS if success, else fail reason
+    //!
+    ODStatus Reserve(uint64_t size);
+
+    //!
+    //! \brief    Copy the data to the end of the buffer
+    //!
+    //! \param    [in] data
+    //!           the data to append
+    //! \param    [in] len
+    //!           length of the data
+    //!
+    //! \return   ODStatus
+    //!           OD_STATUS_SUCCESS if success, else fail reason
+    //!
+    ODStatus Append(const char* data, uint64_t len);
+
+    //!
+    //! \brief    Release the allocated memory over the data size
+    //!
+    void ShrinkToFit();
+
+    //!
+    //! \brief    Get the data of the buffer
+    //!
+    //! \return   const char*
+    //!           the data, NULL if nothing is appended
+    //!
+    const char* GetData(){return m_data;}
+
+    //!
+    //! \brief    Get the data size of the buffer
+    //!
+    //! \return   uint64_t
+    //!           the data size
+    //!
+    uint64_t GetSize(){return m_size;}
+
+private:
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
 
+    char*                   m_data;                     //!< the data of the buffer
+    uint64_t                m_size;                     //!< size of the data
+    uint64_t                m_capacity;                 //!< allocated size of m_data
+    bool                    m_mapped;                   //!< whether m_data is a mapping
+};
 
 //!
 //! \class  Stream
-//! \brief  Stream class, which will store sub-streams
+//! \brief  Stream class, which stores the downloaded sub-streams in one
+//!         contiguous buffer, so the data can be viewed without copying.
+//!         The read data is kept, the buffer always holds the whole stream
 //!
 class Stream: public ThreadLock
 {
@@ -98,7 +147,18 @@ public:
     ~Stream();
 
     //!
-    //! \brief    Add sub-stream
+    //! \brief    Reserve the buffer for the whole stream, e.g. from Content-Length
+    //!
+    //! \param    [in] size
+    //!           the expected total size of the stream
+    //!
+    //! \return   ODStatus
+    //!           OD_STATUS_SUCCESS if success, else fail reason
+    //!
+    ODStatus Reserve(uint64_t size);
+
+    //!
+    //! \brief    Add sub-stream, the data is copied to the end of the buffer
     //!
     //! \param    [in] streamData
     //!           sub-stream data
@@ -108,10 +168,10 @@ public:
     //! \return   ODStatus
     //!           OD_STATUS_SUCCESS if success, else fail reason
     //!
-    ODStatus AddSubStream(char* streamData, uint64_t streamLen);
+    ODStatus AddSubStream(const char* streamData, uint64_t streamLen);
 
     //!
-    //! \brief    Get given size sub-stream
+    //! \brief    Get given size sub-stream, it waits until the data is downloaded
     //!
     //! \param    [in] streamData
     //!           sub-stream data
@@ -119,7 +179,8 @@ public:
     //!           sub-stream length
     //!
     //! \return   ODStatus
-    //!           OD_STATUS_SUCCESS if success, else fail reason
+    //!           OD_STATUS_SUCCESS if success, OD_STATUS_OPERATION_FAILED
+    //!           if the stream ends before streamDataLen bytes
     //!
     ODStatus GetStream(char* streamData, uint64_t streamDataLen);
 
@@ -151,6 +212,41 @@ public:
     //!
     ODStatus PeekStream(char* streamData, uint64_t streamDataLen, size_t offset);
 
+    //!
+    //! \brief    Get a view of the unread stream without copying. It waits
+    //!           for EOS, after which the buffer never moves, so the view is
+    //!           valid until the next GetStream or the stream is destroyed
+    //!
+    //! \param    [out] streamData
+    //!           pointer to the unread data
+    //! \param    [out] streamDataLen
+    //!           length of the unread data
+    //!
+    //! \return   ODStatus
+    //!           OD_STATUS_SUCCESS if success, else fail reason
+    //!
+    ODStatus GetStreamView(const char** streamData, uint64_t* streamDataLen);
+
+    //!
+    //! \brief    Make the stream a complete one over the given buffer without
+    //!           copying, the stream reaches EOS
+    //!
+    //! \param    [in] buffer
+    //!           the buffer of the whole stream
+    //!
+    //! \return   ODStatus
+    //!           OD_STATUS_SUCCESS if success, else fail reason
+    //!
+    ODStatus AttachBuffer(std::shared_ptr<StreamBuffer> buffer);
+
+    //!
+    //! \brief    Get the buffer of the whole stream to share it
+    //!
+    //! \return   std::shared_ptr<StreamBuffer>
+    //!           the buffer, NULL if the stream hasn't reached EOS
+    //!
+    std::shared_ptr<StreamBuffer> GetBuffer();
+
     //!
     //! \brief    Mark this stream reached EOS
     //!
@@ -178,25 +274,25 @@ public:
 private:
 
     //!
-    //! \brief    get number of sub-streams
+    //! \brief    Wait until given size of data after the read position is
+    //!           downloaded or EOS reached, m_mutex must be held
     //!
-    //! \return   size_t
-    //!           number of sub-streams
+    //! \param    [in] lock
+    //!           the lock of m_mutex
+    //! \param    [in] size
+    //!           size of data needed
     //!
-    size_t GetDownloadedListSize()
-    {
-        m_lock.lock();
-        auto listSize = m_listDownloadedStreams.size();
-        m_lock.unlock();
-
-        return listSize;
-    }
+    //! \return   uint64_t
+    //!           the available size, no more than size
+    //!
+    uint64_t WaitForData(unique_lock<mutex>& lock, uint64_t size);
 
-    list<StreamInfo*>       m_listDownloadedStreams;    //!< list stores all downloaded sub-streams
-    ThreadLock              m_lock;                     //!< for downloaded streams synchronize
+    std::shared_ptr<StreamBuffer> m_buffer;             //!< contiguous buffer of the whole stream
+    uint64_t                m_readPos;                  //!< offset of the unread data in m_buffer
+    std::mutex              m_mutex;                    //!< for downloaded streams synchronize
     bool                    m_eos;                      //!< flag for end of stream
     condition_variable      m_cv;                       //!< condition variable for streams
-    uint64_t                m_totalLength;              //!< the total length of stream
+    uint64_t                m_totalLength;              //!< the length of unread stream
 };
 
 VCD_OMAF_END;
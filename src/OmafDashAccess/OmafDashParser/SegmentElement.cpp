@@ -134,6 +134,13 @@ ODStatus SegmentElement::Peek(uint8_t* data, size_t size, size_t offset)
     return m_downloader->Peek(data, size, offset);
 }
 
+ODStatus SegmentElement::GetDataView(const uint8_t** data, size_t* size)
+{
+    CheckNullPtr_PrintLog_ReturnStatus(m_downloader, "The downloader is not created yet!", ERROR, OD_STATUS_INVALID);
+
+    return m_downloader->GetDataView(data, size);
+}
+
 string SegmentElement::GenerateCompleteURL(vector<BaseUrlElement*>& baseURL, string& representationID, int32_t number, int32_t bandwidth, int32_t time)
 {
     string combinedBaseURL;
@@ -216,6 +216,19 @@ public:
     //!
     ODStatus Peek(uint8_t* data, size_t size, size_t offset);
 
+    //!
+    //! \brief    Get a view of the downloaded segment without copying
+    //!
+    //! \param    [out] data
+    //!           pointer to the downloaded data
+    //! \param    [out] size
+    //!           size of the downloaded data
+    //!
+    //! \return   ODStatus
+    //!           OD_STATUS_SUCCESS if success, else fail reason
+    //!
+    ODStatus GetDataView(const uint8_t** data, size_t* size);
+
     //!
     //! \brief    Initialization process
     //!
@@ -29,12 +29,17 @@
 #include "OmafDashSource.h"
 #include <string.h>
 #include "OmafReaderManager.h"
+#include "OmafDownloadScheduler.h"
 #include <math.h>
 #include <dirent.h>
 
 VCD_OMAF_BEGIN
 
 #define MAX_CACHE_SIZE 100*1024*1024
+// max time in ms GetPacket waits for the next packet
+#define PACKET_WAIT_TIME 5
+// interval in ms to check exiting when waiting for init segments
+#define EXIT_CHECK_INTERVAL 100
 
 OmafDashSource::OmafDashSource()
 {
@@ -226,6 +231,8 @@ int OmafDashSource::CloseMedia()
     if( STATUS_STOPPED != this->GetStatus() )
         this->StopThread();
 
+    DOWNLOADSCHEDULER::GetInstance()->CancelAll();
+
     READERMANAGER::GetInstance()->Close();
 
     return ERROR_NONE;
@@ -245,7 +252,9 @@ int OmafDashSource::GetPacket(
         std::list<OmafExtractor*> extractors = pStream->GetEnabledExtractor();
         for(auto it=extractors.begin(); it!=extractors.end(); it++){
             OmafExtractor* pExt = (OmafExtractor*)(*it);
-            int ret = READERMANAGER::GetInstance()->GetNextFrame(pExt->GetTrackNumber(), pkt, needParams);
+            // only wait when nothing is got, the reader fills all tracks of a segment together
+            uint32_t waitTime = pkts->empty() ? PACKET_WAIT_TIME : 0;
+            int ret = READERMANAGER::GetInstance()->GetNextFrame(pExt->GetTrackNumber(), pkt, needParams, waitTime);
             if(ret == ERROR_NONE)
             {
                 pkts->push_back(pkt);
@@ -255,7 +264,8 @@ int OmafDashSource::GetPacket(
         std::map<int, OmafAdaptationSet*> mapAS = pStream->GetMediaAdaptationSet();
         for(auto as_it=mapAS.begin(); as_it!=mapAS.end(); as_it++){
             OmafAdaptationSet* pAS = (OmafAdaptationSet*)(as_it->second);
-            int ret = READERMANAGER::GetInstance()->GetNextFrame(pAS->GetTrackNumber(), pkt, needParams);
+            uint32_t waitTime = pkts->empty() ? PACKET_WAIT_TIME : 0;
+            int ret = READERMANAGER::GetInstance()->GetNextFrame(pAS->GetTrackNumber(), pkt, needParams, waitTime);
             if(ret == ERROR_NONE)
                 pkts->push_back(pkt);
         }
@@ -269,6 +279,8 @@ int OmafDashSource::GetStatistic(DashStatisticInfo* dsInfo)
     DownloadManager* pDM = DOWNLOADMANAGER::GetInstance();
     dsInfo->avg_bandwidth = pDM->GetAverageBitrate();
     dsInfo->immediate_bandwidth = pDM->GetImmediateBitrate();
+    dsInfo->ewma_bandwidth = pDM->GetEwmaBitrate();
+    dsInfo->rtt = pDM->GetRoundTripTime();
     return ERROR_NONE;
 }
 
@@ -339,6 +351,9 @@ void OmafDashSource::Run()
 
 int OmafDashSource::TimedDownloadSegment( bool bFirst )
 {
+    // the segments of this round are needed before the next round starts
+    uint32_t deadline = sys_clock() + mMPDinfo->max_segment_duration;
+
     std::map<int, OmafMediaStream*>::iterator it;
     for(it=this->mMapStream.begin(); it!=this->mMapStream.end(); it++){
         OmafMediaStream* pStream = it->second;
@@ -346,7 +361,7 @@ int OmafDashSource::TimedDownloadSegment( bool bFirst )
             if(mMPDinfo->type == TYPE_LIVE)
                  pStream->UpdateStartNumber(mMPDinfo->availabilityStartTime);
         }
-        pStream->DownloadSegments();
+        pStream->DownloadSegments(deadline);
     }
 
     LOG(INFO)<<"now download number"<<dcount++<<std::endl;
@@ -376,6 +391,18 @@ int OmafDashSource::StartReadThread()
     return ERROR_NONE;
 }
 
+bool OmafDashSource::WaitInitSegParsed()
+{
+    // woken up by the reader as soon as the init segments are parsed
+    while(!READERMANAGER::GetInstance()->WaitInitSegParsed(EXIT_CHECK_INTERVAL))
+    {
+        if(STATUS_EXITING == GetStatus())
+            return false;
+    }
+
+    return true;
+}
+
 int OmafDashSource::SelectSpecialSegments(int extractorTrackIdx)
 {
     int ret = ERROR_NONE;
@@ -493,11 +520,9 @@ void OmafDashSource::thread_dynamic()
         return ;
     }
 
-    bool isInitSegParsed = READERMANAGER::GetInstance()->isAllInitSegParsed();
-    while (!isInitSegParsed)
-    {
-        ::usleep(1000);
-        isInitSegParsed = READERMANAGER::GetInstance()->isAllInitSegParsed();
+    if( !WaitInitSegParsed() ){
+        SetStatus( STATUS_STOPPED );
+        return ;
     }
 
      while((ERROR_NONE != StartReadThread()))
@@ -570,11 +595,9 @@ void OmafDashSource::thread_static()
         return ;
     }
 
-    bool isInitSegParsed = READERMANAGER::GetInstance()->isAllInitSegParsed();
-    while (!isInitSegParsed)
-    {
-        ::usleep(1000);
-        isInitSegParsed = READERMANAGER::GetInstance()->isAllInitSegParsed();
+    if( !WaitInitSegParsed() ){
+        SetStatus( STATUS_STOPPED );
+        return ;
     }
 
     while((ERROR_NONE != StartReadThread()))
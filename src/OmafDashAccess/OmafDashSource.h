@@ -172,6 +172,12 @@ private:
 
     int StartReadThread();
 
+    //!
+    //! \brief Wait until the reader parsed all init segments, return false if
+    //!        the source is exiting before that
+    //!
+    bool WaitInitSegParsed();
+
 private:
     OmafMPDParser*             mMPDParser;                //<! the MPD parser
     DASH_STATUS                mStatus;                   //<! the status of the source
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * File:   OmafDownloadScheduler.cpp
+ * Author: media
+ *
+ * the download scheduler of media segments
+ */
+
+#include "OmafDownloadScheduler.h"
+#include "OmafSegment.h"
+#include "OmafAdaptationSet.h"
+
+// the default max number of segments downloaded at the same time
+#define DEFAULT_MAX_INFLIGHT 32
+
+VCD_OMAF_BEGIN
+
+OmafDownloadScheduler::OmafDownloadScheduler()
+{
+    mMaxInFlight = DEFAULT_MAX_INFLIGHT;
+    mOrder       = 0;
+    mLateCount   = 0;
+}
+
+OmafDownloadScheduler::~OmafDownloadScheduler()
+{
+    CancelAll();
+}
+
+void OmafDownloadScheduler::SetMaxInFlight(uint32_t maxInFlight)
+{
+    mMutex.lock();
+    mMaxInFlight = maxInFlight ? maxInFlight : 1;
+    mMutex.unlock();
+
+    Dispatch();
+}
+
+int OmafDownloadScheduler::AddSegment(OmafSegment* pSeg, OmafAdaptationSet* pAS, uint32_t deadline)
+{
+    if(NULL == pSeg || NULL == pAS) return ERROR_NULL_PTR;
+
+    ScheduleRequest req;
+    req.pSeg     = pSeg;
+    req.pAS      = pAS;
+    req.priority = pAS->GetDownloadPriority();
+    req.deadline = deadline;
+
+    mMutex.lock();
+    req.order = mOrder++;
+    mPending.push_back(req);
+    mMutex.unlock();
+
+    ReleaseFinished();
+    Dispatch();
+
+    return ERROR_NONE;
+}
+
+bool OmafDownloadScheduler::IsMoreUrgent(const ScheduleRequest& a, const ScheduleRequest& b)
+{
+    // segments must be played in order, so an earlier deadline always goes first,
+    // and the segments of the same download round go by priority.
+    int32_t diff = (int32_t)(a.deadline - b.deadline);
+    if(diff != 0) return diff < 0;
+
+    if(a.priority != b.priority) return a.priority < b.priority;
+
+    return a.order < b.order;
+}
+
+void OmafDownloadScheduler::Dispatch()
+{
+    while(true)
+    {
+        mMutex.lock();
+        if(mPending.empty() || mInFlight.size() >= mMaxInFlight)
+        {
+            mMutex.unlock();
+            return;
+        }
+
+        auto urgent = mPending.begin();
+        for(auto it = mPending.begin(); it != mPending.end(); it++)
+        {
+            if(IsMoreUrgent(*it, *urgent)) urgent = it;
+        }
+        ScheduleRequest req = *urgent;
+        mPending.erase(urgent);
+        mInFlight.push_back(req);
+        mMutex.unlock();
+
+        // the lock can't be held, a cached segment is done before Open returns
+        if(ERROR_NONE != req.pSeg->Open())
+        {
+            LOG(ERROR)<<"Fail to open the scheduled segment "<<req.pSeg->GetSegCount()<<endl;
+            SegmentDone(req.pSeg, false);
+        }
+    }
+}
+
+void OmafDownloadScheduler::SegmentDone(OmafSegment* pSeg, bool bDownloaded)
+{
+    bool bLate = false;
+    int  segCnt = 0;
+
+    mMutex.lock();
+    auto it = mInFlight.begin();
+    for( ; it != mInFlight.end(); it++)
+    {
+        if(it->pSeg == pSeg) break;
+    }
+
+    // not scheduled, or cancelled already
+    if(it == mInFlight.end())
+    {
+        mMutex.unlock();
+        return;
+    }
+
+    if(bDownloaded)
+    {
+        bLate = (int32_t)(sys_clock() - it->deadline) > 0;
+        if(bLate) mLateCount++;
+        segCnt = pSeg->GetSegCount();
+    }
+    else
+    {
+        // it can't be released here in the download thread which notifies it
+        mFinished.push_back(*it);
+    }
+    mInFlight.erase(it);
+    mMutex.unlock();
+
+    if(bLate) LOG(INFO)<<"segment "<<segCnt<<" is downloaded after its deadline"<<endl;
+
+    Dispatch();
+}
+
+int OmafDownloadScheduler::CancelStaleRequests()
+{
+    std::list<ScheduleRequest> stalePending;
+    std::list<ScheduleRequest> staleInFlight;
+
+    mMutex.lock();
+    for(auto it = mPending.begin(); it != mPending.end(); )
+    {
+        it->priority = it->pAS->GetDownloadPriority();
+        if(!it->pAS->IsEnabled() && it->priority != PRIORITY_BACKGROUND)
+        {
+            stalePending.push_back(*it);
+            it = mPending.erase(it);
+        }
+        else
+            it++;
+    }
+
+    // the segments handed to reader manager are being parsed, let them finish
+    for(auto it = mInFlight.begin(); it != mInFlight.end(); )
+    {
+        it->priority = it->pAS->GetDownloadPriority();
+        if(!it->pAS->IsEnabled() && it->priority != PRIORITY_BACKGROUND && it->pSeg->Abandon())
+        {
+            staleInFlight.push_back(*it);
+            it = mInFlight.erase(it);
+        }
+        else
+            it++;
+    }
+    mMutex.unlock();
+
+    if(stalePending.size() || staleInFlight.size())
+    {
+        LOG(INFO)<<"cancel "<<stalePending.size()<<" queued and "<<staleInFlight.size()
+                 <<" downloading segments out of viewport"<<endl;
+    }
+
+    ReleaseSegments(stalePending, false);
+    ReleaseSegments(staleInFlight, true);
+    ReleaseFinished();
+    Dispatch();
+
+    return ERROR_NONE;
+}
+
+void OmafDownloadScheduler::CancelAll()
+{
+    std::list<ScheduleRequest> pending;
+    std::list<ScheduleRequest> inFlight;
+
+    mMutex.lock();
+    pending.swap(mPending);
+    for(auto it = mInFlight.begin(); it != mInFlight.end(); )
+    {
+        if(it->pSeg->Abandon())
+        {
+            inFlight.push_back(*it);
+            it = mInFlight.erase(it);
+        }
+        else
+            it++;
+    }
+    mMutex.unlock();
+
+    ReleaseSegments(pending, false);
+    ReleaseSegments(inFlight, true);
+    ReleaseFinished();
+}
+
+void OmafDownloadScheduler::ReleaseSegments(std::list<ScheduleRequest>& requests, bool bStop)
+{
+    for(auto it = requests.begin(); it != requests.end(); it++)
+    {
+        OmafSegment* pSeg = it->pSeg;
+        // wait for the download stopped before the segment is deleted
+        if(bStop) pSeg->Close();
+        if(pSeg->Abandon()) SAFE_DELETE(pSeg);
+    }
+    requests.clear();
+}
+
+void OmafDownloadScheduler::ReleaseFinished()
+{
+    std::list<ScheduleRequest> finished;
+
+    mMutex.lock();
+    finished.swap(mFinished);
+    mMutex.unlock();
+
+    // the segments stopped half way may be handed to reader manager already,
+    // which are released by reader manager then
+    ReleaseSegments(finished, false);
+}
+
+VCD_OMAF_END;
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//!
+//! \file:   OmafDownloadScheduler.h
+//! \brief:  schedule the media segment downloads by viewport priority
+//! \detail: the segments of all adaptation sets are queued here instead of
+//!          being started at once. They are started by priority and deadline
+//!          with a limited number in flight, and the requests of the tiles
+//!          out of the viewport are cancelled once the extractor is switched.
+//!
+
+#ifndef OMAFDOWNLOADSCHEDULER_H
+#define OMAFDOWNLOADSCHEDULER_H
+
+#include "general.h"
+#include <mutex>
+#include <list>
+
+VCD_OMAF_BEGIN
+
+class OmafSegment;
+class OmafAdaptationSet;
+
+//!
+//! \brief  download priority of an adaptation set, the smaller the earlier
+//!
+typedef enum{
+    PRIORITY_VIEWPORT = 0,     //<! high resolution tiles in the viewport and the selected extractor
+    PRIORITY_BACKGROUND,       //<! low resolution tiles, always downloaded and never cancelled
+    PRIORITY_PREDICTED,        //<! high resolution tiles only needed by the predicted extractors
+}DownloadPriority;
+
+class OmafDownloadScheduler {
+public:
+    OmafDownloadScheduler();
+    virtual ~OmafDownloadScheduler();
+
+public:
+    //!
+    //! \brief  queue a segment download of the adaptation set, the segment is
+    //!         opened once it is the most urgent one and a slot is free. The
+    //!         scheduler owns the segment until it is handed to reader manager
+    //! \param  pSeg, the segment to download
+    //! \param  pAS, the adaptation set the segment belongs to
+    //! \param  deadline, the sys_clock time in ms the segment should be downloaded by
+    //!
+    int AddSegment(OmafSegment* pSeg, OmafAdaptationSet* pAS, uint32_t deadline);
+
+    //!
+    //! \brief  called by the segment when its download is done or stopped
+    //!
+    void SegmentDone(OmafSegment* pSeg, bool bDownloaded);
+
+    //!
+    //! \brief  update the priority of the queued segments after the enabled
+    //!         extractors changed, and cancel the segments of the adaptation
+    //!         sets not enabled any more, both queued and downloading ones
+    //!
+    int CancelStaleRequests();
+
+    //!
+    //! \brief  cancel all the segments queued and downloading
+    //!
+    void CancelAll();
+
+    void     SetMaxInFlight(uint32_t maxInFlight);
+    uint32_t GetMaxInFlight()   { return mMaxInFlight; };
+    uint32_t GetLateCount()     { return mLateCount;   };
+
+private:
+    typedef struct SCHEDULEREQUEST{
+        OmafSegment*       pSeg;
+        OmafAdaptationSet* pAS;
+        DownloadPriority   priority;
+        uint32_t           deadline;
+        uint64_t           order;
+    }ScheduleRequest;
+
+    //!
+    //! \brief  start the most urgent queued segments until no slot is free
+    //!
+    void Dispatch();
+
+    //!
+    //! \brief  whether request a should be started before request b
+    //!
+    static bool IsMoreUrgent(const ScheduleRequest& a, const ScheduleRequest& b);
+
+    //!
+    //! \brief  stop the segments and release the ones not handed to reader manager
+    //!
+    void ReleaseSegments(std::list<ScheduleRequest>& requests, bool bStop);
+
+    //!
+    //! \brief  release the segments stopped in download threads
+    //!
+    void ReleaseFinished();
+
+private:
+    std::mutex                            mMutex;            //<! for synchronization
+    std::list<ScheduleRequest>            mPending;          //<! the segments waiting for a slot
+    std::list<ScheduleRequest>            mInFlight;         //<! the segments being downloaded
+    std::list<ScheduleRequest>            mFinished;         //<! the stopped segments to release
+    uint32_t                              mMaxInFlight;      //<! the max number of segments downloaded at the same time
+    uint64_t                              mOrder;            //<! the order of the next queued segment
+    uint32_t                              mLateCount;        //<! the count of segments downloaded after deadline
+};
+
+typedef VCD::VRVideo::Singleton<OmafDownloadScheduler> DOWNLOADSCHEDULER;    //<! singleton of OmafDownloadScheduler
+
+VCD_OMAF_END;
+
+#endif /* OMAFDOWNLOADSCHEDULER_H */
+
@@ -36,10 +36,27 @@
 #include "OmafExtractorSelector.h"
 #include "OmafMediaStream.h"
 #include "OmafReaderManager.h"
+#include "OmafDownloadScheduler.h"
+#include "OmafDashDownload/OmafThroughputEstimator.h"
 #include <cfloat>
 #include <math.h>
 #include <chrono>
 #include <cstdint>
+#include <set>
+#include <algorithm>
+#include <thread>
+
+// the share of the measured throughput that segments can use
+#define ABR_SAFETY_FACTOR 0.85
+// the buffered segments below which the player is about to starve
+#define ABR_LOW_BUFFER 1
+// the segment periods in a row with enough throughput to go up one level
+#define ABR_UP_PERIODS 2
+// the default max count of predicted extractors to prefetch
+#define DEFAULT_PREDICT_COUNT 2
+// the default grid step in degree of the viewport lookup table, the pose is
+// snapped by half of it at most, far less than a tile
+#define DEFAULT_VIEWPORT_GRID_STEP 5
 
 VCD_OMAF_BEGIN
 
@@ -49,9 +66,16 @@ OmafExtractorSelector::OmafExtractorSelector( int size )
     mSize = size;
     m360ViewPortHandle = nullptr;
     mParamViewport = nullptr;
+    mViewportGridStep = DEFAULT_VIEWPORT_GRID_STEP;
     mCurrentExtractor = nullptr;
     mPose = nullptr;
     mUsePrediction = false;
+    mPredictor = new OmafKalmanPosePredictor();
+    mPredictCount = DEFAULT_PREDICT_COUNT;
+    mUseABR = true;
+    mABRLevel = ABR_LEVEL_FULL;
+    mUpPeriods = 0;
+    mHeldExtractor = nullptr;
 }
 
 OmafExtractorSelector::~OmafExtractorSelector()
@@ -64,6 +88,19 @@ OmafExtractorSelector::~OmafExtractorSelector()
         m360ViewPortHandle = nullptr;
     }
 
+    if(mViewportLUT)
+    {
+        // the thread still building the table releases the handle when it's done
+        std::lock_guard<std::mutex> lutLock(mViewportLUT->mutex);
+        mViewportLUT->abandoned = true;
+        if(mViewportLUT->ready)
+        {
+            genViewport_unInit(mViewportLUT->handle);
+            mViewportLUT->handle = nullptr;
+            mViewportLUT->ready = false;
+        }
+    }
+
     if(mParamViewport)
     {
         SAFE_DELETE(mParamViewport->m_pUpLeft);
@@ -79,9 +116,21 @@ OmafExtractorSelector::~OmafExtractorSelector()
         }
     }
 
+    SAFE_DELETE(mPredictor);
+
     mUsePrediction = false;
 }
 
+void OmafExtractorSelector::SetPosePredictor(OmafPosePredictor* predictor)
+{
+    if(!predictor) return;
+
+    pthread_mutex_lock(&mMutex);
+    SAFE_DELETE(mPredictor);
+    mPredictor = predictor;
+    pthread_mutex_unlock(&mMutex);
+}
+
 int OmafExtractorSelector::SelectExtractors(OmafMediaStream* pStream)
 {
     OmafExtractor* pSelectedExtrator = GetExtractorByPose( pStream );
@@ -89,15 +138,42 @@ int OmafExtractorSelector::SelectExtractors(OmafMediaStream* pStream)
     if(NULL == pSelectedExtrator && !mCurrentExtractor)
         return ERROR_NULL_PTR;
 
-    mCurrentExtractor = pSelectedExtrator ? pSelectedExtrator : mCurrentExtractor;
+    // the extractor held in a bandwidth dip is still the one for current pose
+    if(!pSelectedExtrator && mHeldExtractor && mHeldExtractor != mCurrentExtractor)
+        pSelectedExtrator = mHeldExtractor;
+    mHeldExtractor = nullptr;
+
+    ListExtractor viewportExtractors;
+    viewportExtractors.push_back(pSelectedExtrator ? pSelectedExtrator : mCurrentExtractor);
 
     ListExtractor extractors;
 
     if(mUsePrediction)
     {
-        extractors = GetExtractorByPosePrediction( pStream );
+        extractors = GetExtractorByPosePrediction( pStream, viewportExtractors.front() );
+    }
+
+    extractors.push_front(viewportExtractors.front());
+
+    ABRLevel lastLevel = mABRLevel;
+    ABRLevel level = UpdateABRLevel(viewportExtractors, extractors);
+
+    // switching the extractor fetches a new set of high resolution tiles, so
+    // keep the current one in a dip and show the new viewport in low resolution
+    if(level == ABR_LEVEL_LOW && mCurrentExtractor && pSelectedExtrator && pSelectedExtrator != mCurrentExtractor)
+    {
+        LOG(INFO)<<"hold extractor "<<mCurrentExtractor->GetID()<<" instead of "<<pSelectedExtrator->GetID()<<" for low bandwidth"<<endl;
+        mHeldExtractor = pSelectedExtrator;
+        pSelectedExtrator = NULL;
     }
 
+    mCurrentExtractor = pSelectedExtrator ? pSelectedExtrator : mCurrentExtractor;
+
+    if(level != ABR_LEVEL_FULL)
+        extractors.clear();
+    else
+        extractors.pop_front();
+
     extractors.push_front(mCurrentExtractor);
 
     if(pSelectedExtrator || extractors.size() > 1)
@@ -112,6 +188,11 @@ int OmafExtractorSelector::SelectExtractors(OmafMediaStream* pStream)
 
     int ret = pStream->UpdateEnabledExtractors(extractors);
 
+    // the segments of tiles out of the new viewport or the dropped prefetch
+    // are not needed any more
+    if(ERROR_NONE == ret && (pSelectedExtrator || level < lastLevel))
+        DOWNLOADSCHEDULER::GetInstance()->CancelStaleRequests();
+
     return ret;
 }
 
@@ -128,6 +209,7 @@ int OmafExtractorSelector::UpdateViewport(HeadPose* pose)
     std::chrono::high_resolution_clock clock;
     pi.time = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now().time_since_epoch()).count();
     mPoseHistory.push_front(pi);
+    mPredictor->AddPose(pose, pi.time);
     if( mPoseHistory.size() > (uint32_t)(this->mSize) )
     {
         auto pit = mPoseHistory.back();
@@ -169,6 +251,9 @@ int OmafExtractorSelector::SetInitialViewport( std::vector<Viewport*>& pView, He
     if(!m360ViewPortHandle)
         return ERROR_NULL_PTR;
 
+    if(mViewportGridStep > 0 && BuildViewportLUT() != ERROR_NONE)
+        LOG(WARNING)<<"Failed to build the viewport lookup table, map the viewport of every pose!"<<endl;
+
     //set current Pose;
     mPose = new HeadPose;
     memcpy(mPose, headSetInfo->pose, sizeof(HeadPose));
@@ -231,16 +316,17 @@ OmafExtractor* OmafExtractorSelector::GetExtractorByPose( OmafMediaStream* pStre
 OmafExtractor* OmafExtractorSelector::SelectExtractor(OmafMediaStream* pStream, HeadPose* pose)
 {
     // to select extractor;
-    int ret = genViewport_setViewPort(m360ViewPortHandle, pose->yaw, pose->pitch);
+    void* viewPortHandle = GetViewportHandle();
+    int ret = genViewport_setViewPort(viewPortHandle, pose->yaw, pose->pitch);
     if(ret != 0)
         return NULL;
-    ret = genViewport_process(mParamViewport, m360ViewPortHandle);
+    ret = genViewport_process(mParamViewport, viewPortHandle);
     if(ret != 0)
         return NULL;
 
     // get Content Coverage from 360SCVP library
     CCDef* outCC = new CCDef;
-    ret = genViewport_getContentCoverage(m360ViewPortHandle, outCC);
+    ret = genViewport_getContentCoverage(viewPortHandle, outCC);
     if(ret != 0)
         return NULL;
 
@@ -256,6 +342,53 @@ OmafExtractor* OmafExtractorSelector::SelectExtractor(OmafMediaStream* pStream,
     return selectedExtractor;
 }
 
+int OmafExtractorSelector::BuildViewportLUT()
+{
+    // the handle is initialized with its own output, the table takes seconds
+    // to build, so it is built in background and then used for every pose
+    generateViewPortParam param = *mParamViewport;
+    point upLeft[6], downRight[6];
+    param.m_pUpLeft = upLeft;
+    param.m_pDownRight = downRight;
+
+    std::shared_ptr<ViewportLUT> lut = std::make_shared<ViewportLUT>();
+    lut->handle = genViewport_Init(&param);
+    lut->ready = false;
+    lut->abandoned = false;
+    if(!lut->handle)
+        return ERROR_NULL_PTR;
+
+    float step = mViewportGridStep;
+    std::thread([lut, step]{
+        int32_t ret = genViewport_buildLookupTable(lut->handle, step);
+
+        std::lock_guard<std::mutex> lutLock(lut->mutex);
+        if(ret != 0)
+            LOG(ERROR)<<"Failed to build the viewport lookup table with grid step "<<step<<endl;
+        if(ret != 0 || lut->abandoned)
+        {
+            genViewport_unInit(lut->handle);
+            lut->handle = nullptr;
+            return;
+        }
+        lut->ready = true;
+    }).detach();
+
+    mViewportLUT = lut;
+    return ERROR_NONE;
+}
+
+void* OmafExtractorSelector::GetViewportHandle()
+{
+    if(mViewportLUT)
+    {
+        std::lock_guard<std::mutex> lutLock(mViewportLUT->mutex);
+        if(mViewportLUT->ready)
+            return mViewportLUT->handle;
+    }
+    return m360ViewPortHandle;
+}
+
 OmafExtractor* OmafExtractorSelector::GetNearestExtractor(OmafMediaStream* pStream, CCDef* outCC)
 {
     // calculate which extractor should be chosen
@@ -285,35 +418,160 @@ OmafExtractor* OmafExtractorSelector::GetNearestExtractor(OmafMediaStream* pStre
     return selectedExtractor;
 }
 
-ListExtractor OmafExtractorSelector::GetExtractorByPosePrediction( OmafMediaStream* pStream )
+uint64_t OmafExtractorSelector::GetRequiredBitrate(ListExtractor& extractors)
 {
-    ListExtractor extractors;
-    pthread_mutex_lock(&mMutex);
-    if(mPoseHistory.size() <= 1)
+    uint64_t bitrate = 0;
+    std::set<OmafAdaptationSet*> counted;
+    for(auto &extractor: extractors)
     {
-        pthread_mutex_unlock(&mMutex);
-        return extractors;
+        if(!extractor || counted.count(extractor))
+            continue;
+        counted.insert(extractor);
+        bitrate += extractor->GetRepresentationBandwidth();
+
+        std::map<int, OmafAdaptationSet*> AS = extractor->GetDependAdaptationSets();
+        for(auto &it: AS)
+        {
+            if(counted.count(it.second))
+                continue;
+            counted.insert(it.second);
+            bitrate += it.second->GetRepresentationBandwidth();
+        }
     }
+    return bitrate;
+}
 
-    PoseInfo pf, pb;
-    pf = mPoseHistory.front();
-    pb = mPoseHistory.back();
-    pthread_mutex_unlock(&mMutex);
+ABRLevel OmafExtractorSelector::UpdateABRLevel(ListExtractor& viewportExtractors, ListExtractor& allExtractors)
+{
+    if(!mUseABR)
+    {
+        mABRLevel = ABR_LEVEL_FULL;
+        return mABRLevel;
+    }
+
+    // be conservative with the lower one of the long and short term estimates
+    uint64_t windowBitrate = THROUGHPUTESTIMATOR::GetInstance()->GetWindowThroughput();
+    uint64_t ewmaBitrate   = THROUGHPUTESTIMATOR::GetInstance()->GetEwmaThroughput();
+    uint64_t throughput    = windowBitrate && ewmaBitrate ? min(windowBitrate, ewmaBitrate) : max(windowBitrate, ewmaBitrate);
+
+    uint64_t viewportBitrate = GetRequiredBitrate(viewportExtractors);
+    uint64_t fullBitrate     = GetRequiredBitrate(allExtractors);
+
+    // nothing measured yet, or the MPD has no bandwidth to compare with
+    if(!throughput || !viewportBitrate)
+    {
+        mABRLevel = ABR_LEVEL_FULL;
+        mUpPeriods = 0;
+        return mABRLevel;
+    }
+
+    uint32_t buffered = 0;
+    if(mCurrentExtractor)
+        buffered = READERMANAGER::GetInstance()->GetBufferedSegmentCount(mCurrentExtractor->GetTrackNumber());
+
+    double budget = throughput * ABR_SAFETY_FACTOR;
+    ABRLevel target = ABR_LEVEL_LOW;
+    if(budget >= fullBitrate)
+        target = ABR_LEVEL_FULL;
+    else if(budget >= viewportBitrate)
+        target = ABR_LEVEL_VIEWPORT;
+
+    // no prefetching when the player is about to starve
+    if(buffered < ABR_LOW_BUFFER && target == ABR_LEVEL_FULL)
+        target = ABR_LEVEL_VIEWPORT;
+
+    ABRLevel level = mABRLevel;
+    if(target < mABRLevel)
+    {
+        level = target;
+        mUpPeriods = 0;
+    }
+    else if(target > mABRLevel)
+    {
+        // ramp up one level after the throughput stays high enough for a while
+        if(++mUpPeriods >= ABR_UP_PERIODS)
+        {
+            level = (ABRLevel)(mABRLevel + 1);
+            mUpPeriods = 0;
+        }
+    }
+    else
+    {
+        mUpPeriods = 0;
+    }
+
+    if(level != mABRLevel)
+    {
+        LOG(INFO)<<"ABR level changes from "<<mABRLevel<<" to "<<level<<", throughput "<<throughput
+                 <<" bps, viewport needs "<<viewportBitrate<<" bps, buffered segments "<<buffered<<endl;
+    }
+
+    mABRLevel = level;
+    return mABRLevel;
+}
+
+uint64_t OmafExtractorSelector::GetPredictionHorizon( OmafMediaStream* pStream, OmafExtractor* viewportExtractor )
+{
+    uint64_t segmentDuration = pStream->GetSegmentDuration() * 1000;
+    if(!segmentDuration)
+        return CalculatePredictionHorizon(0, 0, 0, 0);
+
+    ListExtractor extractors;
+    extractors.push_back(viewportExtractor);
+
+    return CalculatePredictionHorizon(segmentDuration,
+                                      THROUGHPUTESTIMATOR::GetInstance()->GetRTT(),
+                                      THROUGHPUTESTIMATOR::GetInstance()->GetEwmaThroughput(),
+                                      GetRequiredBitrate(extractors));
+}
+
+ListExtractor OmafExtractorSelector::GetExtractorByPosePrediction( OmafMediaStream* pStream, OmafExtractor* viewportExtractor )
+{
+    ListExtractor extractors;
+    if(mPredictCount <= 0)
+        return extractors;
 
     std::chrono::high_resolution_clock clock;
     uint64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now().time_since_epoch()).count();
+    time += GetPredictionHorizon(pStream, viewportExtractor);
+
+    std::vector<PoseCandidate> candidates;
+    pthread_mutex_lock(&mMutex);
+    int ret = mPredictor->PredictPose(time, candidates);
+    pthread_mutex_unlock(&mMutex);
+    if(ret != ERROR_NONE)
+        return extractors;
+
+    // sum the weights of the candidates falling in each extractor
+    std::vector<std::pair<OmafExtractor*, float>> ranks;
+    for(auto &candidate: candidates)
+    {
+        OmafExtractor *selectedExtractor = SelectExtractor(pStream, &candidate.pose);
+        if(!selectedExtractor || selectedExtractor == viewportExtractor)
+            continue;
+
+        auto it = ranks.begin();
+        for( ; it != ranks.end(); it++)
+        {
+            if(it->first == selectedExtractor) break;
+        }
+        if(it == ranks.end())
+            ranks.push_back(std::make_pair(selectedExtractor, candidate.weight));
+        else
+            it->second += candidate.weight;
+    }
+
+    std::stable_sort(ranks.begin(), ranks.end(), [](const std::pair<OmafExtractor*, float>& a, const std::pair<OmafExtractor*, float>& b){
+        return a.second > b.second;
+    });
+
+    for(auto &rank: ranks)
+    {
+        if((int)extractors.size() >= mPredictCount)
+            break;
+        extractors.push_back(rank.first);
+    }
 
-    // simple prediction, assuming the move is uniform
-    float yaw = (pb.pose->yaw - pf.pose->yaw)/(pb.time - pf.time) * (time - pb.time + 1000) + pb.pose->yaw;
-    float pitch = (pb.pose->pitch - pf.pose->pitch)/(pb.time - pf.time) * (time - pb.time + 1000) + pb.pose->pitch;
-    HeadPose* pose = new HeadPose;
-    pose->yaw = yaw;
-    pose->pitch = pitch;
-    // to select extractor;
-    OmafExtractor *selectedExtractor = SelectExtractor(pStream, pose);
-    if(selectedExtractor)
-        extractors.push_back(selectedExtractor);
-    SAFE_DELETE(pose);
     return extractors;
 }
 
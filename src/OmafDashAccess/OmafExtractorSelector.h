@@ -39,6 +39,9 @@
 #include "OmafExtractor.h"
 #include "OmafMediaStream.h"
 #include "360SCVPViewportAPI.h"
+#include "OmafPosePredictor.h"
+#include <memory>
+#include <mutex>
 
 using namespace VCD::OMAF;
 
@@ -53,6 +56,26 @@ typedef struct POSEINFO{
     uint64_t  time;
 }PoseInfo;
 
+//!
+//! \brief  the viewport handle with the lookup table, shared by the selector and
+//!         the thread building the table. The one leaving last releases it
+//!
+typedef struct VIEWPORTLUT{
+    std::mutex  mutex;
+    void        *handle;      //<! the viewport handle the table is built in
+    bool        ready;        //<! the table is built and the handle can be used
+    bool        abandoned;    //<! the selector is destroyed before the table is built
+}ViewportLUT;
+
+//!
+//! \brief  the quality level chosen by throughput and buffer level for a segment period
+//!
+typedef enum{
+    ABR_LEVEL_LOW = 0,    //<! hold the extractor, the viewport out of its high resolution tiles is shown in low resolution
+    ABR_LEVEL_VIEWPORT,   //<! follow the viewport without prefetching predicted extractors
+    ABR_LEVEL_FULL,       //<! follow the viewport and prefetch predicted extractors
+}ABRLevel;
+
 class OmafExtractorSelector {
 public:
     //!
@@ -88,6 +111,32 @@ public:
 
     void EnablePosePrediction(){mUsePrediction = true;};
 
+    //!
+    //! \brief  replace the pose predictor, the selector takes the ownership.
+    //!         A OmafKalmanPosePredictor is used by default
+    //!
+    void SetPosePredictor(OmafPosePredictor* predictor);
+
+    //!
+    //! \brief  set the max count of predicted extractors to prefetch
+    //!
+    void SetPredictionCount(int count){mPredictCount = count;};
+
+    //!
+    //! \brief  enable or disable the throughput based adaptation, it's enabled
+    //!         by default. The level is always ABR_LEVEL_FULL when disabled
+    //!
+    void EnableABR(bool bEnable){mUseABR = bEnable;};
+
+    //!
+    //! \brief  set the grid step in degree of the viewport lookup table for the
+    //!         pose, 0 to map the viewport of every pose. The table is built in
+    //!         background, so it must be set before SetInitialViewport
+    //!
+    void SetViewportGridStep(float step){mViewportGridStep = step;};
+
+    ABRLevel GetABRLevel(){return mABRLevel;};
+
 private:
     //!
     //! \brief  Get Extractor based on latest Pose
@@ -95,9 +144,17 @@ private:
     OmafExtractor* GetExtractorByPose( OmafMediaStream* pStream );
 
     //!
-    //! \brief  predict Extractor based history Poses
+    //! \brief  predict the extractors at the time the next segment is played,
+    //!         the most likely first. At most mPredictCount extractors other
+    //!         than the viewport extractor are returned
+    //!
+    ListExtractor GetExtractorByPosePrediction( OmafMediaStream* pStream, OmafExtractor* viewportExtractor );
+
+    //!
+    //! \brief  the time in ms from now to predict the pose for, that is a
+    //!         segment duration plus the time to download the segment
     //!
-    ListExtractor GetExtractorByPosePrediction( OmafMediaStream* pStream );
+    uint64_t GetPredictionHorizon( OmafMediaStream* pStream, OmafExtractor* viewportExtractor );
 
     bool IsDifferentPose(HeadPose* pose1, HeadPose* pose2);
 
@@ -105,6 +162,31 @@ private:
 
     OmafExtractor* SelectExtractor(OmafMediaStream* pStream, HeadPose* pose);
 
+    //!
+    //! \brief  start to build the viewport lookup table with another handle in
+    //!         background, m360ViewPortHandle is used until it is built
+    //!
+    int BuildViewportLUT();
+
+    //!
+    //! \brief  get the handle with the lookup table if it is built, or else
+    //!         m360ViewPortHandle
+    //!
+    void* GetViewportHandle();
+
+    //!
+    //! \brief  update the quality level for the next segment period with the
+    //!         measured throughput and the buffered segments. It goes down at
+    //!         once and goes up one level after ABR_UP_PERIODS periods
+    //!
+    ABRLevel UpdateABRLevel(ListExtractor& viewportExtractors, ListExtractor& allExtractors);
+
+    //!
+    //! \brief  the bit rate in bps to download the extractors and the adaptation
+    //!         sets they depend on
+    //!
+    uint64_t GetRequiredBitrate(ListExtractor& extractors);
+
 private:
     std::list<PoseInfo>               mPoseHistory;               //<!
     int                               mSize;
@@ -113,7 +195,15 @@ private:
     OmafExtractor                     *mCurrentExtractor;
     void                              *m360ViewPortHandle;
     generateViewPortParam             *mParamViewport;
+    float                             mViewportGridStep;          //<! the grid step of the viewport lookup table, 0 for no table
+    std::shared_ptr<ViewportLUT>      mViewportLUT;               //<! the viewport lookup table built in background
     bool                              mUsePrediction;
+    OmafPosePredictor                 *mPredictor;                //<! the predictor fed with all poses
+    int                               mPredictCount;              //<! the max count of predicted extractors
+    bool                              mUseABR;                    //<! whether to adapt to throughput
+    ABRLevel                          mABRLevel;                  //<! the quality level of current segment period
+    int                               mUpPeriods;                 //<! the periods the level could go up in a row
+    OmafExtractor                     *mHeldExtractor;            //<! the extractor for the pose but held in ABR_LEVEL_LOW
 };
 
 VCD_OMAF_END;
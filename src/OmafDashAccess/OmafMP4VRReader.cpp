@@ -77,14 +77,32 @@ class SegmentStream : public MP4VR::StreamInterface {
 public:
     SegmentStream(){
         mSegment = NULL;
+        mData    = NULL;
+        mSize    = 0;
+        mPos     = 0;
     };
-    SegmentStream(OmafSegment* seg){
+    SegmentStream(OmafSegment* seg):SegmentStream(){
         mSegment = seg;
-        mFileStream.open( seg->GetSegmentCacheFile().c_str(), ios_base::binary | ios_base::in );
+        if(seg->GetSegmentCacheFile().empty())
+        {
+            // no disk cache, read the download buffer in place
+            const uint8_t* data = NULL;
+            size_t size = 0;
+            if(ERROR_NONE == seg->GetDataView(&data, &size))
+            {
+                mData = (const char*)data;
+                mSize = size;
+            }
+        }
+        else
+        {
+            mFileStream.open( seg->GetSegmentCacheFile().c_str(), ios_base::binary | ios_base::in );
+        }
     };
     ~SegmentStream(){
         mSegment = NULL;
-        mFileStream.close();
+        mData    = NULL;
+        if(mFileStream.is_open()) mFileStream.close();
     };
 public:
     /** Returns the number of bytes read. The value of 0 indicates end
@@ -96,6 +114,15 @@ public:
     virtual offset_t read(char* buffer, offset_t size){
         if(NULL == mSegment) return -1;
 
+        if(!mFileStream.is_open())
+        {
+            if(size <= 0 || mPos >= mSize) return 0;
+            offset_t readCnt = std::min(size, mSize - mPos);
+            memcpy(buffer, mData + mPos, readCnt);
+            mPos += readCnt;
+            return readCnt;
+        }
+
         mFileStream.read(buffer, size);
         std::streamsize readCnt = mFileStream.gcount();
         return (offset_t)readCnt;
@@ -114,6 +141,13 @@ public:
      */
     virtual bool absoluteSeek(offset_t offset){
         if(NULL == mSegment) return false;
+
+        if(!mFileStream.is_open())
+        {
+            mPos = offset;
+            return true;
+        }
+
         if (mFileStream.tellg() == -1)
         {
             mFileStream.clear();
@@ -131,6 +165,7 @@ public:
     virtual offset_t tell(){
 
         if(NULL == mSegment) return -1;
+        if(!mFileStream.is_open()) return mPos;
         offset_t offset1 = mFileStream.tellg();
         return offset1;
     };
@@ -142,6 +177,7 @@ public:
      */
     virtual offset_t size(){
         //return MP4VR::StreamInterface::IndeterminateSize;
+        if(!mFileStream.is_open()) return mSize;
         mFileStream.seekg(0, ios_base::end);
         int64_t size = mFileStream.tellg();
         mFileStream.seekg(0, ios_base::beg);
@@ -151,6 +187,9 @@ public:
 private:
     OmafSegment*   mSegment;
     std::ifstream  mFileStream;
+    const char*    mData;       //!< the downloaded data when the segment isn't cached in file
+    offset_t       mSize;       //!< size of mData
+    offset_t       mPos;        //!< read position in mData
 };
 
 OmafMP4VRReader::OmafMP4VRReader()
@@ -403,6 +442,42 @@ int32_t OmafMP4VRReader::getTrackInformations(std::vector<VCD::OMAF::TrackInform
     return ERROR_NONE;
 }
 
+int32_t OmafMP4VRReader::getSegmentSampleRanges(uint32_t trackId, std::map<uint32_t, VCD::OMAF::SegmentSampleRange>& ranges) const
+{
+    if(NULL == mMP4ReaderImpl) return ERROR_NULL_PTR;
+    MP4VR::MP4VRFileReaderInterface* pReader = (MP4VR::MP4VRFileReaderInterface*)mMP4ReaderImpl;
+
+    ranges.clear();
+
+    MP4VR::DynArray<MP4VR::TrackInformation> *Infos = new MP4VR::DynArray<MP4VR::TrackInformation>;
+
+    pReader->getTrackInformations(*Infos);
+
+    for( uint32_t i=0; i<(*Infos).size; i++){
+        // match the track the same way as SelectedTrackInfos
+        if( (*Infos)[i].initSegmentId != (trackId >> 16) || ((*Infos)[i].trackId & 0xffff) != (trackId & 0xffff) )
+            continue;
+
+        for(uint32_t idx=0; idx<(*Infos)[i].sampleProperties.size; idx++){
+            uint32_t segmentId = (*Infos)[i].sampleProperties[idx].segmentId;
+            auto it = ranges.find(segmentId);
+            if(it == ranges.end()){
+                SegmentSampleRange range;
+                range.segmentId     = segmentId;
+                range.firstSampleId = (*Infos)[i].sampleProperties[idx].sampleId;
+                range.sampleCount   = 1;
+                ranges[segmentId]   = range;
+            }else{
+                it->second.sampleCount++;
+            }
+        }
+        break;
+    }
+
+    delete Infos;
+    return ERROR_NONE;
+}
+
 int32_t OmafMP4VRReader::getDisplayWidth(uint32_t trackId, uint32_t& displayWidth) const
 {
     if(NULL == mMP4ReaderImpl) return ERROR_NULL_PTR;
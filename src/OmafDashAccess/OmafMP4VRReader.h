@@ -64,6 +64,8 @@ public:
 
     virtual int32_t getTrackInformations(std::vector<VCD::OMAF::TrackInformation*>& trackInfos) const  ;
 
+    virtual int32_t getSegmentSampleRanges(uint32_t trackId, std::map<uint32_t, VCD::OMAF::SegmentSampleRange>& ranges) const  ;
+
     virtual int32_t getDisplayWidth(uint32_t trackId, uint32_t& displayWidth) const  ;
 
     virtual int32_t getDisplayHeight(uint32_t trackId, uint32_t& displayHeight) const  ;
@@ -280,7 +280,7 @@ int OmafMediaStream::LoadLocalSegments()
     return ret;
 }
 */
-int OmafMediaStream::DownloadSegments()
+int OmafMediaStream::DownloadSegments(uint32_t deadline)
 {
     int ret = ERROR_NONE;
     pthread_mutex_lock(&mMutex);
@@ -288,7 +288,7 @@ int OmafMediaStream::DownloadSegments()
              it != mMediaAdaptationSet.end();
              it++ ){
         OmafAdaptationSet* pAS = (OmafAdaptationSet*)(it->second);
-        pAS->DownloadSegment();
+        pAS->DownloadSegment(deadline);
     }
 
     // NOTE: this function should be in the same thread with UpdateEnabledExtractors
@@ -298,7 +298,7 @@ int OmafMediaStream::DownloadSegments()
              extrator_it != mExtractors.end();
              extrator_it++ ){
         OmafExtractor* extractor = (OmafExtractor*)(extrator_it->second);
-        extractor->DownloadSegment();
+        extractor->DownloadSegment(deadline);
     }
     //pthread_mutex_unlock(&mCurrentMutex);
     pthread_mutex_unlock(&mMutex);
@@ -348,12 +348,21 @@ int OmafMediaStream::UpdateEnabledExtractors(std::list<OmafExtractor*> extractor
     mCurrentExtractors.clear();
     for( auto it = extractors.begin(); it != extractors.end(); it++ ){
         OmafExtractor* tmp = (OmafExtractor*) (*it);
+        // the first extractor covers current viewport, the others are predicted
+        bool bInView = (it == extractors.begin());
         tmp->Enable(true);
+        tmp->SetDownloadPriority(bInView ? PRIORITY_VIEWPORT : PRIORITY_PREDICTED);
         mCurrentExtractors.push_back(tmp);
         std::map<int, OmafAdaptationSet*> AS = tmp->GetDependAdaptationSets();
         for(auto as_it = AS.begin(); as_it != AS.end(); as_it++ ){
             OmafAdaptationSet* pAS = (OmafAdaptationSet*)(as_it->second);
+            // the tile in view of an earlier extractor keeps its priority
+            bool bInViewBefore = pAS->IsEnabled() && pAS->GetDownloadPriority() == PRIORITY_VIEWPORT;
             pAS->Enable(true);
+            if(pAS->GetRepresentationQualityRanking() != 1)
+                pAS->SetDownloadPriority(PRIORITY_BACKGROUND);
+            else if(!bInViewBefore)
+                pAS->SetDownloadPriority(bInView ? PRIORITY_VIEWPORT : PRIORITY_PREDICTED);
         }
     }
 
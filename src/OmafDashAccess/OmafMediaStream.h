@@ -72,8 +72,9 @@ public:
 
     //!
     //! \brief  download all segments for all AdaptationSets.
+    //! \param  deadline, the sys_clock time in ms the segments are needed by
     //!
-    int DownloadSegments();
+    int DownloadSegments(uint32_t deadline);
 
     //!
     //! \brief  Add extractor Adaptation Set
@@ -129,7 +130,9 @@ public:
     };
 
     //!
-    //! \brief  Update selected extractor after viewport changed
+    //! \brief  Update selected extractor after viewport changed, the first one
+    //!         is for current viewport and the others are predicted. The
+    //!         download priority of adaptation sets are updated as well
     //!
     int UpdateEnabledExtractors(std::list<OmafExtractor*> extractors);
 
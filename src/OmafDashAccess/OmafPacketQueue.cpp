@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * File:   OmafPacketQueue.cpp
+ * Author: media
+ *
+ * the single producer / single consumer packet queue of one track
+ */
+
+#include "OmafPacketQueue.h"
+
+VCD_OMAF_BEGIN
+
+OmafPacketQueue::OmafPacketQueue(uint32_t capacity)
+{
+    mCapacity = 1;
+    while(mCapacity < capacity) mCapacity <<= 1;
+
+    mSlots = new MediaPacket*[mCapacity];
+    for(uint32_t i = 0; i < mCapacity; i++)
+        mSlots[i] = NULL;
+
+    mHead = 0;
+    mTail = 0;
+    mConsumerWaiting = false;
+    mProducerWaiting = false;
+}
+
+OmafPacketQueue::~OmafPacketQueue()
+{
+    Clear();
+    delete []mSlots;
+    mSlots = NULL;
+}
+
+uint32_t OmafPacketQueue::Size()
+{
+    // load head first, so the size never underflows when racing with both sides
+    uint32_t head = mHead.load(std::memory_order_acquire);
+    uint32_t tail = mTail.load(std::memory_order_acquire);
+    return tail - head;
+}
+
+void OmafPacketQueue::Notify(std::atomic<bool>& waiting, std::condition_variable& cond)
+{
+    // the waiter sets the flag before checking the ring again, so it either sees
+    // the change or the flag is seen here and it is woken up under the lock
+    if(!waiting.load(std::memory_order_seq_cst)) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mWaitLock);
+    }
+    cond.notify_all();
+}
+
+bool OmafPacketQueue::Push(MediaPacket* pPacket)
+{
+    uint32_t tail = mTail.load(std::memory_order_relaxed);
+    if(tail - mHead.load(std::memory_order_acquire) >= mCapacity)
+        return false;
+
+    mSlots[tail & (mCapacity - 1)] = pPacket;
+    mTail.store(tail + 1, std::memory_order_seq_cst);
+
+    Notify(mConsumerWaiting, mNotEmpty);
+    return true;
+}
+
+MediaPacket* OmafPacketQueue::Pop(uint32_t waitTime)
+{
+    std::lock_guard<std::mutex> popLock(mPopLock);
+
+    uint32_t head = mHead.load(std::memory_order_relaxed);
+    if(head == mTail.load(std::memory_order_acquire))
+    {
+        if(!waitTime) return NULL;
+
+        std::unique_lock<std::mutex> lock(mWaitLock);
+        mConsumerWaiting.store(true, std::memory_order_seq_cst);
+        mNotEmpty.wait_for(lock, std::chrono::milliseconds(waitTime), [&]{
+            return head != mTail.load(std::memory_order_seq_cst);
+        });
+        mConsumerWaiting.store(false, std::memory_order_relaxed);
+
+        if(head == mTail.load(std::memory_order_acquire)) return NULL;
+    }
+
+    MediaPacket* pPacket = mSlots[head & (mCapacity - 1)];
+    mSlots[head & (mCapacity - 1)] = NULL;
+    mHead.store(head + 1, std::memory_order_seq_cst);
+
+    Notify(mProducerWaiting, mNotFull);
+    return pPacket;
+}
+
+bool OmafPacketQueue::WaitBelow(uint32_t level, uint32_t waitTime)
+{
+    if(Size() <= level) return true;
+    if(!waitTime) return false;
+
+    std::unique_lock<std::mutex> lock(mWaitLock);
+    mProducerWaiting.store(true, std::memory_order_seq_cst);
+    bool below = mNotFull.wait_for(lock, std::chrono::milliseconds(waitTime), [&]{
+        return Size() <= level;
+    });
+    mProducerWaiting.store(false, std::memory_order_relaxed);
+
+    return below;
+}
+
+void OmafPacketQueue::Clear()
+{
+    std::lock_guard<std::mutex> popLock(mPopLock);
+
+    uint32_t head = mHead.load(std::memory_order_relaxed);
+    uint32_t tail = mTail.load(std::memory_order_acquire);
+    for( ; head != tail; head++)
+    {
+        MediaPacket* pPacket = mSlots[head & (mCapacity - 1)];
+        mSlots[head & (mCapacity - 1)] = NULL;
+        SAFE_DELETE(pPacket);
+    }
+    mHead.store(head, std::memory_order_seq_cst);
+
+    Notify(mProducerWaiting, mNotFull);
+}
+
+VCD_OMAF_END
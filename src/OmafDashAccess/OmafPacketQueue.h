@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//!
+//! \file:   OmafPacketQueue.h
+//! \brief:  the packet queue of one track between reader manager and consumer
+//! \detail: a bounded single producer / single consumer ring. The reading thread
+//!          pushes and the consumer pops without sharing any lock; a mutex is
+//!          only taken to sleep when the ring is empty or full, and when the
+//!          queue is flushed by another thread.
+//!
+
+#ifndef OMAFPACKETQUEUE_H
+#define OMAFPACKETQUEUE_H
+
+#include "general.h"
+#include "MediaPacket.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+VCD_OMAF_BEGIN
+
+class OmafPacketQueue {
+public:
+    //!
+    //! \brief  construct the queue, capacity is rounded up to a power of 2
+    //!
+    OmafPacketQueue(uint32_t capacity);
+
+    //!
+    //! \brief  de-construct, the packets left in the queue are released
+    //!
+    virtual ~OmafPacketQueue();
+
+public:
+    //!
+    //! \brief  add a packet at the end of the queue, only called by the producer
+    //!
+    //! \return true if added, false if the queue is full
+    //!
+    bool Push(MediaPacket* pPacket);
+
+    //!
+    //! \brief  get the packet at the front of the queue. If the queue is empty,
+    //!         wait at most waitTime ms for a packet
+    //!
+    //! \return the packet, NULL if none
+    //!
+    MediaPacket* Pop(uint32_t waitTime);
+
+    //!
+    //! \brief  wait at most waitTime ms until there are no more than level packets
+    //!         in the queue, only called by the producer
+    //!
+    //! \return true if the queue is at or below the level
+    //!
+    bool WaitBelow(uint32_t level, uint32_t waitTime);
+
+    //!
+    //! \brief  release all packets in the queue, it can be called by any thread
+    //!
+    void Clear();
+
+    //!
+    //! \brief  get the count of packets in the queue
+    //!
+    uint32_t Size();
+
+    uint32_t GetCapacity() { return mCapacity; };
+
+private:
+    //!
+    //! \brief  wake up the threads sleeping in Pop or WaitBelow
+    //!
+    void Notify(std::atomic<bool>& waiting, std::condition_variable& cond);
+
+private:
+    MediaPacket**            mSlots;            //<! the ring buffer
+    uint32_t                 mCapacity;         //<! the count of slots, power of 2
+    std::atomic<uint32_t>    mHead;             //<! count of popped packets, written by consumer
+    std::atomic<uint32_t>    mTail;             //<! count of pushed packets, written by producer
+    std::mutex               mPopLock;          //<! serializes the consumer and the flushes
+    std::mutex               mWaitLock;         //<! only for sleeping on the conditions
+    std::condition_variable  mNotEmpty;         //<! notified when a packet is pushed
+    std::condition_variable  mNotFull;          //<! notified when packets are popped
+    std::atomic<bool>        mConsumerWaiting;  //<! the consumer sleeps in Pop
+    std::atomic<bool>        mProducerWaiting;  //<! the producer sleeps in WaitBelow
+};
+
+VCD_OMAF_END;
+
+#endif /* OMAFPACKETQUEUE_H */
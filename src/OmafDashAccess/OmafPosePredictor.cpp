@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * File:   OmafPosePredictor.cpp
+ * Author: media
+ *
+ * the predictors of head pose
+ */
+
+#include "OmafPosePredictor.h"
+#include <math.h>
+
+// the variance of the head angular acceleration, (degree/s^2)^2
+#define ACCELERATION_NOISE (60.0 * 60.0)
+// the variance of the pose measurement, degree^2
+#define MEASUREMENT_NOISE 1.0
+// the variance of the initial velocity, (degree/s)^2
+#define INITIAL_VELOCITY_VARIANCE (100.0 * 100.0)
+// the largest standard deviation to spread the candidates, degree
+#define MAX_CANDIDATE_SPREAD 60.0
+// the weight of the candidates one standard deviation away, exp(-0.5)
+#define SIDE_CANDIDATE_WEIGHT 0.6065f
+
+VCD_OMAF_BEGIN
+
+float WrapYaw(double yaw)
+{
+    yaw = fmod(yaw + 180.0, 360.0);
+    if(yaw < 0) yaw += 360.0;
+    return (float)(yaw - 180.0);
+}
+
+uint64_t CalculatePredictionHorizon(uint64_t segmentDuration, uint64_t rtt, uint64_t throughput, uint64_t bitrate)
+{
+    if(!segmentDuration)
+        return DEFAULT_PREDICT_HORIZON;
+
+    // the segment prefetched now is played after it's downloaded
+    uint64_t downloadTime = rtt;
+    if(throughput && bitrate)
+    {
+        uint64_t transferTime = segmentDuration * bitrate / throughput;
+        uint64_t maxTime      = segmentDuration * MAX_DOWNLOAD_PERIODS;
+        downloadTime += transferTime < maxTime ? transferTime : maxTime;
+    }
+
+    return segmentDuration + downloadTime;
+}
+
+OmafKalmanPosePredictor::OmafKalmanPosePredictor()
+{
+    Reset();
+}
+
+OmafKalmanPosePredictor::~OmafKalmanPosePredictor()
+{
+}
+
+void OmafKalmanPosePredictor::Reset()
+{
+    InitAxis(&mYaw, 0);
+    InitAxis(&mPitch, 0);
+    mLastTime    = 0;
+    mInitialized = false;
+}
+
+void OmafKalmanPosePredictor::InitAxis(AxisState* axis, double angle)
+{
+    axis->angle    = angle;
+    axis->velocity = 0;
+    axis->p00      = MEASUREMENT_NOISE;
+    axis->p01      = 0;
+    axis->p11      = INITIAL_VELOCITY_VARIANCE;
+}
+
+void OmafKalmanPosePredictor::PredictAxis(AxisState* axis, double dt)
+{
+    double dt2 = dt * dt;
+
+    axis->angle += axis->velocity * dt;
+
+    // P = F * P * F' + Q, with F = [1 dt; 0 1]
+    axis->p00 += 2 * dt * axis->p01 + dt2 * axis->p11 + ACCELERATION_NOISE * dt2 * dt2 / 4;
+    axis->p01 += dt * axis->p11 + ACCELERATION_NOISE * dt2 * dt / 2;
+    axis->p11 += ACCELERATION_NOISE * dt2;
+}
+
+void OmafKalmanPosePredictor::UpdateAxis(AxisState* axis, double innovation)
+{
+    double s  = axis->p00 + MEASUREMENT_NOISE;
+    double k0 = axis->p00 / s;
+    double k1 = axis->p01 / s;
+
+    axis->angle    += k0 * innovation;
+    axis->velocity += k1 * innovation;
+
+    double p00 = axis->p00;
+    double p01 = axis->p01;
+    axis->p00  = (1 - k0) * p00;
+    axis->p01  = (1 - k0) * p01;
+    axis->p11 -= k1 * p01;
+}
+
+void OmafKalmanPosePredictor::Extrapolate(AxisState* axis, double dt, double* angle, double* variance)
+{
+    double dt2 = dt * dt;
+
+    *angle    = axis->angle + axis->velocity * dt;
+    *variance = axis->p00 + 2 * dt * axis->p01 + dt2 * axis->p11 + ACCELERATION_NOISE * dt2 * dt2 / 4;
+}
+
+void OmafKalmanPosePredictor::AddPose(HeadPose* pose, uint64_t time)
+{
+    if(!pose) return;
+
+    if(!mInitialized)
+    {
+        InitAxis(&mYaw, pose->yaw);
+        InitAxis(&mPitch, pose->pitch);
+        mLastTime    = time;
+        mInitialized = true;
+        return;
+    }
+
+    if(time > mLastTime)
+    {
+        double dt = (time - mLastTime) / 1000.0;
+        PredictAxis(&mYaw, dt);
+        PredictAxis(&mPitch, dt);
+        mLastTime = time;
+    }
+
+    // the measured yaw is wrapped, so take the shortest way to it
+    double yawInnovation = WrapYaw(pose->yaw - mYaw.angle);
+    UpdateAxis(&mYaw, yawInnovation);
+    UpdateAxis(&mPitch, pose->pitch - mPitch.angle);
+}
+
+int OmafKalmanPosePredictor::PredictPose(uint64_t time, std::vector<PoseCandidate>& candidates)
+{
+    candidates.clear();
+
+    if(!mInitialized) return ERROR_INVALID;
+
+    double dt = time > mLastTime ? (time - mLastTime) / 1000.0 : 0;
+
+    double yaw, yawVar, pitch, pitchVar;
+    Extrapolate(&mYaw, dt, &yaw, &yawVar);
+    Extrapolate(&mPitch, dt, &pitch, &pitchVar);
+
+    double yawSpread   = fmin(sqrt(yawVar), MAX_CANDIDATE_SPREAD);
+    double pitchSpread = fmin(sqrt(pitchVar), MAX_CANDIDATE_SPREAD);
+
+    // the head keeps moving the same way more likely than turning back, so
+    // the side along the velocity goes first
+    double yawDir   = mYaw.velocity >= 0 ? 1 : -1;
+    double pitchDir = mPitch.velocity >= 0 ? 1 : -1;
+
+    const double offsets[5][3] = {
+        { 0,                0,                  1                     },
+        { yawDir,           0,                  SIDE_CANDIDATE_WEIGHT },
+        { 0,                pitchDir,           SIDE_CANDIDATE_WEIGHT },
+        { -yawDir,          0,                  SIDE_CANDIDATE_WEIGHT },
+        { 0,                -pitchDir,          SIDE_CANDIDATE_WEIGHT },
+    };
+
+    for(int i = 0; i < 5; i++)
+    {
+        PoseCandidate candidate;
+        candidate.pose.yaw   = WrapYaw(yaw + offsets[i][0] * yawSpread);
+        candidate.pose.pitch = (float)fmax(-90.0, fmin(90.0, pitch + offsets[i][1] * pitchSpread));
+        candidate.weight     = (float)offsets[i][2];
+        candidates.push_back(candidate);
+    }
+
+    return ERROR_NONE;
+}
+
+VCD_OMAF_END;
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//!
+//! \file:   OmafPosePredictor.h
+//! \brief:  predict the head pose at a future time
+//! \detail: the predictor is fed with every pose set by the user, and gives
+//!          weighted candidate poses at a given time, so the extractors most
+//!          likely to be viewed can be prefetched.
+//!
+
+#ifndef OMAFPOSEPREDICTOR_H
+#define OMAFPOSEPREDICTOR_H
+
+#include "general.h"
+#include <vector>
+
+// the prediction horizon in ms if segment duration is unknown
+#define DEFAULT_PREDICT_HORIZON 1000
+// the longest download time in segment durations counted in the horizon
+#define MAX_DOWNLOAD_PERIODS 2
+
+VCD_OMAF_BEGIN
+
+//!
+//! \brief  a predicted pose and its likelihood, the weights are relative
+//!
+typedef struct POSECANDIDATE{
+    HeadPose  pose;
+    float     weight;
+}PoseCandidate;
+
+class OmafPosePredictor {
+public:
+    virtual ~OmafPosePredictor(){};
+
+    //!
+    //! \brief  add a pose set by the user
+    //! \param  pose, the pose, yaw in [-180, 180] and pitch in [-90, 90]
+    //! \param  time, the time in ms the pose is set
+    //!
+    virtual void AddPose(HeadPose* pose, uint64_t time) = 0;
+
+    //!
+    //! \brief  predict the candidate poses at the time, the most likely first
+    //! \param  time, the time in ms to predict
+    //! \param  candidates, output, the candidate poses
+    //! \return ERROR_NONE, or ERROR_INVALID if there is no pose added yet
+    //!
+    virtual int PredictPose(uint64_t time, std::vector<PoseCandidate>& candidates) = 0;
+
+    //!
+    //! \brief  drop all the poses added
+    //!
+    virtual void Reset() = 0;
+};
+
+//!
+//! \class:   OmafKalmanPosePredictor
+//! \brief:   a Kalman filter for each of yaw and pitch with constant velocity
+//!           and white noise acceleration. Yaw is tracked unwrapped, so a turn
+//!           across +-180 degree is not seen as a jump. The candidates are the
+//!           predicted pose and the poses one standard deviation around it
+//!
+class OmafKalmanPosePredictor : public OmafPosePredictor {
+public:
+    OmafKalmanPosePredictor();
+    virtual ~OmafKalmanPosePredictor();
+
+    virtual void AddPose(HeadPose* pose, uint64_t time);
+    virtual int  PredictPose(uint64_t time, std::vector<PoseCandidate>& candidates);
+    virtual void Reset();
+
+private:
+    //!
+    //! \brief  the state of one axis, angle and angular velocity with covariance
+    //!
+    typedef struct AXISSTATE{
+        double angle;       //<! degree
+        double velocity;    //<! degree per second
+        double p00;         //<! covariance of angle
+        double p01;         //<! covariance of angle and velocity
+        double p11;         //<! covariance of velocity
+    }AxisState;
+
+    void InitAxis(AxisState* axis, double angle);
+
+    //!
+    //! \brief  move the state dt seconds forward
+    //!
+    void PredictAxis(AxisState* axis, double dt);
+
+    //!
+    //! \brief  correct the state with the measured innovation
+    //!
+    void UpdateAxis(AxisState* axis, double innovation);
+
+    //!
+    //! \brief  the angle and its variance dt seconds after the state
+    //!
+    void Extrapolate(AxisState* axis, double dt, double* angle, double* variance);
+
+private:
+    AxisState                             mYaw;              //<! state of yaw, unwrapped
+    AxisState                             mPitch;            //<! state of pitch
+    uint64_t                              mLastTime;         //<! the time of the last pose in ms
+    bool                                  mInitialized;      //<! whether any pose is added
+};
+
+//!
+//! \brief  wrap the yaw into [-180, 180)
+//!
+float WrapYaw(double yaw);
+
+//!
+//! \brief  the time in ms ahead to predict the pose for a segment prefetched
+//!         now, that is a segment duration plus the time to download it. The
+//!         download time counts at most MAX_DOWNLOAD_PERIODS segment durations
+//! \param  segmentDuration, the segment duration in ms, 0 if unknown
+//! \param  rtt, the round trip time in ms
+//! \param  throughput, the throughput in bps, 0 if unknown
+//! \param  bitrate, the bit rate in bps of the segment, 0 if unknown
+//! \return the horizon in ms, DEFAULT_PREDICT_HORIZON if the duration is unknown
+//!
+uint64_t CalculatePredictionHorizon(uint64_t segmentDuration, uint64_t rtt, uint64_t throughput, uint64_t bitrate);
+
+VCD_OMAF_END;
+
+#endif /* OMAFPOSEPREDICTOR_H */
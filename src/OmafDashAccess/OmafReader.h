@@ -125,6 +125,20 @@ public:
     //!
     virtual int32_t getTrackInformations(std::vector<VCD::OMAF::TrackInformation*>& trackInfos) const = 0;
 
+    //!
+    //! \brief  Get the sample range of each parsed segment of one track, without
+    //!         creating the track and sample informations of all tracks
+    //!
+    //! \param  [in] uint32_t
+    //!              track Id, combined with initialization segment Id
+    //!         [out] std::map<uint32_t, VCD::OMAF::SegmentSampleRange>&
+    //!               segment Id and the range of its samples
+    //!
+    //! \return int32_t
+    //!         return value
+    //!
+    virtual int32_t getSegmentSampleRanges(uint32_t trackId, std::map<uint32_t, VCD::OMAF::SegmentSampleRange>& ranges) const = 0;
+
     //!
     //! \brief  Get Display Width
     //!
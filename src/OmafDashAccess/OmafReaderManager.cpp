@@ -36,6 +36,8 @@
 #include "OmafReaderManager.h"
 #include "OmafMP4VRReader.h"
 #include <math.h>
+#include <algorithm>
+#include <set>
 
 VCD_OMAF_BEGIN
 
@@ -45,6 +47,17 @@ VCD_OMAF_BEGIN
 #define STATUS_STOPPING      3
 #define STATUS_SEEKING       4
 
+// the max count of packets in the queue of a track
+#define PACKET_QUEUE_CAPACITY   256
+// a new segment of the track is only read when its queue is at or below the mark
+#define PACKET_QUEUE_HIGH_WATER 128
+// the time slice to check stopping when waiting for the packet queue
+#define PACKET_QUEUE_WAIT_TIME  100
+// the room reserved before each payload for VPS/SPS/PPS, as large as mVPS, mSPS and mPPS together
+#define PACKET_PARAMS_HEADROOM  768
+// the max count of the threads reading the segments of different tracks in parallel
+#define READER_WORKER_NUM       4
+
 static uint16_t GetTrackId(uint32_t id)
 {
     return (id & 0xffff);
@@ -72,6 +85,9 @@ OmafReaderManager::OmafReaderManager()
     mWidth  = 0;
     mHeight = 0;
     mReadSync = false;
+    mPacketQueueReady = false;
+    mWorkerStop = false;
+    mSegEventCnt = 0;
 }
 
 OmafReaderManager::~OmafReaderManager()
@@ -93,14 +109,31 @@ int OmafReaderManager::Initialize( OmafMediaSource* pSource )
 int OmafReaderManager::Close()
 {
     if(mStatus == STATUS_RUNNING || mStatus == STATUS_SEEKING){
+        mLock.lock();
         mStatus = STATUS_STOPPING;
+        mLock.unlock();
+        // wake up the reading thread waiting for segments
+        mSegCond.notify_all();
         this->Join();
     }
 
     SAFE_DELETE(mReader);
+    for(auto &it : mTrackReaders)
+    {
+        SAFE_DELETE(it.second);
+    }
+    mTrackReaders.clear();
+    mInitSegments.clear();
     releaseAllSegments();
     releasePacketQueue();
 
+    mPacketQueueReady = false;
+    for(auto &it : mPacketQueues)
+    {
+        SAFE_DELETE(it.second);
+    }
+    mPacketQueues.clear();
+
     for(auto &it:m_readSegMap)
     {
         std::map<uint32_t, OmafSegment*> initSegNormalSeg = it.second;
@@ -135,6 +168,7 @@ int OmafReaderManager::AddInitSegment( OmafSegment* pInitSeg, uint32_t& nInitSeg
 
     pInitSeg->SetInitSegID( nInitSegID );
     pInitSeg->SetSegID( nInitSegID );
+    mInitSegments[nInitSegID] = pInitSeg;
 
     mMapSegCnt[nInitSegID] = 0;
     ///get track information if all initialize segmentation has been parsed
@@ -147,6 +181,7 @@ int OmafReaderManager::AddInitSegment( OmafSegment* pInitSeg, uint32_t& nInitSeg
         //mLock.lock();
         mInitSegParsed = true;
         mLock.unlock();
+        mSegCond.notify_all();
     }
 
     return ERROR_NONE;
@@ -257,22 +292,31 @@ int OmafReaderManager::AddSegment( OmafSegment* pSeg, uint32_t nInitSegID, uint3
     return ERROR_NONE;
 }
 
-int OmafReaderManager::ParseSegment(uint32_t nSegID, uint32_t nInitSegID)
+int OmafReaderManager::ParseSegment(OmafReader* reader, uint32_t nSegID, uint32_t nInitSegID)
 {
-    if(NULL == mReader) return ERROR_NULL_PTR;
+    if(NULL == reader) return ERROR_NULL_PTR;
 
     int ret = ERROR_NONE;
 
-    std::map<uint32_t, OmafSegment*> initSegNormalSeg;
-    initSegNormalSeg = m_readSegMap[nSegID];
-    OmafSegment *pSeg = initSegNormalSeg[nInitSegID];
+    OmafSegment *pSeg = NULL;
+    {
+        // the segments are added to the map by the downloading threads
+        std::lock_guard<std::mutex> lock(mLock);
+        auto itSeg = m_readSegMap.find(nSegID);
+        if(itSeg != m_readSegMap.end())
+        {
+            auto itInitSeg = itSeg->second.find(nInitSegID);
+            if(itInitSeg != itSeg->second.end())
+                pSeg = itInitSeg->second;
+        }
+    }
     if(!pSeg)
     {
         LOG(ERROR) << "cannot get segment with ID "<<nSegID<<endl;
         return ERROR_INVALID;
     }
 
-    ret = mReader->parseSegment(pSeg, nInitSegID, nSegID );
+    ret = reader->parseSegment(pSeg, nInitSegID, nSegID );
 
     if( 0 != ret )
     {
@@ -280,30 +324,22 @@ int OmafReaderManager::ParseSegment(uint32_t nSegID, uint32_t nInitSegID)
         return ERROR_INVALID;
     }
 
-    for (int i = 0; i < mSource->GetStreamCount(); i++)
-    {
-        OmafMediaStream *pStream = mSource->GetStream(i);
-        if (pStream->HasExtractor())
-        {
-            std::list<OmafExtractor*> extractors = pStream->GetEnabledExtractor();
-            for (auto it = extractors.begin(); it != extractors.end(); it++)
-            {
-                OmafExtractor *pExt = (OmafExtractor*)(*it);
+    // only the extractor tracks are read, so only their sample ranges are indexed
+    auto itTrack = mMapInitTrk.find(nInitSegID);
+    if (itTrack == mMapInitTrk.end())
+        return ERROR_NONE;
 
-                uint32_t extractorTrackId = pExt->GetTrackNumber();
-                OmafSegment *initSegment = pExt->GetInitSegment();
-                uint32_t initSegIndex = initSegment->GetInitSegID();
-                if (nInitSegID == initSegIndex)
-                {
-                    if ((uint32_t)(mMapSegStatus[extractorTrackId].segStatus[nSegID]) == (mMapSegStatus[extractorTrackId].depTrackIDs.size() + 1))
-                    {
-                        std::vector<TrackInformation*> readTrackInfos;
-                        mReader->getTrackInformations( readTrackInfos );
-                        mSegTrackInfos[nSegID] = readTrackInfos;
-                    }
-                }
-            }
-        }
+    uint32_t extractorTrackId = itTrack->second;
+    auto itStatus = mMapSegStatus.find(extractorTrackId);
+    auto itTrackRanges = mSegSampleRanges.find(extractorTrackId);
+    if (itStatus == mMapSegStatus.end() || itStatus->second.depTrackIDs.empty() || itTrackRanges == mSegSampleRanges.end())
+        return ERROR_NONE;
+
+    std::map<uint32_t, SegmentSampleRange> ranges;
+    reader->getSegmentSampleRanges(GetCombinedTrackId(extractorTrackId, nInitSegID), ranges);
+    for (auto& itRange : ranges)
+    {
+        itTrackRanges->second[itRange.first] = itRange.second;
     }
     return ERROR_NONE;
 }
@@ -320,6 +356,18 @@ void OmafReaderManager::SetupStatusMap()
             mMapSegStatus[trackID].depTrackIDs = listDepTracks;
         }
     }
+
+    // the queues are looked up without lock once ready, so create all of them here.
+    // So are the per track states changed by the reader workers in parallel
+    for(auto &idPair : mMapInitTrk)
+    {
+        mTrackInitSeg[idPair.second] = idPair.first;
+        mSegSampleRanges[idPair.second];
+        mLastSampleSize[idPair.second] = 0;
+        if(mPacketQueues.find(idPair.second) == mPacketQueues.end())
+            mPacketQueues[idPair.second] = new OmafPacketQueue(PACKET_QUEUE_CAPACITY);
+    }
+    mPacketQueueReady = true;
 }
 
 void OmafReaderManager::UpdateSegmentStatus(uint32_t nInitSegID, uint32_t nSegID, int64_t segCnt)
@@ -357,7 +405,18 @@ void OmafReaderManager::UpdateSegmentStatus(uint32_t nInitSegID, uint32_t nSegID
         }
     }
 
+    mSegEventCnt++;
     mLock.unlock();
+
+    // wake up the reading thread waiting for this segment
+    mSegCond.notify_all();
+}
+
+bool OmafReaderManager::WaitInitSegParsed( uint32_t waitTime )
+{
+    std::unique_lock<std::mutex> lock(mLock);
+
+    return mSegCond.wait_for(lock, std::chrono::milliseconds(waitTime), [this]{ return mInitSegParsed; });
 }
 
 int OmafReaderManager::Seek( )
@@ -380,38 +439,82 @@ int OmafReaderManager::Seek( )
 
 void OmafReaderManager::RemoveTrackFromPacketQueue(list<int>& trackIDs)
 {
+    for(auto &it : trackIDs)
+    {
+        OmafPacketQueue* queue = GetPacketQueue(it);
+        if(queue) queue->Clear();
+    }
+
     mPacketLock.lock();
     for(auto &it : trackIDs)
     {
-        PacketQueue pPackQ = mPacketQueues[it];
-        for (std::list<MediaPacket*>::iterator iter = pPackQ.begin() ; iter != pPackQ.end(); iter++)
-        {
-            MediaPacket *mediaPacket = *iter;
-            delete mediaPacket;
-            mediaPacket = NULL;
-        }
-        mPacketQueues.erase(it);
+        mPacketPools.erase(it);
     }
     mPacketLock.unlock();
 }
 
-int OmafReaderManager::GetNextFrame( int trackID, MediaPacket*& pPacket, bool needParams )
+OmafPacketQueue* OmafReaderManager::GetPacketQueue(int trackID)
 {
-    mPacketLock.lock();
-    if( mPacketQueues[trackID].empty()){
-        pPacket = NULL;
-        mPacketLock.unlock();
+    if(!mPacketQueueReady) return NULL;
+
+    auto it = mPacketQueues.find(trackID);
+    if(it == mPacketQueues.end()) return NULL;
+
+    return it->second;
+}
+
+void OmafReaderManager::WaitPacketQueueDrained(int trackID)
+{
+    OmafPacketQueue* queue = GetPacketQueue(trackID);
+    if(!queue) return;
+
+    while(!queue->WaitBelow(PACKET_QUEUE_HIGH_WATER, PACKET_QUEUE_WAIT_TIME))
+    {
+        if(mStatus == STATUS_STOPPING || mStatus == STATUS_SEEKING) return;
+    }
+}
+
+std::shared_ptr<PacketBufferPool> OmafReaderManager::GetPacketPool(int trackID)
+{
+    std::lock_guard<std::mutex> packetLock(mPacketLock);
+    std::shared_ptr<PacketBufferPool>& pool = mPacketPools[trackID];
+    if (!pool)
+        pool = std::make_shared<PacketBufferPool>();
+    return pool;
+}
+
+uint32_t OmafReaderManager::GetBufferedSegmentCount(int trackID)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto it = mMapSegStatus.find(trackID);
+    if(it == mMapSegStatus.end())
+        return 0;
+
+    SampleIndex* sampleIndex = &(it->second.sampleIndex);
+    if(sampleIndex->mCurrentAddSegment < sampleIndex->mCurrentReadSegment)
+        return 0;
+
+    return sampleIndex->mCurrentAddSegment - sampleIndex->mCurrentReadSegment + 1;
+}
+
+int OmafReaderManager::GetNextFrame( int trackID, MediaPacket*& pPacket, bool needParams, uint32_t waitTime )
+{
+    pPacket = NULL;
+
+    OmafPacketQueue* queue = GetPacketQueue(trackID);
+    if( !queue && waitTime && WaitInitSegParsed(waitTime) ){
+        queue = GetPacketQueue(trackID);
+    }
+    if( !queue ){
         return ERROR_NULL_PACKET;
     }
 
-    if( !mPacketQueues[trackID].size() ){
-        mPacketLock.unlock();
-        return OMAF_ERROR_END_OF_STREAM;
+    // wake up as soon as the reading thread adds a packet for the track
+    pPacket = queue->Pop(waitTime);
+    if( NULL == pPacket ){
+        return ERROR_NULL_PACKET;
     }
-    pPacket = mPacketQueues[trackID].front();
-    mPacketQueues[trackID].pop_front();
-    LOG(INFO)<<"========mPacketQueues size========:"<<mPacketQueues[trackID].size()<<std::endl;
-    mPacketLock.unlock();
 
     if (needParams)
     {
@@ -421,9 +524,19 @@ int OmafReaderManager::GetNextFrame( int trackID, MediaPacket*& pPacket, bool ne
             return OMAF_ERROR_INVALID_DATA;
         }
 
+        // the packets are read with headroom, so the parameter sets are just written before the payload
+        if (pPacket->GetHeadroom() >= mVPSLen + mSPSLen + mPPSLen)
+        {
+            pPacket->PrependData((char*)mPPS, mPPSLen);
+            pPacket->PrependData((char*)mSPS, mSPSLen);
+            pPacket->PrependData((char*)mVPS, mVPSLen);
+            return ERROR_NONE;
+        }
+
         MediaPacket *newPacket = new MediaPacket();
         uint32_t newSize = mVPSLen + mSPSLen + mPPSLen + pPacket->Size();
-        newPacket->ReAllocatePacket(newSize);
+        newPacket->SetPool(pPacket->GetPool());
+        newPacket->ReservePacket(newSize);
         newPacket->SetRealSize(newSize);
 
         char *origData = pPacket->Payload();
@@ -438,85 +551,90 @@ int OmafReaderManager::GetNextFrame( int trackID, MediaPacket*& pPacket, bool ne
         memcpy(newData + mVPSLen + mSPSLen, mPPS, mPPSLen);
         memcpy(newData + mVPSLen + mSPSLen + mPPSLen, origData, pPacket->Size());
 
-        RegionWisePacking *newRwpk = new RegionWisePacking;
-        RegionWisePacking *pRwpk = pPacket->GetRwpk();
-        if(!newRwpk || !pRwpk)
+        if(!pPacket->GetRwpk())
         {
             SAFE_DELETE(newPacket);
-            SAFE_DELETE(newRwpk);
             return OMAF_ERROR_NULL_PTR;
         }
-        *newRwpk = *pRwpk;
-        newRwpk->rectRegionPacking = new RectangularRegionWisePacking[newRwpk->numRegions];
-        memcpy(newRwpk->rectRegionPacking, pRwpk->rectRegionPacking, pRwpk->numRegions * sizeof(RectangularRegionWisePacking));
-        newPacket->SetRwpk(newRwpk);
+        newPacket->SetSharedRwpk(pPacket->GetSharedRwpk());
         delete pPacket;
         pPacket = newPacket;
     }
     return ERROR_NONE;
 }
 
+uint32_t OmafReaderManager::GetInitSegID(int trackID)
+{
+    auto it = mTrackInitSeg.find(trackID);
+    return it == mTrackInitSeg.end() ? 0 : it->second;
+}
+
 int OmafReaderManager::ReadNextSegment(
+    OmafReader* reader,
     int trackID,
     uint16_t initSegID,
     bool isExtractor,
-    std::vector<TrackInformation*> readTrackInfos,
     bool& segmentChanged )
 {
-    if(NULL == mReader) return ERROR_NULL_PTR;
+    if(NULL == reader) return ERROR_NULL_PTR;
     int32_t ret = ERROR_NONE;
 
-    SampleIndex *sampleIdx = &(mMapSegStatus[trackID].sampleIndex);
-
-    LOG(INFO) << "Begin to read segment " << sampleIdx->mCurrentReadSegment <<" for track "<<trackID<< endl;
-    TrackInformation *trackInfo = nullptr;
-    for ( auto &itTrack : readTrackInfos)
+    // the add index is updated by the download thread and the read index is
+    // looked at by the other workers, so both are only touched under mLock
+    SampleIndex *sampleIdx = NULL;
+    uint32_t readSegment = 0;
+    uint32_t addSegment = 0;
+    uint32_t globalSampleIndex = 0;
     {
-        if (GetTrackId(itTrack->trackId) == trackID)
-        {
-            trackInfo = itTrack;
-            break;
-        }
+        std::lock_guard<std::mutex> lock(mLock);
+        sampleIdx = &(mMapSegStatus[trackID].sampleIndex);
+        readSegment = sampleIdx->mCurrentReadSegment;
+        addSegment = sampleIdx->mCurrentAddSegment;
+        globalSampleIndex = sampleIdx->mGlobalSampleIndex;
     }
-    if (!trackInfo)
+
+    LOG(INFO) << "Begin to read segment " << readSegment <<" for track "<<trackID<< endl;
+    auto itTrackRanges = mSegSampleRanges.find(trackID);
+    if (itTrackRanges == mSegSampleRanges.end())
     {
         LOG(ERROR) << "The specified track is not found " << endl;
         return ERROR_NOT_FOUND;
     }
 
-    if (sampleIdx->mCurrentReadSegment > sampleIdx->mCurrentAddSegment)
+    if (readSegment > addSegment)
     {
         LOG(ERROR) << "Can't read not added segment ! " << endl;
         return OMAF_ERROR_INVALID_DATA;
     }
 
-    std::map<uint32_t, uint32_t> segSizeMap;
+    auto itRange = itTrackRanges->second.find(readSegment);
+    if (itRange == itTrackRanges->second.end()) return OMAF_ERROR_INVALID_DATA;
 
-    for (auto& itSample : trackInfo->samplePropertyArrays)
-    {
-        segSizeMap[itSample->segmentId] = 0;
-    }
-    int32_t beginSampleId = -1;
-    for (auto& itSample : trackInfo->samplePropertyArrays)
+    SegmentSampleRange range = itRange->second;
+    int32_t beginSampleId = range.firstSampleId;
+
+    OmafPacketQueue* queue = GetPacketQueue(trackID);
+    if(!queue)
     {
-        segSizeMap[itSample->segmentId]++;
-        if (beginSampleId == -1 && itSample->segmentId == sampleIdx->mCurrentReadSegment)
-        {
-            beginSampleId = itSample->id;
-        }
+        LOG(ERROR) << "No packet queue for track " << trackID << endl;
+        return ERROR_NOT_FOUND;
     }
 
-    if(beginSampleId == -1) return OMAF_ERROR_INVALID_DATA;
+    std::shared_ptr<RegionWisePacking> segRwpk;
 
-    for ( ; beginSampleId < (int32_t)(segSizeMap[sampleIdx->mCurrentReadSegment]); beginSampleId++)
+    for ( ; beginSampleId < (int32_t)(range.sampleCount); beginSampleId++)
     {
         int sample = beginSampleId;
 
         uint32_t combinedTrackId = GetCombinedTrackId(trackID, initSegID);
 
+        // the sample size and the parameter sets are shared by all tracks, so only
+        // the first worker reads them
+        std::unique_lock<std::mutex> paramLock(mParamLock);
+
         if (!mWidth || !mHeight)
         {
-            ret = mReader->getWidth(combinedTrackId, sample, mWidth);
+            ret = reader->getWidth(combinedTrackId, sample, mWidth);
             if (ret)
             {
                 LOG(ERROR) << "Failed to get sample width !" << endl;
@@ -529,7 +647,7 @@ int OmafReaderManager::ReadNextSegment(
                 return OMAF_ERROR_INVALID_DATA;
             }
 
-            ret = mReader->getHeight(combinedTrackId, sample, mHeight);
+            ret = reader->getHeight(combinedTrackId, sample, mHeight);
             if (ret)
             {
                 LOG(ERROR) << "Failed to get sample height !" << endl;
@@ -545,10 +663,6 @@ int OmafReaderManager::ReadNextSegment(
             LOG(INFO) << "Get sample width " << mWidth << " and sample height " << mHeight << " !" << endl;
         }
 
-        MediaPacket* packet = new MediaPacket();
-        uint32_t packetSize = ((mWidth * mHeight * 3) / 2 ) / 2;
-        packet->ReAllocatePacket(packetSize);
-
         if (!mVPSLen || !mSPSLen || !mPPSLen)
         {
             memset(mVPS, 0, 256);
@@ -559,7 +673,7 @@ int OmafReaderManager::ReadNextSegment(
             mPPSLen = 0;
 
             std::vector<VCD::OMAF::DecoderSpecificInfo> parameterSets;
-            ret = mReader->getDecoderConfiguration(combinedTrackId, sample, parameterSets);
+            ret = reader->getDecoderConfiguration(combinedTrackId, sample, parameterSets);
             if (ret)
             {
                 LOG(ERROR) << "Failed to get VPS/SPS/PPS ! " << endl;
@@ -598,102 +712,133 @@ int OmafReaderManager::ReadNextSegment(
             }
         }
 
-        if (isExtractor)
-        {
-            ret = mReader->getExtractorTrackSampleData(combinedTrackId, sample, (char *)(packet->Payload()), packetSize );
-        }
-        else
-        {
-            ret =  mReader->getTrackSampleData(combinedTrackId, sample, (char *)(packet->Payload()), packetSize );
-        }
+        paramLock.unlock();
 
-        RegionWisePacking *pRwpk = new RegionWisePacking;
+        // size the packet by the sample instead of the whole frame. An extractor
+        // sample grows when its references are resolved, so the last sample size of
+        // the track is the hint and the buffer is enlarged when reported too small
+        uint32_t maxPacketSize = ((mWidth * mHeight * 3) / 2 ) / 2;
+        uint64_t sampleOffset = 0;
+        uint32_t sampleLength = 0;
+        reader->getTrackSampleOffset(combinedTrackId, sample, sampleOffset, sampleLength);
+        uint32_t packetSize = std::max(sampleLength, mLastSampleSize[trackID]);
+        if (!packetSize || packetSize > maxPacketSize)
+            packetSize = maxPacketSize;
 
-        ret = mReader->getPropertyRegionWisePacking(combinedTrackId, sample, pRwpk);
+        MediaPacket* packet = new MediaPacket();
+        packet->SetPool(GetPacketPool(trackID));
+        if (packet->ReservePacket(packetSize, PACKET_PARAMS_HEADROOM) < 0)
+        {
+            LOG(ERROR) << "Failed to allocate packet for track " << trackID << endl;
+            delete packet;
+            return OMAF_ERROR_NULL_PTR;
+        }
 
-        packet->SetRwpk(pRwpk);
+        ret = packet->ReadPayload([&](char *payload, uint32_t &size) -> int32_t {
+            if (isExtractor)
+                return reader->getExtractorTrackSampleData(combinedTrackId, sample, payload, size);
+            return reader->getTrackSampleData(combinedTrackId, sample, payload, size);
+        }, PACKET_PARAMS_HEADROOM, maxPacketSize, packetSize);
 
         if (ret == OMAF_MEMORY_TOO_SMALL_BUFFER )
         {
             LOG(ERROR) << "The frame size has exceeded the maximum packet size" << endl;
+            delete packet;
             return ret;
         }
         else if (ret)
         {
-            LOG(ERROR) << "Failed to get packet " << (sampleIdx->mGlobalSampleIndex + beginSampleId) << " for track " << trackID << " and error is " << ret << endl;
+            LOG(ERROR) << "Failed to get packet " << (globalSampleIndex + beginSampleId) << " for track " << trackID << " and error is " << ret << endl;
+            delete packet;
             return ret;
         }
-        packet->SetRealSize(packetSize);
-        mPacketLock.lock();
-        mPacketQueues[trackID].push_back(packet);
-        mPacketLock.unlock();
-    }
 
-    LOG(INFO) << "Segment " << trackInfo->samplePropertyArrays[beginSampleId - 1]->segmentId << " for track " << trackID << " has been read !" << endl;
-    sampleIdx->mCurrentReadSegment++;
-    sampleIdx->mGlobalSampleIndex += beginSampleId;
-    LOG(INFO) << "Total read " << sampleIdx->mGlobalSampleIndex << " samples for track " << trackID <<" now !" << endl;
+        // the region wise packing comes with the sample entry, so it is read
+        // once for the segment and shared by all its packets
+        if (!segRwpk)
+        {
+            RegionWisePacking *pRwpk = new RegionWisePacking();
 
-    removeSegment(initSegID, sampleIdx->mCurrentReadSegment - 1);
+            ret = reader->getPropertyRegionWisePacking(combinedTrackId, sample, pRwpk);
 
-    SegStatus st = mMapSegStatus[trackID];
-    std::list<int>::iterator itRef = st.depTrackIDs.begin();
-    for ( ; itRef != st.depTrackIDs.end(); itRef++)
-    {
-        int refTrack = *itRef;
+            segRwpk = std::shared_ptr<RegionWisePacking>(pRwpk, MediaPacket::DeleteRwpk);
+        }
 
-        TrackInformation *refTrackInfo = nullptr;
-        for ( auto &itRefInfo : readTrackInfos)
+        packet->SetSharedRwpk(segRwpk);
+
+        if (ret)
         {
-            if (GetTrackId(itRefInfo->trackId) == refTrack)
-            {
-                refTrackInfo = itRefInfo;
-                break;
-            }
+            LOG(ERROR) << "Failed to get region wise packing of packet " << (globalSampleIndex + beginSampleId) << " for track " << trackID << " and error is " << ret << endl;
+            delete packet;
+            return ret;
         }
+        packet->SetRealSize(packetSize);
+        mLastSampleSize[trackID] = packetSize;
 
-        if(refTrackInfo) removeSegment(refTrackInfo->initSegId, sampleIdx->mCurrentReadSegment - 1);
+        // the queue only fills up when a segment has more samples than the room
+        // left above the high water mark, then wait for the consumer
+        bool pushed = queue->Push(packet);
+        while (!pushed && mStatus == STATUS_RUNNING)
+        {
+            queue->WaitBelow(queue->GetCapacity() - 1, PACKET_QUEUE_WAIT_TIME);
+            pushed = queue->Push(packet);
+        }
+        if (!pushed)
+        {
+            delete packet;
+        }
+    }
 
+    LOG(INFO) << "Segment " << range.segmentId << " for track " << trackID << " has been read !" << endl;
+    std::list<int> depTrackIDs;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        sampleIdx->mCurrentReadSegment = readSegment + 1;
+        sampleIdx->mGlobalSampleIndex += beginSampleId;
+        globalSampleIndex = sampleIdx->mGlobalSampleIndex;
+        depTrackIDs = mMapSegStatus[trackID].depTrackIDs;
     }
+    LOG(INFO) << "Total read " << globalSampleIndex << " samples for track " << trackID <<" now !" << endl;
+
+    removeSegment(reader, initSegID, readSegment);
 
-    for(auto &it : readTrackInfos)
+    for (auto refTrack : depTrackIDs)
     {
-        for(uint32_t i = 0; i < it->samplePropertyArrays.size(); i++)
-        {
-            SampleInformation* sampInfo = it->samplePropertyArrays[i];
-            SAFE_DELETE(sampInfo);
-        }
-        it->samplePropertyArrays.clear();
-        SAFE_DELETE(it);
+        auto itInit = mTrackInitSeg.find(refTrack);
+        if (itInit != mTrackInitSeg.end()) removeSegment(reader, itInit->second, readSegment);
     }
-    readTrackInfos.clear();
+
+    itTrackRanges->second.erase(range.segmentId);
 
     return ERROR_NONE;
 }
 
 void OmafReaderManager::Run()
 {
-    bool go_on = true;
-
     if(NULL == mSource) return;
 
-    bool bSegChange = false;
-
     mStatus = STATUS_RUNNING;
 
-    while(go_on && mStatus != STATUS_STOPPED){
-        mLock.lock();
+    StartReaderWorkers();
 
-        // exit the waiting if segment is parsed or wait time is more than 10 mins
-        int64_t waitTime = 0;
-        while (!mInitSegParsed && waitTime < 600000)
+    ReadSegments();
+
+    // the segments handed over are read before the workers exit, unless stopping
+    StopReaderWorkers();
+}
+
+void OmafReaderManager::ReadSegments()
+{
+    bool go_on = true;
+
+    bool bSegChange = false;
+
+    while(go_on && mStatus != STATUS_STOPPED){
         {
-            mLock.unlock();
-            ::usleep(1000);
-            mLock.lock();
-            waitTime++;
+            // exit the waiting if segment is parsed, stopping or wait time is more than 10 mins
+            std::unique_lock<std::mutex> lock(mLock);
+            mSegCond.wait_for(lock, std::chrono::minutes(10), [this]{ return mInitSegParsed || mStatus == STATUS_STOPPING; });
         }
-        mLock.unlock();
 
         if( mStatus==STATUS_STOPPING ){
             mStatus = STATUS_STOPPED;
@@ -718,10 +863,22 @@ void OmafReaderManager::Run()
             }
             OmafMediaStream* pStream = mSource->GetStream(i);
             if(pStream->HasExtractor()){
+                uint64_t segEventCnt = 0;
+                {
+                    std::lock_guard<std::mutex> lock(mLock);
+                    segEventCnt = mSegEventCnt;
+                }
+
+                bool dispatched = false;
                 std::list<OmafExtractor*> extractors = pStream->GetEnabledExtractor();
                 for(auto it=extractors.begin(); it!=extractors.end(); it++){
                     OmafExtractor* pExt = (OmafExtractor*)(*it);
-                    SegStatus *st = &(mMapSegStatus[pExt->GetTrackNumber()]);
+                    int trackID = pExt->GetTrackNumber();
+
+                    // the sample index of the track is updated by the worker reading it
+                    if(IsTrackReading(trackID)) continue;
+
+                    SegStatus *st = &(mMapSegStatus[trackID]);
 
                     ///if static mode, check EOS
                     if(type == 1){
@@ -741,65 +898,16 @@ void OmafReaderManager::Run()
                         }
                     }
 
-                    // exit the waiting if segment downloaded or wait time is more than 10 mins
-                    int64_t waitTime = 0;
-                    mLock.lock();
-                    while (st->sampleIndex.mCurrentReadSegment > st->sampleIndex.mCurrentAddSegment && mStatus!=STATUS_STOPPING && waitTime < 600000)
-                    {
-                        LOG(INFO) << "New segment " << st->sampleIndex.mCurrentReadSegment << " hasn't come, then wait !" << endl;
-                        mLock.unlock();
-                        ::usleep(1000);
-                        mLock.lock();
-                        waitTime++;
-                    }
-                    mLock.unlock();
-
-                    if( mStatus==STATUS_STOPPING ){
-                        mStatus = STATUS_STOPPED;
-                          break;
-                    }
-
-                    if((uint32_t)(st->segStatus[st->sampleIndex.mCurrentReadSegment]) == (st->depTrackIDs.size() + 1)){
-                        uint16_t trackID = pExt->GetTrackNumber();
-                        uint16_t initSegID = 0;
-                        for (auto& idPair : mMapInitTrk)
-                        {
-                            if (idPair.second == trackID)
-                            {
-                                initSegID = idPair.first;
-                                break;
-                            }
-                        }
-
-
-                        std::list<int>::iterator itRef = st->depTrackIDs.begin();
-                        for ( ; itRef != st->depTrackIDs.end(); itRef++)
-                        {
-                            int refTrack = *itRef;
-                            uint32_t initSegIndex = 0;
-
-                            for (auto& idPair : mMapInitTrk)
-                            {
-                                if (idPair.second == refTrack)
-                                {
-                                    initSegIndex = idPair.first;
-                                    break;
-                                }
-                            }
-
-                            ParseSegment(st->sampleIndex.mCurrentReadSegment, initSegIndex);
-
-                        }
-
-                        ParseSegment(st->sampleIndex.mCurrentReadSegment, initSegID);
-                        std::vector<TrackInformation*> readTrackInfos = mSegTrackInfos[st->sampleIndex.mCurrentReadSegment];
-                        this->ReadNextSegment(trackID, initSegID, true, readTrackInfos, bSegChange);
-                        mSegTrackInfos.erase(st->sampleIndex.mCurrentReadSegment - 1);
+                    if(DispatchSegment(trackID, st)) dispatched = true;
+                }
 
-                        RemoveReadSegmentFromMap();
-                    }else{
-                        ::usleep(100);
-                    }
+                if(!dispatched){
+                    // wait for a segment added or read. The packet queues are not
+                    // watched, so check again after a while for the drained ones
+                    std::unique_lock<std::mutex> lock(mLock);
+                    mSegCond.wait_for(lock, std::chrono::milliseconds(PACKET_QUEUE_WAIT_TIME), [&]{
+                        return mSegEventCnt != segEventCnt || mStatus == STATUS_STOPPING;
+                    });
                 }
             }else{
                 std::map<int, OmafAdaptationSet*> mapAS = pStream->GetMediaAdaptationSet();
@@ -823,36 +931,24 @@ void OmafReaderManager::Run()
                         }
                     }
                     uint16_t trackID = pAS->GetTrackNumber();
-                    uint16_t initSegID = 0;
-                    for (auto& idPair : mMapInitTrk)
-                    {
-                        if (idPair.second == trackID)
-                        {
-                            initSegID = idPair.first;
-                            break;
-                        }
-                    }
+                    uint16_t initSegID = GetInitSegID(trackID);
 
-                    // exit the waiting if segment downloaded or wait time is more than 10 mins
-                    int64_t waitTime = 0;
-                    mLock.lock();
-                    while (st->sampleIndex.mCurrentReadSegment > st->sampleIndex.mCurrentAddSegment && mStatus!=STATUS_STOPPING && waitTime < 600000)
-                    {
-                        LOG(INFO) << "New segment " << st->sampleIndex.mCurrentReadSegment << " hasn't come, then wait !" << endl;
-                        mLock.unlock();
-                        ::usleep(1000);
-                        mLock.lock();
-                        waitTime++;
-                    }
-                    mLock.unlock();
+                    // exit the waiting if segment downloaded, stopping or wait time is more than 10 mins
+                    WaitSegmentAdded(st);
 
                     if( mStatus==STATUS_STOPPING ){
                         mStatus = STATUS_STOPPED;
                           break;
                     }
 
-                    std::vector<TrackInformation*> readTrackInfos = mSegTrackInfos[st->sampleIndex.mCurrentReadSegment];
-                    this->ReadNextSegment(trackID, initSegID, false, readTrackInfos, bSegChange);
+                    // hold back reading while the consumer is behind
+                    WaitPacketQueueDrained(trackID);
+                    if( mStatus==STATUS_STOPPING ){
+                        mStatus = STATUS_STOPPED;
+                        break;
+                    }
+
+                    this->ReadNextSegment(mReader, trackID, initSegID, false, bSegChange);
                 }
             }
         }
@@ -865,29 +961,251 @@ void OmafReaderManager::Run()
     }
 }
 
+bool OmafReaderManager::DispatchSegment(int trackID, SegStatus* st)
+{
+    // wait for the segments of the depended tracks
+    if(!IsSegmentReady(st)) return false;
+
+    // hold back reading while the consumer is behind
+    OmafPacketQueue* queue = GetPacketQueue(trackID);
+    if(queue && queue->Size() > PACKET_QUEUE_HIGH_WATER) return false;
+
+    SubmitReadJob(trackID, st->sampleIndex.mCurrentReadSegment);
+    return true;
+}
+
+bool OmafReaderManager::IsSegmentReady(SegStatus* st)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    uint32_t segID = st->sampleIndex.mCurrentReadSegment;
+    if(segID > st->sampleIndex.mCurrentAddSegment) return false;
+
+    auto it = st->segStatus.find(segID);
+    return it != st->segStatus.end() && (uint32_t)(it->second) == (st->depTrackIDs.size() + 1);
+}
+
+void OmafReaderManager::StartReaderWorkers()
+{
+    std::lock_guard<std::mutex> jobLock(mJobLock);
+
+    mWorkerStop = false;
+
+    uint32_t workerNum = std::min((uint32_t)READER_WORKER_NUM, std::thread::hardware_concurrency());
+    if(!workerNum) workerNum = 1;
+
+    for(uint32_t i = 0; i < workerNum; i++)
+    {
+        mReaderWorkers.push_back(std::thread(&OmafReaderManager::ReaderWorkerRun, this));
+    }
+}
+
+void OmafReaderManager::StopReaderWorkers()
+{
+    mJobLock.lock();
+    mWorkerStop = true;
+    mJobLock.unlock();
+    mJobCond.notify_all();
+
+    for(auto &worker : mReaderWorkers)
+    {
+        worker.join();
+    }
+    mReaderWorkers.clear();
+}
+
+void OmafReaderManager::ReaderWorkerRun()
+{
+    while(true)
+    {
+        std::pair<int, uint32_t> job;
+        {
+            std::unique_lock<std::mutex> jobLock(mJobLock);
+            mJobCond.wait(jobLock, [this]{ return mWorkerStop || !mReadJobs.empty(); });
+            if(mReadJobs.empty()) break;
+
+            job = mReadJobs.front();
+            mReadJobs.pop_front();
+        }
+
+        ReadTrackSegment(job.first, job.second);
+
+        mJobLock.lock();
+        mReadingTracks.erase(job.first);
+        mJobLock.unlock();
+
+        RemoveReadSegmentFromMap();
+
+        mLock.lock();
+        mSegEventCnt++;
+        mLock.unlock();
+        mSegCond.notify_all();
+    }
+}
+
+void OmafReaderManager::SubmitReadJob(int trackID, uint32_t segID)
+{
+    mJobLock.lock();
+    mReadingTracks[trackID] = segID;
+    mReadJobs.push_back(std::make_pair(trackID, segID));
+    mJobLock.unlock();
+    mJobCond.notify_one();
+}
+
+bool OmafReaderManager::IsTrackReading(int trackID)
+{
+    std::lock_guard<std::mutex> jobLock(mJobLock);
+    return mReadingTracks.find(trackID) != mReadingTracks.end();
+}
+
+int OmafReaderManager::ReadTrackSegment(int trackID, uint32_t segID)
+{
+    if(mStatus != STATUS_RUNNING) return ERROR_NONE;
+
+    OmafReader* reader = GetTrackReader(trackID);
+    if(NULL == reader) return ERROR_NULL_PTR;
+
+    SegStatus *st = NULL;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        st = &(mMapSegStatus[trackID]);
+    }
+    uint16_t initSegID = GetInitSegID(trackID);
+
+    for (auto refTrack : st->depTrackIDs)
+    {
+        ParseSegment(reader, segID, GetInitSegID(refTrack));
+    }
+
+    ParseSegment(reader, segID, initSegID);
+
+    bool bSegChange = false;
+    int ret = ReadNextSegment(reader, trackID, initSegID, true, bSegChange);
+
+    uint32_t readSegment = 0;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        readSegment = st->sampleIndex.mCurrentReadSegment;
+    }
+    if(ret != ERROR_NONE && readSegment == segID)
+    {
+        // the segments are parsed again when reading the track next time
+        for (auto refTrack : st->depTrackIDs)
+        {
+            reader->invalidateSegment(GetInitSegID(refTrack), segID);
+        }
+        reader->invalidateSegment(initSegID, segID);
+    }
+    return ret;
+}
+
+OmafReader* OmafReaderManager::GetTrackReader(int trackID)
+{
+    std::lock_guard<std::mutex> trackReaderLock(mTrackReaderLock);
+
+    auto it = mTrackReaders.find(trackID);
+    if(it != mTrackReaders.end()) return it->second;
+
+    // the extractor samples are resolved from the samples of the depended tracks,
+    // so the tracks are parsed into one reader
+    std::list<int> tracks = mMapSegStatus[trackID].depTrackIDs;
+    tracks.push_back(trackID);
+
+    OmafReader* reader = new OmafMP4VRReader();
+    for(auto trk : tracks)
+    {
+        uint32_t initSegID = GetInitSegID(trk);
+        auto itInitSeg = mInitSegments.find(initSegID);
+        if(itInitSeg == mInitSegments.end() || 0 != reader->parseInitializationSegment(itInitSeg->second, initSegID))
+        {
+            LOG(ERROR) << "Failed to parse init segment " << initSegID << " for the reader of track " << trackID << endl;
+            delete reader;
+            return NULL;
+        }
+    }
+    reader->setMapInitTrk(mMapInitTrk);
+
+    mTrackReaders[trackID] = reader;
+    return reader;
+}
+
+void OmafReaderManager::WaitSegmentAdded(SegStatus* st)
+{
+    std::unique_lock<std::mutex> lock(mLock);
+
+    if (st->sampleIndex.mCurrentReadSegment > st->sampleIndex.mCurrentAddSegment)
+    {
+        LOG(INFO) << "New segment " << st->sampleIndex.mCurrentReadSegment << " hasn't come, then wait !" << endl;
+    }
+
+    mSegCond.wait_for(lock, std::chrono::minutes(10), [&]{
+        return st->sampleIndex.mCurrentReadSegment <= st->sampleIndex.mCurrentAddSegment || mStatus == STATUS_STOPPING;
+    });
+}
+
 // Keep more than 1 element in m_readSegMap for segment count update if viewport changed
 void OmafReaderManager::RemoveReadSegmentFromMap()
 {
-    if(m_readSegMap.size() < 10) return;
+    // the segments of the enabled tracks not read yet are kept
+    std::set<int> trackIDs;
+    for( int i = 0; i < mSource->GetStreamCount(); i++ ){
+        OmafMediaStream* pStream = mSource->GetStream(i);
+        if(pStream->HasExtractor()){
+            std::list<OmafExtractor*> extractors = pStream->GetEnabledExtractor();
+            for(auto it=extractors.begin(); it!=extractors.end(); it++){
+                trackIDs.insert((*it)->GetTrackNumber());
+            }
+        }else{
+            std::map<int, OmafAdaptationSet*> mapAS = pStream->GetMediaAdaptationSet();
+            for(auto as_it=mapAS.begin(); as_it!=mapAS.end(); as_it++){
+                trackIDs.insert(as_it->second->GetTrackNumber());
+            }
+        }
+    }
 
-    for(auto &it:m_readSegMap)
+    std::vector<OmafSegment*> rmSegs;
     {
-        if(m_readSegMap.size() < 10)
-            break;
-        std::map<uint32_t, OmafSegment*> initSegNormalSeg = it.second;
-        for (auto& itRmSeg : initSegNormalSeg)
+        // no new read job is queued while removing, and the segments being read are kept
+        std::lock_guard<std::mutex> jobLock(mJobLock);
+        uint32_t minReadingSeg = UINT32_MAX;
+        for(auto &it : mReadingTracks) minReadingSeg = std::min(minReadingSeg, it.second);
+
+        std::lock_guard<std::mutex> lock(mLock);
+        for(auto &trackID : trackIDs)
         {
-            OmafSegment *rmSeg = itRmSeg.second;
-            delete rmSeg;
-            rmSeg = NULL;
+            auto st = mMapSegStatus.find(trackID);
+            if(st != mMapSegStatus.end())
+                minReadingSeg = std::min(minReadingSeg, st->second.sampleIndex.mCurrentReadSegment);
+        }
+
+        for(auto it = m_readSegMap.begin(); it != m_readSegMap.end() && it->first < minReadingSeg;)
+        {
+            if(m_readSegMap.size() < 10) break;
+            for (auto& itRmSeg : it->second)
+            {
+                rmSegs.push_back(itRmSeg.second);
+            }
+            it = m_readSegMap.erase(it);
         }
-        m_readSegMap.erase(it.first);
+    }
+
+    // deleting a segment stops its download and may wait for the download
+    // engine, whose callbacks take the locks above
+    for(auto &rmSeg : rmSegs)
+    {
+        SAFE_DELETE(rmSeg);
     }
 }
 
 void OmafReaderManager::releaseAllSegments( )
 {
-    ScopeLock managerLock(mLock);
+    std::lock_guard<std::mutex> managerLock(mLock);
+
+    // the tracks are kept, they are looked up by the reader workers without lock
+    for(auto &it : mSegSampleRanges)
+    {
+        it.second.clear();
+    }
 
      for(auto it=mMapSegStatus.begin(); it!=mMapSegStatus.end(); it++){
 
@@ -930,19 +1248,20 @@ void OmafReaderManager::setNextSampleId(int trackID, uint32_t id, bool& segmentC
     }
 }
 
-uint32_t OmafReaderManager::removeSegment(uint32_t initSegmentId, uint32_t segmentId)
+uint32_t OmafReaderManager::removeSegment(OmafReader* reader, uint32_t initSegmentId, uint32_t segmentId)
 {
     LOG(INFO) << "removeSegment " << segmentId << " for track " << mMapInitTrk[initSegmentId] << endl;
 
-    ScopeLock managerLock(mLock);
-
-    int32_t result = mReader->invalidateSegment(initSegmentId, segmentId);
+    // the reader is only used by the thread reading the track
+    int32_t result = reader->invalidateSegment(initSegmentId, segmentId);
 
     if (result != 0){
         LOG(ERROR) << "removeSegment Failed " << segmentId << endl;
         return ERROR_INVALID;
     }
 
+    std::lock_guard<std::mutex> managerLock(mLock);
+
     if (mMapSegStatus[mMapInitTrk[initSegmentId]].listActiveSeg.size() > 0)
     {
         std::list<int>::iterator it = mMapSegStatus[mMapInitTrk[initSegmentId]].listActiveSeg.begin();
@@ -965,16 +1284,14 @@ uint32_t OmafReaderManager::removeSegment(uint32_t initSegmentId, uint32_t segme
 
 void OmafReaderManager::releasePacketQueue()
 {
-    ScopeLock packetLock(mPacketLock);
     for(auto it=mPacketQueues.begin(); it!=mPacketQueues.end(); it++){
-        PacketQueue queue = (*it).second;
-        for(auto qu_it=queue.begin(); qu_it!=queue.end(); qu_it++){
-            MediaPacket* pkt = (MediaPacket*)(*qu_it);
-            delete pkt;
-            pkt = NULL;
-        }
-        queue.clear();
+        OmafPacketQueue* queue = (*it).second;
+        if(queue) queue->Clear();
     }
+
+    std::lock_guard<std::mutex> packetLock(mPacketLock);
+    // the pools are freed once the packets still held by the consumer are released
+    mPacketPools.clear();
 }
 
 VCD_OMAF_END
@@ -39,12 +39,17 @@
 #include "general.h"
 #include "OmafReader.h"
 #include "MediaPacket.h"
+#include "OmafPacketQueue.h"
 #include "OmafMediaSource.h"
 #include "OmafDashSource.h"
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
 
 VCD_OMAF_BEGIN
 
-typedef std::list<MediaPacket*> PacketQueue;
 
 struct SampleIndex
 {
@@ -92,11 +97,15 @@ public:
     //!
     int AddSegment( OmafSegment* pSeg, uint32_t nInitSegID, uint32_t& nSegID);
 
-    int ParseSegment(uint32_t nSegID, uint32_t nInitSegID);
+    //!  \brief parse the segment with the reader of the track reading it, and index
+    //!         the sample ranges of the segment if it belongs to an extractor track
+    //!
+    int ParseSegment(OmafReader* reader, uint32_t nSegID, uint32_t nInitSegID);
 
-    //!  \brief Get Next packet from packet queue. each track has a packet queue
+    //!  \brief Get Next packet from packet queue. each track has a packet queue.
+    //!         if the queue is empty, wait at most waitTime ms for a packet
     //!
-    int GetNextFrame( int trackID, MediaPacket*& pPacket, bool needParams );
+    int GetNextFrame( int trackID, MediaPacket*& pPacket, bool needParams, uint32_t waitTime = 0 );
 
     //!  \brief Get initial segments parse status.
     //!
@@ -109,6 +118,11 @@ public:
         return isParsed;
     };
 
+    //!  \brief Wait until all initial segments are parsed, at most waitTime ms.
+    //!         return true if all initial segments are parsed
+    //!
+    bool WaitInitSegParsed( uint32_t waitTime );
+
 public:
     //!  \brief call when seeking
     //!
@@ -116,6 +130,11 @@ public:
 
     void RemoveTrackFromPacketQueue(list<int>& trackIDs);
 
+    //!  \brief get the count of segments downloaded for the track but not
+    //!         read to the packet queue yet, including the one being read
+    //!
+    uint32_t GetBufferedSegmentCount(int trackID);
+
 public:
     //!  \brief the thread routine to read packet for each active track
     //!
@@ -125,12 +144,16 @@ private:
     //!  \brief read packet for trackID
     //!
     int  ReadNextSegment(
+        OmafReader* reader,
         int trackID,
         uint16_t initSegID,
         bool isExtractor,
-        std::vector<TrackInformation*> readTrackInfos,
         bool& segmentChanged );
 
+    //!  \brief get the init segment ID of the track, 0 if not found
+    //!
+    uint32_t GetInitSegID(int trackID);
+
     //!  \brief Setup Track information for each stream and relative adaptation set
     //!
     void UpdateSourceTrackID();
@@ -150,7 +173,7 @@ private:
 
     //!  \brief remove segment for reader based on initSegmentID & SegmentID
     //!
-    uint32_t removeSegment(uint32_t initSegmentId, uint32_t segmentId);
+    uint32_t removeSegment(OmafReader* reader, uint32_t initSegmentId, uint32_t segmentId);
 
     //!  \brief release all packets in the packet queues
     //!
@@ -162,19 +185,99 @@ private:
 
     void RemoveReadSegmentFromMap();
 
+    //!  \brief wait until the segment to read is added, the reader is stopping or time out
+    //!
+    void WaitSegmentAdded(SegStatus* st);
+
+    //!  \brief get the pool of the packet buffers for the track, create it if needed
+    //!
+    std::shared_ptr<PacketBufferPool> GetPacketPool(int trackID);
+
+    //!  \brief get the packet queue of the track, NULL if the queues are not set up
+    //!         yet. The queues are created once with the status map and never
+    //!         removed before closing, so no lock is needed to look them up
+    //!
+    OmafPacketQueue* GetPacketQueue(int trackID);
+
+    //!  \brief wait until the packet queue of the track is at or below the high
+    //!         water mark before reading its next segment, or until stopping
+    //!
+    void WaitPacketQueueDrained(int trackID);
+
+    //!  \brief the reading loop of the thread, hand the complete segments of the
+    //!         enabled extractors to the reader workers
+    //!
+    void ReadSegments();
+
+    //!  \brief hand the next segment of the extractor track to the reader workers
+    //!         if it is complete and the packet queue has room. return true if
+    //!         the segment is handed over
+    //!
+    bool DispatchSegment(int trackID, SegStatus* st);
+
+    //!  \brief check if the segment to read next for the track is downloaded
+    //!         together with the segments of all depended tracks
+    //!
+    bool IsSegmentReady(SegStatus* st);
+
+    //!  \brief start and stop the threads reading the segments of the tracks
+    //!
+    void StartReaderWorkers();
+    void StopReaderWorkers();
+
+    //!  \brief the thread routine of the reader workers
+    //!
+    void ReaderWorkerRun();
+
+    //!  \brief queue the segment of the track for the reader workers. Only one
+    //!         segment of a track is read at a time, so the packets stay in order
+    //!
+    void SubmitReadJob(int trackID, uint32_t segID);
+
+    //!  \brief check if a segment of the track is queued or being read
+    //!
+    bool IsTrackReading(int trackID);
+
+    //!  \brief parse and read the segment of the extractor track and the segments
+    //!         of its depended tracks into the packet queue of the track
+    //!
+    int  ReadTrackSegment(int trackID, uint32_t segID);
+
+    //!  \brief get the reader of the extractor track, create it with the init
+    //!         segments of the track and its depended tracks if needed. The
+    //!         reader is only used by the worker reading the track
+    //!
+    OmafReader* GetTrackReader(int trackID);
+
 private:
     OmafReader*                     mReader;          //<! the Reader implementation
-    std::map<int, PacketQueue>      mPacketQueues;    //<! <trackID, PacketQueue>
+    std::map<int, OmafReader*>      mTrackReaders;    //<! <trackID, Reader> for each extractor track read by the workers
+    std::map<uint32_t, OmafSegment*> mInitSegments;   //<! <InitSegID, init segment>, parsed again by the reader of each extractor track
+    std::mutex                      mTrackReaderLock; //<! lock for the readers of the extractor tracks
+    std::vector<std::thread>        mReaderWorkers;   //<! the threads reading the segments of the tracks
+    std::list<std::pair<int, uint32_t>> mReadJobs;    //<! <trackID, segment ID> queued for the reader workers
+    std::map<int, uint32_t>         mReadingTracks;   //<! <trackID, segment ID> queued or being read
+    std::mutex                      mJobLock;         //<! lock for the read jobs
+    std::condition_variable         mJobCond;         //<! notified when a read job is queued or the workers stop
+    bool                            mWorkerStop;      //<! the workers exit once the queued jobs are done
+    uint64_t                        mSegEventCnt;     //<! count of the segments added and read, the dispatching waits for a change
+    std::map<int, OmafPacketQueue*> mPacketQueues;    //<! <trackID, PacketQueue>, only changed when not running
+    std::atomic<bool>               mPacketQueueReady; //<! the packet queues of all tracks are created
+    std::map<int, std::shared_ptr<PacketBufferPool>> mPacketPools; //<! <trackID, pool of the packet buffers>
+    std::map<int, uint32_t>         mLastSampleSize;  //<! <trackID, size of the last read sample>, the size hint of the next one
     std::vector<TrackInformation*>   mTrackInfos;      //<! track information of the opened media
-    std::map<uint32_t, std::vector<TrackInformation*>> mSegTrackInfos; //<! seg id and its corresponding track infos
+    std::unordered_map<int, std::unordered_map<uint32_t, SegmentSampleRange>> mSegSampleRanges; //<! <trackID, <segment ID, sample range>> of the parsed segments not read yet
+    std::unordered_map<int, uint32_t> mTrackInitSeg;  //<! <trackID, InitSegID>, the reverse of mMapInitTrk
     int                             mCurTrkCnt;       //<! ID base for Init Segment
     OmafMediaSource*                mSource;          //<! reference to the source
     std::map<int, int>              mMapSegCnt;       //<! ID base for segment based on each InitSeg
     std::map<int, SegStatus>        mMapSegStatus;    //<! Segment status for each track
     std::map<int, int>              mMapInitTrk;      //<! ID pair for InitSegID to TrackID;
-    ThreadLock                      mLock;            //<! for synchronization
+    std::mutex                      mLock;            //<! for synchronization
+    std::condition_variable         mSegCond;         //<! notified when init segments parsed, a segment added or stopping
     ThreadLock                      mReaderLock;      //<! lock for reader synchronization
-    ThreadLock                      mPacketLock;      //<! lock for packet queue synchronization
+    std::mutex                      mPacketLock;      //<! lock for the packet pools
+    std::mutex                      mParamLock;       //<! lock for the sample size and the parameter sets read by the workers
     bool                            mEOS;             //<! flag for end of stream
     int                             mStatus;          //<! thread status: 0: runing; 1: stopping, 2. stopped;
     bool                            mReadSync;        //<! need to read  the frame at the bound of I frame (GOP boundary)
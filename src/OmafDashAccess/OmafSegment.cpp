@@ -38,6 +38,7 @@
 #include "OmafSegment.h"
 #include "DownloadManager.h"
 #include "OmafReaderManager.h"
+#include "OmafDownloadScheduler.h"
 
 VCD_OMAF_BEGIN
 
@@ -51,22 +52,26 @@ OmafSegment::OmafSegment()
     mStatus      = SegUnknown;
     mSegSize     = 0;
     mInitSegment = false;
-    mData        = NULL;
     mReEnabled   = false;
     mSegCnt      = 0;
     mInitSegID   = 0;
     mSegID       = 0;
+    mAddedToReader = false;
+    mAbandoned   = false;
 }
 
 OmafSegment::~OmafSegment()
 {
-    pthread_mutex_destroy( &mMutex );
-    pthread_cond_destroy( &mCond );
-
     //SAFE_DELETE(mSeg);
-    mSeg->StopDownloadSegment((OmafDownloaderObserver*) this);
+    // stopping the download notifies the status, which takes mMutex, so
+    // detach from the downloader before the lock is destroyed
+    if(mSeg) mSeg->StopDownloadSegment((OmafDownloaderObserver*) this);
+
+    if(mCacheFile.size())
+        DOWNLOADMANAGER::GetInstance()->DeleteCacheFile(mCacheFile);
 
-    DOWNLOADMANAGER::GetInstance()->DeleteCacheFile(mCacheFile);
+    pthread_mutex_destroy( &mMutex );
+    pthread_cond_destroy( &mCond );
 }
 
 OmafSegment::OmafSegment(SegmentElement* pSeg, int segCnt, bool bInitSegment, bool reEnabled):OmafSegment()
@@ -83,15 +88,16 @@ OmafSegment::OmafSegment(SegmentElement* pSeg, int segCnt, bool bInitSegment, bo
     mSegCnt      = segCnt;
     mInitSegID   = 0;
     mSegID       = 0;
+    mAddedToReader = false;
+    mAbandoned   = false;
 }
 
 int OmafSegment::StartDownload()
 {
     if(NULL == mSeg) return ERROR_NULL_PTR;
 
-    mStoreFile = DOWNLOADMANAGER::GetInstance()->UseCache();
-
     mSegSize     = 0;
+    mAddedToReader = false;
 
     mStatus = SegReady;
 
@@ -104,18 +110,17 @@ int OmafSegment::WaitComplete()
 {
     if( mStatus == SegDownloaded ) return ERROR_NONE;
 
-    int64_t waitTime = 0;
-
-    //printf("wait download =======\n");
-    /*pthread_mutex_lock(&m_mutex);
-    pthread_cond_wait(&m_cond, &m_mutex);
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 600;
 
-    pthread_mutex_unlock(&m_mutex);*/
-    // exit the waiting if segment downloaded or wait time is more than 10 mins
-    while(mStatus != SegDownloaded && waitTime < 60000){
-        ::usleep(10000);
-        waitTime++;
+    // exit the waiting if segment downloaded or aborted, or wait time is more than 10 mins
+    pthread_mutex_lock(&mMutex);
+    while(mStatus != SegDownloaded && mStatus != SegAborted){
+        if(ETIMEDOUT == pthread_cond_timedwait(&mCond, &mMutex, &deadline))
+            break;
     }
+    pthread_mutex_unlock(&mMutex);
 
     return ERROR_NONE;
 }
@@ -159,58 +164,79 @@ int OmafSegment::Peek(uint8_t *data, size_t len, size_t offset)
     return mSeg->Peek(data, len, offset);
 }
 
+int OmafSegment::GetDataView(const uint8_t **data, size_t *len)
+{
+    if(NULL == mSeg) return ERROR_NULL_PTR;
+
+    if(mStatus != SegDownloaded) WaitComplete();
+
+    return mSeg->GetDataView(data, len);
+}
+
 int OmafSegment::Close()
 {
     if(NULL == mSeg) return ERROR_NULL_PTR;
 
-    if(mStatus != SegDownloading) mSeg->StopDownloadSegment((OmafDownloaderObserver*) this);
+    mSeg->StopDownloadSegment((OmafDownloaderObserver*) this);
 
     //SAFE_DELETE( mSeg );
 
     return ERROR_NONE;
 }
 
-int OmafSegment::SaveToFile()
+bool OmafSegment::Abandon()
 {
-    mCacheFile = DOWNLOADMANAGER::GetInstance()->GetCacheFolder() + "/" + DOWNLOADMANAGER::GetInstance()->AssignCacheFileName();
-    mFileStream.open(mCacheFile, ios::out|ios::binary);
+    pthread_mutex_lock(&mMutex);
+    if(!mAddedToReader) mAbandoned = true;
+    bool bAbandoned = mAbandoned;
+    pthread_mutex_unlock(&mMutex);
 
-    mData = (uint8_t*)malloc(mSegSize);
-    Read( mData, mSegSize );
-
-    mFileStream.write( (char *)mData, mSegSize);
+    return bAbandoned;
+}
 
-    mFileStream.close();
+void OmafSegment::DownloadDataNotify(uint64_t bytesDownloaded)
+{
+    // every time OnDownloadRateChanged called, the input bytesDownloaded
+    // is the total bytes number includes previous downloaded bytes
+    mSegSize = bytesDownloaded;
+}
 
-    if (mData)
+void OmafSegment::AddToReader()
+{
+    pthread_mutex_lock(&mMutex);
+    if(mAbandoned || mAddedToReader)
     {
-        free(mData);
-        mData = NULL;
+        pthread_mutex_unlock(&mMutex);
+        return;
     }
+    mAddedToReader = true;
+    pthread_mutex_unlock(&mMutex);
 
-    LOG(INFO)<<"close saved cache "<<mCacheFile<<", size= "<<mSegSize<<std::endl;
-    return ERROR_NONE;
+    if(this->mInitSegment){
+        READERMANAGER::GetInstance()->AddInitSegment(this, mInitSegID);
+    }else{
+        READERMANAGER::GetInstance()->AddSegment(this, mInitSegID, mSegID);
+    }
 }
 
-void OmafSegment::DownloadDataNotify(uint64_t bytesDownloaded)
+void OmafSegment::SetStatusAndNotify(SEGSTATUS status)
 {
-    // every time OnDownloadRateChanged called, the input bytesDownloaded
-    // is the total bytes number includes previous downloaded bytes
-    mSegSize = bytesDownloaded;
+    pthread_mutex_lock(&mMutex);
+    mStatus = status;
+    pthread_cond_broadcast(&mCond);
+    pthread_mutex_unlock(&mMutex);
 }
 
 void OmafSegment::DownloadStatusNotify(DownloaderStatus state)
 {
     switch(state){
         case DOWNLOADED:
-            mStatus = SegDownloaded;
-            if( mStoreFile ) SaveToFile();
+            SetStatusAndNotify(SegDownloaded);
 
-            if(this->mInitSegment){
-                READERMANAGER::GetInstance()->AddInitSegment(this, mInitSegID);
-            }else{
-                READERMANAGER::GetInstance()->AddSegment(this, mInitSegID, mSegID);
-            }
+            // free the download slot before the segment is handed to reader manager
+            if(!mInitSegment) DOWNLOADSCHEDULER::GetInstance()->SegmentDone(this, true);
+
+            if(!mAddedToReader) AddToReader();
 
             break;
         case NOT_START:
@@ -220,8 +246,11 @@ void OmafSegment::DownloadStatusNotify(DownloaderStatus state)
             mStatus = SegDownloading;
             break;
         case STOPPING:
+            SetStatusAndNotify(SegAborted);
+            break;
         case STOPPED:
-            mStatus = SegAborted;
+            SetStatusAndNotify(SegAborted);
+            if(!mInitSegment) DOWNLOADSCHEDULER::GetInstance()->SegmentDone(this, false);
             break;
         default:
             mStatus = SegUnknown;
@@ -107,12 +107,23 @@ public:
     //!
     //!  \brief Basic operation to read / write the segment data.
     //!
-    int     Open( );
+    virtual int Open( );
     int     Open( SegmentElement* pSeg );
     int     Read(uint8_t *data, size_t len);
     int     Peek(uint8_t *data, size_t len);
     int     Peek(uint8_t *data, size_t len, size_t offset);
-    int     Close();
+    int     GetDataView(const uint8_t **data, size_t *len);
+
+    //!
+    //!  \brief stop downloading the segment and wait until it is stopped
+    //!
+    virtual int Close();
+
+    //!
+    //!  \brief give up the segment so it won't be handed to reader manager.
+    //!         return false if it is handed to reader manager already
+    //!
+    bool    Abandon();
 
     void     SetSegID( uint32_t id )     { mSegID = id;        };
     uint32_t GetSegID()                  { return mSegID;      };
@@ -124,11 +135,6 @@ public:
     int     GetSegCount(){return mSegCnt;};
 
 private:
-    //!
-    //!  \brief save the memory data to file.
-    //!
-    int SaveToFile();
-
     //!
     //!  \brief start downloading process.
     //!
@@ -139,21 +145,31 @@ private:
     //!
     int WaitComplete();
 
+    //!
+    //!  \brief set the status and wake up the threads in WaitComplete.
+    //!
+    void SetStatusAndNotify(SEGSTATUS status);
+
+    //!
+    //!  \brief hand the segment to the reader manager, only once.
+    //!
+    void AddToReader();
+
 private:
     SegmentElement*                   mSeg;               //<! SegmentElement
     bool                              mStoreFile;         //<! flag to indicate whether the segment should be stored in disk
     std::string                       mCacheFile;         //<! the file name for downloaded segment file
     SEGSTATUS                         mStatus;            //<! status of the segment
-    std::ofstream                     mFileStream;        //<! file handle for writing
     pthread_mutex_t                   mMutex;             //<! for synchronization
     pthread_cond_t                    mCond;              //<! for synchronization
     uint64_t                          mSegSize;           //<! the total size of data downloaded for this segment
     bool                              mInitSegment;       //<! flag to indicate whether this segment is initialize MP4
     uint32_t                          mSegID;             //<! the Segment ID used for segment reading
     uint32_t                          mInitSegID;         //<! the init Segement ID relative to this segment
-    uint8_t                           *mData;             //<! memory for saving segment data
     bool                              mReEnabled;         //<! flag to indicate whether the segment is re-enabled
     int                               mSegCnt;            //<! the count for this segment
+    bool                              mAddedToReader;     //<! flag to indicate whether the segment is handed to reader manager
+    bool                              mAbandoned;         //<! flag to indicate whether the segment is given up by download scheduler
 };
 
 VCD_OMAF_END
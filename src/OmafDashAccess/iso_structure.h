@@ -376,6 +376,13 @@ typedef struct TrackInformation
     TrackTypeInformation type;
 }TrackInformation;
 
+typedef struct SegmentSampleRange
+{
+    uint32_t segmentId;
+    uint32_t firstSampleId;
+    uint32_t sampleCount;
+}SegmentSampleRange;
+
 typedef struct SegmentInformation
 {
     uint32_t refId;
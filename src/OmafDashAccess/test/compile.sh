@@ -6,6 +6,12 @@ g++ -I../../google_test -std=c++11 -I../util/ -g  -c testMediaSource.cpp -D_GLIB
 g++ -I../../google_test -std=c++11 -I../util/ -g  -c testMPDParser.cpp -D_GLIBCXX_USE_CXX11_ABI=0
 g++ -I../../google_test -std=c++11 -I../util/ -g  -c testOmafReader.cpp -D_GLIBCXX_USE_CXX11_ABI=0
 g++ -I../../google_test -std=c++11 -I../util/ -g  -c testOmafReaderManager.cpp -D_GLIBCXX_USE_CXX11_ABI=0
+g++ -I../../google_test -std=c++11 -I../util/ -g  -c testPoseTraceReplay.cpp -D_GLIBCXX_USE_CXX11_ABI=0
+g++ -I../../google_test -std=c++11 -I../util/ -g  -c testOmafPacketQueue.cpp -D_GLIBCXX_USE_CXX11_ABI=0
+g++ -I../../google_test -std=c++11 -I../util/ -g  -c testOmafPosePredictor.cpp -D_GLIBCXX_USE_CXX11_ABI=0
+g++ -I../../google_test -std=c++11 -I../util/ -g  -c testOmafDownloadScheduler.cpp -D_GLIBCXX_USE_CXX11_ABI=0
+g++ -I../../google_test -std=c++11 -I../util/ -g  -c testOmafThroughputEstimator.cpp -D_GLIBCXX_USE_CXX11_ABI=0
+g++ -I../../google_test -std=c++11 -I../util/ -g  -c testMediaPacket.cpp -D_GLIBCXX_USE_CXX11_ABI=0
 
 LD_FLAGS="-I/usr/local/include/ -lcurl -lstdc++ -lOmafDashAccess -lpthread -lglog -l360SCVP -lm -L/usr/local/lib"
 g++ -L/usr/local/lib testMediaSource.o testMPDParser.o testOmafReader.o testOmafReaderManager.o libgtest.a -o testLib ${LD_FLAGS}
@@ -13,6 +19,12 @@ g++ -L/usr/local/lib testMediaSource.o libgtest.a -o testMediaSource ${LD_FLAGS}
 g++ -L/usr/local/lib testMPDParser.o libgtest.a -o testMPDParser ${LD_FLAGS}
 g++ -L/usr/local/lib testOmafReader.o libgtest.a -o testOmafReader ${LD_FLAGS}
 g++ -L/usr/local/lib testOmafReaderManager.o libgtest.a -o testOmafReaderManager ${LD_FLAGS}
+g++ -L/usr/local/lib testPoseTraceReplay.o libgtest.a -o testPoseTraceReplay ${LD_FLAGS}
+g++ -L/usr/local/lib testOmafPacketQueue.o libgtest.a -o testOmafPacketQueue ${LD_FLAGS}
+g++ -L/usr/local/lib testOmafPosePredictor.o libgtest.a -o testOmafPosePredictor ${LD_FLAGS}
+g++ -L/usr/local/lib testOmafDownloadScheduler.o libgtest.a -o testOmafDownloadScheduler ${LD_FLAGS}
+g++ -L/usr/local/lib testOmafThroughputEstimator.o libgtest.a -o testOmafThroughputEstimator ${LD_FLAGS}
+g++ -L/usr/local/lib testMediaPacket.o libgtest.a -o testMediaPacket ${LD_FLAGS}
 
 ./run.sh
 if [ $? -ne 0 ]; then exit 1; fi
@@ -24,6 +24,18 @@ if [ $? -ne 0 ]; then exit 1; fi
 if [ $? -ne 0 ]; then exit 1; fi
 ./testOmafReaderManager
 if [ $? -ne 0 ]; then exit 1; fi
+./testPoseTraceReplay
+if [ $? -ne 0 ]; then exit 1; fi
+./testOmafPacketQueue
+if [ $? -ne 0 ]; then exit 1; fi
+./testOmafPosePredictor
+if [ $? -ne 0 ]; then exit 1; fi
+./testOmafDownloadScheduler
+if [ $? -ne 0 ]; then exit 1; fi
+./testOmafThroughputEstimator
+if [ $? -ne 0 ]; then exit 1; fi
+./testMediaPacket
+if [ $? -ne 0 ]; then exit 1; fi
 
 # All caes passed
 ################################
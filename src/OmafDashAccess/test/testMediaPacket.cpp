@@ -0,0 +1,466 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//!
+//! \file:   testMediaPacket.cpp
+//! \brief:  media packet and packet buffer pool unit test
+//!
+
+#include "gtest/gtest.h"
+#include "../MediaPacket.h"
+#include <memory>
+#include <vector>
+#include <set>
+#include <functional>
+
+VCD_USE_VROMAF;
+VCD_USE_VRVIDEO;
+
+namespace {
+
+//!
+//! \brief  reader of a sample of sampleSize bytes, which reports the size it
+//!         needs if knownSize, like the extractor track reader, or just fails
+//!
+class FakeSampleReader
+{
+public:
+    FakeSampleReader(uint32_t sampleSize, bool knownSize)
+        : mSampleSize(sampleSize), mKnownSize(knownSize), mCalls(0) {}
+
+    int operator()(char* buf, uint32_t& size)
+    {
+        mCalls++;
+        mSizes.push_back(size);
+        if(size < mSampleSize)
+        {
+            size = mKnownSize ? mSampleSize : 0;
+            return OMAF_MEMORY_TOO_SMALL_BUFFER;
+        }
+        for(uint32_t i = 0; i < mSampleSize; i++)
+            buf[i] = (char)i;
+        size = mSampleSize;
+        return ERROR_NONE;
+    }
+
+    uint32_t              mSampleSize;
+    bool                  mKnownSize;
+    int                   mCalls;
+    std::vector<uint32_t> mSizes;     //<! the buffer sizes of the calls
+};
+
+TEST(PacketBufferPoolTest, ClassSize)
+{
+    // never smaller than the min size
+    EXPECT_EQ(PacketBufferPool::ClassSize(0), 4096);
+    EXPECT_EQ(PacketBufferPool::ClassSize(1), 4096);
+    EXPECT_EQ(PacketBufferPool::ClassSize(4096), 4096);
+
+    // 2^n and 1.5 * 2^n in turn
+    EXPECT_EQ(PacketBufferPool::ClassSize(4097), 6144);
+    EXPECT_EQ(PacketBufferPool::ClassSize(6144), 6144);
+    EXPECT_EQ(PacketBufferPool::ClassSize(6145), 8192);
+    EXPECT_EQ(PacketBufferPool::ClassSize(8192), 8192);
+    EXPECT_EQ(PacketBufferPool::ClassSize(8193), 12288);
+    EXPECT_EQ(PacketBufferPool::ClassSize(12288), 12288);
+    EXPECT_EQ(PacketBufferPool::ClassSize(12289), 16384);
+    EXPECT_EQ(PacketBufferPool::ClassSize((1 << 20) - 1), 1 << 20);
+    EXPECT_EQ(PacketBufferPool::ClassSize(1 << 20), 1 << 20);
+    EXPECT_EQ(PacketBufferPool::ClassSize((1 << 20) + 1), 3 << 19);
+    EXPECT_EQ(PacketBufferPool::ClassSize(3 << 19), 3 << 19);
+    EXPECT_EQ(PacketBufferPool::ClassSize((3 << 19) + 1), 1 << 21);
+
+    // never wastes more than a third of the buffer, and a class is its own class
+    for(int size = 1; size < (1 << 22); size += 997)
+    {
+        int classSize = PacketBufferPool::ClassSize(size);
+        ASSERT_GE(classSize, size);
+        if(size > 4096) ASSERT_LT(classSize - size, classSize / 3 + 1) << size;
+        ASSERT_EQ(PacketBufferPool::ClassSize(classSize), classSize);
+    }
+}
+
+TEST(PacketBufferPoolTest, Reuse)
+{
+    PacketBufferPool pool;
+    int allocSize = 0;
+
+    char* buf = pool.Acquire(5000, allocSize);
+    ASSERT_TRUE(buf != NULL);
+    EXPECT_EQ(allocSize, 6144);
+    memset(buf, 0x5A, allocSize);
+    EXPECT_EQ(pool.GetFreeCount(6144), 0);
+
+    pool.Release(buf, allocSize);
+    EXPECT_EQ(pool.GetFreeCount(6144), 1);
+
+    // any size of the same class gets the buffer released
+    char* other = pool.Acquire(8192, allocSize);
+    EXPECT_EQ(allocSize, 8192);
+    EXPECT_EQ(pool.GetFreeCount(6144), 1);
+
+    char* reused = pool.Acquire(6000, allocSize);
+    EXPECT_EQ(reused, buf);
+    EXPECT_EQ(allocSize, 6144);
+    EXPECT_EQ(pool.GetFreeCount(6144), 0);
+
+    pool.Release(reused, 6144);
+    pool.Release(other, 8192);
+    EXPECT_EQ(pool.GetFreeCount(6144), 1);
+    EXPECT_EQ(pool.GetFreeCount(8192), 1);
+
+    // not from the pool, freed at once
+    pool.Release((char*)malloc(5000), 5000);
+    EXPECT_EQ(pool.GetFreeCount(5000), 0);
+    EXPECT_EQ(pool.GetFreeCount(6144), 1);
+    pool.Release(NULL, 4096);
+    EXPECT_EQ(pool.GetFreeCount(4096), 0);
+}
+
+TEST(PacketBufferPoolTest, MaxFreeBuffers)
+{
+    PacketBufferPool pool;
+    std::vector<char*> bufs;
+    int allocSize = 0;
+
+    for(int i = 0; i < POOL_MAX_FREE_BUFFERS + 4; i++)
+        bufs.push_back(pool.Acquire(4096, allocSize));
+    for(auto buf: bufs)
+        pool.Release(buf, allocSize);
+    EXPECT_EQ(pool.GetFreeCount(4096), POOL_MAX_FREE_BUFFERS);
+
+    // the kept ones are taken back before new ones are allocated
+    std::set<char*> kept(bufs.begin(), bufs.begin() + POOL_MAX_FREE_BUFFERS);
+    for(int i = 0; i < POOL_MAX_FREE_BUFFERS; i++)
+    {
+        char* buf = pool.Acquire(100, allocSize);
+        EXPECT_TRUE(kept.count(buf));
+        kept.erase(buf);
+        bufs[i] = buf;
+    }
+    EXPECT_EQ(pool.GetFreeCount(4096), 0);
+
+    for(int i = 0; i < POOL_MAX_FREE_BUFFERS; i++)
+        pool.Release(bufs[i], allocSize);
+
+    // each class is capped separately
+    char* large = pool.Acquire(100000, allocSize);
+    pool.Release(large, allocSize);
+    EXPECT_EQ(pool.GetFreeCount(allocSize), 1);
+    EXPECT_EQ(pool.GetFreeCount(4096), POOL_MAX_FREE_BUFFERS);
+}
+
+TEST(PacketBufferPoolTest, PacketBuffer)
+{
+    std::shared_ptr<PacketBufferPool> pool = std::make_shared<PacketBufferPool>();
+
+    MediaPacket* packet = new MediaPacket();
+    packet->SetPool(pool);
+    EXPECT_EQ(packet->ReservePacket(5000), 6144);
+    char* payload = packet->Payload();
+    delete packet;
+    EXPECT_EQ(pool->GetFreeCount(6144), 1);
+
+    // the buffer of a packet goes to the next packet
+    packet = new MediaPacket();
+    packet->SetPool(pool);
+    EXPECT_EQ(packet->ReservePacket(4500), 6144);
+    EXPECT_EQ(packet->Payload(), payload);
+    EXPECT_EQ(pool->GetFreeCount(6144), 0);
+
+    // a larger reserve gives the smaller buffer back
+    EXPECT_EQ(packet->ReservePacket(7000), 8192);
+    EXPECT_EQ(pool->GetFreeCount(6144), 1);
+    delete packet;
+    EXPECT_EQ(pool->GetFreeCount(8192), 1);
+
+    // the packets without the pool don't touch it
+    packet = new MediaPacket();
+    EXPECT_EQ(packet->ReservePacket(5000), 5000);
+    delete packet;
+    EXPECT_EQ(pool->GetFreeCount(6144), 1);
+    EXPECT_EQ(pool->GetFreeCount(5000), 0);
+}
+
+TEST(PacketBufferPoolTest, PacketOutlivesPool)
+{
+    std::shared_ptr<PacketBufferPool> pool = std::make_shared<PacketBufferPool>();
+    std::weak_ptr<PacketBufferPool> weakPool = pool;
+
+    MediaPacket* packet = new MediaPacket();
+    packet->SetPool(pool);
+    ASSERT_GT(packet->ReservePacket(10000), 0);
+    memset(packet->Payload(), 0x11, 10000);
+
+    MediaPacket* kept = new MediaPacket();
+    kept->SetPool(pool);
+    ASSERT_GT(kept->ReservePacket(10000), 0);
+    delete kept;
+
+    // the reader manager drops its pools while packets are still queued
+    pool.reset();
+    EXPECT_FALSE(weakPool.expired());
+
+    EXPECT_EQ(packet->Payload()[9999], 0x11);
+    delete packet;
+    EXPECT_TRUE(weakPool.expired());
+}
+
+TEST(PacketBufferPoolTest, ReadPayloadFits)
+{
+    std::shared_ptr<PacketBufferPool> pool = std::make_shared<PacketBufferPool>();
+    MediaPacket packet;
+    packet.SetPool(pool);
+    ASSERT_EQ(packet.ReservePacket(4000, 96), 4000);
+
+    FakeSampleReader reader(3000, true);
+    uint32_t size = 0;
+    EXPECT_EQ(packet.ReadPayload(std::ref(reader), 96, 100000, size), ERROR_NONE);
+    EXPECT_EQ(size, 3000u);
+    EXPECT_EQ(reader.mCalls, 1);
+    EXPECT_EQ(reader.mSizes[0], 4000u);
+    EXPECT_EQ(packet.Payload()[2999], (char)2999);
+}
+
+TEST(PacketBufferPoolTest, ReadPayloadGrowsToSizeRequired)
+{
+    std::shared_ptr<PacketBufferPool> pool = std::make_shared<PacketBufferPool>();
+    MediaPacket packet;
+    packet.SetPool(pool);
+    ASSERT_GT(packet.ReservePacket(4000, 96), 0);
+
+    FakeSampleReader reader(50000, true);
+    uint32_t size = 0;
+    EXPECT_EQ(packet.ReadPayload(std::ref(reader), 96, 100000, size), ERROR_NONE);
+    EXPECT_EQ(size, 50000u);
+    EXPECT_EQ(reader.mCalls, 2);
+
+    // the buffer grows from the pool once, the headroom is kept
+    EXPECT_EQ(packet.GetHeadroom(), 96);
+    EXPECT_EQ(packet.GetAllocSize(), PacketBufferPool::ClassSize(50000 + 96) - 96);
+    EXPECT_EQ(pool->GetFreeCount(4096), 1);
+    EXPECT_EQ(packet.Payload()[49999], (char)49999);
+}
+
+TEST(PacketBufferPoolTest, ReadPayloadDoublesUnknownSize)
+{
+    std::shared_ptr<PacketBufferPool> pool = std::make_shared<PacketBufferPool>();
+    MediaPacket packet;
+    packet.SetPool(pool);
+    ASSERT_GT(packet.ReservePacket(4000, 96), 0);
+
+    FakeSampleReader reader(30000, false);
+    uint32_t size = 0;
+    EXPECT_EQ(packet.ReadPayload(std::ref(reader), 96, 100000, size), ERROR_NONE);
+    EXPECT_EQ(size, 30000u);
+
+    // at least twice larger every time
+    ASSERT_GE(reader.mCalls, 2);
+    for(int i = 1; i < reader.mCalls; i++)
+        EXPECT_GE(reader.mSizes[i], reader.mSizes[i - 1] * 2);
+    EXPECT_LT(reader.mSizes[reader.mCalls - 2], 30000u);
+    EXPECT_EQ(packet.GetHeadroom(), 96);
+}
+
+TEST(PacketBufferPoolTest, ReadPayloadMaxSize)
+{
+    std::shared_ptr<PacketBufferPool> pool = std::make_shared<PacketBufferPool>();
+    MediaPacket packet;
+    packet.SetPool(pool);
+    ASSERT_GT(packet.ReservePacket(4000, 96), 0);
+
+    // the unknown size grows up to the max size, then gives up
+    FakeSampleReader reader(200000, false);
+    uint32_t size = 0;
+    EXPECT_EQ(packet.ReadPayload(std::ref(reader), 96, 100000, size), OMAF_MEMORY_TOO_SMALL_BUFFER);
+    EXPECT_GE((uint32_t)packet.GetAllocSize(), 100000u);
+    EXPECT_LT((uint32_t)packet.GetAllocSize(), 200000u);
+    EXPECT_LT(reader.mCalls, 10);
+
+    // the size required is taken even beyond the max size
+    FakeSampleReader known(200000, true);
+    EXPECT_EQ(packet.ReadPayload(std::ref(known), 96, 100000, size), ERROR_NONE);
+    EXPECT_EQ(size, 200000u);
+    EXPECT_EQ(known.mCalls, 2);
+}
+
+TEST(PacketBufferPoolTest, ReadPayloadError)
+{
+    MediaPacket packet;
+    FakeSampleReader reader(100, true);
+    uint32_t size = 0;
+
+    // nothing reserved
+    EXPECT_EQ(packet.ReadPayload(std::ref(reader), 0, 100000, size), OMAF_ERROR_NULL_PTR);
+    EXPECT_EQ(reader.mCalls, 0);
+
+    // the other errors are returned at once
+    ASSERT_GT(packet.ReservePacket(4000), 0);
+    int calls = 0;
+    EXPECT_EQ(packet.ReadPayload([&](char*, uint32_t&){ calls++; return OMAF_ERROR_INVALID_DATA; }, 0, 100000, size),
+              OMAF_ERROR_INVALID_DATA);
+    EXPECT_EQ(calls, 1);
+}
+
+TEST(MediaPacketTest, ReserveHeadroom)
+{
+    MediaPacket packet;
+    EXPECT_EQ(packet.GetAllocSize(), 0);
+
+    EXPECT_EQ(packet.ReservePacket(1000, 768), 1000);
+    ASSERT_TRUE(packet.Payload() != NULL);
+    EXPECT_EQ(packet.GetHeadroom(), 768);
+    EXPECT_EQ(packet.GetAllocSize(), 1000);
+    EXPECT_EQ(packet.Size(), 0);
+
+    // a smaller reserve keeps the buffer
+    char* payload = packet.Payload();
+    EXPECT_EQ(packet.ReservePacket(900, 868), 900);
+    EXPECT_EQ(packet.Payload(), payload + 100);
+    EXPECT_EQ(packet.GetHeadroom(), 868);
+
+    EXPECT_EQ(packet.ReservePacket(1768), 1768);
+    EXPECT_EQ(packet.Payload(), payload - 768);
+    EXPECT_EQ(packet.GetHeadroom(), 0);
+
+    // the size with the headroom counts for the pool class
+    std::shared_ptr<PacketBufferPool> pool = std::make_shared<PacketBufferPool>();
+    MediaPacket pooled;
+    pooled.SetPool(pool);
+    EXPECT_EQ(pooled.ReservePacket(5000, 768), 6144 - 768);
+    EXPECT_EQ(pooled.GetAllocSize(), 6144 - 768);
+    EXPECT_EQ(pooled.GetHeadroom(), 768);
+}
+
+TEST(MediaPacketTest, PrependParameterSets)
+{
+    const char vps[24] = { 0x00, 0x00, 0x00, 0x01, 0x40, 0x01 };
+    const char sps[40] = { 0x00, 0x00, 0x00, 0x01, 0x42, 0x01 };
+    const char pps[7]  = { 0x00, 0x00, 0x00, 0x01, 0x44, 0x01, 0x7F };
+
+    MediaPacket packet;
+    ASSERT_EQ(packet.ReservePacket(1000, 768), 1000);
+    char* payload = packet.Payload();
+    for(int i = 0; i < 1000; i++)
+        payload[i] = (char)(i * 7);
+    packet.SetRealSize(1000);
+
+    // written backwards before the payload, the sample is not moved
+    EXPECT_TRUE(packet.PrependData(pps, sizeof(pps)));
+    EXPECT_TRUE(packet.PrependData(sps, sizeof(sps)));
+    EXPECT_TRUE(packet.PrependData(vps, sizeof(vps)));
+
+    int paramSize = sizeof(vps) + sizeof(sps) + sizeof(pps);
+    EXPECT_EQ(packet.Payload(), payload - paramSize);
+    EXPECT_EQ(packet.Size(), 1000 + paramSize);
+    EXPECT_EQ(packet.GetHeadroom(), 768 - paramSize);
+    EXPECT_EQ(packet.GetAllocSize(), 1000 + paramSize);
+
+    char* data = packet.Payload();
+    EXPECT_EQ(memcmp(data, vps, sizeof(vps)), 0);
+    EXPECT_EQ(memcmp(data + sizeof(vps), sps, sizeof(sps)), 0);
+    EXPECT_EQ(memcmp(data + sizeof(vps) + sizeof(sps), pps, sizeof(pps)), 0);
+    for(int i = 0; i < 1000; i++)
+        ASSERT_EQ(data[paramSize + i], (char)(i * 7)) << i;
+}
+
+TEST(MediaPacketTest, PrependRefused)
+{
+    char data[32];
+    memset(data, 0x3C, sizeof(data));
+
+    // nothing reserved
+    MediaPacket empty;
+    EXPECT_FALSE(empty.PrependData(data, 1));
+    EXPECT_EQ(empty.Size(), 0);
+
+    MediaPacket packet;
+    ASSERT_EQ(packet.ReservePacket(100, 16), 100);
+    packet.SetRealSize(100);
+    char* payload = packet.Payload();
+
+    // the packet is left as it is
+    EXPECT_FALSE(packet.PrependData(data, 17));
+    EXPECT_EQ(packet.Payload(), payload);
+    EXPECT_EQ(packet.Size(), 100);
+    EXPECT_EQ(packet.GetHeadroom(), 16);
+
+    // the headroom is used up exactly
+    EXPECT_TRUE(packet.PrependData(data, 10));
+    EXPECT_TRUE(packet.PrependData(data, 6));
+    EXPECT_EQ(packet.GetHeadroom(), 0);
+    EXPECT_EQ(packet.Size(), 116);
+    EXPECT_FALSE(packet.PrependData(data, 1));
+    EXPECT_EQ(packet.Size(), 116);
+
+    // no headroom reserved
+    MediaPacket noHeadroom;
+    ASSERT_EQ(noHeadroom.ReservePacket(100), 100);
+    EXPECT_FALSE(noHeadroom.PrependData(data, 1));
+    EXPECT_TRUE(noHeadroom.PrependData(data, 0));
+}
+
+TEST(MediaPacketTest, ReAllocateKeepsPayload)
+{
+    MediaPacket packet;
+    ASSERT_EQ(packet.ReservePacket(1000, 768), 1000);
+    for(int i = 0; i < 1000; i++)
+        packet.Payload()[i] = (char)(i * 3);
+    packet.SetRealSize(1000);
+
+    // the payload is copied to the start of the new buffer, the headroom is dropped
+    EXPECT_EQ(packet.ReAllocatePacket(4000), 0);
+    EXPECT_EQ(packet.GetHeadroom(), 0);
+    EXPECT_EQ(packet.GetAllocSize(), 4000);
+    EXPECT_EQ(packet.Size(), 0);
+    for(int i = 0; i < 1000; i++)
+        ASSERT_EQ(packet.Payload()[i], (char)(i * 3)) << i;
+
+    // the same with a pooled buffer, which is given back
+    std::shared_ptr<PacketBufferPool> pool = std::make_shared<PacketBufferPool>();
+    MediaPacket pooled;
+    pooled.SetPool(pool);
+    ASSERT_EQ(pooled.ReservePacket(5000, 768), 6144 - 768);
+    for(int i = 0; i < 5000; i++)
+        pooled.Payload()[i] = (char)(i * 5);
+    EXPECT_EQ(pooled.ReAllocatePacket(20000), 0);
+    EXPECT_EQ(pool->GetFreeCount(6144), 1);
+    EXPECT_GE(pooled.GetAllocSize(), 20000);
+    for(int i = 0; i < 5000; i++)
+        ASSERT_EQ(pooled.Payload()[i], (char)(i * 5)) << i;
+
+    // a smaller size doesn't keep the data
+    EXPECT_EQ(packet.ReAllocatePacket(10), 10);
+    EXPECT_EQ(packet.GetHeadroom(), 0);
+    EXPECT_EQ(packet.Size(), 0);
+
+    // nothing allocated before
+    MediaPacket empty;
+    EXPECT_EQ(empty.ReAllocatePacket(100), 100);
+    EXPECT_EQ(empty.GetAllocSize(), 100);
+}
+
+}
@@ -0,0 +1,414 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//!
+//! \file:   testOmafDownloadScheduler.cpp
+//! \brief:  download scheduler unit test with fake segments which never
+//!          touch the network, the downloads are completed by the test
+//!
+
+#include "gtest/gtest.h"
+#include "../OmafDownloadScheduler.h"
+#include "../OmafSegment.h"
+#include "../OmafAdaptationSet.h"
+#include <vector>
+#include <set>
+#include <map>
+
+VCD_USE_VROMAF;
+VCD_USE_VRVIDEO;
+
+namespace {
+
+//!
+//! \brief  what happened to the fake segments, by segment count
+//!
+typedef struct SEGMENTLOG{
+    std::vector<int> opened;
+    std::set<int>    closed;
+    std::set<int>    deleted;
+}SegmentLog;
+
+//!
+//! \brief  segment recording the scheduler operations instead of downloading
+//!
+class FakeSegment : public OmafSegment
+{
+public:
+    FakeSegment(int segCnt, SegmentLog* log, int openResult = ERROR_NONE)
+        : OmafSegment(NULL, segCnt), mLog(log), mOpenResult(openResult)
+    {
+    }
+    virtual ~FakeSegment()
+    {
+        mLog->deleted.insert(GetSegCount());
+    }
+    virtual int Open()
+    {
+        mLog->opened.push_back(GetSegCount());
+        return mOpenResult;
+    }
+    virtual int Close()
+    {
+        mLog->closed.insert(GetSegCount());
+        return ERROR_NONE;
+    }
+private:
+    SegmentLog* mLog;
+    int         mOpenResult;
+};
+
+class OmafDownloadSchedulerTest : public testing::Test
+{
+public:
+    virtual void SetUp()
+    {
+        mViewport.SetDownloadPriority(PRIORITY_VIEWPORT);
+        mBackground.SetDownloadPriority(PRIORITY_BACKGROUND);
+        mPredicted.SetDownloadPriority(PRIORITY_PREDICTED);
+        // far enough not to be late
+        mDeadline = sys_clock() + 1000000;
+    }
+    virtual void TearDown()
+    {
+        // the segments downloaded are handed to reader manager, which is the test here
+        for(auto seg: mDownloaded) delete seg;
+        mDownloaded.clear();
+    }
+
+    void Add(OmafDownloadScheduler& scheduler, int segCnt, OmafAdaptationSet* pAS, uint32_t deadline, int openResult = ERROR_NONE)
+    {
+        FakeSegment* seg = new FakeSegment(segCnt, &mLog, openResult);
+        mSegments[segCnt] = seg;
+        EXPECT_EQ(scheduler.AddSegment(seg, pAS, deadline), ERROR_NONE);
+    }
+
+    void Downloaded(OmafDownloadScheduler& scheduler, int segCnt)
+    {
+        ASSERT_TRUE(mSegments.count(segCnt));
+        ASSERT_FALSE(mLog.deleted.count(segCnt));
+        ASSERT_TRUE(IsOpened(segCnt));
+        scheduler.SegmentDone(mSegments[segCnt], true);
+        mDownloaded.push_back(mSegments[segCnt]);
+    }
+
+    void Stopped(OmafDownloadScheduler& scheduler, int segCnt)
+    {
+        ASSERT_TRUE(mSegments.count(segCnt));
+        ASSERT_FALSE(mLog.deleted.count(segCnt));
+        ASSERT_TRUE(IsOpened(segCnt));
+        scheduler.SegmentDone(mSegments[segCnt], false);
+    }
+
+    bool IsOpened(int segCnt)
+    {
+        for(auto cnt: mLog.opened)
+            if(cnt == segCnt) return true;
+        return false;
+    }
+
+    OmafAdaptationSet           mViewport;
+    OmafAdaptationSet           mBackground;
+    OmafAdaptationSet           mPredicted;
+    uint32_t                    mDeadline;
+    SegmentLog                  mLog;
+    std::map<int, FakeSegment*> mSegments;
+    std::vector<FakeSegment*>   mDownloaded;
+};
+
+TEST_F(OmafDownloadSchedulerTest, NullSegment)
+{
+    OmafDownloadScheduler scheduler;
+    FakeSegment seg(1, &mLog);
+
+    EXPECT_EQ(scheduler.AddSegment(NULL, &mViewport, mDeadline), ERROR_NULL_PTR);
+    EXPECT_EQ(scheduler.AddSegment(&seg, NULL, mDeadline), ERROR_NULL_PTR);
+    EXPECT_TRUE(mLog.opened.empty());
+
+    // not scheduled, ignored
+    scheduler.SegmentDone(&seg, true);
+    scheduler.SegmentDone(&seg, false);
+    EXPECT_EQ(scheduler.GetLateCount(), 0u);
+}
+
+TEST_F(OmafDownloadSchedulerTest, DeadlineThenPriority)
+{
+    OmafDownloadScheduler scheduler;
+    scheduler.SetMaxInFlight(1);
+
+    // takes the only slot, so the others are queued
+    Add(scheduler, 0, &mViewport, mDeadline);
+
+    Add(scheduler, 1, &mViewport,   mDeadline + 2000);
+    Add(scheduler, 2, &mPredicted,  mDeadline + 1000);
+    Add(scheduler, 3, &mBackground, mDeadline + 1000);
+    Add(scheduler, 4, &mViewport,   mDeadline + 1000);
+    Add(scheduler, 5, &mPredicted,  mDeadline + 1000);
+    Add(scheduler, 6, &mViewport,   mDeadline + 1000);
+    Add(scheduler, 7, &mBackground, mDeadline + 500);
+    ASSERT_EQ(mLog.opened.size(), 1u);
+
+    // each download done starts the next most urgent one: the earliest
+    // deadline, then viewport, background, predicted, then the queued order
+    while(mLog.opened.size() < mSegments.size())
+    {
+        uint32_t opened = mLog.opened.size();
+        Downloaded(scheduler, mLog.opened.back());
+        ASSERT_EQ(mLog.opened.size(), opened + 1);
+    }
+    Downloaded(scheduler, mLog.opened.back());
+
+    std::vector<int> expected = { 0, 7, 4, 6, 3, 2, 5, 1 };
+    EXPECT_EQ(mLog.opened, expected);
+    EXPECT_TRUE(mLog.closed.empty());
+    EXPECT_TRUE(mLog.deleted.empty());
+    EXPECT_EQ(scheduler.GetLateCount(), 0u);
+}
+
+TEST_F(OmafDownloadSchedulerTest, DeadlineWrapAround)
+{
+    OmafDownloadScheduler scheduler;
+    scheduler.SetMaxInFlight(1);
+
+    Add(scheduler, 0, &mViewport, mDeadline);
+
+    // the clock in ms wraps around every 49 days, 0x10 is after 0xFFFFFF00
+    Add(scheduler, 1, &mViewport, 0x10);
+    Add(scheduler, 2, &mViewport, 0xFFFFFF00);
+
+    Downloaded(scheduler, 0);
+    Downloaded(scheduler, 2);
+    Downloaded(scheduler, 1);
+
+    std::vector<int> expected = { 0, 2, 1 };
+    EXPECT_EQ(mLog.opened, expected);
+}
+
+TEST_F(OmafDownloadSchedulerTest, MaxInFlight)
+{
+    OmafDownloadScheduler scheduler;
+    EXPECT_EQ(scheduler.GetMaxInFlight(), 32u);
+
+    for(int i = 0; i < 40; i++)
+        Add(scheduler, i, &mViewport, mDeadline + i);
+    EXPECT_EQ(mLog.opened.size(), 32u);
+
+    // a slot is freed by a download done or stopped
+    Downloaded(scheduler, 0);
+    EXPECT_EQ(mLog.opened.size(), 33u);
+    EXPECT_EQ(mLog.opened.back(), 32);
+
+    Stopped(scheduler, 1);
+    EXPECT_EQ(mLog.opened.size(), 34u);
+    EXPECT_EQ(mLog.opened.back(), 33);
+
+    // the segments done are not started again
+    scheduler.SegmentDone(mSegments[0], true);
+    EXPECT_EQ(mLog.opened.size(), 34u);
+
+    // a larger cap starts the queued ones at once
+    scheduler.SetMaxInFlight(36);
+    EXPECT_EQ(mLog.opened.size(), 38u);
+
+    // a smaller one only holds the queued ones back
+    scheduler.SetMaxInFlight(0);
+    EXPECT_EQ(scheduler.GetMaxInFlight(), 1u);
+    for(int i = 2; i < 30; i++)
+        Downloaded(scheduler, i);
+    EXPECT_EQ(mLog.opened.size(), 38u);
+
+    scheduler.CancelAll();
+}
+
+TEST_F(OmafDownloadSchedulerTest, StoppedReleased)
+{
+    OmafDownloadScheduler scheduler;
+    scheduler.SetMaxInFlight(1);
+
+    Add(scheduler, 0, &mViewport, mDeadline);
+    Add(scheduler, 1, &mViewport, mDeadline + 1000);
+
+    // stopped in the download thread, it is released later in the next call
+    Stopped(scheduler, 0);
+    EXPECT_EQ(mLog.opened.size(), 2u);
+    EXPECT_FALSE(mLog.deleted.count(0));
+
+    Add(scheduler, 2, &mViewport, mDeadline + 2000);
+    EXPECT_TRUE(mLog.deleted.count(0));
+    EXPECT_FALSE(mLog.closed.count(0));
+
+    Downloaded(scheduler, 1);
+    Downloaded(scheduler, 2);
+}
+
+TEST_F(OmafDownloadSchedulerTest, OpenFailed)
+{
+    OmafDownloadScheduler scheduler;
+    scheduler.SetMaxInFlight(1);
+
+    Add(scheduler, 0, &mViewport, mDeadline, ERROR_INVALID);
+    // the slot is not held by the failed segment
+    Add(scheduler, 1, &mViewport, mDeadline + 1000);
+    EXPECT_TRUE(IsOpened(0));
+    EXPECT_TRUE(IsOpened(1));
+    EXPECT_TRUE(mLog.deleted.count(0));
+
+    Downloaded(scheduler, 1);
+}
+
+TEST_F(OmafDownloadSchedulerTest, LateCount)
+{
+    OmafDownloadScheduler scheduler;
+
+    Add(scheduler, 0, &mViewport, sys_clock() - 1000);
+    Add(scheduler, 1, &mViewport, mDeadline);
+    Add(scheduler, 2, &mViewport, sys_clock() - 1000);
+
+    Downloaded(scheduler, 0);
+    Downloaded(scheduler, 1);
+    EXPECT_EQ(scheduler.GetLateCount(), 1u);
+
+    // the segments stopped are not counted
+    Stopped(scheduler, 2);
+    EXPECT_EQ(scheduler.GetLateCount(), 1u);
+}
+
+TEST_F(OmafDownloadSchedulerTest, CancelStaleRequests)
+{
+    OmafDownloadScheduler scheduler;
+    scheduler.SetMaxInFlight(3);
+
+    OmafAdaptationSet stale;
+    OmafAdaptationSet staleBackground;
+    stale.SetDownloadPriority(PRIORITY_PREDICTED);
+    staleBackground.SetDownloadPriority(PRIORITY_BACKGROUND);
+
+    // in flight
+    Add(scheduler, 0, &stale,           mDeadline);
+    Add(scheduler, 1, &staleBackground, mDeadline);
+    Add(scheduler, 2, &mViewport,       mDeadline);
+    // queued
+    Add(scheduler, 3, &stale,           mDeadline + 1000);
+    Add(scheduler, 4, &staleBackground, mDeadline + 2000);
+    Add(scheduler, 5, &mPredicted,      mDeadline + 3000);
+    Add(scheduler, 6, &mViewport,       mDeadline + 3000);
+    ASSERT_EQ(mLog.opened.size(), 3u);
+
+    // nothing changes while all adaptation sets are enabled
+    EXPECT_EQ(scheduler.CancelStaleRequests(), ERROR_NONE);
+    EXPECT_EQ(mLog.opened.size(), 3u);
+    EXPECT_TRUE(mLog.closed.empty());
+    EXPECT_TRUE(mLog.deleted.empty());
+
+    // the tiles move out of the viewport, and the predicted extractor turns
+    // into the viewport one
+    stale.Enable(false);
+    staleBackground.Enable(false);
+    mPredicted.SetDownloadPriority(PRIORITY_VIEWPORT);
+    mViewport.SetDownloadPriority(PRIORITY_PREDICTED);
+
+    EXPECT_EQ(scheduler.CancelStaleRequests(), ERROR_NONE);
+
+    // the download is stopped before the segment is released
+    EXPECT_TRUE(mLog.closed.count(0));
+    EXPECT_TRUE(mLog.deleted.count(0));
+    // the queued one is released without being started
+    EXPECT_FALSE(IsOpened(3));
+    EXPECT_FALSE(mLog.closed.count(3));
+    EXPECT_TRUE(mLog.deleted.count(3));
+    // the background ones are never cancelled
+    EXPECT_FALSE(mLog.closed.count(1));
+    EXPECT_FALSE(mLog.deleted.count(1));
+    EXPECT_FALSE(mLog.deleted.count(4));
+    EXPECT_FALSE(mLog.closed.count(2));
+    EXPECT_FALSE(mLog.deleted.count(2));
+
+    // the freed slot goes to the earliest deadline
+    ASSERT_EQ(mLog.opened.size(), 4u);
+    EXPECT_EQ(mLog.opened.back(), 4);
+
+    // the updated priority counts for the same deadline
+    Downloaded(scheduler, 4);
+    ASSERT_EQ(mLog.opened.size(), 5u);
+    EXPECT_EQ(mLog.opened.back(), 5);
+    Downloaded(scheduler, 5);
+    ASSERT_EQ(mLog.opened.size(), 6u);
+    EXPECT_EQ(mLog.opened.back(), 6);
+
+    Downloaded(scheduler, 2);
+    Downloaded(scheduler, 1);
+    Downloaded(scheduler, 6);
+    EXPECT_EQ(mLog.deleted.size(), 2u);
+}
+
+TEST_F(OmafDownloadSchedulerTest, CancelAll)
+{
+    OmafDownloadScheduler scheduler;
+    scheduler.SetMaxInFlight(2);
+
+    Add(scheduler, 0, &mViewport,   mDeadline);
+    Add(scheduler, 1, &mBackground, mDeadline);
+    Add(scheduler, 2, &mPredicted,  mDeadline + 1000);
+    Add(scheduler, 3, &mBackground, mDeadline + 1000);
+    ASSERT_EQ(mLog.opened.size(), 2u);
+
+    scheduler.CancelAll();
+
+    // all the segments are released whatever the priority, the ones in flight
+    // are stopped first, and nothing queued is started
+    EXPECT_EQ(mLog.opened.size(), 2u);
+    std::set<int> closed = { 0, 1 };
+    std::set<int> deleted = { 0, 1, 2, 3 };
+    EXPECT_EQ(mLog.closed, closed);
+    EXPECT_EQ(mLog.deleted, deleted);
+
+    // the slots are free for new segments
+    Add(scheduler, 4, &mViewport, mDeadline + 2000);
+    Add(scheduler, 5, &mViewport, mDeadline + 2000);
+    EXPECT_EQ(mLog.opened.size(), 4u);
+
+    Downloaded(scheduler, 4);
+    Downloaded(scheduler, 5);
+}
+
+TEST_F(OmafDownloadSchedulerTest, DestroyCancelsAll)
+{
+    {
+        OmafDownloadScheduler scheduler;
+        scheduler.SetMaxInFlight(1);
+        Add(scheduler, 0, &mViewport, mDeadline);
+        Add(scheduler, 1, &mViewport, mDeadline);
+        Stopped(scheduler, 0);
+        Add(scheduler, 2, &mViewport, mDeadline);
+    }
+
+    std::set<int> deleted = { 0, 1, 2 };
+    EXPECT_EQ(mLog.deleted, deleted);
+    EXPECT_TRUE(mLog.closed.count(1));
+    EXPECT_FALSE(IsOpened(2));
+}
+
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//!
+//! \file:   testOmafPacketQueue.cpp
+//! \brief:  single producer / single consumer packet queue unit test
+//!
+
+#include "gtest/gtest.h"
+#include "../OmafPacketQueue.h"
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+VCD_USE_VROMAF;
+VCD_USE_VRVIDEO;
+
+namespace {
+
+typedef std::chrono::steady_clock TestClock;
+
+static uint64_t ElapsedMs(TestClock::time_point from)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(TestClock::now() - from).count();
+}
+
+//!
+//! \brief  packet counting its releases, the pts is the sequence number
+//!
+class CountedPacket : public MediaPacket
+{
+public:
+    CountedPacket(uint64_t seq, std::atomic<uint32_t>* released) : mReleased(released)
+    {
+        SetPTS(seq);
+    }
+    virtual ~CountedPacket()
+    {
+        if(mReleased) (*mReleased)++;
+    }
+private:
+    std::atomic<uint32_t>* mReleased;
+};
+
+TEST(OmafPacketQueueTest, CapacityRoundedUp)
+{
+    OmafPacketQueue queue(5);
+    EXPECT_EQ(queue.GetCapacity(), 8u);
+    EXPECT_EQ(queue.Size(), 0u);
+}
+
+TEST(OmafPacketQueueTest, WrapAroundAndFull)
+{
+    std::atomic<uint32_t> released(0);
+    OmafPacketQueue queue(4);
+
+    uint64_t pushed = 0;
+    uint64_t popped = 0;
+    // go around the ring several times, half of it at a time
+    for(int round = 0; round < 10; round++)
+    {
+        while(queue.Size() < queue.GetCapacity())
+        {
+            EXPECT_TRUE(queue.Push(new CountedPacket(pushed, &released)));
+            pushed++;
+        }
+
+        MediaPacket* extra = new CountedPacket(UINT64_MAX, NULL);
+        EXPECT_FALSE(queue.Push(extra));
+        delete extra;
+        EXPECT_EQ(queue.Size(), queue.GetCapacity());
+
+        for(uint32_t i = 0; i < queue.GetCapacity() / 2; i++)
+        {
+            MediaPacket* pPacket = queue.Pop(0);
+            ASSERT_TRUE(pPacket != NULL);
+            EXPECT_EQ(pPacket->GetPTS(), popped);
+            popped++;
+            delete pPacket;
+        }
+    }
+
+    while(MediaPacket* pPacket = queue.Pop(0))
+    {
+        EXPECT_EQ(pPacket->GetPTS(), popped);
+        popped++;
+        delete pPacket;
+    }
+    EXPECT_EQ(popped, pushed);
+    EXPECT_EQ(released.load(), pushed);
+}
+
+TEST(OmafPacketQueueTest, PopTimeoutWhenEmpty)
+{
+    OmafPacketQueue queue(4);
+
+    auto start = TestClock::now();
+    EXPECT_TRUE(queue.Pop(0) == NULL);
+    EXPECT_LT(ElapsedMs(start), 20u);
+
+    start = TestClock::now();
+    EXPECT_TRUE(queue.Pop(50) == NULL);
+    uint64_t elapsed = ElapsedMs(start);
+    EXPECT_GE(elapsed, 45u);
+    EXPECT_LT(elapsed, 1000u);
+}
+
+TEST(OmafPacketQueueTest, PopWokenByPush)
+{
+    OmafPacketQueue queue(4);
+
+    std::thread producer([&]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        queue.Push(new CountedPacket(7, NULL));
+    });
+
+    auto start = TestClock::now();
+    MediaPacket* pPacket = queue.Pop(5000);
+    uint64_t elapsed = ElapsedMs(start);
+    producer.join();
+
+    ASSERT_TRUE(pPacket != NULL);
+    EXPECT_EQ(pPacket->GetPTS(), 7u);
+    EXPECT_LT(elapsed, 2000u);
+    delete pPacket;
+}
+
+TEST(OmafPacketQueueTest, WaitBelowWokenByPop)
+{
+    OmafPacketQueue queue(4);
+    for(uint32_t i = 0; i < queue.GetCapacity(); i++)
+        EXPECT_TRUE(queue.Push(new CountedPacket(i, NULL)));
+
+    // already below
+    EXPECT_TRUE(queue.WaitBelow(queue.GetCapacity(), 0));
+    EXPECT_FALSE(queue.WaitBelow(queue.GetCapacity() - 1, 0));
+
+    std::thread consumer([&]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        delete queue.Pop(0);
+    });
+
+    auto start = TestClock::now();
+    EXPECT_TRUE(queue.WaitBelow(queue.GetCapacity() - 1, 5000));
+    uint64_t elapsed = ElapsedMs(start);
+    consumer.join();
+
+    EXPECT_LT(elapsed, 2000u);
+    EXPECT_EQ(queue.Size(), queue.GetCapacity() - 1);
+}
+
+TEST(OmafPacketQueueTest, WaitBelowTimeout)
+{
+    OmafPacketQueue queue(2);
+    queue.Push(new CountedPacket(0, NULL));
+    queue.Push(new CountedPacket(1, NULL));
+
+    auto start = TestClock::now();
+    EXPECT_FALSE(queue.WaitBelow(0, 50));
+    EXPECT_GE(ElapsedMs(start), 45u);
+}
+
+TEST(OmafPacketQueueTest, ProducerConsumerOrder)
+{
+    const uint64_t packetNum = 200000;
+    std::atomic<uint32_t> released(0);
+    OmafPacketQueue queue(64);
+
+    std::thread producer([&]{
+        for(uint64_t i = 0; i < packetNum; i++)
+        {
+            MediaPacket* pPacket = new CountedPacket(i, &released);
+            while(!queue.Push(pPacket))
+                queue.WaitBelow(queue.GetCapacity() - 1, 10);
+        }
+    });
+
+    uint64_t expected = 0;
+    bool inOrder = true;
+    while(expected < packetNum)
+    {
+        MediaPacket* pPacket = queue.Pop(10);
+        if(!pPacket) continue;
+        if(pPacket->GetPTS() != expected) inOrder = false;
+        expected++;
+        delete pPacket;
+    }
+    producer.join();
+
+    EXPECT_TRUE(inOrder);
+    EXPECT_EQ(queue.Size(), 0u);
+    EXPECT_EQ(released.load(), packetNum);
+}
+
+TEST(OmafPacketQueueTest, ClearRacingPush)
+{
+    const uint64_t packetNum = 100000;
+    std::atomic<uint32_t> released(0);
+    std::atomic<bool> done(false);
+    OmafPacketQueue* queue = new OmafPacketQueue(16);
+
+    std::thread producer([&]{
+        for(uint64_t i = 0; i < packetNum; i++)
+        {
+            MediaPacket* pPacket = new CountedPacket(i, &released);
+            while(!queue->Push(pPacket))
+                queue->WaitBelow(queue->GetCapacity() - 1, 10);
+        }
+        done = true;
+    });
+
+    std::thread cleaner([&]{
+        while(!done)
+        {
+            queue->Clear();
+            std::this_thread::yield();
+        }
+    });
+
+    // the consumer still sees the packets in order, only some are flushed
+    uint64_t last = 0;
+    bool first = true;
+    bool inOrder = true;
+    uint32_t poppedCnt = 0;
+    while(!done || queue->Size())
+    {
+        MediaPacket* pPacket = queue->Pop(1);
+        if(!pPacket) continue;
+        if(!first && pPacket->GetPTS() <= last) inOrder = false;
+        last = pPacket->GetPTS();
+        first = false;
+        poppedCnt++;
+        delete pPacket;
+    }
+    producer.join();
+    cleaner.join();
+
+    EXPECT_TRUE(inOrder);
+    EXPECT_LE(queue->Size(), queue->GetCapacity());
+
+    // every packet is released exactly once, by the consumer or a flush
+    delete queue;
+    EXPECT_EQ(released.load(), packetNum);
+    EXPECT_LE(poppedCnt, packetNum);
+}
+
+}
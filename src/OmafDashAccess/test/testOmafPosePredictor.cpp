@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//!
+//! \file:   testOmafPosePredictor.cpp
+//! \brief:  pose predictor and prediction horizon unit test
+//!
+
+#include "gtest/gtest.h"
+#include "../OmafPosePredictor.h"
+#include <math.h>
+
+VCD_USE_VROMAF;
+VCD_USE_VRVIDEO;
+
+namespace {
+
+// the interval in ms between the poses fed
+#define POSE_INTERVAL 20
+
+//!
+//! \brief  feed a pose moving at constant speed every POSE_INTERVAL ms,
+//!         the yaw is wrapped as the player does
+//! \return the time of the last pose
+//!
+static uint64_t FeedConstantVelocity(OmafPosePredictor* predictor, double yaw, double yawSpeed,
+                                     double pitch, double pitchSpeed, uint64_t duration)
+{
+    uint64_t time = 0;
+    for(time = 0; time <= duration; time += POSE_INTERVAL)
+    {
+        HeadPose pose;
+        pose.yaw   = WrapYaw(yaw + yawSpeed * time / 1000.0);
+        pose.pitch = (float)(pitch + pitchSpeed * time / 1000.0);
+        predictor->AddPose(&pose, time);
+    }
+    return time - POSE_INTERVAL;
+}
+
+//!
+//! \brief  the yaw distance in degree, taking the shortest way
+//!
+static double YawDistance(double yaw1, double yaw2)
+{
+    return fabs(WrapYaw(yaw1 - yaw2));
+}
+
+TEST(OmafPosePredictorTest, WrapYaw)
+{
+    EXPECT_FLOAT_EQ(WrapYaw(0), 0);
+    EXPECT_FLOAT_EQ(WrapYaw(179), 179);
+    EXPECT_FLOAT_EQ(WrapYaw(180), -180);
+    EXPECT_FLOAT_EQ(WrapYaw(190), -170);
+    EXPECT_FLOAT_EQ(WrapYaw(-190), 170);
+    EXPECT_FLOAT_EQ(WrapYaw(720 + 45), 45);
+    EXPECT_FLOAT_EQ(WrapYaw(-720 - 45), -45);
+}
+
+TEST(OmafPosePredictorTest, NoPose)
+{
+    OmafKalmanPosePredictor predictor;
+    std::vector<PoseCandidate> candidates;
+
+    EXPECT_EQ(predictor.PredictPose(1000, candidates), ERROR_INVALID);
+    EXPECT_TRUE(candidates.empty());
+
+    HeadPose pose = {0};
+    predictor.AddPose(&pose, 0);
+    EXPECT_EQ(predictor.PredictPose(1000, candidates), ERROR_NONE);
+
+    predictor.Reset();
+    EXPECT_EQ(predictor.PredictPose(1000, candidates), ERROR_INVALID);
+    EXPECT_TRUE(candidates.empty());
+}
+
+TEST(OmafPosePredictorTest, StaticPose)
+{
+    OmafKalmanPosePredictor predictor;
+    uint64_t last = FeedConstantVelocity(&predictor, 30, 0, -20, 0, 1000);
+
+    std::vector<PoseCandidate> candidates;
+    ASSERT_EQ(predictor.PredictPose(last + 1000, candidates), ERROR_NONE);
+    ASSERT_FALSE(candidates.empty());
+    EXPECT_NEAR(candidates[0].pose.yaw, 30, 0.01);
+    EXPECT_NEAR(candidates[0].pose.pitch, -20, 0.01);
+}
+
+TEST(OmafPosePredictorTest, ConstantVelocityExtrapolated)
+{
+    OmafKalmanPosePredictor predictor;
+    // 30 degree/s to the right and 10 degree/s up for 2 seconds
+    uint64_t last = FeedConstantVelocity(&predictor, -60, 30, -10, 10, 2000);
+
+    uint64_t horizons[] = { 0, 500, 1000, 2000 };
+    for(auto horizon: horizons)
+    {
+        std::vector<PoseCandidate> candidates;
+        ASSERT_EQ(predictor.PredictPose(last + horizon, candidates), ERROR_NONE);
+        ASSERT_FALSE(candidates.empty());
+
+        double seconds = (last + horizon) / 1000.0;
+        EXPECT_NEAR(candidates[0].pose.yaw, -60 + 30 * seconds, 0.5) << "horizon " << horizon;
+        EXPECT_NEAR(candidates[0].pose.pitch, -10 + 10 * seconds, 0.5) << "horizon " << horizon;
+    }
+
+    // the time before the last pose predicts the last pose
+    std::vector<PoseCandidate> candidates;
+    ASSERT_EQ(predictor.PredictPose(last - 500, candidates), ERROR_NONE);
+    EXPECT_NEAR(candidates[0].pose.yaw, 0, 0.5);
+    EXPECT_NEAR(candidates[0].pose.pitch, 10, 0.5);
+}
+
+TEST(OmafPosePredictorTest, PitchClamped)
+{
+    OmafKalmanPosePredictor predictor;
+    uint64_t last = FeedConstantVelocity(&predictor, 0, 0, 60, 20, 1000);
+
+    std::vector<PoseCandidate> candidates;
+    ASSERT_EQ(predictor.PredictPose(last + 3000, candidates), ERROR_NONE);
+    for(auto &candidate: candidates)
+    {
+        EXPECT_LE(candidate.pose.pitch, 90);
+        EXPECT_GE(candidate.pose.pitch, -90);
+    }
+    EXPECT_FLOAT_EQ(candidates[0].pose.pitch, 90);
+}
+
+TEST(OmafPosePredictorTest, YawWrapAround)
+{
+    // turning right across +180, and left across -180
+    double speeds[] = { 60, -60 };
+    for(auto speed: speeds)
+    {
+        OmafKalmanPosePredictor predictor;
+        double start = speed > 0 ? 150 : -150;
+        uint64_t last = FeedConstantVelocity(&predictor, start, speed, 0, 0, 1000);
+
+        // the last pose is at -150 or 150, already wrapped once
+        uint64_t horizons[] = { 0, 500, 1000, 4000 };
+        for(auto horizon: horizons)
+        {
+            std::vector<PoseCandidate> candidates;
+            ASSERT_EQ(predictor.PredictPose(last + horizon, candidates), ERROR_NONE);
+            ASSERT_FALSE(candidates.empty());
+
+            double expected = start + speed * (last + horizon) / 1000.0;
+            for(auto &candidate: candidates)
+            {
+                EXPECT_GE(candidate.pose.yaw, -180);
+                EXPECT_LT(candidate.pose.yaw, 180);
+            }
+            EXPECT_LT(YawDistance(candidates[0].pose.yaw, expected), 0.5)
+                << "speed " << speed << " horizon " << horizon << " yaw " << candidates[0].pose.yaw;
+            EXPECT_NEAR(candidates[0].pose.pitch, 0, 0.01);
+        }
+    }
+}
+
+TEST(OmafPosePredictorTest, CandidateOrdering)
+{
+    double speeds[] = { 40, -40 };
+    for(auto speed: speeds)
+    {
+        OmafKalmanPosePredictor predictor;
+        uint64_t last = FeedConstantVelocity(&predictor, 0, speed, 0, -speed / 2, 1000);
+
+        std::vector<PoseCandidate> candidates;
+        ASSERT_EQ(predictor.PredictPose(last + 500, candidates), ERROR_NONE);
+        ASSERT_EQ(candidates.size(), 5u);
+
+        // the predicted pose first, the weights never go up
+        EXPECT_FLOAT_EQ(candidates[0].weight, 1.0f);
+        for(uint32_t i = 1; i < candidates.size(); i++)
+        {
+            EXPECT_GT(candidates[i].weight, 0);
+            EXPECT_LT(candidates[i].weight, candidates[0].weight);
+            EXPECT_LE(candidates[i].weight, candidates[i - 1].weight);
+        }
+
+        PoseCandidate& center = candidates[0];
+        double yawDir   = speed > 0 ? 1 : -1;
+        double pitchDir = -yawDir;
+
+        // the yaw side along the velocity, then the pitch side along the
+        // velocity, then the sides turning back
+        double yawAhead = WrapYaw(candidates[1].pose.yaw - center.pose.yaw) * yawDir;
+        EXPECT_GT(yawAhead, 0);
+        EXPECT_FLOAT_EQ(candidates[1].pose.pitch, center.pose.pitch);
+
+        EXPECT_GT((candidates[2].pose.pitch - center.pose.pitch) * pitchDir, 0);
+        EXPECT_FLOAT_EQ(candidates[2].pose.yaw, center.pose.yaw);
+
+        double yawBack = WrapYaw(candidates[3].pose.yaw - center.pose.yaw) * yawDir;
+        EXPECT_LT(yawBack, 0);
+        EXPECT_NEAR(yawBack, -yawAhead, 0.01);
+        EXPECT_FLOAT_EQ(candidates[3].pose.pitch, center.pose.pitch);
+
+        EXPECT_LT((candidates[4].pose.pitch - center.pose.pitch) * pitchDir, 0);
+        EXPECT_FLOAT_EQ(candidates[4].pose.yaw, center.pose.yaw);
+    }
+}
+
+TEST(OmafPosePredictorTest, CandidateSpread)
+{
+    OmafKalmanPosePredictor predictor;
+    uint64_t last = FeedConstantVelocity(&predictor, 0, 20, 0, 0, 1000);
+
+    // the uncertainty grows with the horizon
+    double previous = 0;
+    uint64_t horizons[] = { 100, 500, 1000 };
+    for(auto horizon: horizons)
+    {
+        std::vector<PoseCandidate> candidates;
+        ASSERT_EQ(predictor.PredictPose(last + horizon, candidates), ERROR_NONE);
+        double spread = YawDistance(candidates[1].pose.yaw, candidates[0].pose.yaw);
+        EXPECT_GT(spread, previous) << "horizon " << horizon;
+        previous = spread;
+    }
+
+    // but the candidates are never spread more than 60 degree
+    std::vector<PoseCandidate> candidates;
+    ASSERT_EQ(predictor.PredictPose(last + 10000, candidates), ERROR_NONE);
+    EXPECT_NEAR(YawDistance(candidates[1].pose.yaw, candidates[0].pose.yaw), 60, 0.01);
+    EXPECT_NEAR(YawDistance(candidates[3].pose.yaw, candidates[0].pose.yaw), 60, 0.01);
+}
+
+TEST(OmafPosePredictorTest, PredictionHorizon)
+{
+    // unknown segment duration
+    EXPECT_EQ(CalculatePredictionHorizon(0, 100, 10000000, 5000000), (uint64_t)DEFAULT_PREDICT_HORIZON);
+
+    // unknown throughput or bit rate, only the round trip is counted
+    EXPECT_EQ(CalculatePredictionHorizon(1000, 0, 0, 0), 1000u);
+    EXPECT_EQ(CalculatePredictionHorizon(1000, 80, 0, 5000000), 1080u);
+    EXPECT_EQ(CalculatePredictionHorizon(1000, 80, 10000000, 0), 1080u);
+
+    // the segment takes half of its duration to download
+    EXPECT_EQ(CalculatePredictionHorizon(1000, 80, 10000000, 5000000), 1580u);
+    EXPECT_EQ(CalculatePredictionHorizon(2000, 0, 10000000, 5000000), 3000u);
+
+    // just at the cap of two segment durations
+    EXPECT_EQ(CalculatePredictionHorizon(1000, 80, 5000000, 10000000), 3080u);
+
+    // the download time is capped at two segment durations
+    EXPECT_EQ(CalculatePredictionHorizon(1000, 80, 1000000, 10000000), 3080u);
+    EXPECT_EQ(CalculatePredictionHorizon(1000, 80, 1, 10000000), 3080u);
+    EXPECT_EQ(CalculatePredictionHorizon(500, 0, 1000, 10000000000ULL), 1500u);
+}
+
+}
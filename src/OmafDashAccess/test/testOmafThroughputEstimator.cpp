@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//!
+//! \file:   testOmafThroughputEstimator.cpp
+//! \brief:  throughput estimator unit test with synthetic transfer timings
+//!
+
+#include "gtest/gtest.h"
+#include "../OmafDashDownload/OmafThroughputEstimator.h"
+#include <math.h>
+
+VCD_USE_VROMAF;
+VCD_USE_VRVIDEO;
+
+namespace {
+
+// the EWMA is a floating average truncated to bps, so compared within 1 bps
+
+//!
+//! \brief  estimator on a clock set by the test
+//!
+class ManualClockEstimator : public OmafThroughputEstimator
+{
+public:
+    ManualClockEstimator() : mNow(1000000) {}
+
+    void SetTimeMs(uint64_t ms) { mNow = 1000000 + ms * 1000; }
+
+protected:
+    virtual uint64_t NowUs() { return mNow; }
+
+private:
+    uint64_t mNow;
+};
+
+//!
+//! \brief  a single transfer receiving bytes every 10 ms at the bit rate
+//!         from the start time until the end time, in ms
+//!
+static void RunTransfer(ManualClockEstimator& estimator, uint64_t start, uint64_t end, uint64_t bitrate)
+{
+    estimator.SetTimeMs(start);
+    estimator.TransferStarted();
+    for(uint64_t time = start + 10; time <= end; time += 10)
+    {
+        estimator.SetTimeMs(time);
+        estimator.BytesReceived(bitrate / 8 / 100);
+    }
+    estimator.TransferFinished(0, 0);
+}
+
+TEST(OmafThroughputEstimatorTest, NoTransfer)
+{
+    ManualClockEstimator estimator;
+
+    EXPECT_EQ(estimator.GetWindowThroughput(), 0u);
+    EXPECT_EQ(estimator.GetEwmaThroughput(), 0u);
+    EXPECT_EQ(estimator.GetAverageThroughput(), 0u);
+    EXPECT_EQ(estimator.GetRTT(), 0u);
+}
+
+TEST(OmafThroughputEstimatorTest, SingleTransfer)
+{
+    ManualClockEstimator estimator;
+    RunTransfer(estimator, 0, 1000, 8000000);
+
+    EXPECT_EQ(estimator.GetWindowThroughput(), 8000000u);
+    EXPECT_NEAR((double)estimator.GetEwmaThroughput(), 8000000, 1);
+    EXPECT_EQ(estimator.GetAverageThroughput(), 8000000u);
+}
+
+TEST(OmafThroughputEstimatorTest, IdleTimeNotCounted)
+{
+    ManualClockEstimator estimator;
+
+    // 4 Mbps in two transfers with a long gap between them
+    RunTransfer(estimator, 0, 500, 4000000);
+    RunTransfer(estimator, 2000, 2500, 4000000);
+
+    EXPECT_EQ(estimator.GetWindowThroughput(), 4000000u);
+    EXPECT_EQ(estimator.GetAverageThroughput(), 4000000u);
+    EXPECT_NEAR((double)estimator.GetEwmaThroughput(), 4000000, 1);
+
+    // the time before any transfer is neither counted
+    estimator.SetTimeMs(5000);
+    estimator.TransferStarted();
+    estimator.SetTimeMs(5100);
+    estimator.BytesReceived(50000);
+    estimator.TransferFinished(0, 0);
+    EXPECT_EQ(estimator.GetAverageThroughput(), 4000000u);
+}
+
+TEST(OmafThroughputEstimatorTest, OverlappedTransfers)
+{
+    ManualClockEstimator estimator;
+
+    // A runs from 0 to 200 ms, B from 100 to 300 ms, the link is busy for
+    // 300 ms, not the 400 ms the transfers take together
+    estimator.SetTimeMs(0);
+    estimator.TransferStarted();
+    estimator.SetTimeMs(100);
+    estimator.BytesReceived(100000);
+    estimator.TransferStarted();
+    estimator.SetTimeMs(200);
+    estimator.BytesReceived(50000);
+    estimator.BytesReceived(50000);
+    estimator.TransferFinished(0, 0);
+    estimator.SetTimeMs(300);
+    estimator.BytesReceived(100000);
+    estimator.TransferFinished(0, 0);
+
+    // 300000 bytes in 300 ms
+    EXPECT_EQ(estimator.GetAverageThroughput(), 8000000u);
+    EXPECT_EQ(estimator.GetWindowThroughput(), 8000000u);
+
+    // the link is idle after both are finished
+    estimator.SetTimeMs(1000);
+    estimator.TransferStarted();
+    estimator.SetTimeMs(1100);
+    estimator.BytesReceived(100000);
+    estimator.TransferFinished(0, 0);
+    EXPECT_EQ(estimator.GetAverageThroughput(), 8000000u);
+}
+
+TEST(OmafThroughputEstimatorTest, SampleBusyTime)
+{
+    ManualClockEstimator estimator;
+
+    // less than a sample of busy time while the transfer is active
+    estimator.SetTimeMs(0);
+    estimator.TransferStarted();
+    estimator.SetTimeMs(40);
+    estimator.BytesReceived(40000);
+    EXPECT_EQ(estimator.GetAverageThroughput(), 0u);
+    EXPECT_EQ(estimator.GetWindowThroughput(), 0u);
+
+    // a sample is taken once 50 ms busy time is reached
+    estimator.SetTimeMs(50);
+    estimator.BytesReceived(10000);
+    EXPECT_EQ(estimator.GetAverageThroughput(), 8000000u);
+
+    // and the rest is taken when the link goes idle
+    estimator.SetTimeMs(60);
+    estimator.BytesReceived(5000);
+    EXPECT_EQ(estimator.GetAverageThroughput(), 8000000u);
+    estimator.TransferFinished(0, 0);
+    EXPECT_EQ(estimator.GetAverageThroughput(), 55000u * 8 * 1000 / 60);
+}
+
+TEST(OmafThroughputEstimatorTest, WindowExpiry)
+{
+    ManualClockEstimator estimator;
+
+    RunTransfer(estimator, 0, 1000, 8000000);
+    RunTransfer(estimator, 2000, 3000, 2000000);
+
+    // both in the window
+    estimator.SetTimeMs(3000);
+    EXPECT_EQ(estimator.GetWindowThroughput(), 5000000u);
+
+    // the samples are dropped 3 s after they are taken, the first transfer
+    // is out of the window after 4 s
+    estimator.SetTimeMs(3900);
+    EXPECT_GT(estimator.GetWindowThroughput(), 2000000u);
+    estimator.SetTimeMs(4001);
+    EXPECT_EQ(estimator.GetWindowThroughput(), 2000000u);
+
+    // the window is empty after 6 s, it's the EWMA then
+    estimator.SetTimeMs(6001);
+    uint64_t ewma = estimator.GetEwmaThroughput();
+    EXPECT_EQ(estimator.GetWindowThroughput(), ewma);
+    EXPECT_GT(ewma, 2000000u);
+    EXPECT_LT(ewma, 8000000u);
+
+    // the average never expires
+    EXPECT_EQ(estimator.GetAverageThroughput(), 5000000u);
+}
+
+TEST(OmafThroughputEstimatorTest, Ewma)
+{
+    ManualClockEstimator estimator;
+
+    // 30 s at 8 Mbps and then 3 s at 2 Mbps, which is one half life
+    RunTransfer(estimator, 0, 30000, 8000000);
+    EXPECT_NEAR((double)estimator.GetEwmaThroughput(), 8000000, 1);
+
+    RunTransfer(estimator, 40000, 43000, 2000000);
+
+    // the weight of the first 30 s is normalized for the bias at the beginning
+    double weight1 = 1 - pow(0.5, 10);
+    double expected = (0.5 * weight1 * 8000000 + 0.5 * 2000000) / (0.5 * weight1 + 0.5);
+    EXPECT_NEAR((double)estimator.GetEwmaThroughput(), expected, 10);
+    EXPECT_NEAR((double)estimator.GetEwmaThroughput(), 5000000, 5000);
+
+    // the window only has the recent rate, and the average all of them
+    EXPECT_EQ(estimator.GetWindowThroughput(), 2000000u);
+    EXPECT_EQ(estimator.GetAverageThroughput(), (uint64_t)((8000000.0 * 30 + 2000000.0 * 3) / 33));
+
+    // the idle time doesn't decay the EWMA
+    estimator.SetTimeMs(100000);
+    EXPECT_NEAR((double)estimator.GetEwmaThroughput(), expected, 10);
+}
+
+TEST(OmafThroughputEstimatorTest, RTT)
+{
+    ManualClockEstimator estimator;
+
+    // the first sample is taken as is
+    estimator.TransferStarted();
+    estimator.TransferFinished(0.010, 0.050);
+    EXPECT_EQ(estimator.GetRTT(), 40u);
+
+    // then smoothed with a gain of 1/8
+    estimator.TransferStarted();
+    estimator.TransferFinished(0, 0.120);
+    EXPECT_EQ(estimator.GetRTT(), 50u);
+
+    // nothing received, or an invalid timing, is ignored
+    estimator.TransferStarted();
+    estimator.TransferFinished(0.010, 0);
+    estimator.TransferStarted();
+    estimator.TransferFinished(0.100, 0.050);
+    EXPECT_EQ(estimator.GetRTT(), 50u);
+
+    estimator.Reset();
+    EXPECT_EQ(estimator.GetRTT(), 0u);
+}
+
+TEST(OmafThroughputEstimatorTest, Reset)
+{
+    ManualClockEstimator estimator;
+    RunTransfer(estimator, 0, 1000, 8000000);
+
+    estimator.Reset();
+    EXPECT_EQ(estimator.GetWindowThroughput(), 0u);
+    EXPECT_EQ(estimator.GetEwmaThroughput(), 0u);
+    EXPECT_EQ(estimator.GetAverageThroughput(), 0u);
+
+    RunTransfer(estimator, 2000, 3000, 2000000);
+    EXPECT_EQ(estimator.GetWindowThroughput(), 2000000u);
+    EXPECT_NEAR((double)estimator.GetEwmaThroughput(), 2000000, 1);
+    EXPECT_EQ(estimator.GetAverageThroughput(), 2000000u);
+}
+
+}
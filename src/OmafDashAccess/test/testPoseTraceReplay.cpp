@@ -0,0 +1,606 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//!
+//! \file:   testPoseTraceReplay.cpp
+//! \brief:  offline replay harness for OmafDashAccess. A packed OMAF output
+//!          directory is served by an in-process http server with bandwidth and
+//!          latency shaping, a recorded pose trace drives OmafAccess_ChangeViewport
+//!          and the packets are consumed at the frame rate of the stream.
+//!
+//!          the harness is configured by environment variables and is skipped
+//!          when OMAF_REPLAY_DIR is not set:
+//!            OMAF_REPLAY_DIR       : the directory with the packed mpd and segments
+//!            OMAF_REPLAY_MPD       : the mpd file name in the directory, Test.mpd by default
+//!            OMAF_REPLAY_TRACE     : pose trace file, one "time_ms yaw pitch" per line,
+//!                                    '#' starts a comment. A yaw sweep is used if unset
+//!            OMAF_REPLAY_BANDWIDTH : link bandwidth in kbps, 0 (default) for unlimited
+//!            OMAF_REPLAY_LATENCY   : latency added to every request in ms
+//!            OMAF_REPLAY_DURATION  : replay duration in ms, the trace length by default
+//!
+
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../OmafDashAccessApi.h"
+
+using namespace std;
+
+namespace{
+
+typedef chrono::steady_clock ReplayClock;
+
+//!
+//! \brief  minimal http/1.1 server on the loopback interface. Every request
+//!         waits the configured latency, then the bodies of all connections
+//!         share one token bucket so the total rate never exceeds the bandwidth
+//!
+class ShapedHttpServer
+{
+public:
+    ShapedHttpServer(string root, uint32_t bandwidthKbps, uint32_t latencyMs)
+        : mRoot(root), mBandwidth(bandwidthKbps), mLatency(latencyMs),
+          mListenFd(-1), mPort(0), mStop(false), mServedBytes(0), mRequests(0)
+    {
+        mNextSend = ReplayClock::now();
+    };
+
+    ~ShapedHttpServer()
+    {
+        Stop();
+    };
+
+    //!
+    //! \brief  bind to a free port of 127.0.0.1 and start accepting connections
+    //!
+    bool Start()
+    {
+        mListenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if(mListenFd < 0) return false;
+
+        int reuse = 1;
+        setsockopt(mListenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port        = 0;
+        if(bind(mListenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(mListenFd, 64) < 0)
+        {
+            close(mListenFd);
+            mListenFd = -1;
+            return false;
+        }
+
+        socklen_t len = sizeof(addr);
+        getsockname(mListenFd, (struct sockaddr*)&addr, &len);
+        mPort = ntohs(addr.sin_port);
+
+        mAcceptThread = thread(&ShapedHttpServer::AcceptLoop, this);
+        return true;
+    };
+
+    void Stop()
+    {
+        if(mListenFd < 0) return;
+
+        mStop = true;
+        shutdown(mListenFd, SHUT_RDWR);
+        mAcceptThread.join();
+        close(mListenFd);
+        mListenFd = -1;
+
+        {
+            lock_guard<mutex> lock(mMutex);
+            for(auto fd : mClients)
+                shutdown(fd, SHUT_RDWR);
+        }
+        for(auto& t : mWorkers)
+            t.join();
+        mWorkers.clear();
+    };
+
+    string   GetBaseUrl()     { return "http://127.0.0.1:" + to_string(mPort) + "/"; };
+    uint64_t GetServedBytes() { return mServedBytes; };
+    uint32_t GetRequestCnt()  { return mRequests; };
+
+private:
+    void AcceptLoop()
+    {
+        while(!mStop)
+        {
+            int fd = accept(mListenFd, NULL, NULL);
+            if(fd < 0) break;
+
+            lock_guard<mutex> lock(mMutex);
+            mClients.insert(fd);
+            mWorkers.push_back(thread(&ShapedHttpServer::Serve, this, fd));
+        }
+    };
+
+    void Serve(int fd)
+    {
+        string request;
+        char   buf[4096];
+        while(!mStop)
+        {
+            size_t end = request.find("\r\n\r\n");
+            if(end == string::npos)
+            {
+                ssize_t n = recv(fd, buf, sizeof(buf), 0);
+                if(n <= 0) break;
+                request.append(buf, n);
+                continue;
+            }
+
+            string header = request.substr(0, end);
+            request.erase(0, end + 4);
+
+            istringstream line(header);
+            string method, path;
+            line >> method >> path;
+            bool keepAlive = header.find("Connection: close") == string::npos;
+
+            this_thread::sleep_for(chrono::milliseconds(mLatency));
+            mRequests++;
+
+            string body;
+            bool found = ReadFile(path, body);
+            string response = found ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n";
+            response += "Content-Length: " + to_string(body.size()) + "\r\n";
+            response += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+            if(!SendAll(fd, response.data(), response.size(), false)) break;
+            if(method != "HEAD" && !SendAll(fd, body.data(), body.size(), true)) break;
+
+            if(!keepAlive) break;
+        }
+
+        {
+            lock_guard<mutex> lock(mMutex);
+            mClients.erase(fd);
+        }
+        close(fd);
+    };
+
+    //!
+    //! \brief  read the requested file. The BaseURL elements of an mpd are
+    //!         rewritten so every segment is fetched from this server
+    //!
+    bool ReadFile(string path, string& body)
+    {
+        size_t query = path.find('?');
+        if(query != string::npos) path.erase(query);
+        if(path.find("..") != string::npos) return false;
+
+        ifstream file(mRoot + "/" + path, ios::binary);
+        if(!file.is_open()) return false;
+        body.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+
+        if(path.size() > 4 && path.compare(path.size() - 4, 4, ".mpd") == 0)
+        {
+            size_t pos = 0;
+            while((pos = body.find("<BaseURL>", pos)) != string::npos)
+            {
+                pos += strlen("<BaseURL>");
+                size_t close = body.find("</BaseURL>", pos);
+                if(close == string::npos) break;
+                body.replace(pos, close - pos, GetBaseUrl());
+            }
+        }
+        return true;
+    };
+
+    //!
+    //! \brief  send the data in small chunks, the body chunks are paced by the
+    //!         shared token bucket and counted as served bytes
+    //!
+    bool SendAll(int fd, const char* data, size_t size, bool shaped)
+    {
+        const size_t chunk = 16 * 1024;
+        size_t sent = 0;
+        while(sent < size)
+        {
+            size_t len = min(chunk, size - sent);
+            if(shaped && mBandwidth)
+            {
+                ReplayClock::time_point slotEnd;
+                {
+                    lock_guard<mutex> lock(mMutex);
+                    auto now = ReplayClock::now();
+                    if(mNextSend < now) mNextSend = now;
+                    mNextSend += chrono::microseconds((uint64_t)len * 8 * 1000 / mBandwidth);
+                    slotEnd = mNextSend;
+                }
+                this_thread::sleep_until(slotEnd);
+            }
+            ssize_t n = send(fd, data + sent, len, MSG_NOSIGNAL);
+            if(n <= 0) return false;
+            sent += n;
+            if(shaped) mServedBytes += n;
+        }
+        return true;
+    };
+
+    string                     mRoot;          //<! the directory to serve
+    uint32_t                   mBandwidth;     //<! link bandwidth in kbps, 0 for unlimited
+    uint32_t                   mLatency;       //<! latency of each request in ms
+    int                        mListenFd;
+    uint16_t                   mPort;
+    atomic<bool>               mStop;
+    atomic<uint64_t>           mServedBytes;   //<! body bytes sent to the client
+    atomic<uint32_t>           mRequests;
+    mutex                      mMutex;
+    set<int>                   mClients;
+    vector<thread>             mWorkers;
+    thread                     mAcceptThread;
+    ReplayClock::time_point    mNextSend;      //<! when the token bucket is free again
+};
+
+typedef struct POSE_SAMPLE{
+    uint64_t time;
+    float    yaw;
+    float    pitch;
+}PoseSample;
+
+//!
+//! \brief  the metrics of one replay
+//!
+typedef struct REPLAY_REPORT{
+    int64_t          firstFrameTime;     //<! from open to the first packet, in ms, -1 if none
+    uint32_t         frameCnt;
+    uint32_t         stallCnt;
+    uint64_t         stallTime;          //<! total stalled time in ms
+    vector<uint64_t> switchLatency;      //<! from a pose change to a high quality packet, in ms
+    uint32_t         missedSwitchCnt;    //<! pose changes never covered by high quality
+    uint64_t         fetchedBytes;
+    uint64_t         displayedBytes;
+}ReplayReport;
+
+class PoseTraceReplayTest : public testing::Test {
+public:
+    virtual void SetUp(){
+        const char* dir = getenv("OMAF_REPLAY_DIR");
+        root = dir ? dir : "";
+        mpd = GetEnv("OMAF_REPLAY_MPD", "Test.mpd");
+        trace = GetEnv("OMAF_REPLAY_TRACE", "");
+        bandwidth = stoul(GetEnv("OMAF_REPLAY_BANDWIDTH", "0"));
+        latency = stoul(GetEnv("OMAF_REPLAY_LATENCY", "0"));
+        duration = stoul(GetEnv("OMAF_REPLAY_DURATION", "0"));
+        cache = "./cache_replay";
+
+        clientInfo = new HeadSetInfo;
+        clientInfo->input_geoType = 0;
+        clientInfo->output_geoType = E_SVIDEO_VIEWPORT;
+        clientInfo->pose = new HeadPose;
+        clientInfo->pose->yaw = 0;
+        clientInfo->pose->pitch = 0;
+        clientInfo->viewPort_hFOV = 80;
+        clientInfo->viewPort_vFOV = 80;
+        clientInfo->viewPort_Width = 960;
+        clientInfo->viewPort_Height = 960;
+    }
+
+    virtual void TearDown(){
+        delete clientInfo->pose;
+        clientInfo->pose = nullptr;
+
+        delete clientInfo;
+        clientInfo = nullptr;
+    }
+
+    string GetEnv(const char* name, const char* def)
+    {
+        const char* val = getenv(name);
+        return (val && *val) ? string(val) : string(def);
+    }
+
+    //!
+    //! \brief  load "time_ms yaw pitch" samples, or sweep the yaw 30 degrees
+    //!         every 2 seconds for 20 seconds when no trace is given
+    //!
+    bool LoadTrace(vector<PoseSample>& poses)
+    {
+        if(trace.empty())
+        {
+            for(uint64_t t = 0; t <= 20000; t += 2000)
+            {
+                PoseSample sample = {t, (float)((t / 2000) * 30 % 360) - 180, 0};
+                poses.push_back(sample);
+            }
+            return true;
+        }
+
+        ifstream file(trace);
+        if(!file.is_open()) return false;
+
+        string line;
+        while(getline(file, line))
+        {
+            size_t comment = line.find('#');
+            if(comment != string::npos) line.erase(comment);
+
+            istringstream fields(line);
+            PoseSample sample;
+            if(fields >> sample.time >> sample.yaw >> sample.pitch)
+                poses.push_back(sample);
+        }
+        sort(poses.begin(), poses.end(), [](const PoseSample& a, const PoseSample& b){ return a.time < b.time; });
+        return !poses.empty();
+    }
+
+    //!
+    //! \brief  whether the centre of the pose lies in a region packed at the
+    //!         highest resolution of the packet
+    //!
+    static bool IsHighQuality(RegionWisePacking* rwpk, float yaw, float pitch)
+    {
+        if(!rwpk || !rwpk->numRegions || !rwpk->rectRegionPacking) return false;
+
+        double minScale = 0;
+        for(int i = 0; i < rwpk->numRegions; i++)
+        {
+            RectangularRegionWisePacking* reg = &rwpk->rectRegionPacking[i];
+            if(!reg->packedRegWidth) continue;
+            double scale = (double)reg->projRegWidth / reg->packedRegWidth;
+            if(minScale == 0 || scale < minScale) minScale = scale;
+        }
+
+        uint32_t x = (uint32_t)((yaw + 180) / 360 * rwpk->projPicWidth) % rwpk->projPicWidth;
+        uint32_t y = min((uint32_t)((90 - pitch) / 180 * rwpk->projPicHeight), rwpk->projPicHeight - 1);
+        for(int i = 0; i < rwpk->numRegions; i++)
+        {
+            RectangularRegionWisePacking* reg = &rwpk->rectRegionPacking[i];
+            if(!reg->packedRegWidth) continue;
+            if(x < reg->projRegLeft || x >= reg->projRegLeft + reg->projRegWidth ||
+               y < reg->projRegTop  || y >= reg->projRegTop  + reg->projRegHeight)
+                continue;
+            if((double)reg->projRegWidth / reg->packedRegWidth <= minScale * 1.01)
+                return true;
+        }
+        return false;
+    }
+
+    static uint64_t ElapsedMs(ReplayClock::time_point from)
+    {
+        return chrono::duration_cast<chrono::milliseconds>(ReplayClock::now() - from).count();
+    }
+
+    void Replay(vector<PoseSample>& poses, ShapedHttpServer& server, ReplayReport& report)
+    {
+        string url = server.GetBaseUrl() + mpd;
+        DashStreamingClient client;
+        client.media_url   = url.c_str();
+        client.source_type = MultiResSource;
+        client.cache_path  = cache.c_str();
+
+        report.firstFrameTime  = -1;
+        report.frameCnt        = 0;
+        report.stallCnt        = 0;
+        report.stallTime       = 0;
+        report.missedSwitchCnt = 0;
+        report.displayedBytes  = 0;
+
+        auto start = ReplayClock::now();
+        Handler hdl = OmafAccess_Init(&client);
+        ASSERT_TRUE(hdl != NULL);
+
+        clientInfo->pose->yaw   = poses[0].yaw;
+        clientInfo->pose->pitch = poses[0].pitch;
+        EXPECT_EQ(OmafAccess_SetupHeadSetInfo(hdl, clientInfo), ERROR_NONE);
+        ASSERT_EQ(OmafAccess_OpenMedia(hdl, &client, false), ERROR_NONE);
+
+        DashMediaInfo info;
+        memset(&info, 0, sizeof(info));
+        OmafAccess_GetMediaInfo(hdl, &info);
+        double frameInterval = 1000.0 / 30;
+        if(info.stream_info[0].framerate_num > 0 && info.stream_info[0].framerate_den > 0)
+            frameInterval = 1000.0 * info.stream_info[0].framerate_den / info.stream_info[0].framerate_num;
+
+        uint64_t endTime = duration ? duration : poses.back().time + 2000;
+        size_t   nextPose = 1;
+        float    yaw = poses[0].yaw, pitch = poses[0].pitch;
+        bool     switchPending = false;
+        uint64_t switchStart = 0;
+        bool     stalled = false;
+        uint64_t stallStart = 0;
+        double   nextFrame = 0;
+        bool     needParams = true;
+
+        while(ElapsedMs(start) < endTime)
+        {
+            uint64_t now = ElapsedMs(start);
+
+            // the trace clock starts with the playback
+            uint64_t traceNow = report.firstFrameTime < 0 ? 0 : now - report.firstFrameTime;
+            while(nextPose < poses.size() && poses[nextPose].time <= traceNow)
+            {
+                HeadPose pose;
+                memset(&pose, 0, sizeof(pose));
+                pose.yaw   = yaw   = poses[nextPose].yaw;
+                pose.pitch = pitch = poses[nextPose].pitch;
+                OmafAccess_ChangeViewport(hdl, &pose);
+                if(switchPending) report.missedSwitchCnt++;
+                switchPending = true;
+                switchStart   = now;
+                nextPose++;
+            }
+
+            if(report.firstFrameTime >= 0 && now < nextFrame)
+            {
+                this_thread::sleep_for(chrono::milliseconds(1));
+                continue;
+            }
+
+            DashPacket pkts[5];
+            memset(pkts, 0, sizeof(pkts));
+            int      pktCnt = 0;
+            uint64_t pts = 0;
+            int ret = OmafAccess_GetPacket(hdl, 0, pkts, &pktCnt, &pts, needParams, false);
+            if(ret == ERROR_EOS) break;
+
+            if(ret == ERROR_NONE && pktCnt > 0)
+            {
+                now = ElapsedMs(start);
+                if(report.firstFrameTime < 0)
+                {
+                    report.firstFrameTime = now;
+                    nextFrame = now;
+                }
+                if(stalled)
+                {
+                    report.stallTime += now - stallStart;
+                    stalled   = false;
+                    nextFrame = now;
+                }
+                if(switchPending && IsHighQuality(pkts[0].rwpk, yaw, pitch))
+                {
+                    report.switchLatency.push_back(now - switchStart);
+                    switchPending = false;
+                }
+                needParams = false;
+                report.frameCnt++;
+                nextFrame += frameInterval;
+
+                for(int i = 0; i < pktCnt; i++)
+                {
+                    report.displayedBytes += pkts[i].size;
+                    free(pkts[i].buf);
+                    if(pkts[i].rwpk)
+                    {
+                        delete [] pkts[i].rwpk->rectRegionPacking;
+                        delete pkts[i].rwpk;
+                    }
+                }
+            }
+            else if(report.firstFrameTime >= 0 && !stalled && now > nextFrame + frameInterval)
+            {
+                // a frame is late by more than one frame interval
+                stalled    = true;
+                stallStart = now;
+                report.stallCnt++;
+            }
+        }
+
+        if(stalled) report.stallTime += ElapsedMs(start) - stallStart;
+        if(switchPending) report.missedSwitchCnt++;
+
+        OmafAccess_CloseMedia(hdl);
+        OmafAccess_Close(hdl);
+
+        report.fetchedBytes = server.GetServedBytes();
+    }
+
+    void PrintReport(ReplayReport& report, uint32_t requestCnt)
+    {
+        uint64_t maxSwitch = 0, sumSwitch = 0;
+        for(auto lat : report.switchLatency)
+        {
+            maxSwitch = max(maxSwitch, lat);
+            sumSwitch += lat;
+        }
+
+        cout<<"======== pose trace replay ========"<<endl;
+        cout<<"bandwidth(kbps)          : "<<bandwidth<<" latency(ms): "<<latency<<endl;
+        cout<<"time to first frame(ms)  : "<<report.firstFrameTime<<endl;
+        cout<<"frames displayed         : "<<report.frameCnt<<endl;
+        cout<<"stalls                   : "<<report.stallCnt<<" ("<<report.stallTime<<" ms)"<<endl;
+        cout<<"viewport switches        : "<<report.switchLatency.size()<<" reached high quality, "
+            <<report.missedSwitchCnt<<" missed"<<endl;
+        if(report.switchLatency.size())
+            cout<<"switch latency(ms)       : avg "<<sumSwitch / report.switchLatency.size()
+                <<" max "<<maxSwitch<<endl;
+        cout<<"requests                 : "<<requestCnt<<endl;
+        cout<<"bytes fetched/displayed  : "<<report.fetchedBytes<<" / "<<report.displayedBytes;
+        if(report.displayedBytes)
+            cout<<" ("<<(double)report.fetchedBytes / report.displayedBytes<<"x)";
+        cout<<endl;
+    }
+
+    HeadSetInfo* clientInfo;
+    std::string root;
+    std::string mpd;
+    std::string trace;
+    std::string cache;
+    uint32_t bandwidth;
+    uint32_t latency;
+    uint32_t duration;
+};
+
+TEST_F(PoseTraceReplayTest, LoadTrace_default)
+{
+    vector<PoseSample> poses;
+    trace = "";
+    EXPECT_TRUE(LoadTrace(poses));
+    EXPECT_TRUE(poses.size() > 1);
+    for(auto& pose : poses)
+        EXPECT_TRUE(pose.yaw >= -180 && pose.yaw <= 180);
+}
+
+TEST_F(PoseTraceReplayTest, Replay)
+{
+    if(root.empty())
+    {
+        cout<<"OMAF_REPLAY_DIR is not set, skip the replay."<<endl;
+        return;
+    }
+
+    vector<PoseSample> poses;
+    ASSERT_TRUE(LoadTrace(poses));
+
+    const string command = "rm -rf " + cache + "/*";
+    system(command.c_str());
+
+    ShapedHttpServer server(root, bandwidth, latency);
+    ASSERT_TRUE(server.Start());
+
+    ReplayReport report;
+    Replay(poses, server, report);
+    uint32_t requestCnt = server.GetRequestCnt();
+    server.Stop();
+
+    PrintReport(report, requestCnt);
+
+    EXPECT_TRUE(report.firstFrameTime >= 0);
+    EXPECT_TRUE(report.frameCnt > 0);
+    EXPECT_TRUE(report.fetchedBytes > 0);
+}
+
+}
@@ -65,12 +65,16 @@ typedef struct SOURCERESOLUTION {
 }SourceResolution;
 
 /*
- * avg_bandwidth : average bandwidth since the begin of downloading
- * immediate_bandwidth: immediate bandwidth at the moment
+ * avg_bandwidth : average bandwidth since the begin of downloading, in kbps
+ * immediate_bandwidth: bandwidth in the last few seconds, in kbps
+ * ewma_bandwidth: exponentially weighted moving average bandwidth, in kbps
+ * rtt: smoothed round trip time of the requests, in ms
  */
 typedef struct DASHSTATISTICINFO{
     int32_t avg_bandwidth;
     int32_t immediate_bandwidth;
+    int32_t ewma_bandwidth;
+    int32_t rtt;
 }DashStatisticInfo;
 
 /*